@@ -16,13 +16,18 @@
  * along with uproc.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
+
 #if HAVE_CONFIG_H
 #include <config.h>
 #endif
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
+#include <math.h>
+#include <time.h>
 
 #if HAVE__MKDIR
 #include <direct.h>
@@ -30,10 +35,22 @@
 #include <sys/stat.h>
 #endif
 
+#if HAVE_SCHED_H
+#include <sched.h>
+#endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 #include <uproc.h>
 
 #include "common.h"
 
+#if SERVER_SUPPORT
+#include <errno.h>
+#include <unistd.h>
+#endif
+
 #define PROGRESS_WIDTH 20
 
 uproc_io_stream *open_read(const char *path)
@@ -186,6 +203,16 @@ int create_classifiers(uproc_protclass **pc, uproc_dnaclass **dc,
         uproc_error_msg(UPROC_EINVAL, "database parameter must not be NULL");
         return -1;
     }
+    return create_classifiers_ecurves(pc, dc, uproc_database_ecurve_forward(db),
+                                      uproc_database_ecurve_reverse(db), db,
+                                      model, short_read_mode);
+}
+
+int create_classifiers_ecurves(uproc_protclass **pc, uproc_dnaclass **dc,
+                               uproc_ecurve *fwd, uproc_ecurve *rev,
+                               uproc_database *db, uproc_model *model,
+                               bool short_read_mode)
+{
     if (!model) {
         uproc_error_msg(UPROC_EINVAL, "model parameter must not be NULL");
         return -1;
@@ -198,8 +225,7 @@ int create_classifiers(uproc_protclass **pc, uproc_dnaclass **dc,
         pc_mode = UPROC_PROTCLASS_MAX;
         dc_mode = UPROC_DNACLASS_MAX;
     }
-    *pc = uproc_protclass_create(pc_mode, uproc_database_ecurve_forward(db),
-                                 uproc_database_ecurve_reverse(db),
+    *pc = uproc_protclass_create(pc_mode, fwd, rev,
                                  uproc_model_substitution_matrix(model),
                                  prot_filter,
                                  uproc_database_protein_threshold(db));
@@ -222,6 +248,418 @@ int create_classifiers(uproc_protclass **pc, uproc_dnaclass **dc,
     return 0;
 }
 
+int result_format_compile(struct result_format *fmt, const char *format,
+                          bool dna)
+{
+    const char *valid =
+        dna ? OUTFMT_PROT OUTFMT_DNA OUTFMT_PRED : OUTFMT_PROT OUTFMT_PRED;
+    size_t n = 0;
+
+    fmt->fields = malloc(strlen(format) + 1);
+    if (!fmt->fields) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    fmt->comma = false;
+    for (; *format; format++) {
+        if (strchr(valid, *format)) {
+            fmt->fields[n++] = *format;
+            fmt->comma = format[1];
+        }
+    }
+    fmt->fields[n] = '\0';
+    return 0;
+}
+
+void result_format_free(struct result_format *fmt)
+{
+    free(fmt->fields);
+    fmt->fields = NULL;
+}
+
+void textbuf_free(struct textbuf *buf)
+{
+    free(buf->data);
+    *buf = (struct textbuf){0};
+}
+
+/* Make room for `n` more bytes and return where they go */
+static char *textbuf_reserve(struct textbuf *buf, size_t n)
+{
+    if (buf->len + n > buf->alloc) {
+        size_t sz = buf->alloc ? buf->alloc : 4096;
+        char *tmp;
+        while (sz < buf->len + n) {
+            sz *= 2;
+        }
+        tmp = realloc(buf->data, sz);
+        if (!tmp) {
+            uproc_error(UPROC_ENOMEM);
+            return NULL;
+        }
+        buf->data = tmp;
+        buf->alloc = sz;
+    }
+    return buf->data + buf->len;
+}
+
+static void textbuf_append(struct textbuf *buf, const char *s, size_t n)
+{
+    char *p = textbuf_reserve(buf, n);
+    if (p) {
+        memcpy(p, s, n);
+        buf->len += n;
+    }
+}
+
+static void textbuf_append_ulong(struct textbuf *buf, unsigned long x)
+{
+    char tmp[24], *p = tmp + sizeof tmp;
+    do {
+        *--p = '0' + x % 10;
+        x /= 10;
+    } while (x);
+    textbuf_append(buf, p, tmp + sizeof tmp - p);
+}
+
+/* Append `x` like printf("%1.3f") */
+static void textbuf_append_score(struct textbuf *buf, double x)
+{
+    double t = fabs(x) * 1000.0, frac = t - floor(t);
+    unsigned long r;
+    char *p;
+
+    /* printf() rounds the exact binary value, which can differ from
+     * rounding `t` if it is close to a tie; leave those (and huge or
+     * non-finite values) to snprintf() */
+    if (!(t < 1e9) || fabs(frac - 0.5) < 1e-6) {
+        int n = snprintf(NULL, 0, "%1.3f", x);
+        p = textbuf_reserve(buf, n + 1);
+        if (p) {
+            snprintf(p, n + 1, "%1.3f", x);
+            buf->len += n;
+        }
+        return;
+    }
+    r = t + 0.5;
+    if (signbit(x)) {
+        textbuf_append(buf, "-", 1);
+    }
+    textbuf_append_ulong(buf, r / 1000);
+    p = textbuf_reserve(buf, 4);
+    if (p) {
+        r %= 1000;
+        p[0] = '.';
+        p[1] = '0' + r / 100;
+        p[2] = '0' + r / 10 % 10;
+        p[3] = '0' + r % 10;
+        buf->len += 4;
+    }
+}
+
+void format_result(struct textbuf *buf, const struct result_format *fmt,
+                   unsigned long seq_num, const char *header,
+                   unsigned long seq_len, const struct uproc_orf *orf,
+                   uproc_family family, double score, uproc_idmap *idmap)
+{
+    const char *name;
+    for (const char *f = fmt->fields; *f; f++) {
+        switch (*f) {
+            case 'n':
+                textbuf_append_ulong(buf, seq_num);
+                break;
+            case 'h':
+                textbuf_append(buf, header, strlen(header));
+                break;
+            case 'l':
+                textbuf_append_ulong(buf, seq_len);
+                break;
+            case 'F':
+                textbuf_append_ulong(buf, orf->frame + 1);
+                break;
+            case 'I':
+                textbuf_append_ulong(buf, orf->start + 1);
+                break;
+            case 'L':
+                textbuf_append_ulong(buf, orf->length);
+                break;
+            case 'f':
+                if (idmap) {
+                    name = uproc_idmap_str(idmap, family);
+                    textbuf_append(buf, name, strlen(name));
+                } else {
+                    textbuf_append_ulong(buf, family);
+                }
+                break;
+            case 's':
+                textbuf_append_score(buf, score);
+                break;
+        }
+        if (f[1] || fmt->comma) {
+            textbuf_append(buf, ",", 1);
+        }
+    }
+    textbuf_append(buf, "\n", 1);
+}
+
+struct count
+{
+    uproc_family fam;
+    unsigned long n;
+};
+
+static int compare_count(const void *p1, const void *p2)
+{
+    const struct count *c1 = p1, *c2 = p2;
+
+    /* sort by n in descending order */
+    if (c1->n > c2->n) {
+        return -1;
+    } else if (c1->n < c2->n) {
+        return 1;
+    }
+
+    /* or fam in ascending */
+    if (c1->fam < c2->fam) {
+        return -1;
+    } else if (c1->fam > c2->fam) {
+        return 1;
+    }
+    return 0;
+}
+
+void print_counts(uproc_io_stream *stream,
+                  unsigned long counts[UPROC_FAMILY_MAX + 1],
+                  uproc_idmap *idmap)
+{
+    struct count c[UPROC_FAMILY_MAX + 1];
+    uproc_family i, n = 0;
+    for (i = 0; i < UPROC_FAMILY_MAX + 1; i++) {
+        if (counts[i]) {
+            c[n].fam = i;
+            c[n].n = counts[i];
+            n++;
+        }
+    }
+
+    qsort(c, n, sizeof *c, compare_count);
+
+    for (i = 0; i < n; i++) {
+        if (idmap) {
+            uproc_io_printf(stream, "%s", uproc_idmap_str(idmap, c[i].fam));
+        } else {
+            uproc_io_printf(stream, "%" UPROC_FAMILY_PRI, c[i].fam);
+        }
+        uproc_io_printf(stream, ",%lu\n", c[i].n);
+    }
+}
+
+#if SERVER_SUPPORT
+int write_all(int fd, const void *buf, size_t n)
+{
+    const char *p = buf;
+    while (n) {
+        ssize_t res = write(fd, p, n);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res < 0) {
+            return uproc_error_msg(UPROC_ERRNO, "write failed");
+        }
+        p += res;
+        n -= res;
+    }
+    return 0;
+}
+
+int server_request_send(int fd, const struct server_request *req)
+{
+    int res;
+    char *buf;
+    const char *fmt =
+        SERVER_PROTOCOL "\n"
+        "mode %s\n"
+        "db %s\n"
+        "model %s\n"
+        "pthresh %d\n"
+        "othresh %d\n"
+        "short %d\n"
+        "output %s%s%s%s\n"
+        "format %s\n"
+        "\n";
+#define ARGS                                                                \
+    req->dna ? "dna" : "prot", req->dbdir, req->modeldir,                   \
+        req->prot_thresh_level, req->orf_thresh_level, req->short_read_mode, \
+        req->preds ? "p" : "", req->counts ? "c" : "",                      \
+        req->stats ? "f" : "", req->numeric ? "n" : "", req->format
+    int n = snprintf(NULL, 0, fmt, ARGS);
+    buf = malloc(n + 1);
+    if (!buf) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    sprintf(buf, fmt, ARGS);
+#undef ARGS
+    res = write_all(fd, buf, n);
+    free(buf);
+    return res;
+}
+
+int server_request_recv(uproc_io_stream *stream, struct server_request *req)
+{
+    char *line = NULL, *value;
+    size_t sz = 0;
+    long len;
+    int res = 0;
+
+    *req = (struct server_request){0};
+    len = uproc_io_getline(&line, &sz, stream);
+    if (len < 0 || strcmp(line, SERVER_PROTOCOL "\n")) {
+        free(line);
+        return uproc_error_msg(UPROC_EINVAL, "unknown protocol");
+    }
+    while ((len = uproc_io_getline(&line, &sz, stream)) > 1) {
+        if (line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        }
+        value = strchr(line, ' ');
+        if (!value) {
+            res = uproc_error_msg(UPROC_EINVAL, "invalid request line");
+            break;
+        }
+        *value++ = '\0';
+        if (!strcmp(line, "mode")) {
+            req->dna = !strcmp(value, "dna");
+        } else if (!strcmp(line, "db")) {
+            free(req->dbdir);
+            req->dbdir = strdup(value);
+            if (!req->dbdir) {
+                res = uproc_error(UPROC_ENOMEM);
+                break;
+            }
+        } else if (!strcmp(line, "model")) {
+            free(req->modeldir);
+            req->modeldir = strdup(value);
+            if (!req->modeldir) {
+                res = uproc_error(UPROC_ENOMEM);
+                break;
+            }
+        } else if (!strcmp(line, "pthresh")) {
+            if (parse_prot_thresh_level(value, &req->prot_thresh_level)) {
+                res = uproc_error_msg(UPROC_EINVAL,
+                                      "invalid protein threshold level");
+                break;
+            }
+        } else if (!strcmp(line, "othresh")) {
+            if (parse_orf_thresh_level(value, &req->orf_thresh_level)) {
+                res = uproc_error_msg(UPROC_EINVAL,
+                                      "invalid ORF threshold level");
+                break;
+            }
+        } else if (!strcmp(line, "short")) {
+            int short_read_mode;
+            if (parse_int(value, &short_read_mode)) {
+                res = uproc_error_msg(UPROC_EINVAL, "invalid read mode");
+                break;
+            }
+            req->short_read_mode = short_read_mode;
+        } else if (!strcmp(line, "output")) {
+            req->preds = strchr(value, 'p');
+            req->counts = strchr(value, 'c');
+            req->stats = strchr(value, 'f');
+            req->numeric = strchr(value, 'n');
+        } else if (!strcmp(line, "format")) {
+            free(req->format);
+            req->format = strdup(value);
+            if (!req->format) {
+                res = uproc_error(UPROC_ENOMEM);
+                break;
+            }
+        }
+        /* unknown keys are ignored */
+    }
+    free(line);
+    if (!res && (len != 1 || !req->dbdir || !req->modeldir || !req->format)) {
+        res = uproc_error_msg(UPROC_EINVAL, "incomplete request");
+    }
+    if (res) {
+        server_request_free(req);
+    }
+    return res;
+}
+
+void server_request_free(struct server_request *req)
+{
+    free(req->dbdir);
+    free(req->modeldir);
+    free(req->format);
+    *req = (struct server_request){0};
+}
+#endif
+
+/* CPU quota and period of the cgroup, 0 if the quota is unlimited */
+static void cgroup_quota(long long *quota, long long *period)
+{
+    char buf[64];
+    FILE *f;
+
+    *quota = *period = 0;
+    f = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if (f) {
+        /* cgroup v2: "QUOTA PERIOD" or "max PERIOD" */
+        if (fgets(buf, sizeof buf, f) &&
+            sscanf(buf, "%lld %lld", quota, period) != 2) {
+            *quota = 0;
+        }
+        fclose(f);
+        return;
+    }
+    /* cgroup v1, the quota is -1 if unlimited */
+    f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r");
+    if (f) {
+        if (fscanf(f, "%lld", quota) != 1) {
+            *quota = 0;
+        }
+        fclose(f);
+    }
+    f = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r");
+    if (f) {
+        if (fscanf(f, "%lld", period) != 1) {
+            *period = 0;
+        }
+        fclose(f);
+    }
+}
+
+int available_cpus(void)
+{
+    long long quota = 0, period = 0;
+    int n = 1;
+#if HAVE_UNISTD_H && defined(_SC_NPROCESSORS_ONLN)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+#if HAVE_SCHED_H && defined(CPU_COUNT)
+    cpu_set_t set;
+    if (!sched_getaffinity(0, sizeof set, &set)) {
+        n = CPU_COUNT(&set);
+    }
+#endif
+    cgroup_quota(&quota, &period);
+    if (quota > 0 && period > 0 && (quota + period - 1) / period < n) {
+        n = (quota + period - 1) / period;
+    }
+    return n > 0 ? n : 1;
+}
+
+double wall_time(void)
+{
+#if HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+    return time(NULL);
+#endif
+}
+
 #if defined(TIMEIT) && HAVE_CLOCK_GETTIME
 void timeit_start(timeit *t)
 {
@@ -258,9 +696,11 @@ void progress(uproc_io_stream *stream, const char *new_label, double percent)
 {
     static const char *label;
     static double last_percent;
+    static time_t start;
     if (new_label) {
         last_percent = -1.0;
         label = new_label;
+        start = time(NULL);
     }
     if (percent < 0.0 || last_percent >= 100.0 ||
         (!new_label && fabs(percent - last_percent) < 0.05 &&
@@ -274,7 +714,7 @@ void progress(uproc_io_stream *stream, const char *new_label, double percent)
     }
     uproc_io_printf(stream, "\r%s: [%s] %5.1f%%", label, bar, percent);
     if (percent >= 100.0) {
-        uproc_io_printf(stream, "\n");
+        uproc_io_printf(stream, " (%.0f s)\n", difftime(time(NULL), start));
     }
     last_percent = percent;
 }
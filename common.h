@@ -36,6 +36,18 @@
 #define STR1(x) #x
 #define STR(x) STR1(x)
 
+/* Description of the -L option of uproc-makedb and uproc-import */
+#define ECURVE_LAYOUT_HELP                                                   \
+    "Store the ecurves in the given layout, a comma-separated list of:\n"  \
+    "    compact  compact prefix index (much smaller for databases with\n" \
+    "             few sequences)\n"                                         \
+    "    packed   bit-packed suffixes and run-length encoded families\n"    \
+    "    btree    search trees over large prefix buckets (faster lookups)\n"\
+    "    interleaved\n"                                                    \
+    "             suffixes and families in the same cache line (faster\n"  \
+    "             lookups, can't be combined with \"packed\")\n"           \
+    "The default layout can be read by all versions of UProC."
+
 /* Open file for reading or stdin if `path` is "-" */
 uproc_io_stream *open_read(const char *path);
 
@@ -48,6 +60,10 @@ void print_version(const char *progname);
 /* Parse int from string */
 int parse_int(const char *arg, int *x);
 
+/* Default threshold levels of uproc-dna, uproc-prot and uproc-server */
+#define PROT_THRESH_DEFAULT 3
+#define ORF_THRESH_DEFAULT 2
+
 /* Parse int and check whether it is 0, 2 or 3 */
 int parse_prot_thresh_level(const char *arg, int *x);
 
@@ -72,6 +88,110 @@ int create_classifiers(uproc_protclass **pc, uproc_dnaclass **dc,
                        uproc_database *db, uproc_model *model,
                        bool short_read_mode);
 
+/* Like create_classifiers(), but using the given ecurves instead of the ones
+ * of `db` (e.g. copies local to a NUMA node) */
+int create_classifiers_ecurves(uproc_protclass **pc, uproc_dnaclass **dc,
+                               uproc_ecurve *fwd, uproc_ecurve *rev,
+                               uproc_database *db, uproc_model *model,
+                               bool short_read_mode);
+
+/* Characters of the -F option of uproc-dna and uproc-prot */
+#define OUTFMT_PROT "nhl"
+#define OUTFMT_DNA "FIL" /* uproc-dna only */
+#define OUTFMT_PRED "fs"
+
+/* A -F format, compiled by result_format_compile() */
+struct result_format
+{
+    /* the known field characters of the format */
+    char *fields;
+
+    /* whether the last field is followed by a comma, which is the case if
+     * unknown characters come after it */
+    bool comma;
+};
+
+/* Compile `format`, ignoring unknown characters and the characters of
+ * OUTFMT_DNA unless `dna` is true */
+int result_format_compile(struct result_format *fmt, const char *format,
+                          bool dna);
+
+void result_format_free(struct result_format *fmt);
+
+/* Growable output buffer, emptied by setting `len` to 0 */
+struct textbuf
+{
+    char *data;
+    size_t len, alloc;
+};
+
+void textbuf_free(struct textbuf *buf);
+
+/* Append a classification result as a CSV line with the fields of `fmt`
+ *
+ * `orf` is only used for the fields of OUTFMT_DNA. Scores are printed like
+ * with "%1.3f". */
+void format_result(struct textbuf *buf, const struct result_format *fmt,
+                   unsigned long seq_num, const char *header,
+                   unsigned long seq_len, const struct uproc_orf *orf,
+                   uproc_family family, double score, uproc_idmap *idmap);
+
+/* Print the number of classifications per family, most frequent first */
+void print_counts(uproc_io_stream *stream,
+                  unsigned long counts[UPROC_FAMILY_MAX + 1],
+                  uproc_idmap *idmap);
+
+/* Number of CPUs the process may use: the CPUs in its affinity mask, limited
+ * by the CPU quota of its cgroup (rounded up) */
+int available_cpus(void);
+
+/* Monotonic wall clock time in seconds */
+double wall_time(void);
+
+#if HAVE_SYS_SOCKET_H && HAVE_SYS_UN_H && HAVE_POLL_H
+#define SERVER_SUPPORT 1
+
+/* Classification request sent to uproc-server
+ *
+ * The client sends SERVER_PROTOCOL and a "key value" line for each field,
+ * followed by an empty line. The server answers with a line containing "OK"
+ * or "ERROR" and a message. After "OK", the client sends a header line
+ * (trimmed by trim_header()) and a sequence line for every sequence and
+ * shuts down its side of the connection. The server sends the output exactly
+ * as uproc-dna or uproc-prot would print it and closes the connection.
+ */
+#define SERVER_PROTOCOL "UPROC-SERVER 1"
+
+struct server_request
+{
+    /* DNA or protein sequences */
+    bool dna;
+
+    /* absolute paths of the database and model the client wants */
+    char *dbdir, *modeldir;
+
+    /* the classification options of the client (see uproc-dna) */
+    int prot_thresh_level, orf_thresh_level;
+    bool short_read_mode;
+
+    /* output options */
+    bool preds, counts, stats, numeric;
+    char *format;
+};
+
+/* Send a request to the socket `fd` */
+int server_request_send(int fd, const struct server_request *req);
+
+/* Receive a request, allocating the string members of `req` */
+int server_request_recv(uproc_io_stream *stream, struct server_request *req);
+
+/* Free the members of a request received by server_request_recv() */
+void server_request_free(struct server_request *req);
+
+/* Write all of `buf` to `fd` */
+int write_all(int fd, const void *buf, size_t n);
+#endif
+
 #if defined(TIMEIT) && HAVE_CLOCK_GETTIME
 #include <time.h>
 typedef struct
@@ -166,18 +166,18 @@ void bst_map_list_destroy(union uproc_bst_key key, void *value, void *opaque)
     uproc_list_destroy(*p);
 }
 
-void classify_detailed(uproc_protclass *pc, const struct uproc_sequence *seq)
+void classify_detailed(uproc_protclass *pc, uproc_classify_workspace *ws,
+                       const struct uproc_sequence *seq, uproc_list **results)
 {
     static unsigned long seq_num = 1;
     uproc_bst *match_lists =
         uproc_bst_create(UPROC_BST_UINT, sizeof(uproc_list *));
     uproc_protclass_set_trace(pc, trace_cb, match_lists);
 
-    uproc_list *results = NULL;
-    uproc_protclass_classify(pc, seq->data, &results);
-    for (long i = 0, n = uproc_list_size(results); i < n; i++) {
+    uproc_protclass_classify_ws(pc, ws, seq->data, results);
+    for (long i = 0, n = uproc_list_size(*results); i < n; i++) {
         struct uproc_protresult result;
-        uproc_list_get(results, i, &result);
+        uproc_list_get(*results, i, &result);
 
         uproc_list *matches;
         union uproc_bst_key key = {.uint = result.family};
@@ -187,7 +187,6 @@ void classify_detailed(uproc_protclass *pc, const struct uproc_sequence *seq)
         output_details(seq_num, seq, result.family, matches);
         uproc_list_destroy(matches);
     }
-    uproc_list_destroy(results);
     uproc_bst_map(match_lists, bst_map_list_destroy, NULL);
     uproc_bst_destroy(match_lists);
     seq_num++;
@@ -197,11 +196,15 @@ void classify_file(uproc_io_stream *stream, uproc_protclass *pc)
 {
     struct uproc_sequence seq = UPROC_SEQUENCE_INITIALIZER;
     uproc_seqiter *seqit = uproc_seqiter_create(stream);
+    uproc_classify_workspace *ws = uproc_classify_workspace_create();
+    uproc_list *results = NULL;
 
     while (!uproc_seqiter_next(seqit, &seq)) {
         trim_header(seq.header);
-        classify_detailed(pc, &seq);
+        classify_detailed(pc, ws, &seq, &results);
     }
+    uproc_list_destroy(results);
+    uproc_classify_workspace_destroy(ws);
     uproc_seqiter_destroy(seqit);
 }
 
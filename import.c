@@ -24,6 +24,7 @@
 #endif
 #include "common.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -64,6 +65,14 @@ void make_opts(struct ppopts *o, const char *progname)
     if (uproc_features_zlib()) {
         O('n', "nocompress", "", "Store without gzip compression.");
     }
+    O('B', "bundle", "",
+      "Write DEST as a single-file database bundle, which can be passed to "
+      "the classification tools instead of a database directory and is "
+      "loaded without parsing.");
+    O('c', "checksums", "",
+      "With -B, store checksums that are verified on every load.");
+#else
+    O('L', "layout", "LAYOUT", ECURVE_LAYOUT_HELP);
 #endif
 #undef O
 }
@@ -134,9 +143,15 @@ uproc_ecurve *wrap_load(uproc_io_stream *stream)
     return uproc_ecurve_loadps(UPROC_ECURVE_PLAIN, progress_cb, stream);
 }
 
+/* layout of the imported ecurves (see -L) */
+unsigned ecurve_layout = UPROC_ECURVE_LAYOUT_DEFAULT;
+
 int wrap_store(uproc_ecurve *ec, enum uproc_io_type iotype, const char *fmt,
                const char *dir, const char *name)
 {
+    if (uproc_ecurve_convert(ec, ecurve_layout)) {
+        return -1;
+    }
     progress(uproc_stderr, "Storing", -1);
     return uproc_ecurve_storep(ec, UPROC_ECURVE_BINARY, iotype, progress_cb,
                                fmt, dir, name);
@@ -187,6 +202,8 @@ int main(int argc, char **argv)
 
 #ifdef EXPORT
     enum uproc_io_type iotype = UPROC_IO_GZIP;
+    bool bundle = false;
+    unsigned bundle_flags = 0;
 #endif
 
     int opt;
@@ -207,6 +224,19 @@ int main(int argc, char **argv)
             case 'n':
                 iotype = UPROC_IO_STDIO;
                 break;
+            case 'B':
+                bundle = true;
+                break;
+            case 'c':
+                bundle_flags |= UPROC_DATABASE_BUNDLE_CHECKSUMS;
+                break;
+#else
+            case 'L':
+                if (uproc_ecurve_layout_parse(optarg, &ecurve_layout)) {
+                    uproc_perror("");
+                    return EXIT_FAILURE;
+                }
+                break;
 #endif
             case '?':
                 return EXIT_FAILURE;
@@ -220,6 +250,14 @@ int main(int argc, char **argv)
 #define IMEX "ex"
     dir = argv[optind + SOURCE];
     file = argv[optind + DEST];
+    if (bundle) {
+        fprintf(stderr, "bundling %s\n", dir);
+        if (uproc_database_bundle(dir, file, bundle_flags)) {
+            uproc_perror("error writing bundle %s", file);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
     stream = open_write(file, iotype);
 #else
 #define IMEX "im"
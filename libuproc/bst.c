@@ -52,6 +52,9 @@ struct uproc_bst_s
 
     /** Size of value objects */
     size_t value_size;
+
+    /** Nodes released by uproc_bst_clear(), linked via their `left` member */
+    struct bstnode *pool;
 };
 
 struct uproc_bstiter_s
@@ -84,14 +87,17 @@ static int cmp_keys(struct uproc_bst_s *t, union uproc_bst_key x,
     return uproc_error_msg(UPROC_EINVAL, "uninitialized bst");
 }
 
-/* create a new bst node */
-static struct bstnode *bstnode_create(union uproc_bst_key key,
+/* create a new bst node, reusing a pooled one if available */
+static struct bstnode *bstnode_create(struct uproc_bst_s *t,
+                                      union uproc_bst_key key,
                                       const void *value, size_t value_size,
                                       struct bstnode *parent)
 {
-    struct bstnode *n = malloc(sizeof *n + value_size);
+    struct bstnode *n = t->pool;
 
-    if (!n) {
+    if (n) {
+        t->pool = n->left;
+    } else if (!(n = malloc(sizeof *n + value_size))) {
         return NULL;
     }
     n->key = key;
@@ -113,6 +119,18 @@ static void bstnode_free(struct bstnode *n, size_t value_size)
     free(n);
 }
 
+/* move a node and all it's descendants to the pool of `t` */
+static void bstnode_release(struct uproc_bst_s *t, struct bstnode *n)
+{
+    if (!n) {
+        return;
+    }
+    bstnode_release(t, n->left);
+    bstnode_release(t, n->right);
+    n->left = t->pool;
+    t->pool = n;
+}
+
 /* find node in tree */
 static struct bstnode *bstnode_find(struct uproc_bst_s *t, struct bstnode *n,
                                     union uproc_bst_key key)
@@ -221,6 +239,7 @@ uproc_bst *uproc_bst_create(enum uproc_bst_keytype key_type, size_t value_size)
     t->size = 0;
     t->key_type = key_type;
     t->value_size = value_size;
+    t->pool = NULL;
     return t;
 }
 
@@ -230,9 +249,21 @@ void uproc_bst_destroy(uproc_bst *t)
         return;
     }
     bstnode_free(t->root, t->value_size);
+    while (t->pool) {
+        struct bstnode *n = t->pool;
+        t->pool = n->left;
+        free(n);
+    }
     free(t);
 }
 
+void uproc_bst_clear(uproc_bst *t)
+{
+    bstnode_release(t, t->root);
+    t->root = NULL;
+    t->size = 0;
+}
+
 int uproc_bst_isempty(uproc_bst *t)
 {
     return t->root == NULL;
@@ -249,7 +280,7 @@ static int insert_or_update(struct uproc_bst_s *t, union uproc_bst_key key,
     struct bstnode *n, *ins;
     int cmp;
     if (!t->root) {
-        t->root = bstnode_create(key, value, t->value_size, NULL);
+        t->root = bstnode_create(t, key, value, t->value_size, NULL);
         if (t->root) {
             t->size = 1;
             return 0;
@@ -267,10 +298,10 @@ static int insert_or_update(struct uproc_bst_s *t, union uproc_bst_key key,
         }
         return UPROC_BST_KEY_EXISTS;
     } else if (cmp < 0) {
-        ins = bstnode_create(key, value, t->value_size, n);
+        ins = bstnode_create(t, key, value, t->value_size, n);
         n->left = ins;
     } else {
-        ins = bstnode_create(key, value, t->value_size, n);
+        ins = bstnode_create(t, key, value, t->value_size, n);
         n->right = ins;
     }
 
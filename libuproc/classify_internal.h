@@ -0,0 +1,92 @@
+#ifndef UPROC_CLASSIFY_INTERNAL_H
+#define UPROC_CLASSIFY_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "uproc/bst.h"
+#include "uproc/list.h"
+#include "uproc/orf.h"
+#include "uproc/protclass.h"
+#include "uproc/word.h"
+
+#include "wordcache_internal.h"
+
+/* Words of one or more sequences and their neighbours in one ecurve */
+struct lookup_dir
+{
+    struct uproc_word *word, *lower_nb, *upper_nb;
+    uproc_family *lower_family, *upper_family;
+};
+
+/* Words in the order they are extracted from the sequence(s) */
+struct wordtab
+{
+    size_t n, alloc;
+    size_t *index;
+    struct lookup_dir fwd, rev;
+};
+
+/* Words of the current sequence looked up in the word cache: whether the
+ * `i`th word in direction `d` (0: forward, 1: reverse) was found, and its
+ * entry. The other words are collected in `missed`, `miss` holds their
+ * positions. */
+struct cachetab
+{
+    size_t alloc;
+    bool *hit[2];
+    struct wordcache_entry *entry[2];
+    size_t *miss;
+    struct lookup_dir missed;
+};
+
+/* Scores of the families touched by the current sequence
+ *
+ * `slot` has an entry for every family, holding one more than the position of
+ * the family's scores in `sc`, or 0 if the family was not touched. Only the
+ * slots of the `n` touched families are reset for the next sequence. */
+struct scoretab
+{
+    uint32_t *slot;
+    struct sc *sc;
+    size_t n, alloc;
+
+    /* Pruning: the current sequence, the word index at which the families
+     * are checked next and the highest lower bound of a reportable score */
+    const char *seq;
+    size_t seq_len, next_check;
+    double best;
+
+    struct uproc_protclass_stats stats;
+};
+
+/* A pooled ORF data buffer of `sz` bytes */
+struct orfbuf
+{
+    char *data;
+    size_t sz;
+};
+
+/* Members are created on first use, so that a workspace only used for
+ * protein classification does not carry the DNA specific parts */
+struct uproc_classify_workspace_s
+{
+    /* Protein classification (protclass.c): per-family scores, word iterator
+     * and the extracted words of the current sequence(s) */
+    struct scoretab scores;
+    uproc_worditer *words;
+    struct wordtab tab;
+    struct cachetab cache;
+
+    /* DNA classification (dnaclass.c): best ORF per family, ORF iterator and
+     * the protein classification results of the current ORF */
+    uproc_bst *max_scores;
+    uproc_orfiter *orfs;
+    uproc_list *orf_results;
+
+    /* ORF data buffers of discarded DNA results, reused for new ones */
+    struct orfbuf *orf_pool;
+    size_t orf_pool_n, orf_pool_alloc;
+};
+
+#endif
@@ -22,53 +22,173 @@
 #include <config.h>
 #endif
 
+#include <stdbool.h>
 #include <stdlib.h>
 
+#if _OPENMP
+#include <omp.h>
+#endif
+
 #include "uproc/error.h"
 #include "uproc/database.h"
 
 #include "database_internal.h"
+#include "error_internal.h"
 
 uproc_database *uproc_database_load(const char *path, int prot_thresh_level,
                                     enum uproc_ecurve_format format)
 {
-    uproc_database *db = malloc(sizeof *db);
-    *db = (struct uproc_database_s)UPROC_DATABASE_INITIALIZER;
+    unsigned memory = UPROC_ECURVE_MEMORY_DEFAULT;
+    const char *value = getenv("UPROC_MEMORY");
+
+    if (value && uproc_ecurve_memory_parse(value, &memory)) {
+        return NULL;
+    }
+    return uproc_database_load_memory(path, prot_thresh_level, format, memory);
+}
+
+uproc_database *uproc_database_load_memory(const char *path,
+                                           int prot_thresh_level,
+                                           enum uproc_ecurve_format format,
+                                           unsigned memory)
+{
+    return uproc_database_loadp(path, prot_thresh_level, format, memory, NULL);
+}
+
+#if _OPENMP
+/* Whether there is a second processor to load components concurrently */
+static bool load_parallel(void)
+{
+    return omp_get_num_procs() > 1;
+}
+#endif
+
+/* Progress of both ecurves, combined into one callback */
+struct load_progress
+{
+    void (*callback)(double);
+    double percent[2];
+};
+
+/* The ecurve loaded by the calling thread reports to `progress_slot` */
+#ifdef THREAD_LOCAL
+static THREAD_LOCAL struct load_progress *progress_state;
+static THREAD_LOCAL int progress_slot;
+#else
+static struct load_progress *progress_state;
+static int progress_slot;
+#if _OPENMP
+#pragma omp threadprivate(progress_state, progress_slot)
+#endif
+#endif
+
+static void progress_combined(double percent)
+{
+    struct load_progress *p = progress_state;
+#pragma omp critical(uproc_database_progress)
+    {
+        p->percent[progress_slot] = percent;
+        p->callback((p->percent[0] + p->percent[1]) / 2.0);
+    }
+}
+
+static uproc_ecurve *load_ecurve(const char *path, const char *name,
+                                 enum uproc_ecurve_format format,
+                                 struct load_progress *progress, int slot)
+{
+    if (!progress) {
+        return uproc_ecurve_load(format, UPROC_IO_GZIP, "%s/%s", path, name);
+    }
+    progress_state = progress;
+    progress_slot = slot;
+    return uproc_ecurve_loadp(format, UPROC_IO_GZIP, progress_combined,
+                              "%s/%s", path, name);
+}
+
+uproc_database *uproc_database_loadp(const char *path, int prot_thresh_level,
+                                     enum uproc_ecurve_format format,
+                                     unsigned memory,
+                                     void (*progress)(double))
+{
+    /* components in the order in which their errors are reported */
+    enum { FWD, REV, IDMAP, PROT_THRESH, COMPONENTS };
+    struct error_state errors[COMPONENTS];
+    bool failed[COMPONENTS] = {false};
+    struct load_progress load_progress = {progress, {0.0, 0.0}};
+    uproc_database *db;
+
+    if (database_is_bundle(path)) {
+        db = database_bundle_load(path, prot_thresh_level, memory);
+        if (db && progress) {
+            progress(100.0);
+        }
+        return db;
+    }
+    if (prot_thresh_level != 0 && prot_thresh_level != 2 &&
+        prot_thresh_level != 3) {
+        uproc_error_msg(UPROC_EINVAL,
+                        "protein threshold level must be 0, 2, or 3");
+        return NULL;
+    }
+
+    db = malloc(sizeof *db);
     if (!db) {
         uproc_error_msg(UPROC_ENOMEM,
                         "can not allocate memory for database object");
         return NULL;
     }
+    *db = (struct uproc_database_s)UPROC_DATABASE_INITIALIZER;
 
-    switch (prot_thresh_level) {
-        case 2:
-        case 3:
-            db->prot_thresh = uproc_matrix_load(
-                UPROC_IO_GZIP, "%s/prot_thresh_e%d", path, prot_thresh_level);
+    /* the components are independent, so the wall-clock time is that of the
+     * slowest one (usually an ecurve) rather than the sum */
+#pragma omp parallel sections num_threads(COMPONENTS) if (load_parallel())
+    {
+#pragma omp section
+        {
+            db->fwd = load_ecurve(path, "fwd.ecurve", format,
+                                  progress ? &load_progress : NULL, 0);
+            if (!db->fwd) {
+                failed[FWD] = true;
+                error_save(&errors[FWD]);
+            }
+        }
+#pragma omp section
+        {
+            db->rev = load_ecurve(path, "rev.ecurve", format,
+                                  progress ? &load_progress : NULL, 1);
+            if (!db->rev) {
+                failed[REV] = true;
+                error_save(&errors[REV]);
+            }
+        }
+#pragma omp section
+        {
+            db->idmap = uproc_idmap_load(UPROC_IO_GZIP, "%s/idmap", path);
+            if (!db->idmap) {
+                failed[IDMAP] = true;
+                error_save(&errors[IDMAP]);
+            }
+        }
+#pragma omp section
+        if (prot_thresh_level) {
+            db->prot_thresh =
+                uproc_matrix_load(UPROC_IO_GZIP, "%s/prot_thresh_e%d", path,
+                                  prot_thresh_level);
             if (!db->prot_thresh) {
-                goto error;
+                failed[PROT_THRESH] = true;
+                error_save(&errors[PROT_THRESH]);
             }
-            break;
-
-        case 0:
-            break;
-
-        default:
-            uproc_error_msg(UPROC_EINVAL,
-                            "protein threshold level must be 0, 2, or 3");
+        }
+    }
+    for (int i = 0; i < COMPONENTS; i++) {
+        if (failed[i]) {
+            error_restore(&errors[i]);
             goto error;
+        }
     }
 
-    db->idmap = uproc_idmap_load(UPROC_IO_GZIP, "%s/idmap", path);
-    if (!db->idmap) {
-        goto error;
-    }
-    db->fwd = uproc_ecurve_load(format, UPROC_IO_GZIP, "%s/fwd.ecurve", path);
-    if (!db->fwd) {
-        goto error;
-    }
-    db->rev = uproc_ecurve_load(format, UPROC_IO_GZIP, "%s/rev.ecurve", path);
-    if (!db->rev) {
+    if (memory && (uproc_ecurve_place(db->fwd, memory) == -1 ||
+                   uproc_ecurve_place(db->rev, memory) == -1)) {
         goto error;
     }
 
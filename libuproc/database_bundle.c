@@ -0,0 +1,850 @@
+/* Single-file database bundles
+ *
+ * Copyright 2014 Peter Meinicke, Robin Martinjak
+ *
+ * This file is part of libuproc.
+ *
+ * libuproc is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libuproc is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libuproc.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_MMAP && USE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#include "uproc/common.h"
+#include "uproc/error.h"
+#include "uproc/database.h"
+#include "uproc/ecurve.h"
+#include "uproc/idmap.h"
+#include "uproc/io.h"
+#include "uproc/matrix.h"
+
+#include "database_internal.h"
+#include "ecurve_internal.h"
+#include "idmap_internal.h"
+
+#define ALIGN(n, a) (((n) + (a)-1) / (a) * (a))
+
+/* 64-bit FNV-1a, applied to 64-bit words instead of bytes (the last word of
+ * a section being padded with zeros) so that verifying gigabytes of ecurve
+ * doesn't take longer than loading them */
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/* Size of the blocks in which sections are read for verification */
+#define VERIFY_BLOCK ((size_t)1 << 20)
+
+struct checksum
+{
+    uint64_t hash;
+    /* incomplete word and the number of bytes in it */
+    unsigned char tail[8];
+    size_t tail_len;
+};
+
+static void checksum_init(struct checksum *c)
+{
+    c->hash = FNV_OFFSET;
+    c->tail_len = 0;
+}
+
+static void checksum_update(struct checksum *c, const void *data, size_t n)
+{
+    const unsigned char *p = data;
+    uint64_t word, hash = c->hash;
+
+    while (c->tail_len && n) {
+        c->tail[c->tail_len++] = *p++;
+        n--;
+        if (c->tail_len == sizeof word) {
+            memcpy(&word, c->tail, sizeof word);
+            hash = (hash ^ word) * FNV_PRIME;
+            c->tail_len = 0;
+        }
+    }
+    for (; n >= sizeof word; p += sizeof word, n -= sizeof word) {
+        memcpy(&word, p, sizeof word);
+        hash = (hash ^ word) * FNV_PRIME;
+    }
+    memcpy(c->tail + c->tail_len, p, n);
+    c->tail_len += n;
+    c->hash = hash;
+}
+
+static uint64_t checksum_final(struct checksum *c)
+{
+    uint64_t word = 0;
+    if (c->tail_len) {
+        memcpy(&word, c->tail, c->tail_len);
+        c->hash = (c->hash ^ word) * FNV_PRIME;
+        c->tail_len = 0;
+    }
+    return c->hash;
+}
+
+/* Everything that goes into a bundle */
+struct bundle_parts
+{
+    uproc_ecurve *fwd, *rev;
+    uproc_idmap *idmap;
+    uproc_matrix *prot_thresh[2];
+    char *info;
+    size_t info_len;
+};
+
+/* Writes a bundle to `stream`, or (if `stream` is NULL) only determines the
+ * section table and checksums */
+struct bundle_writer
+{
+    uproc_io_stream *stream;
+    size_t offset;
+    bool checksums;
+    struct checksum checksum;
+    struct database_bundle_header header;
+};
+
+static int emit(struct bundle_writer *w, const void *data, size_t n)
+{
+    if (w->checksums) {
+        checksum_update(&w->checksum, data, n);
+    }
+    if (w->stream && n && uproc_io_write(data, n, 1, w->stream) != 1) {
+        return uproc_error(UPROC_ERRNO);
+    }
+    w->offset += n;
+    return 0;
+}
+
+static int emit_pad(struct bundle_writer *w, size_t offset)
+{
+    static const char zeros[4096];
+    while (w->offset < offset) {
+        size_t n = offset - w->offset;
+        if (emit(w, zeros, n < sizeof zeros ? n : sizeof zeros)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int section_begin(struct bundle_writer *w,
+                         enum database_bundle_section_id id)
+{
+    uint32_t i = w->header.section_count++;
+    if (emit_pad(w, ALIGN(w->offset, DATABASE_BUNDLE_ALIGN))) {
+        return -1;
+    }
+    w->header.sections[i].id = id;
+    w->header.sections[i].offset = w->offset;
+    checksum_init(&w->checksum);
+    return 0;
+}
+
+static void section_end(struct bundle_writer *w)
+{
+    uint32_t i = w->header.section_count - 1;
+    w->header.sections[i].size = w->offset - w->header.sections[i].offset;
+    if (w->checksums) {
+        w->header.sections[i].checksum = checksum_final(&w->checksum);
+    }
+}
+
+static int emit_ecurve(struct bundle_writer *w, uproc_ecurve *ecurve)
+{
+    size_t i, start = w->offset;
+    struct ecurve_format_header header;
+    struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+
+    ecurve_format_header(ecurve, &header, sec);
+    if (emit(w, &header, sizeof header)) {
+        return -1;
+    }
+    for (i = 0; i < header.section_count; i++) {
+        if (emit_pad(w, start + header.sections[i].offset) ||
+            emit(w, *sec[i].ptr, sec[i].size)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int emit_idmap(struct bundle_writer *w, const uproc_idmap *idmap)
+{
+    uint64_t n = idmap_size(idmap), offset = 0;
+    if (emit(w, &n, sizeof n)) {
+        return -1;
+    }
+    for (uproc_family i = 0; i < n; i++) {
+        if (emit(w, &offset, sizeof offset)) {
+            return -1;
+        }
+        offset += strlen(uproc_idmap_str(idmap, i)) + 1;
+    }
+    for (uproc_family i = 0; i < n; i++) {
+        const char *s = uproc_idmap_str(idmap, i);
+        if (emit(w, s, strlen(s) + 1)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int emit_matrix(struct bundle_writer *w, const uproc_matrix *matrix)
+{
+    unsigned long rows, cols;
+    uint64_t dim[2];
+
+    uproc_matrix_dimensions(matrix, &rows, &cols);
+    dim[0] = rows;
+    dim[1] = cols;
+    if (emit(w, dim, sizeof dim)) {
+        return -1;
+    }
+    for (unsigned long i = 0; i < rows; i++) {
+        for (unsigned long k = 0; k < cols; k++) {
+            double value = uproc_matrix_get(matrix, i, k);
+            if (emit(w, &value, sizeof value)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Write all sections; `header` is written first, as a placeholder in the
+ * first pass */
+static int bundle_emit(struct bundle_writer *w, const struct bundle_parts *p,
+                       const struct database_bundle_header *header)
+{
+    static const enum database_bundle_section_id thresh_ids[] = {
+        BUNDLE_SEC_PROT_THRESH_E2, BUNDLE_SEC_PROT_THRESH_E3,
+    };
+
+    w->offset = 0;
+    memset(&w->header, 0, sizeof w->header);
+    if (emit(w, header, sizeof *header)) {
+        return -1;
+    }
+
+    /* the small sections first, so that they share as few pages as possible
+     * with the ecurves */
+    if (section_begin(w, BUNDLE_SEC_IDMAP) || emit_idmap(w, p->idmap)) {
+        return -1;
+    }
+    section_end(w);
+    for (int i = 0; i < 2; i++) {
+        if (section_begin(w, thresh_ids[i]) ||
+            emit_matrix(w, p->prot_thresh[i])) {
+            return -1;
+        }
+        section_end(w);
+    }
+    if (p->info) {
+        if (section_begin(w, BUNDLE_SEC_INFO) ||
+            emit(w, p->info, p->info_len)) {
+            return -1;
+        }
+        section_end(w);
+    }
+    if (section_begin(w, BUNDLE_SEC_FWD) || emit_ecurve(w, p->fwd)) {
+        return -1;
+    }
+    section_end(w);
+    if (section_begin(w, BUNDLE_SEC_REV) || emit_ecurve(w, p->rev)) {
+        return -1;
+    }
+    section_end(w);
+    return 0;
+}
+
+/* Read DIR/info.txt if it exists */
+static int read_info(const char *dir, char **info, size_t *len)
+{
+    char *path, buf[4096];
+    size_t n;
+    FILE *f;
+
+    path = malloc(strlen(dir) + sizeof "/info.txt");
+    if (!path) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    sprintf(path, "%s/info.txt", dir);
+    f = fopen(path, "rb");
+    free(path);
+    if (!f) {
+        return 0;
+    }
+    while ((n = fread(buf, 1, sizeof buf, f))) {
+        char *tmp = realloc(*info, *len + n);
+        if (!tmp) {
+            fclose(f);
+            return uproc_error(UPROC_ENOMEM);
+        }
+        *info = tmp;
+        memcpy(*info + *len, buf, n);
+        *len += n;
+    }
+    fclose(f);
+    return 0;
+}
+
+int uproc_database_bundle(const char *dir, const char *path, unsigned flags)
+{
+    int res = -1;
+    struct bundle_parts parts = {0};
+    struct bundle_writer w = {0};
+    struct database_bundle_header header;
+
+    parts.prot_thresh[0] =
+        uproc_matrix_load(UPROC_IO_GZIP, "%s/prot_thresh_e2", dir);
+    if (!parts.prot_thresh[0]) {
+        goto error;
+    }
+    parts.prot_thresh[1] =
+        uproc_matrix_load(UPROC_IO_GZIP, "%s/prot_thresh_e3", dir);
+    if (!parts.prot_thresh[1]) {
+        goto error;
+    }
+    parts.idmap = uproc_idmap_load(UPROC_IO_GZIP, "%s/idmap", dir);
+    if (!parts.idmap) {
+        goto error;
+    }
+    parts.fwd = uproc_ecurve_load(UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                                  "%s/fwd.ecurve", dir);
+    if (!parts.fwd) {
+        goto error;
+    }
+    parts.rev = uproc_ecurve_load(UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                                  "%s/rev.ecurve", dir);
+    if (!parts.rev) {
+        goto error;
+    }
+    if (read_info(dir, &parts.info, &parts.info_len)) {
+        goto error;
+    }
+
+    /* determine the section table (and checksums), then write it all */
+    memset(&header, 0, sizeof header);
+    w.checksums = flags & UPROC_DATABASE_BUNDLE_CHECKSUMS;
+    if (bundle_emit(&w, &parts, &header)) {
+        goto error;
+    }
+    header = w.header;
+    memcpy(header.magic, DATABASE_BUNDLE_MAGIC, sizeof header.magic);
+    header.version = DATABASE_BUNDLE_VERSION;
+    header.byte_order = DATABASE_BUNDLE_BYTE_ORDER;
+    header.flags = flags & UPROC_DATABASE_BUNDLE_CHECKSUMS;
+
+    w = (struct bundle_writer){0};
+    w.stream = uproc_io_open("wb", UPROC_IO_STDIO, "%s", path);
+    if (!w.stream) {
+        goto error;
+    }
+    res = bundle_emit(&w, &parts, &header);
+    if (uproc_io_close(w.stream) && !res) {
+        res = uproc_error_msg(UPROC_ERRNO, "failed to write %s", path);
+    }
+
+error:
+    uproc_matrix_destroy(parts.prot_thresh[0]);
+    uproc_matrix_destroy(parts.prot_thresh[1]);
+    uproc_idmap_destroy(parts.idmap);
+    uproc_ecurve_destroy(parts.fwd);
+    uproc_ecurve_destroy(parts.rev);
+    free(parts.info);
+    return res;
+}
+
+bool database_is_bundle(const char *path)
+{
+    char magic[sizeof DATABASE_BUNDLE_MAGIC - 1];
+    FILE *f = fopen(path, "rb");
+    bool res;
+    if (!f) {
+        return false;
+    }
+    res = fread(magic, sizeof magic, 1, f) == 1 &&
+          !memcmp(magic, DATABASE_BUNDLE_MAGIC, sizeof magic);
+    fclose(f);
+    return res;
+}
+
+/* Check the header of a bundle of `size` bytes (or of unknown size if
+ * `size` is 0) */
+static int header_check(const struct database_bundle_header *header,
+                        size_t size)
+{
+    uint64_t end = sizeof *header;
+
+    if (memcmp(header->magic, DATABASE_BUNDLE_MAGIC, sizeof header->magic)) {
+        return uproc_error_msg(UPROC_EINVAL, "not a database bundle");
+    }
+    if (header->version != DATABASE_BUNDLE_VERSION) {
+        return uproc_error_msg(UPROC_EINVAL,
+                               "unsupported database bundle version %lu",
+                               (unsigned long)header->version);
+    }
+    if (header->byte_order != DATABASE_BUNDLE_BYTE_ORDER) {
+        return uproc_error_msg(UPROC_EINVAL, "database bundle was created on "
+                                             "a host with different byte "
+                                             "order");
+    }
+    if (header->section_count > DATABASE_BUNDLE_SECTIONS_MAX) {
+        return uproc_error_msg(UPROC_EINVAL, "invalid database bundle header");
+    }
+    /* sections are stored in order, don't overlap and lie within the file */
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        uint64_t offset = header->sections[i].offset,
+                 sec_size = header->sections[i].size;
+        if (offset < end || offset % DATABASE_BUNDLE_ALIGN ||
+            sec_size > UINT64_MAX - offset) {
+            return uproc_error_msg(UPROC_EINVAL,
+                                   "invalid database bundle header");
+        }
+        if (size && (offset > size || sec_size > size - offset)) {
+            return uproc_error_msg(UPROC_EINVAL, "truncated database bundle");
+        }
+        end = offset + sec_size;
+    }
+    return 0;
+}
+
+/* Section with the protein thresholds of `level`, 0 if not needed */
+static int thresh_section(int level, enum database_bundle_section_id *id)
+{
+    switch (level) {
+        case 2:
+            *id = BUNDLE_SEC_PROT_THRESH_E2;
+            return 0;
+        case 3:
+            *id = BUNDLE_SEC_PROT_THRESH_E3;
+            return 0;
+        case 0:
+            *id = 0;
+            return 0;
+    }
+    return uproc_error_msg(UPROC_EINVAL,
+                           "protein threshold level must be 0, 2, or 3");
+}
+
+static uproc_idmap *idmap_parse(const char *data, size_t size)
+{
+    uint64_t n, offset;
+    const char *strings;
+    uproc_idmap *idmap;
+
+    if (size < sizeof n) {
+        goto invalid;
+    }
+    memcpy(&n, data, sizeof n);
+    if (n > UPROC_FAMILY_MAX || size < (n + 1) * sizeof n ||
+        (n && data[size - 1])) {
+        goto invalid;
+    }
+    strings = data + (n + 1) * sizeof n;
+    idmap = uproc_idmap_create();
+    if (!idmap) {
+        return NULL;
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        memcpy(&offset, data + (i + 1) * sizeof n, sizeof offset);
+        if (offset >= size - (strings - data)) {
+            uproc_idmap_destroy(idmap);
+            goto invalid;
+        }
+        if (idmap_append(idmap, strings + offset)) {
+            uproc_idmap_destroy(idmap);
+            return NULL;
+        }
+    }
+    return idmap;
+
+invalid:
+    uproc_error_msg(UPROC_EINVAL, "invalid idmap in database bundle");
+    return NULL;
+}
+
+static uproc_matrix *matrix_parse(const char *data, size_t size)
+{
+    uint64_t dim[2];
+    double *values;
+    uproc_matrix *matrix;
+
+    if (size < sizeof dim) {
+        goto invalid;
+    }
+    memcpy(dim, data, sizeof dim);
+    if (!dim[0] || !dim[1] || dim[0] > SIZE_MAX / sizeof *values / dim[1] ||
+        size - sizeof dim != dim[0] * dim[1] * sizeof *values) {
+        goto invalid;
+    }
+    /* copy, as the values might not be aligned */
+    values = malloc(size - sizeof dim);
+    if (!values) {
+        uproc_error(UPROC_ENOMEM);
+        return NULL;
+    }
+    memcpy(values, data + sizeof dim, size - sizeof dim);
+    matrix = uproc_matrix_create(dim[0], dim[1], values);
+    free(values);
+    return matrix;
+
+invalid:
+    uproc_error_msg(UPROC_EINVAL, "invalid matrix in database bundle");
+    return NULL;
+}
+
+/* Read up to `offset`, discarding the data */
+static int skip_to(uproc_io_stream *stream, size_t *pos, size_t offset)
+{
+    char buf[4096];
+    while (*pos < offset) {
+        size_t n = offset - *pos < sizeof buf ? offset - *pos : sizeof buf;
+        if (uproc_io_read(buf, 1, n, stream) != n) {
+            return uproc_error_msg(UPROC_EIO, "truncated database bundle");
+        }
+        *pos += n;
+    }
+    return 0;
+}
+
+/* Compare the checksums of all sections with the ones in `header` */
+static int bundle_verify(const char *path,
+                         const struct database_bundle_header *header)
+{
+    int res = 0;
+    size_t pos = 0;
+    uproc_io_stream *stream;
+    char *buf;
+
+    stream = uproc_io_open("rb", UPROC_IO_STDIO, "%s", path);
+    if (!stream) {
+        return -1;
+    }
+    buf = malloc(VERIFY_BLOCK);
+    if (!buf) {
+        uproc_io_close(stream);
+        return uproc_error(UPROC_ENOMEM);
+    }
+    for (uint32_t i = 0; !res && i < header->section_count; i++) {
+        struct checksum sum;
+        size_t end = header->sections[i].offset + header->sections[i].size;
+        checksum_init(&sum);
+        res = skip_to(stream, &pos, header->sections[i].offset);
+        while (!res && pos < end) {
+            size_t n = end - pos < VERIFY_BLOCK ? end - pos : VERIFY_BLOCK;
+            if (uproc_io_read(buf, 1, n, stream) != n) {
+                res = uproc_error_msg(UPROC_EIO, "truncated database bundle");
+                break;
+            }
+            checksum_update(&sum, buf, n);
+            pos += n;
+        }
+        if (!res && checksum_final(&sum) != header->sections[i].checksum) {
+            res = uproc_error_msg(UPROC_EINVAL,
+                                  "checksum mismatch in database bundle "
+                                  "section %d",
+                                  (int)header->sections[i].id);
+        }
+    }
+    free(buf);
+    uproc_io_close(stream);
+    return res;
+}
+
+#if HAVE_MMAP && USE_MMAP
+static int section_find(const struct database_bundle_header *header,
+                        enum database_bundle_section_id id)
+{
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        if (header->sections[i].id == id) {
+            return i;
+        }
+    }
+    uproc_error_msg(UPROC_EINVAL, "database bundle lacks section %d", (int)id);
+    return -1;
+}
+
+/* Set up an ecurve that takes over the part of the mapping at `ptr` */
+static uproc_ecurve *map_ecurve(char *ptr, size_t size, size_t page_size)
+{
+    struct uproc_ecurve_s *ec = malloc(sizeof *ec);
+    if (!ec) {
+        uproc_error(UPROC_ENOMEM);
+        return NULL;
+    }
+    *ec = (struct uproc_ecurve_s){0};
+    ec->mmap_fd = -1;
+    ec->mmap_ptr = ptr;
+    ec->mmap_size = size;
+    if (ecurve_map_sections(ec)) {
+        free(ec);
+        return NULL;
+    }
+    /* the ecurve unmaps its pages when it is destroyed */
+    ec->mmap_size = ALIGN(size, page_size);
+#ifdef POSIX_MADV_RANDOM
+    posix_madvise(ptr, ec->mmap_size, POSIX_MADV_RANDOM);
+#endif
+    return ec;
+}
+
+/* Map the whole bundle, let the ecurves take over their sections and copy
+ * the rest */
+static uproc_database *bundle_map(const char *path,
+                                  const struct database_bundle_header *header,
+                                  int prot_thresh_level)
+{
+    int fd, sec[2];
+    struct stat st;
+    char *base;
+    size_t page_size = sysconf(_SC_PAGESIZE), mapped, prev;
+    enum database_bundle_section_id thresh_id = 0;
+    unsigned residency;
+    uproc_database *db;
+    struct uproc_ecurve_s *ecurves[2] = {NULL, NULL};
+
+    if (thresh_section(prot_thresh_level, &thresh_id) ||
+        ecurve_residency(&residency)) {
+        return NULL;
+    }
+    if (DATABASE_BUNDLE_ALIGN % page_size) {
+        uproc_error_msg(UPROC_ENOTSUP, "unsupported page size %lu",
+                        (unsigned long)page_size);
+        return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        uproc_error_msg(UPROC_ERRNO, "failed to open %s", path);
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1) {
+        uproc_error_msg(UPROC_ERRNO, "stat failed");
+        close(fd);
+        return NULL;
+    }
+    if (header_check(header, st.st_size)) {
+        close(fd);
+        return NULL;
+    }
+    mapped = ALIGN((size_t)st.st_size, page_size);
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd,
+                0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        uproc_error_msg(UPROC_ERRNO, "mmap failed");
+        return NULL;
+    }
+    db = malloc(sizeof *db);
+    if (!db) {
+        uproc_error(UPROC_ENOMEM);
+        munmap(base, mapped);
+        return NULL;
+    }
+    *db = (struct uproc_database_s)UPROC_DATABASE_INITIALIZER;
+
+#define SECTION(i) (base + header->sections[i].offset), header->sections[i].size
+    int i = section_find(header, BUNDLE_SEC_IDMAP);
+    if (i < 0 || !(db->idmap = idmap_parse(SECTION(i)))) {
+        goto error;
+    }
+    if (thresh_id) {
+        i = section_find(header, thresh_id);
+        if (i < 0 || !(db->prot_thresh = matrix_parse(SECTION(i)))) {
+            goto error;
+        }
+    }
+    sec[0] = section_find(header, BUNDLE_SEC_FWD);
+    sec[1] = section_find(header, BUNDLE_SEC_REV);
+    if (sec[0] < 0 || sec[1] < 0 ||
+        !(ecurves[0] = map_ecurve(SECTION(sec[0]), page_size)) ||
+        !(ecurves[1] = map_ecurve(SECTION(sec[1]), page_size))) {
+        goto error;
+    }
+#undef SECTION
+    db->fwd = ecurves[0];
+    db->rev = ecurves[1];
+
+    /* unmap everything but the ecurves, which are sorted by offset */
+    if (sec[0] > sec[1]) {
+        int tmp = sec[0];
+        sec[0] = sec[1];
+        sec[1] = tmp;
+    }
+    prev = 0;
+    for (i = 0; i < 2; i++) {
+        size_t offset = header->sections[sec[i]].offset;
+        if (offset > prev) {
+            munmap(base + prev, offset - prev);
+        }
+        prev = ALIGN(offset + header->sections[sec[i]].size, page_size);
+    }
+    if (mapped > prev) {
+        munmap(base + prev, mapped - prev);
+    }
+    ecurve_residency_apply(db->fwd, residency);
+    ecurve_residency_apply(db->rev, residency);
+    return db;
+
+error:
+    /* the ecurves don't own their part of the mapping yet */
+    for (i = 0; i < 2; i++) {
+        if (ecurves[i]) {
+            uproc_alphabet_destroy(ecurves[i]->alphabet);
+            free(ecurves[i]);
+        }
+    }
+    uproc_database_destroy(db);
+    munmap(base, mapped);
+    return NULL;
+}
+#else
+/* Read the sections one after another */
+static uproc_database *bundle_read(const char *path,
+                                   const struct database_bundle_header *header,
+                                   int prot_thresh_level)
+{
+    size_t pos = 0;
+    uproc_io_stream *stream;
+    enum database_bundle_section_id thresh_id = 0;
+    uproc_database *db;
+
+    if (thresh_section(prot_thresh_level, &thresh_id) ||
+        header_check(header, 0)) {
+        return NULL;
+    }
+    db = malloc(sizeof *db);
+    if (!db) {
+        uproc_error(UPROC_ENOMEM);
+        return NULL;
+    }
+    *db = (struct uproc_database_s)UPROC_DATABASE_INITIALIZER;
+    stream = uproc_io_open("rb", UPROC_IO_STDIO, "%s", path);
+    if (!stream) {
+        goto error;
+    }
+
+    for (uint32_t i = 0; i < header->section_count; i++) {
+        uint32_t id = header->sections[i].id;
+        size_t size = header->sections[i].size;
+        uproc_ecurve **ec = id == BUNDLE_SEC_FWD
+                                ? &db->fwd
+                                : id == BUNDLE_SEC_REV ? &db->rev : NULL;
+        char *data;
+
+        if (!ec && id != BUNDLE_SEC_IDMAP && (!thresh_id || id != thresh_id)) {
+            continue;
+        }
+        if (skip_to(stream, &pos, header->sections[i].offset)) {
+            goto error;
+        }
+        if (ec) {
+            *ec = uproc_ecurve_loads(UPROC_ECURVE_BINARY, stream);
+            if (!*ec) {
+                goto error;
+            }
+            pos += size;
+            continue;
+        }
+        data = malloc(size ? size : 1);
+        if (!data) {
+            uproc_error(UPROC_ENOMEM);
+            goto error;
+        }
+        if (uproc_io_read(data, 1, size, stream) != size) {
+            uproc_error_msg(UPROC_EIO, "truncated database bundle");
+            free(data);
+            goto error;
+        }
+        pos += size;
+        if (id == BUNDLE_SEC_IDMAP) {
+            db->idmap = idmap_parse(data, size);
+        } else {
+            db->prot_thresh = matrix_parse(data, size);
+        }
+        free(data);
+        if (id == BUNDLE_SEC_IDMAP ? !db->idmap : !db->prot_thresh) {
+            goto error;
+        }
+    }
+    if (!db->fwd || !db->rev || !db->idmap ||
+        (thresh_id && !db->prot_thresh)) {
+        uproc_error_msg(UPROC_EINVAL, "incomplete database bundle");
+        goto error;
+    }
+    uproc_io_close(stream);
+    return db;
+
+error:
+    if (stream) {
+        uproc_io_close(stream);
+    }
+    uproc_database_destroy(db);
+    return NULL;
+}
+#endif
+
+uproc_database *database_bundle_load(const char *path, int prot_thresh_level,
+                                     unsigned memory)
+{
+    struct database_bundle_header header;
+    uproc_io_stream *stream;
+    uproc_database *db;
+    size_t sz;
+
+    stream = uproc_io_open("rb", UPROC_IO_STDIO, "%s", path);
+    if (!stream) {
+        return NULL;
+    }
+    sz = uproc_io_read(&header, sizeof header, 1, stream);
+    uproc_io_close(stream);
+    if (sz != 1) {
+        uproc_error_msg(UPROC_EIO, "truncated database bundle");
+        return NULL;
+    }
+    if (header_check(&header, 0)) {
+        return NULL;
+    }
+    if ((header.flags & UPROC_DATABASE_BUNDLE_CHECKSUMS) &&
+        bundle_verify(path, &header)) {
+        return NULL;
+    }
+
+#if HAVE_MMAP && USE_MMAP
+    db = bundle_map(path, &header, prot_thresh_level);
+#else
+    db = bundle_read(path, &header, prot_thresh_level);
+#endif
+    if (db && memory &&
+        (uproc_ecurve_place(db->fwd, memory) == -1 ||
+         uproc_ecurve_place(db->rev, memory) == -1)) {
+        uproc_database_destroy(db);
+        return NULL;
+    }
+    return db;
+}
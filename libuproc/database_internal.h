@@ -1,6 +1,10 @@
 #ifndef UPROC_DATABASE_INTERNAL_H
 #define UPROC_DATABASE_INTERNAL_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "uproc/database.h"
 #include "uproc/ecurve.h"
 #include "uproc/matrix.h"
 #include "uproc/idmap.h"
@@ -36,4 +40,72 @@ struct uproc_database_s
         0, 0, 0, 0                 \
     }
 
+/** Single-file database bundle, see uproc_database_bundle()
+ *
+ * The file starts with a `struct database_bundle_header`, followed by the
+ * sections it lists. All sections start at a multiple of
+ * #DATABASE_BUNDLE_ALIGN, so that each one can be mapped (and unmapped)
+ * separately on any common page size. Sections:
+ *
+ * - `BUNDLE_SEC_FWD`, `BUNDLE_SEC_REV`: ecurve in the sectioned format (see
+ *   `struct ecurve_format_header`), exactly as it would be stored in a file.
+ * - `BUNDLE_SEC_IDMAP`: `uint64_t n`, `uint64_t offsets[n]` and the
+ *   null-terminated IDs, the offsets being relative to the first ID.
+ * - `BUNDLE_SEC_PROT_THRESH_E2`, `BUNDLE_SEC_PROT_THRESH_E3`:
+ *   `uint64_t rows, cols` and `double values[rows * cols]`.
+ * - `BUNDLE_SEC_INFO`: contents of info.txt (optional).
+ */
+#define DATABASE_BUNDLE_MAGIC "\x89UPROCDB"
+#define DATABASE_BUNDLE_VERSION 1
+#define DATABASE_BUNDLE_ALIGN ((size_t)1 << 16)
+#define DATABASE_BUNDLE_SECTIONS_MAX 16
+
+enum database_bundle_section_id {
+    BUNDLE_SEC_FWD = 1,
+    BUNDLE_SEC_REV,
+    BUNDLE_SEC_IDMAP,
+    BUNDLE_SEC_PROT_THRESH_E2,
+    BUNDLE_SEC_PROT_THRESH_E3,
+    BUNDLE_SEC_INFO,
+};
+
+struct database_bundle_header
+{
+    /** #DATABASE_BUNDLE_MAGIC (without the terminating null byte) */
+    char magic[8];
+
+    /** #DATABASE_BUNDLE_VERSION */
+    uint32_t version;
+
+    /** 0x01020304 as written by the host that created the file */
+    uint32_t byte_order;
+
+    /** ::uproc_database_bundle_flags used to create the file */
+    uint32_t flags;
+
+    /** Number of used entries in `#sections` */
+    uint32_t section_count;
+
+    struct
+    {
+        uint32_t id, reserved;
+        /** Offset from the start of the file, in bytes */
+        uint64_t offset;
+        /** Size in bytes */
+        uint64_t size;
+        /** FNV-1a hash (over 64-bit words) of the section if
+         * UPROC_DATABASE_BUNDLE_CHECKSUMS is set in `#flags`, otherwise 0 */
+        uint64_t checksum;
+    } sections[DATABASE_BUNDLE_SECTIONS_MAX];
+};
+
+#define DATABASE_BUNDLE_BYTE_ORDER 0x01020304
+
+/** Whether the file at `path` starts with #DATABASE_BUNDLE_MAGIC */
+bool database_is_bundle(const char *path);
+
+/** Load a database bundle, see uproc_database_load_memory() */
+uproc_database *database_bundle_load(const char *path, int prot_thresh_level,
+                                     unsigned memory);
+
 #endif
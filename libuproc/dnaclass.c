@@ -36,6 +36,8 @@
 #include "uproc/protclass.h"
 #include "uproc/orf.h"
 
+#include "classify_internal.h"
+
 struct uproc_dnaclass_s
 {
     enum uproc_dnaclass_mode mode;
@@ -78,122 +80,378 @@ void uproc_dnaclass_destroy(uproc_dnaclass *dc)
     free(dc);
 }
 
-static void map_list_dnaresult_free(void *value, void *opaque)
+/* Maximum number of buffers in the ORF data pool of a workspace */
+#define ORF_POOL_MAX 4096
+
+/* Hand an ORF data buffer of `sz` bytes to the pool of `ws`, or free it if
+ * its size is unknown (`sz` is 0) or the pool is full */
+static void orfbuf_release(struct uproc_classify_workspace_s *ws, char *data,
+                           size_t sz)
 {
-    (void)opaque;
-    uproc_dnaresult_free(value);
+    if (!data) {
+        return;
+    }
+    if (!sz || ws->orf_pool_n == ORF_POOL_MAX) {
+        free(data);
+        return;
+    }
+    if (ws->orf_pool_n == ws->orf_pool_alloc) {
+        size_t alloc = ws->orf_pool_alloc ? ws->orf_pool_alloc * 2 : 64;
+        struct orfbuf *tmp = realloc(ws->orf_pool, alloc * sizeof *tmp);
+        if (!tmp) {
+            free(data);
+            return;
+        }
+        ws->orf_pool = tmp;
+        ws->orf_pool_alloc = alloc;
+    }
+    ws->orf_pool[ws->orf_pool_n++] = (struct orfbuf){.data = data, .sz = sz};
 }
 
-static void map_bst_dnaresult_free(union uproc_bst_key key, void *value,
-                                   void *opaque)
+/* Size of the buffer allocated for an ORF of length `len`
+ *
+ * Rounded up, so that the buffer fits most later ORFs as well. */
+static size_t orfbuf_size(size_t len)
 {
-    (void)key;
-    (void)opaque;
-    uproc_dnaresult_free(value);
+    size_t sz;
+    for (sz = 128; sz <= len; sz *= 2) {
+        ;
+    }
+    return sz;
 }
 
-int uproc_dnaclass_classify(const uproc_dnaclass *dc, const char *seq,
-                            uproc_list **results)
+/* Copy `src` to `dest`, reusing its buffer or a pooled one if possible */
+static int orfbuf_assign(struct uproc_classify_workspace_s *ws,
+                         struct uproc_dnaresult *dest,
+                         const struct uproc_orf *src)
 {
-    int res;
-    size_t i;
-    struct uproc_orf orf;
-    uproc_orfiter *orf_iter;
-    uproc_bst *max_scores;
-    uproc_bstiter *max_scores_iter;
-    union uproc_bst_key key;
-    uproc_list *pc_results = NULL;
+    char *data = dest->orf.data;
+    size_t sz = dest->orf_alloc, len = strlen(src->data);
+
+    if (!data && ws->orf_pool_n) {
+        struct orfbuf *buf = &ws->orf_pool[--ws->orf_pool_n];
+        data = buf->data;
+        sz = buf->sz;
+    }
+    if (!data || sz <= len) {
+        size_t alloc = orfbuf_size(len);
+        char *tmp = realloc(data, alloc);
+        if (!tmp) {
+            /* leave `dest` as it was */
+            if (data != dest->orf.data) {
+                orfbuf_release(ws, data, sz);
+            }
+            return uproc_error(UPROC_ENOMEM);
+        }
+        data = tmp;
+        sz = alloc;
+    }
+    memcpy(data, src->data, len + 1);
+    dest->orf = *src;
+    dest->orf.data = data;
+    dest->orf_alloc = sz;
+    return 0;
+}
 
-    struct uproc_dnaresult pred = UPROC_DNARESULT_INITIALIZER,
-                           pred_max = UPROC_DNARESULT_INITIALIZER;
+static void map_list_dnaresult_release(void *value, void *opaque)
+{
+    struct uproc_dnaresult *result = value;
+    orfbuf_release(opaque, result->orf.data, result->orf_alloc);
+}
+
+static void map_bst_max_score_release(union uproc_bst_key key, void *value,
+                                      void *opaque)
+{
+    struct uproc_dnaresult *ms = value;
+    (void)key;
+    orfbuf_release(opaque, ms->orf.data, ms->orf_alloc);
+}
 
+static int results_prepare(struct uproc_classify_workspace_s *ws,
+                           uproc_list **results)
+{
     if (!*results) {
-        *results = uproc_list_create(sizeof pred);
+        *results = uproc_list_create(sizeof(struct uproc_dnaresult));
         if (!*results) {
             return -1;
         }
     } else {
-        uproc_list_map(*results, map_list_dnaresult_free, NULL);
+        uproc_list_map(*results, map_list_dnaresult_release, ws);
         uproc_list_clear(*results);
     }
+    return 0;
+}
+
+/* Prepare the `max_scores` tree of `ws` for a new sequence */
+static int max_scores_prepare(struct uproc_classify_workspace_s *ws)
+{
+    if (!ws->max_scores) {
+        ws->max_scores =
+            uproc_bst_create(UPROC_BST_UINT, sizeof(struct uproc_dnaresult));
+        if (!ws->max_scores) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Keep the best-scoring ORF per family */
+static int max_scores_add(struct uproc_classify_workspace_s *ws,
+                          const struct uproc_orf *orf, uproc_list *pc_results)
+{
+    int res;
+    union uproc_bst_key key;
+    struct uproc_dnaresult ms;
+
+    for (long n = uproc_list_size(pc_results), i = 0; i < n; i++) {
+        struct uproc_protresult pp;
+        (void)uproc_list_get(pc_results, i, &pp);
+        key.uint = pp.family;
+        uproc_dnaresult_init(&ms);
+        ms.score = -INFINITY;
+        (void)uproc_bst_get(ws->max_scores, key, &ms);
+        if (pp.score > ms.score) {
+            res = orfbuf_assign(ws, &ms, orf);
+            if (res) {
+                return res;
+            }
+            ms.family = pp.family;
+            ms.score = pp.score;
+            /* can only fail when inserting a new family */
+            res = uproc_bst_update(ws->max_scores, key, &ms);
+            if (res) {
+                orfbuf_release(ws, ms.orf.data, ms.orf_alloc);
+                return res;
+            }
+        }
+    }
+    return 0;
+}
+
+struct finalize_arg
+{
+    const uproc_dnaclass *dc;
+    struct uproc_classify_workspace_s *ws;
+    uproc_list *results;
+    struct uproc_dnaresult max;
+    int res;
+};
+
+static void finalize_family(union uproc_bst_key key, void *value, void *opaque)
+{
+    struct finalize_arg *arg = opaque;
+    struct uproc_dnaresult *ms = value;
+    (void)key;
+
+    if (arg->res) {
+        orfbuf_release(arg->ws, ms->orf.data, ms->orf_alloc);
+    } else if (arg->dc->mode == UPROC_DNACLASS_MAX) {
+        if (!arg->max.orf.data) {
+            arg->max = *ms;
+        } else if (ms->score > arg->max.score) {
+            orfbuf_release(arg->ws, arg->max.orf.data, arg->max.orf_alloc);
+            arg->max = *ms;
+        } else {
+            orfbuf_release(arg->ws, ms->orf.data, ms->orf_alloc);
+        }
+    } else {
+        arg->res = uproc_list_append(arg->results, ms);
+        if (arg->res) {
+            orfbuf_release(arg->ws, ms->orf.data, ms->orf_alloc);
+        }
+    }
+}
 
-    max_scores = uproc_bst_create(UPROC_BST_UINT, sizeof pred);
-    orf_iter = uproc_orfiter_create(seq, dc->codon_scores, dc->orf_filter,
+/* Move the entries of `max_scores` to `results`, according to the mode */
+static int max_scores_finalize(const uproc_dnaclass *dc,
+                               struct uproc_classify_workspace_s *ws,
+                               uproc_list *results)
+{
+    struct finalize_arg arg = {.dc = dc, .ws = ws, .results = results};
+
+    uproc_bst_map(ws->max_scores, finalize_family, &arg);
+    uproc_bst_clear(ws->max_scores);
+    if (arg.max.orf.data) {
+        arg.res = uproc_list_append(results, &arg.max);
+        if (arg.res) {
+            orfbuf_release(ws, arg.max.orf.data, arg.max.orf_alloc);
+        }
+    }
+    return arg.res;
+}
+
+/* Discard the entries of `max_scores` after an error */
+static void max_scores_discard(struct uproc_classify_workspace_s *ws)
+{
+    if (ws->max_scores) {
+        uproc_bst_map(ws->max_scores, map_bst_max_score_release, ws);
+        uproc_bst_clear(ws->max_scores);
+    }
+}
+
+/* Start iterating over the ORFs of `seq` */
+static int orfs_prepare(const uproc_dnaclass *dc,
+                        struct uproc_classify_workspace_s *ws, const char *seq)
+{
+    if (ws->orfs) {
+        uproc_orfiter_reset(ws->orfs, seq, dc->codon_scores, dc->orf_filter,
+                            dc->orf_filter_arg);
+        return 0;
+    }
+    ws->orfs = uproc_orfiter_create(seq, dc->codon_scores, dc->orf_filter,
                                     dc->orf_filter_arg);
+    return ws->orfs ? 0 : -1;
+}
 
-    if (!max_scores || !orf_iter) {
-        res = -1;
-        goto error;
+int uproc_dnaclass_classify(const uproc_dnaclass *dc, const char *seq,
+                            uproc_list **results)
+{
+    return uproc_dnaclass_classify_ws(dc, NULL, seq, results);
+}
+
+int uproc_dnaclass_classify_ws(const uproc_dnaclass *dc,
+                               uproc_classify_workspace *ws, const char *seq,
+                               uproc_list **results)
+{
+    int res;
+    struct uproc_orf orf;
+
+    if (!ws) {
+        ws = uproc_classify_workspace_create();
+        if (!ws) {
+            return -1;
+        }
+        res = uproc_dnaclass_classify_ws(dc, ws, seq, results);
+        uproc_classify_workspace_destroy(ws);
+        return res;
+    }
+
+    if (results_prepare(ws, results) || max_scores_prepare(ws) ||
+        orfs_prepare(dc, ws, seq)) {
+        return -1;
     }
 
-    while (res = uproc_orfiter_next(orf_iter, &orf), !res) {
-        res = uproc_protclass_classify(dc->pc, orf.data, &pc_results);
+    while (res = uproc_orfiter_next(ws->orfs, &orf), !res) {
+        res = uproc_protclass_classify_ws(dc->pc, ws, orf.data,
+                                          &ws->orf_results);
         if (res) {
             goto error;
         }
-        for (long n = uproc_list_size(pc_results), i = 0; i < n; i++) {
-            struct uproc_protresult pp;
-            (void)uproc_list_get(pc_results, i, &pp);
-            key.uint = pp.family;
-            uproc_dnaresult_init(&pred);
-            pred.score = -INFINITY;
-            (void)uproc_bst_get(max_scores, key, &pred);
-            if (pp.score > pred.score) {
-                uproc_dnaresult_free(&pred);
-                pred.family = pp.family;
-                pred.score = pp.score;
-                res = uproc_orf_copy(&pred.orf, &orf);
-                if (res) {
-                    goto error;
-                }
-                res = uproc_bst_update(max_scores, key, &pred);
-                if (res) {
-                    goto error;
-                }
-            }
+        res = max_scores_add(ws, &orf, ws->orf_results);
+        if (res) {
+            goto error;
         }
     }
     if (res == -1) {
         goto error;
     }
+    return max_scores_finalize(dc, ws, *results);
 
-    max_scores_iter = uproc_bstiter_create(max_scores);
-    if (!max_scores_iter) {
-        goto error;
+error:
+    max_scores_discard(ws);
+    return res;
+}
+
+int uproc_dnaclass_classify_many(const uproc_dnaclass *dc,
+                                 uproc_classify_workspace *ws,
+                                 const char *const *seqs, size_t n,
+                                 uproc_list **results)
+{
+    int res = 0;
+    size_t i, k, n_orfs = 0, orfs_alloc = 0, *start;
+    struct uproc_orf orf, *orfs = NULL;
+    const char **orf_seqs = NULL;
+    uproc_list **pc_results = NULL;
+
+    if (!ws) {
+        ws = uproc_classify_workspace_create();
+        if (!ws) {
+            return -1;
+        }
+        res = uproc_dnaclass_classify_many(dc, ws, seqs, n, results);
+        uproc_classify_workspace_destroy(ws);
+        return res;
     }
-    for (i = 0; !uproc_bstiter_next(max_scores_iter, &key, &pred); i++) {
-        if (dc->mode == UPROC_DNACLASS_MAX) {
-            if (!uproc_list_size(*results)) {
-                pred_max = pred;
-                res = uproc_list_append(*results, &pred);
-                if (res) {
+
+    start = malloc((n + 1) * sizeof *start);
+    if (!start) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+
+    /* collect the ORFs of all sequences */
+    for (i = 0; i < n; i++) {
+        start[i] = n_orfs;
+        res = orfs_prepare(dc, ws, seqs[i]);
+        if (res) {
+            goto error;
+        }
+        while (res = uproc_orfiter_next(ws->orfs, &orf), !res) {
+            if (n_orfs == orfs_alloc) {
+                size_t alloc = orfs_alloc ? orfs_alloc * 2 : 64;
+                struct uproc_orf *tmp = realloc(orfs, alloc * sizeof *tmp);
+                if (!tmp) {
+                    res = uproc_error(UPROC_ENOMEM);
                     break;
                 }
-            } else if (pred.score > pred_max.score) {
-                uproc_dnaresult_free(&pred_max);
-                pred_max = pred;
-                uproc_list_set(*results, 0, &pred_max);
-            } else {
-                uproc_dnaresult_free(&pred);
+                orfs = tmp;
+                orfs_alloc = alloc;
             }
-        } else {
-            res = uproc_list_append(*results, &pred);
+            res = uproc_orf_copy(&orfs[n_orfs], &orf);
             if (res) {
-                goto error;
+                break;
             }
+            n_orfs++;
+        }
+        if (res == -1) {
+            goto error;
         }
     }
-    uproc_bstiter_destroy(max_scores_iter);
+    start[n] = n_orfs;
 
-    res = 0;
+    orf_seqs = malloc(n_orfs * sizeof *orf_seqs);
+    pc_results = calloc(n_orfs, sizeof *pc_results);
+    if (n_orfs && (!orf_seqs || !pc_results)) {
+        res = uproc_error(UPROC_ENOMEM);
+        goto error;
+    }
+    for (k = 0; k < n_orfs; k++) {
+        orf_seqs[k] = orfs[k].data;
+    }
+    res = uproc_protclass_classify_many(dc->pc, ws, orf_seqs, n_orfs,
+                                        pc_results);
+    if (res) {
+        goto error;
+    }
 
-    if (0) {
-    error:
-        uproc_bst_map(max_scores, map_bst_dnaresult_free, NULL);
+    for (i = 0; i < n; i++) {
+        res = results_prepare(ws, &results[i]);
+        if (res || (res = max_scores_prepare(ws))) {
+            goto error;
+        }
+        for (k = start[i]; k < start[i + 1]; k++) {
+            res = max_scores_add(ws, &orfs[k], pc_results[k]);
+            if (res) {
+                max_scores_discard(ws);
+                goto error;
+            }
+        }
+        res = max_scores_finalize(dc, ws, results[i]);
+        if (res) {
+            goto error;
+        }
+    }
+
+error:
+    for (k = 0; k < n_orfs; k++) {
+        uproc_orf_free(&orfs[k]);
+        if (pc_results) {
+            uproc_list_destroy(pc_results[k]);
+        }
     }
-    uproc_list_destroy(pc_results);
-    uproc_bst_destroy(max_scores);
-    uproc_orfiter_destroy(orf_iter);
+    free(pc_results);
+    free(orf_seqs);
+    free(orfs);
+    free(start);
     return res;
 }
 
@@ -205,11 +463,13 @@ void uproc_dnaresult_init(struct uproc_dnaresult *result)
 void uproc_dnaresult_free(struct uproc_dnaresult *result)
 {
     uproc_orf_free(&result->orf);
+    result->orf_alloc = 0;
 }
 
 int uproc_dnaresult_copy(struct uproc_dnaresult *dest,
                          const struct uproc_dnaresult *src)
 {
     *dest = *src;
+    dest->orf_alloc = 0;
     return uproc_orf_copy(&dest->orf, &src->orf);
 }
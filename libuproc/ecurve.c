@@ -33,6 +33,10 @@
 
 #include "ecurve_internal.h"
 
+#if ECURVE_HAVE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
 /** Perform a lookup in the prefix table.
  *
  * \param table         table of prefixes
@@ -95,7 +99,281 @@ static int prefix_lookup(const struct uproc_ecurve_pfxtable *table,
     return UPROC_ECURVE_EXACT;
 }
 
-/** Find exact match or nearest neighbours in suffix array.
+/** Perform a lookup in the compact prefix index.
+ *
+ * Same semantics as prefix_lookup().
+ */
+static int pfxindex_lookup(const struct ecurve_pfxindex *idx,
+                           uproc_prefix key, size_t *index, size_t *count,
+                           uproc_prefix *lower_prefix,
+                           uproc_prefix *upper_prefix)
+{
+    size_t r = ecurve_rank(idx->bits, idx->rank, key);
+
+    if (idx->bits[key / 64] >> key % 64 & 1) {
+        *index = idx->first[r];
+        *count = idx->first[r + 1] - idx->first[r];
+        *lower_prefix = *upper_prefix = key;
+        return UPROC_ECURVE_EXACT;
+    }
+
+    /* below the first or above the last non-empty prefix */
+    if (!r || r == idx->count) {
+        if (!r) {
+            *index = 0;
+        } else {
+            r--;
+            *index = idx->first[r + 1] - 1;
+        }
+        *count = 1;
+        *lower_prefix = *upper_prefix = idx->keys[r];
+        return UPROC_ECURVE_OOB;
+    }
+
+    /* last suffix of the lower neighbour, followed by the first one of the
+     * upper neighbour */
+    *index = idx->first[r] - 1;
+    *count = 2;
+    *lower_prefix = idx->keys[r - 1];
+    *upper_prefix = idx->keys[r];
+    return UPROC_ECURVE_INEXACT;
+}
+
+/*************************
+ * suffix search kernels *
+ *************************/
+
+/* Number of elements of `s[0..n)` that are not greater than `key` */
+static unsigned count_le_scalar(const uproc_suffix *s, size_t n,
+                                uproc_suffix key)
+{
+    unsigned cnt = 0;
+    size_t i;
+    for (i = 0; i < n; i++) {
+        cnt += s[i] <= key;
+    }
+    return cnt;
+}
+
+#if ECURVE_HAVE_X86_DISPATCH
+/* There are only signed 64-bit comparisons, flipping the sign bit turns them
+ * into unsigned ones */
+#define SIGN_BIT 0x8000000000000000LL
+
+__attribute__((target("sse4.2,popcnt"))) static unsigned count_le_sse42(
+    const uproc_suffix *s, size_t n, uproc_suffix key)
+{
+    __m128i flip = _mm_set1_epi64x(SIGN_BIT);
+    __m128i k = _mm_xor_si128(_mm_set1_epi64x(key), flip);
+    unsigned gt = 0;
+    size_t i;
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        v = _mm_cmpgt_epi64(_mm_xor_si128(v, flip), k);
+        gt += popcount64(_mm_movemask_pd(_mm_castsi128_pd(v)));
+    }
+    return i - gt + count_le_scalar(s + i, n - i, key);
+}
+
+__attribute__((target("avx2,popcnt"))) static unsigned count_le_avx2(
+    const uproc_suffix *s, size_t n, uproc_suffix key)
+{
+    __m256i flip = _mm256_set1_epi64x(SIGN_BIT);
+    __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(key), flip);
+    unsigned gt = 0;
+    size_t i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        v = _mm256_cmpgt_epi64(_mm256_xor_si256(v, flip), k);
+        gt += popcount64(_mm256_movemask_pd(_mm256_castsi256_pd(v)));
+    }
+    return i - gt + count_le_scalar(s + i, n - i, key);
+}
+#undef SIGN_BIT
+#endif
+
+#if ECURVE_HAVE_X86_DISPATCH
+typedef unsigned count_le_fn(const uproc_suffix *, size_t, uproc_suffix);
+
+/* Kernel used by count_le(), selected on its first call */
+static count_le_fn *count_le_kernel;
+
+/* Widest kernel supported by the CPU */
+static count_le_fn *count_le_best(void)
+{
+    if (__builtin_cpu_supports("avx2")) {
+        return count_le_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return count_le_sse42;
+    }
+    return count_le_scalar;
+}
+#endif
+
+/* Number of elements of `s[0..n)` that are not greater than `key`, using the
+ * widest vector instructions the CPU supports */
+static inline unsigned count_le(const uproc_suffix *s, size_t n,
+                                uproc_suffix key)
+{
+#if ECURVE_HAVE_X86_DISPATCH
+    /* every thread that finds it unset stores the same kernel */
+    count_le_fn *kernel = __atomic_load_n(&count_le_kernel, __ATOMIC_RELAXED);
+    if (!kernel) {
+        kernel = count_le_best();
+        __atomic_store_n(&count_le_kernel, kernel, __ATOMIC_RELAXED);
+    }
+    return kernel(s, n, key);
+#else
+    return count_le_scalar(s, n, key);
+#endif
+}
+
+/* Index of the greatest element of `s[0..n)` that is not greater than
+ * `key`, which must not be less than `s[0]`.
+ *
+ * The loop has a fixed number of iterations for a given `n` and the
+ * comparison only selects a pointer (compiled into a conditional move), so
+ * there are no mispredicted branches. */
+static size_t search_branchless(const uproc_suffix *s, size_t n,
+                                uproc_suffix key)
+{
+    const uproc_suffix *base = s;
+    while (n > 1) {
+        size_t half = n / 2;
+        base = (base[half] <= key) ? base + half : base;
+        n -= half;
+    }
+    return base - s;
+}
+
+/* Same as search_branchless(), but starts with a few steps of interpolation
+ * search, which needs O(log log n) probes for uniformly distributed keys
+ * (which suffixes are, roughly). */
+static size_t search_interpolation(const uproc_suffix *s, size_t n,
+                                   uproc_suffix key)
+{
+    /* answer is in [lo, hi), with s[lo] <= key and s[hi] > key (if hi < n) */
+    size_t lo = 0, hi = n, pos;
+    int i;
+
+    for (i = 0; i < SEARCH_INTERP_STEPS && hi - lo > SEARCH_LINEAR_MAX; i++) {
+        uproc_suffix a = s[lo], b = s[hi - 1];
+        if (key >= b) {
+            return hi - 1;
+        }
+        /* lo <= pos < hi - 1 because a <= key < b */
+        pos = lo + (size_t)((double)(key - a) / (b - a) * (hi - 1 - lo));
+        if (pos >= hi - 1) {
+            pos = hi - 2;
+        }
+        if (s[pos] <= key) {
+            lo = pos;
+            /* guesses tend to be slightly off, check the next element before
+             * giving up the upper bound */
+            if (s[pos + 1] > key) {
+                return pos;
+            }
+            lo = pos + 1;
+        } else {
+            hi = pos;
+        }
+    }
+    return lo + search_branchless(s + lo, hi - lo, key);
+}
+
+/* Index of the greatest element of `s[0..n)` that is not greater than `key`,
+ * which must lie between s[0] and s[n - 1]. Picks the search strategy by the
+ * size of the range. */
+static size_t search_suffixes(const uproc_suffix *s, size_t n,
+                              uproc_suffix key)
+{
+    if (n <= SEARCH_LINEAR_MAX) {
+        return count_le(s, n, key) - 1;
+    }
+    if (n < SEARCH_INTERP_MIN) {
+        return search_branchless(s, n, key);
+    }
+    return search_interpolation(s, n, key);
+}
+
+static inline uproc_suffix record_suffix(const struct ecurve_record *records,
+                                         size_t i)
+{
+    return records[i / INTERLEAVE_N].suffixes[i % INTERLEAVE_N];
+}
+
+/* search_suffixes() for interleaved records, `first` being the index of the
+ * first suffix of the range */
+static size_t search_records(const struct ecurve_record *records, size_t first,
+                             size_t n, uproc_suffix key)
+{
+    size_t base = first, i;
+    unsigned cnt = 0;
+
+    if (n <= SEARCH_LINEAR_MAX) {
+        for (i = 0; i < n; i++) {
+            cnt += record_suffix(records, first + i) <= key;
+        }
+        return cnt - 1;
+    }
+    while (n > 1) {
+        size_t half = n / 2;
+        base = (record_suffix(records, base + half) <= key) ? base + half
+                                                            : base;
+        n -= half;
+    }
+    return base - first;
+}
+
+/* Number of keys in each level of the search tree of a bucket of `n`
+ * suffixes, bottom-up. Returns the number of levels. */
+static int btree_levels(size_t n, size_t *sizes)
+{
+    int l = 0;
+    do {
+        n = (n + BTREE_FANOUT - 1) / BTREE_FANOUT;
+        sizes[l++] = n;
+    } while (n > BTREE_FANOUT);
+    return l;
+}
+
+/** Search the tree of a bucket.
+ *
+ * Returns the (bucket-relative) index of the greatest suffix that is not
+ * greater than `key`, which must lie between the first and last suffix of the
+ * bucket.
+ */
+static size_t btree_search(const struct uproc_ecurve_s *ecurve, size_t first,
+                           size_t n, uproc_suffix key)
+{
+    const struct ecurve_btree *bt = &ecurve->btree;
+    size_t sizes[BTREE_MAX_LEVELS], node = 0, lo, hi, i;
+    const uint64_t *level;
+    unsigned cnt = 0;
+    int l;
+
+    level = bt->keys + bt->offsets[first / BTREE_MIN];
+    for (l = btree_levels(n, sizes) - 1; l >= 0; l--) {
+        node = node * BTREE_FANOUT +
+               count_le(level + node * BTREE_FANOUT, BTREE_FANOUT, key) - 1;
+        level += (sizes[l] + BTREE_FANOUT - 1) / BTREE_FANOUT * BTREE_FANOUT;
+    }
+
+    /* leaf */
+    lo = node * BTREE_FANOUT;
+    hi = lo + BTREE_FANOUT < n ? lo + BTREE_FANOUT : n;
+    if (ecurve->suffixes) {
+        cnt = count_le(ecurve->suffixes + first + lo, hi - lo, key);
+    } else {
+        for (i = lo; i < hi; i++) {
+            cnt += ecurve_suffix(ecurve, first + i) <= key;
+        }
+    }
+    return lo + cnt - 1;
+}
+
+/** Find exact match or nearest neighbours in a range of suffixes.
  *
  * If `key` is less than the first item in `search` (resp. greater than the
  * last one), #UPROC_ECURVE_OOB is returned and both `*lower` and `*upper` are
@@ -106,8 +384,9 @@ static int prefix_lookup(const struct uproc_ecurve_pfxtable *table,
  * the indices of the values that are closest to `key`, i.e. such that
  * `search[*lower] < key < search[*upper]`.
  *
- * \param search    array to search
- * \param n         number of elements in `search`
+ * \param ecurve    ecurve to search
+ * \param search    index of the first suffix of the range to search
+ * \param n         number of elements in the range
  * \param key       value to find
  * \param lower     OUT: index of the lower neighbour
  * \param upper     OUT: index of the upper neighbour
@@ -115,37 +394,41 @@ static int prefix_lookup(const struct uproc_ecurve_pfxtable *table,
  * \return `#UPROC_ECURVE_EXACT`, `#UPROC_ECURVE_OOB` or
  * `#UPROC_ECURVE_INEXACT` as described above.
  */
-static int suffix_lookup(const uproc_suffix *search, size_t n, uproc_suffix key,
-                         size_t *lower, size_t *upper)
+static int suffix_lookup(const struct uproc_ecurve_s *ecurve, size_t search,
+                         size_t n, uproc_suffix key, size_t *lower,
+                         size_t *upper)
 {
-    size_t lo = 0, mid, hi = n - 1;
+    size_t lo = 0, hi;
 
-    if (!n || key < search[0]) {
+    if (!n || key < ecurve_suffix(ecurve, search)) {
         *lower = *upper = 0;
         return UPROC_ECURVE_OOB;
     }
 
-    if (key > search[n - 1]) {
+    if (key > ecurve_suffix(ecurve, search + n - 1)) {
         *lower = *upper = n - 1;
         return UPROC_ECURVE_OOB;
     }
 
-    while (hi > lo + 1) {
-        mid = (hi + lo) / 2;
-
-        if (key == search[mid]) {
-            lo = mid;
-            break;
-        } else if (key > search[mid]) {
-            lo = mid;
-        } else {
-            hi = mid;
+    if (n >= BTREE_MIN && ecurve->btree.offsets) {
+        lo = btree_search(ecurve, search, n, key);
+    } else if (ecurve->suffixes) {
+        lo = search_suffixes(ecurve->suffixes + search, n, key);
+    } else if (ecurve->records) {
+        lo = search_records(ecurve->records, search, n, key);
+    } else {
+        /* packed suffixes, same as search_branchless() */
+        while (n > 1) {
+            size_t half = n / 2;
+            if (ecurve_suffix(ecurve, search + lo + half) <= key) {
+                lo += half;
+            }
+            n -= half;
         }
     }
-    if (search[lo] == key) {
-        hi = lo;
-    } else if (search[hi] == key) {
-        lo = hi;
+    hi = lo;
+    if (ecurve_suffix(ecurve, search + lo) != key) {
+        hi++;
     }
     *lower = lo;
     *upper = hi;
@@ -210,6 +493,7 @@ uproc_ecurve *uproc_ecurve_create(const char *alphabet, size_t suffix_count)
         return NULL;
     }
     *ec = (struct uproc_ecurve_s){0};
+    ec->mmap_fd = -1;
 
     ec->alphabet = uproc_alphabet_create(alphabet);
     if (!ec->alphabet) {
@@ -251,12 +535,14 @@ void uproc_ecurve_destroy(uproc_ecurve *ecurve)
     }
 
     uproc_alphabet_destroy(ecurve->alphabet);
-    if (ecurve->mmap_fd > -1) {
+    if (ecurve->mmap_ptr) {
         uproc_ecurve_munmap(ecurve);
     } else {
-        free(ecurve->prefixes);
-        free(ecurve->suffixes);
-        free(ecurve->families);
+        struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+        size_t i, n = ecurve_sections(ecurve, sec);
+        for (i = 0; i < n; i++) {
+            free(*sec[i].ptr);
+        }
     }
     free(ecurve);
 }
@@ -345,24 +631,82 @@ int uproc_ecurve_finalize(uproc_ecurve *ecurve)
     return 0;
 }
 
-int uproc_ecurve_lookup(const uproc_ecurve *ecurve,
-                        const struct uproc_word *word,
-                        struct uproc_word *lower_neighbour,
-                        uproc_family *lower_class,
-                        struct uproc_word *upper_neighbour,
-                        uproc_family *upper_class)
+/* Result of the first (prefix table) stage of a lookup */
+struct pfxlookup
 {
     int res;
-    uproc_prefix p_lower, p_upper;
     size_t index, count;
-    size_t lower, upper;
+    uproc_prefix lower, upper;
+};
+
+static void lookup_prefix(const struct uproc_ecurve_s *ecurve,
+                          const struct uproc_word *word, struct pfxlookup *p)
+{
+    if (ecurve->prefixes) {
+        p->res = prefix_lookup(ecurve->prefixes, word->prefix, &p->index,
+                               &p->count, &p->lower, &p->upper);
+    } else {
+        p->res = pfxindex_lookup(&ecurve->pfxindex, word->prefix, &p->index,
+                                 &p->count, &p->lower, &p->upper);
+    }
+}
 
-    res = prefix_lookup(ecurve->prefixes, word->prefix, &index, &count,
-                        &p_lower, &p_upper);
+/* Prefetch what lookup_prefix() is going to touch first */
+static void prefetch_prefix(const struct uproc_ecurve_s *ecurve,
+                            uproc_prefix key)
+{
+    if (ecurve->prefixes) {
+        ECURVE_PREFETCH(&ecurve->prefixes[key]);
+    } else {
+        ECURVE_PREFETCH(&ecurve->pfxindex.rank[key / 64 / ECURVE_RANK_WORDS]);
+        ECURVE_PREFETCH(&ecurve->pfxindex.bits[key / 64]);
+    }
+}
+
+/* Prefetch the parts of the suffix and family tables that
+ * lookup_suffix() is going to touch first */
+static void prefetch_suffixes(const struct uproc_ecurve_s *ecurve,
+                              const struct pfxlookup *p)
+{
+    if (ecurve->suffixes) {
+        ECURVE_PREFETCH(&ecurve->suffixes[p->index]);
+        if (p->count > 1) {
+            ECURVE_PREFETCH(&ecurve->suffixes[p->index + p->count - 1]);
+        }
+        ECURVE_PREFETCH(&ecurve->families[p->index]);
+    } else if (ecurve->records) {
+        ECURVE_PREFETCH(&ecurve->records[p->index / INTERLEAVE_N]);
+        if (p->count > 1) {
+            ECURVE_PREFETCH(
+                &ecurve->records[(p->index + p->count - 1) / INTERLEAVE_N]);
+        }
+    } else {
+        const struct ecurve_packed *pk = &ecurve->packed;
+        size_t b = p->index / PACKED_BLOCK;
+        ECURVE_PREFETCH(&pk->base[b]);
+        ECURVE_PREFETCH(&pk->start[b]);
+        ECURVE_PREFETCH(&pk->runs[p->index / 64]);
+        ECURVE_PREFETCH(&pk->run_rank[p->index / 64 / ECURVE_RANK_WORDS]);
+    }
+    if (p->count >= BTREE_MIN && ecurve->btree.offsets) {
+        ECURVE_PREFETCH(&ecurve->btree.offsets[p->index / BTREE_MIN]);
+    }
+}
+
+static int lookup_suffix(const struct uproc_ecurve_s *ecurve,
+                         const struct uproc_word *word,
+                         const struct pfxlookup *p,
+                         struct uproc_word *lower_neighbour,
+                         uproc_family *lower_class,
+                         struct uproc_word *upper_neighbour,
+                         uproc_family *upper_class)
+{
+    int res = p->res;
+    size_t lower, upper;
 
     if (res == UPROC_ECURVE_EXACT) {
-        res = suffix_lookup(&ecurve->suffixes[index], count, word->suffix,
-                            &lower, &upper);
+        res = suffix_lookup(ecurve, p->index, p->count, word->suffix, &lower,
+                            &upper);
         if (res != UPROC_ECURVE_EXACT) {
             res = UPROC_ECURVE_INEXACT;
         }
@@ -372,21 +716,794 @@ int uproc_ecurve_lookup(const uproc_ecurve *ecurve,
     }
 
     /* `lower` and `upper` are relative to `index` */
-    lower += index;
-    upper += index;
+    lower += p->index;
+    upper += p->index;
 
     /* populate output variables */
-    lower_neighbour->prefix = p_lower;
-    lower_neighbour->suffix = ecurve->suffixes[lower];
-    *lower_class = ecurve->families[lower];
-    upper_neighbour->prefix = p_upper;
-    upper_neighbour->suffix = ecurve->suffixes[upper];
-    *upper_class = ecurve->families[upper];
+    lower_neighbour->prefix = p->lower;
+    lower_neighbour->suffix = ecurve_suffix(ecurve, lower);
+    *lower_class = ecurve_family(ecurve, lower);
+    upper_neighbour->prefix = p->upper;
+    upper_neighbour->suffix = ecurve_suffix(ecurve, upper);
+    *upper_class = ecurve_family(ecurve, upper);
 
     return res;
 }
 
+int uproc_ecurve_lookup(const uproc_ecurve *ecurve,
+                        const struct uproc_word *word,
+                        struct uproc_word *lower_neighbour,
+                        uproc_family *lower_class,
+                        struct uproc_word *upper_neighbour,
+                        uproc_family *upper_class)
+{
+    struct pfxlookup p;
+    lookup_prefix(ecurve, word, &p);
+    return lookup_suffix(ecurve, word, &p, lower_neighbour, lower_class,
+                         upper_neighbour, upper_class);
+}
+
+void uproc_ecurve_lookup_batch(const uproc_ecurve *ecurve,
+                               const struct uproc_word *words, size_t n,
+                               struct uproc_word *lower_neighbours,
+                               uproc_family *lower_classes,
+                               struct uproc_word *upper_neighbours,
+                               uproc_family *upper_classes, int *results)
+{
+    /* Software pipeline with three stages, each running
+     * ECURVE_PREFETCH_DISTANCE words ahead of the next one:
+     *
+     *  1. prefetch the prefix table entry of word `i`
+     *  2. look up the prefix of word `i - D` and prefetch its suffix bucket
+     *  3. search the suffix bucket of word `i - 2D` and store the result
+     *
+     * Stage 3 consumes the slot of `pending` before stage 2 of the same
+     * iteration overwrites it. */
+    enum { D = ECURVE_PREFETCH_DISTANCE };
+    struct pfxlookup pending[D];
+    size_t i, k;
+
+    for (i = 0; i < n + 2 * D; i++) {
+        if (i >= 2 * D) {
+            int res;
+            k = i - 2 * D;
+            res = lookup_suffix(ecurve, &words[k], &pending[k % D],
+                                &lower_neighbours[k], &lower_classes[k],
+                                &upper_neighbours[k], &upper_classes[k]);
+            if (results) {
+                results[k] = res;
+            }
+        }
+        if (i >= D && i - D < n) {
+            k = i - D;
+            lookup_prefix(ecurve, &words[k], &pending[k % D]);
+            prefetch_suffixes(ecurve, &pending[k % D]);
+        }
+        if (i < n) {
+            prefetch_prefix(ecurve, words[i].prefix);
+        }
+    }
+}
+
+void uproc_ecurve_lookup_sorted(const uproc_ecurve *ecurve,
+                                const struct uproc_word *words, size_t n,
+                                struct uproc_word *lower_neighbours,
+                                uproc_family *lower_classes,
+                                struct uproc_word *upper_neighbours,
+                                uproc_family *upper_classes, int *results)
+{
+    int res;
+    size_t i;
+    struct pfxlookup p;
+
+    for (i = 0; i < n; i++) {
+        /* words sharing a prefix share the result of the first stage */
+        if (!i || words[i].prefix != words[i - 1].prefix) {
+            lookup_prefix(ecurve, &words[i], &p);
+        }
+        res = lookup_suffix(ecurve, &words[i], &p, &lower_neighbours[i],
+                            &lower_classes[i], &upper_neighbours[i],
+                            &upper_classes[i]);
+        if (results) {
+            results[i] = res;
+        }
+    }
+}
+
 uproc_alphabet *uproc_ecurve_alphabet(const uproc_ecurve *ecurve)
 {
     return ecurve->alphabet;
 }
+
+/*****************
+ * ecurve layout *
+ *****************/
+
+struct flag_name
+{
+    unsigned flag;
+    const char *name;
+};
+
+static const struct flag_name layout_names[] = {
+    {UPROC_ECURVE_COMPACT_PREFIXES, "compact"},
+    {UPROC_ECURVE_PACKED_SUFFIXES, "packed"},
+    {UPROC_ECURVE_BTREE_BUCKETS, "btree"},
+    {UPROC_ECURVE_INTERLEAVED, "interleaved"},
+};
+
+static const struct flag_name memory_names[] = {
+    {UPROC_ECURVE_HUGEPAGES, "hugepages"},
+    {UPROC_ECURVE_HUGETLB, "hugetlb"},
+    {UPROC_ECURVE_MLOCK, "mlock"},
+    {UPROC_ECURVE_NUMA_INTERLEAVE, "numa-interleave"},
+};
+
+static const struct flag_name residency_names[] = {
+    {UPROC_ECURVE_POPULATE, "populate"},
+    {UPROC_ECURVE_LAZY, "lazy"},
+    {UPROC_ECURVE_PREFETCH, "prefetch"},
+    {UPROC_ECURVE_KEEP_WARM, "keep-warm"},
+};
+
+#define ELEMENTS(a) (sizeof(a) / sizeof(a)[0])
+
+void *ecurve_alloc(size_t size)
+{
+#if HAVE_POSIX_MEMALIGN
+    void *p;
+    if (posix_memalign(&p, ECURVE_CACHE_LINE, size)) {
+        return NULL;
+    }
+    return p;
+#else
+    return malloc(size);
+#endif
+}
+
+size_t ecurve_sections(struct uproc_ecurve_s *ecurve,
+                       struct ecurve_section *sections)
+{
+    size_t n = 0;
+#define SEC(id_, ptr_, size_) \
+    sections[n++] = (struct ecurve_section){(id_), (void **)&(ptr_), (size_)}
+
+    if (ecurve->layout & UPROC_ECURVE_COMPACT_PREFIXES) {
+        struct ecurve_pfxindex *idx = &ecurve->pfxindex;
+        SEC(ECURVE_SEC_PFX_BITS, idx->bits, PFXINDEX_WORDS * sizeof *idx->bits);
+        SEC(ECURVE_SEC_PFX_RANK, idx->rank,
+            PFXINDEX_BLOCKS * sizeof *idx->rank);
+        SEC(ECURVE_SEC_PFX_KEYS, idx->keys, idx->count * sizeof *idx->keys);
+        SEC(ECURVE_SEC_PFX_FIRST, idx->first,
+            (idx->count + 1) * sizeof *idx->first);
+    } else {
+        SEC(ECURVE_SEC_PREFIXES, ecurve->prefixes,
+            (UPROC_PREFIX_MAX + 1) * sizeof *ecurve->prefixes);
+    }
+    if (ecurve->layout & UPROC_ECURVE_PACKED_SUFFIXES) {
+        struct ecurve_packed *pk = &ecurve->packed;
+        size_t blocks = PACKED_BLOCKS(ecurve->suffix_count);
+        SEC(ECURVE_SEC_PACKED_BASE, pk->base, blocks * sizeof *pk->base);
+        SEC(ECURVE_SEC_PACKED_START, pk->start,
+            (blocks + 1) * sizeof *pk->start);
+        SEC(ECURVE_SEC_PACKED_DATA, pk->data,
+            pk->data_words * sizeof *pk->data);
+        SEC(ECURVE_SEC_RUNS, pk->runs, blocks * sizeof *pk->runs);
+        SEC(ECURVE_SEC_RUN_RANK, pk->run_rank,
+            ECURVE_RANK_BLOCKS(blocks) * sizeof *pk->run_rank);
+        SEC(ECURVE_SEC_RUN_FAMILIES, pk->run_families,
+            pk->run_count * sizeof *pk->run_families);
+    } else if (ecurve->layout & UPROC_ECURVE_INTERLEAVED) {
+        SEC(ECURVE_SEC_RECORDS, ecurve->records,
+            (ecurve->suffix_count + INTERLEAVE_N - 1) / INTERLEAVE_N *
+                sizeof *ecurve->records);
+    } else {
+        SEC(ECURVE_SEC_SUFFIXES, ecurve->suffixes,
+            ecurve->suffix_count * sizeof *ecurve->suffixes);
+        SEC(ECURVE_SEC_FAMILIES, ecurve->families,
+            ecurve->suffix_count * sizeof *ecurve->families);
+    }
+    if (ecurve->layout & UPROC_ECURVE_BTREE_BUCKETS) {
+        struct ecurve_btree *bt = &ecurve->btree;
+        SEC(ECURVE_SEC_BTREE_OFFSETS, bt->offsets,
+            BTREE_BLOCKS(ecurve->suffix_count) * sizeof *bt->offsets);
+        SEC(ECURVE_SEC_BTREE_KEYS, bt->keys, bt->key_count * sizeof *bt->keys);
+    }
+#undef SEC
+    return n;
+}
+
+int ecurve_attach_sections(struct uproc_ecurve_s *ecurve,
+                           const struct ecurve_section *sections, size_t n)
+{
+    size_t i, k, n_expected;
+    struct ecurve_section expected[ECURVE_SECTIONS_MAX];
+
+    /* sizes that aren't implied by the suffix count */
+    for (i = 0; i < n; i++) {
+        if (sections[i].id == ECURVE_SEC_PFX_KEYS) {
+            ecurve->pfxindex.count =
+                sections[i].size / sizeof *ecurve->pfxindex.keys;
+        } else if (sections[i].id == ECURVE_SEC_PACKED_DATA) {
+            ecurve->packed.data_words =
+                sections[i].size / sizeof *ecurve->packed.data;
+        } else if (sections[i].id == ECURVE_SEC_RUN_FAMILIES) {
+            ecurve->packed.run_count =
+                sections[i].size / sizeof *ecurve->packed.run_families;
+        } else if (sections[i].id == ECURVE_SEC_BTREE_KEYS) {
+            ecurve->btree.key_count =
+                sections[i].size / sizeof *ecurve->btree.keys;
+        }
+    }
+
+    /* sections with unknown IDs are ignored */
+    n_expected = ecurve_sections(ecurve, expected);
+    for (k = 0; k < n_expected; k++) {
+        for (i = 0; i < n && sections[i].id != expected[k].id; i++) {
+            ;
+        }
+        if (i == n || sections[i].size != expected[k].size) {
+            return uproc_error_msg(UPROC_EINVAL,
+                                   "missing or invalid ecurve section %d",
+                                   (int)expected[k].id);
+        }
+        *expected[k].ptr = *sections[i].ptr;
+    }
+
+    if (ecurve->layout & UPROC_ECURVE_COMPACT_PREFIXES) {
+        const struct ecurve_pfxindex *idx = &ecurve->pfxindex;
+        if (!idx->count || idx->first[idx->count] != ecurve->suffix_count) {
+            return uproc_error_msg(UPROC_EINVAL, "invalid prefix index");
+        }
+    }
+    if (ecurve->layout & UPROC_ECURVE_PACKED_SUFFIXES) {
+        const struct ecurve_packed *pk = &ecurve->packed;
+        size_t blocks = PACKED_BLOCKS(ecurve->suffix_count);
+        if (pk->start[blocks] != pk->data_words ||
+            (ecurve->suffix_count && !pk->run_count)) {
+            return uproc_error_msg(UPROC_EINVAL, "invalid packed suffixes");
+        }
+    }
+    return 0;
+}
+
+int ecurve_next_prefix(const struct uproc_ecurve_s *ecurve, size_t *iter,
+                       uproc_prefix *prefix, size_t *first, size_t *count)
+{
+    if (ecurve->prefixes) {
+        for (; *iter <= UPROC_PREFIX_MAX; (*iter)++) {
+            const struct uproc_ecurve_pfxtable *pt = &ecurve->prefixes[*iter];
+            if (ECURVE_ISEDGE(*pt) || !pt->count) {
+                continue;
+            }
+            *prefix = *iter;
+            *first = pt->first;
+            *count = pt->count;
+            (*iter)++;
+            return 0;
+        }
+    } else if (*iter < ecurve->pfxindex.count) {
+        const struct ecurve_pfxindex *idx = &ecurve->pfxindex;
+        *prefix = idx->keys[*iter];
+        *first = idx->first[*iter];
+        *count = idx->first[*iter + 1] - idx->first[*iter];
+        (*iter)++;
+        return 0;
+    }
+    return 1;
+}
+
+/* Replace the prefix table by a compact prefix index */
+static int pfxindex_build(struct uproc_ecurve_s *ecurve)
+{
+    size_t n = 0, r = 0;
+    uproc_prefix p;
+    struct ecurve_pfxindex idx = {0};
+    const struct uproc_ecurve_pfxtable *table = ecurve->prefixes;
+
+    for (p = 0; p <= UPROC_PREFIX_MAX; p++) {
+        n += !ECURVE_ISEDGE(table[p]) && table[p].count;
+    }
+    if (!n) {
+        return uproc_error_msg(UPROC_EINVAL, "empty ecurve");
+    }
+
+    idx.count = n;
+    idx.bits = calloc(PFXINDEX_WORDS, sizeof *idx.bits);
+    idx.rank = malloc(PFXINDEX_BLOCKS * sizeof *idx.rank);
+    idx.keys = malloc(n * sizeof *idx.keys);
+    idx.first = malloc((n + 1) * sizeof *idx.first);
+    if (!idx.bits || !idx.rank || !idx.keys || !idx.first) {
+        free(idx.bits);
+        free(idx.rank);
+        free(idx.keys);
+        free(idx.first);
+        return uproc_error(UPROC_ENOMEM);
+    }
+
+    for (p = 0; p <= UPROC_PREFIX_MAX; p++) {
+        if (ECURVE_ISEDGE(table[p]) || !table[p].count) {
+            continue;
+        }
+        idx.bits[p / 64] |= UINT64_C(1) << p % 64;
+        idx.keys[r] = p;
+        idx.first[r] = table[p].first;
+        r++;
+    }
+    idx.first[n] = ecurve->suffix_count;
+
+    ecurve_rank_build(idx.bits, idx.rank, PFXINDEX_WORDS);
+
+    free(ecurve->prefixes);
+    ecurve->prefixes = NULL;
+    ecurve->pfxindex = idx;
+    return 0;
+}
+
+/* Replace the compact prefix index by a prefix table */
+static int pfxtable_build(struct uproc_ecurve_s *ecurve)
+{
+    size_t r;
+    uproc_prefix p = 0;
+    struct ecurve_pfxindex *idx = &ecurve->pfxindex;
+    struct uproc_ecurve_pfxtable *table, *pt;
+
+    table = malloc(sizeof *table * (UPROC_PREFIX_MAX + 1));
+    if (!table) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+
+    for (r = 0; r < idx->count; r++) {
+        uproc_prefix key = idx->keys[r];
+        size_t count = idx->first[r + 1] - idx->first[r];
+        if (count >= ECURVE_EDGE) {
+            free(table);
+            return uproc_error_msg(UPROC_EINVAL, "too many suffixes");
+        }
+        /* same as in uproc_ecurve_add_prefix() */
+        for (; p < key; p++) {
+            pt = &table[p];
+            pt->prev = r ? neigh_dist(idx->keys[r - 1], p) : 0;
+            pt->next = neigh_dist(p, key);
+            pt->count = r ? 0 : ECURVE_EDGE;
+        }
+        table[key].first = idx->first[r];
+        table[key].count = count;
+        p = key + 1;
+    }
+    /* same as in uproc_ecurve_finalize() */
+    for (; p <= UPROC_PREFIX_MAX; p++) {
+        pt = &table[p];
+        pt->prev = neigh_dist(idx->keys[idx->count - 1], p);
+        pt->next = 0;
+        pt->count = ECURVE_EDGE;
+    }
+
+    free(idx->bits);
+    free(idx->rank);
+    free(idx->keys);
+    free(idx->first);
+    *idx = (struct ecurve_pfxindex){0};
+    ecurve->prefixes = table;
+    return 0;
+}
+
+/* Number of bits needed to represent `x` */
+static unsigned bit_width(uint64_t x)
+{
+    unsigned n = 0;
+    while (x) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+}
+
+static void packed_free(struct ecurve_packed *pk)
+{
+    free(pk->base);
+    free(pk->start);
+    free(pk->data);
+    free(pk->runs);
+    free(pk->run_rank);
+    free(pk->run_families);
+    *pk = (struct ecurve_packed){0};
+}
+
+/* Replace the suffix and family arrays by their packed representation */
+static int packed_build(struct uproc_ecurve_s *ecurve)
+{
+    size_t i, b, r, n = ecurve->suffix_count, blocks = PACKED_BLOCKS(n);
+    const uproc_suffix *suffixes = ecurve->suffixes;
+    const uproc_family *families = ecurve->families;
+    struct ecurve_packed pk = {0};
+
+    pk.base = malloc(blocks * sizeof *pk.base);
+    pk.start = malloc((blocks + 1) * sizeof *pk.start);
+    pk.runs = calloc(blocks, sizeof *pk.runs);
+    pk.run_rank = malloc(ECURVE_RANK_BLOCKS(blocks) * sizeof *pk.run_rank);
+    if ((blocks && (!pk.base || !pk.runs || !pk.run_rank)) || !pk.start) {
+        goto error;
+    }
+
+    /* frame of reference and width of each block */
+    pk.start[0] = 0;
+    for (b = 0; b < blocks; b++) {
+        size_t end = (b + 1) * PACKED_BLOCK < n ? (b + 1) * PACKED_BLOCK : n;
+        uproc_suffix min = suffixes[b * PACKED_BLOCK], max = min;
+        for (i = b * PACKED_BLOCK + 1; i < end; i++) {
+            if (suffixes[i] < min) {
+                min = suffixes[i];
+            }
+            if (suffixes[i] > max) {
+                max = suffixes[i];
+            }
+        }
+        pk.base[b] = min;
+        pk.start[b + 1] = pk.start[b] + bit_width(max - min);
+    }
+    pk.data_words = pk.start[blocks];
+    pk.data = calloc(pk.data_words ? pk.data_words : 1, sizeof *pk.data);
+    if (!pk.data) {
+        goto error;
+    }
+    for (i = 0; i < n; i++) {
+        unsigned width, shift;
+        uint64_t bit, v, k;
+        b = i / PACKED_BLOCK;
+        width = pk.start[b + 1] - pk.start[b];
+        if (!width) {
+            continue;
+        }
+        v = suffixes[i] - pk.base[b];
+        bit = (uint64_t)(i % PACKED_BLOCK) * width;
+        k = pk.start[b] + bit / 64;
+        shift = bit % 64;
+        pk.data[k] |= v << shift;
+        if (shift + width > 64) {
+            pk.data[k + 1] |= v >> (64 - shift);
+        }
+    }
+
+    /* runs of families */
+    for (i = 0; i < n; i++) {
+        if (!i || families[i] != families[i - 1]) {
+            pk.runs[i / 64] |= UINT64_C(1) << i % 64;
+            pk.run_count++;
+        }
+    }
+    pk.run_families =
+        malloc((pk.run_count ? pk.run_count : 1) * sizeof *pk.run_families);
+    if (!pk.run_families) {
+        goto error;
+    }
+    for (i = r = 0; i < n; i++) {
+        if (!i || families[i] != families[i - 1]) {
+            pk.run_families[r++] = families[i];
+        }
+    }
+    ecurve_rank_build(pk.runs, pk.run_rank, blocks);
+
+    free(ecurve->suffixes);
+    free(ecurve->families);
+    ecurve->suffixes = NULL;
+    ecurve->families = NULL;
+    ecurve->suffix_alloc = 0;
+    ecurve->packed = pk;
+    return 0;
+
+error:
+    packed_free(&pk);
+    return uproc_error(UPROC_ENOMEM);
+}
+
+/* Replace the packed representation by plain suffix and family arrays */
+static int packed_unpack(struct uproc_ecurve_s *ecurve)
+{
+    size_t i, n = ecurve->suffix_count;
+    uproc_suffix *suffixes;
+    uproc_family *families;
+
+    suffixes = malloc((n ? n : 1) * sizeof *suffixes);
+    families = malloc((n ? n : 1) * sizeof *families);
+    if (!suffixes || !families) {
+        free(suffixes);
+        free(families);
+        return uproc_error(UPROC_ENOMEM);
+    }
+    for (i = 0; i < n; i++) {
+        suffixes[i] = ecurve_suffix(ecurve, i);
+        families[i] = ecurve_family(ecurve, i);
+    }
+    packed_free(&ecurve->packed);
+    ecurve->suffixes = suffixes;
+    ecurve->families = families;
+    ecurve->suffix_alloc = n;
+    return 0;
+}
+
+/* Replace the suffix and family arrays by interleaved records */
+static int records_build(struct uproc_ecurve_s *ecurve)
+{
+    size_t i, n = ecurve->suffix_count;
+    size_t count = (n + INTERLEAVE_N - 1) / INTERLEAVE_N;
+    struct ecurve_record *records;
+
+    records = ecurve_alloc((count ? count : 1) * sizeof *records);
+    if (!records) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    memset(records, 0, count * sizeof *records);
+    for (i = 0; i < n; i++) {
+        records[i / INTERLEAVE_N].suffixes[i % INTERLEAVE_N] =
+            ecurve->suffixes[i];
+        records[i / INTERLEAVE_N].families[i % INTERLEAVE_N] =
+            ecurve->families[i];
+    }
+    free(ecurve->suffixes);
+    free(ecurve->families);
+    ecurve->suffixes = NULL;
+    ecurve->families = NULL;
+    ecurve->suffix_alloc = 0;
+    ecurve->records = records;
+    return 0;
+}
+
+/* Replace the interleaved records by plain suffix and family arrays */
+static int records_unpack(struct uproc_ecurve_s *ecurve)
+{
+    size_t i, n = ecurve->suffix_count;
+    uproc_suffix *suffixes;
+    uproc_family *families;
+
+    suffixes = malloc((n ? n : 1) * sizeof *suffixes);
+    families = malloc((n ? n : 1) * sizeof *families);
+    if (!suffixes || !families) {
+        free(suffixes);
+        free(families);
+        return uproc_error(UPROC_ENOMEM);
+    }
+    for (i = 0; i < n; i++) {
+        suffixes[i] = ecurve_suffix(ecurve, i);
+        families[i] = ecurve_family(ecurve, i);
+    }
+    free(ecurve->records);
+    ecurve->records = NULL;
+    ecurve->suffixes = suffixes;
+    ecurve->families = families;
+    ecurve->suffix_alloc = n;
+    return 0;
+}
+
+static void btree_free(struct ecurve_btree *bt)
+{
+    free(bt->offsets);
+    free(bt->keys);
+    *bt = (struct ecurve_btree){0};
+}
+
+/* Build the search trees of all large buckets */
+static int btree_build(struct uproc_ecurve_s *ecurve)
+{
+    size_t iter, first, count, blocks, k;
+    size_t sizes[BTREE_MAX_LEVELS];
+    uproc_prefix p;
+    struct ecurve_btree bt = {0};
+    int l;
+
+    /* count keys */
+    iter = 0;
+    while (!ecurve_next_prefix(ecurve, &iter, &p, &first, &count)) {
+        if (count < BTREE_MIN) {
+            continue;
+        }
+        for (l = btree_levels(count, sizes) - 1; l >= 0; l--) {
+            bt.key_count +=
+                (sizes[l] + BTREE_FANOUT - 1) / BTREE_FANOUT * BTREE_FANOUT;
+        }
+    }
+    if (bt.key_count > UINT32_MAX) {
+        return uproc_error_msg(UPROC_EINVAL, "too many suffixes");
+    }
+
+    blocks = BTREE_BLOCKS(ecurve->suffix_count);
+    bt.offsets = calloc(blocks ? blocks : 1, sizeof *bt.offsets);
+    bt.keys = malloc((bt.key_count ? bt.key_count : 1) * sizeof *bt.keys);
+    if (!bt.offsets || !bt.keys) {
+        btree_free(&bt);
+        return uproc_error(UPROC_ENOMEM);
+    }
+
+    iter = k = 0;
+    while (!ecurve_next_prefix(ecurve, &iter, &p, &first, &count)) {
+        if (count < BTREE_MIN) {
+            continue;
+        }
+        bt.offsets[first / BTREE_MIN] = k;
+        for (l = btree_levels(count, sizes) - 1; l >= 0; l--) {
+            size_t i, stride = 1, padded;
+            int m;
+            for (m = 0; m <= l; m++) {
+                stride *= BTREE_FANOUT;
+            }
+            padded =
+                (sizes[l] + BTREE_FANOUT - 1) / BTREE_FANOUT * BTREE_FANOUT;
+            for (i = 0; i < padded; i++) {
+                bt.keys[k++] = i < sizes[l]
+                                   ? ecurve_suffix(ecurve, first + i * stride)
+                                   : UINT64_MAX;
+            }
+        }
+    }
+
+    ecurve->btree = bt;
+    return 0;
+}
+
+int uproc_ecurve_convert(uproc_ecurve *ecurve, unsigned layout)
+{
+    int res;
+
+    if (layout & ~UPROC_ECURVE_LAYOUT_ALL ||
+        ((layout & UPROC_ECURVE_PACKED_SUFFIXES) &&
+         (layout & UPROC_ECURVE_INTERLEAVED))) {
+        return uproc_error_msg(UPROC_EINVAL, "invalid ecurve layout");
+    }
+    if (ecurve->mmap_ptr) {
+        return uproc_error_msg(UPROC_EINVAL, "can't convert mmap()ed ecurve");
+    }
+
+    if ((layout ^ ecurve->layout) & UPROC_ECURVE_COMPACT_PREFIXES) {
+        if (layout & UPROC_ECURVE_COMPACT_PREFIXES) {
+            res = pfxindex_build(ecurve);
+        } else {
+            res = pfxtable_build(ecurve);
+        }
+        if (res) {
+            return res;
+        }
+        ecurve->layout ^= UPROC_ECURVE_COMPACT_PREFIXES;
+    }
+    /* the suffix storage is converted via plain arrays */
+    if ((layout ^ ecurve->layout) &
+        (UPROC_ECURVE_PACKED_SUFFIXES | UPROC_ECURVE_INTERLEAVED)) {
+        if (ecurve->layout & UPROC_ECURVE_PACKED_SUFFIXES) {
+            res = packed_unpack(ecurve);
+            if (res) {
+                return res;
+            }
+            ecurve->layout ^= UPROC_ECURVE_PACKED_SUFFIXES;
+        }
+        if (ecurve->layout & UPROC_ECURVE_INTERLEAVED) {
+            res = records_unpack(ecurve);
+            if (res) {
+                return res;
+            }
+            ecurve->layout ^= UPROC_ECURVE_INTERLEAVED;
+        }
+        if (layout & UPROC_ECURVE_PACKED_SUFFIXES) {
+            res = packed_build(ecurve);
+            if (res) {
+                return res;
+            }
+            ecurve->layout ^= UPROC_ECURVE_PACKED_SUFFIXES;
+        }
+        if (layout & UPROC_ECURVE_INTERLEAVED) {
+            res = records_build(ecurve);
+            if (res) {
+                return res;
+            }
+            ecurve->layout ^= UPROC_ECURVE_INTERLEAVED;
+        }
+    }
+    if ((layout ^ ecurve->layout) & UPROC_ECURVE_BTREE_BUCKETS) {
+        if (layout & UPROC_ECURVE_BTREE_BUCKETS) {
+            res = btree_build(ecurve);
+            if (res) {
+                return res;
+            }
+        } else {
+            btree_free(&ecurve->btree);
+        }
+        ecurve->layout ^= UPROC_ECURVE_BTREE_BUCKETS;
+    }
+    return 0;
+}
+
+unsigned uproc_ecurve_layout(const uproc_ecurve *ecurve)
+{
+    return ecurve->layout;
+}
+
+/* Parse a comma-separated list of names from `names` */
+static int flags_parse(const struct flag_name *names, size_t n_names,
+                       const char *what, const char *str, unsigned *flags)
+{
+    unsigned result = 0;
+
+    while (*str) {
+        size_t i, len = strcspn(str, ",");
+        if (len == strlen("default") && !strncmp(str, "default", len)) {
+            i = n_names;
+        } else {
+            for (i = 0; i < n_names; i++) {
+                if (strlen(names[i].name) == len &&
+                    !strncmp(str, names[i].name, len)) {
+                    result |= names[i].flag;
+                    break;
+                }
+            }
+            if (i == n_names) {
+                return uproc_error_msg(UPROC_EINVAL, "unknown %s \"%.*s\"",
+                                       what, (int)len, str);
+            }
+        }
+        str += len + !!str[len];
+    }
+    *flags = result;
+    return 0;
+}
+
+static int flags_str(const struct flag_name *names, size_t n_names,
+                     unsigned flags, char *buf, size_t n)
+{
+    size_t i;
+    int len = 0;
+
+    if (!flags) {
+        return snprintf(buf, n, "default");
+    }
+    if (n) {
+        buf[0] = '\0';
+    }
+    for (i = 0; i < n_names; i++) {
+        if (flags & names[i].flag) {
+            size_t left = (size_t)len < n ? n - len : 0;
+            len += snprintf(left ? buf + len : NULL, left, "%s%s",
+                            len ? "," : "", names[i].name);
+        }
+    }
+    return len;
+}
+
+int uproc_ecurve_layout_parse(const char *str, unsigned *layout)
+{
+    return flags_parse(layout_names, ELEMENTS(layout_names), "ecurve layout",
+                       str, layout);
+}
+
+int uproc_ecurve_layout_str(unsigned layout, char *buf, size_t n)
+{
+    return flags_str(layout_names, ELEMENTS(layout_names), layout, buf, n);
+}
+
+unsigned uproc_ecurve_memory(const uproc_ecurve *ecurve)
+{
+    return ecurve->memory;
+}
+
+int uproc_ecurve_memory_parse(const char *str, unsigned *flags)
+{
+    return flags_parse(memory_names, ELEMENTS(memory_names), "memory flag",
+                       str, flags);
+}
+
+int uproc_ecurve_memory_str(unsigned flags, char *buf, size_t n)
+{
+    return flags_str(memory_names, ELEMENTS(memory_names), flags, buf, n);
+}
+
+int uproc_ecurve_residency_parse(const char *str, unsigned *residency)
+{
+    unsigned flags;
+    if (flags_parse(residency_names, ELEMENTS(residency_names),
+                    "residency policy", str, &flags)) {
+        return -1;
+    }
+    if ((flags & UPROC_ECURVE_LAZY) && (flags & UPROC_ECURVE_PREFETCH)) {
+        return uproc_error_msg(UPROC_EINVAL,
+                               "\"lazy\" and \"prefetch\" are exclusive");
+    }
+    *residency = flags;
+    return 0;
+}
@@ -13,6 +13,85 @@ typedef uint_least16_t pfxtab_count;
 #define ECURVE_EDGE ((pfxtab_count)-1)
 #define ECURVE_ISEDGE(p) ((p).count == ECURVE_EDGE)
 
+/** Number of 64-bit words in the bitvector of a compact prefix index */
+#define PFXINDEX_WORDS ((UPROC_PREFIX_MAX + 64) / 64)
+
+/** Number of bitvector words covered by one entry of a rank directory
+ *
+ * 8 words are 64 bytes, so computing a rank touches a single cache line of
+ * the bitvector.
+ */
+#define ECURVE_RANK_WORDS 8
+
+/** Number of rank directory entries for a bitvector of `words` words */
+#define ECURVE_RANK_BLOCKS(words) \
+    (((words) + ECURVE_RANK_WORDS - 1) / ECURVE_RANK_WORDS)
+
+#define PFXINDEX_BLOCKS ECURVE_RANK_BLOCKS(PFXINDEX_WORDS)
+
+/** Number of suffixes sharing a frame of reference in a packed ecurve
+ *
+ * With 64 suffixes, a block of `w` bits per suffix takes exactly `w` 64-bit
+ * words.
+ */
+#define PACKED_BLOCK 64
+#define PACKED_BLOCKS(suffix_count) \
+    (((suffix_count) + PACKED_BLOCK - 1) / PACKED_BLOCK)
+
+/** Buckets up to this size are searched linearly (using SIMD) */
+#define SEARCH_LINEAR_MAX 16
+
+/** Buckets of at least this size start with interpolation search */
+#define SEARCH_INTERP_MIN 512
+
+/** Maximum number of interpolation steps before falling back to binary
+ * search */
+#define SEARCH_INTERP_STEPS 3
+
+/* Vectorized search kernels, selected at runtime */
+#if HAVE_IMMINTRIN_H && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define ECURVE_HAVE_X86_DISPATCH 1
+#else
+#define ECURVE_HAVE_X86_DISPATCH 0
+#endif
+
+/** Number of suffixes (and families) per record of an interleaved ecurve
+ *
+ * 6 suffixes and 6 families take 60 of the 64 bytes of a cache line.
+ */
+#define INTERLEAVE_N 6
+
+/** Cache line size assumed for aligning arrays */
+#define ECURVE_CACHE_LINE 64
+
+/** Number of keys per search tree node
+ *
+ * 8 suffixes fill a 64-byte cache line.
+ */
+#define BTREE_FANOUT 8
+
+/** Minimum bucket size for which a search tree is built
+ *
+ * Smaller buckets are searched in a few cache lines anyway, the binary
+ * search is faster there.
+ */
+#define BTREE_MIN 1024
+#define BTREE_BLOCKS(suffix_count) \
+    (((suffix_count) + BTREE_MIN - 1) / BTREE_MIN)
+
+/** Maximum height of a search tree (enough for 2^36 suffixes) */
+#define BTREE_MAX_LEVELS 12
+
+/** Number of words uproc_ecurve_lookup_batch() prefetches ahead */
+#define ECURVE_PREFETCH_DISTANCE 8
+
+#if defined(__GNUC__)
+#define ECURVE_PREFETCH(addr) __builtin_prefetch((addr))
+#else
+#define ECURVE_PREFETCH(addr) ((void)(addr))
+#endif
+
 /** Struct defining an ecurve */
 struct uproc_ecurve_s
 {
@@ -72,6 +151,124 @@ struct uproc_ecurve_s
         *
         prefixes;
 
+    /** Layout flags, see ::uproc_ecurve_layout */
+    unsigned layout;
+
+    /** Compact prefix index
+     *
+     * Replaces `#prefixes` (which is NULL then) if `#layout` contains
+     * ::UPROC_ECURVE_COMPACT_PREFIXES.
+     */
+    struct ecurve_pfxindex
+    {
+        /** Number of non-empty prefixes */
+        size_t count;
+
+        /** Bitvector with one bit per prefix, set for non-empty ones
+         *
+         * Holds #PFXINDEX_WORDS words.
+         */
+        uint64_t *bits;
+
+        /** Number of bits set before each block of #ECURVE_RANK_WORDS
+         * words in `#bits` (#PFXINDEX_BLOCKS entries) */
+        uint32_t *rank;
+
+        /** The non-empty prefixes in ascending order (`#count` entries) */
+        uint32_t *keys;
+
+        /** Index of the first suffix of each entry in `#keys`
+         *
+         * Holds `#count + 1` entries, the last one being the total number of
+         * suffixes.
+         */
+        uint32_t *first;
+    } pfxindex;
+
+    /** Records of interleaved suffixes and families
+     *
+     * Replace `#suffixes` and `#families` (which are NULL then) if `#layout`
+     * contains ::UPROC_ECURVE_INTERLEAVED. Holds
+     * `ceil(#suffix_count / #INTERLEAVE_N)` records, the unused entries of
+     * the last one are zero.
+     */
+    struct ecurve_record
+    {
+        uproc_suffix suffixes[INTERLEAVE_N];
+        uproc_family families[INTERLEAVE_N];
+        char padding[ECURVE_CACHE_LINE - INTERLEAVE_N * (sizeof(uproc_suffix) +
+                                                         sizeof(uproc_family))];
+    } *records;
+
+    /** Packed suffixes and run-length encoded families
+     *
+     * Replace `#suffixes` and `#families` (which are NULL then) if `#layout`
+     * contains ::UPROC_ECURVE_PACKED_SUFFIXES.
+     *
+     * The suffixes are split into blocks of #PACKED_BLOCK. Every suffix is
+     * stored as its difference to the smallest suffix of its block, using as
+     * many bits as the largest difference in the block needs.
+     */
+    struct ecurve_packed
+    {
+        /** Smallest suffix of each block */
+        uint64_t *base;
+
+        /** Offset of each block in `#data`, in 64-bit words
+         *
+         * Holds `#PACKED_BLOCKS(suffix_count) + 1` entries. The number of
+         * bits per suffix of block `b` is `start[b + 1] - start[b]`.
+         */
+        uint64_t *start;
+
+        /** Bit-packed differences (`#data_words` words) */
+        uint64_t *data;
+
+        /** Number of words in `#data`, equal to the last entry of
+         * `#start` */
+        size_t data_words;
+
+        /** Bitvector with one bit per suffix, set where a new run of
+         * families starts */
+        uint64_t *runs;
+
+        /** Rank directory of `#runs` */
+        uint32_t *run_rank;
+
+        /** Family of each run */
+        uproc_family *run_families;
+
+        /** Number of runs */
+        size_t run_count;
+    } packed;
+
+    /** Search trees over large prefix buckets
+     *
+     * Present if `#layout` contains ::UPROC_ECURVE_BTREE_BUCKETS. Buckets of
+     * at least #BTREE_MIN suffixes get a static B+-tree with #BTREE_FANOUT
+     * keys per node. Its leaves are the (unmodified) suffixes of the bucket
+     * in groups of #BTREE_FANOUT. The `i`-th key of level `l` (counting from
+     * 1 at the bottom) is the suffix at index `i * BTREE_FANOUT^l` of the
+     * bucket. The levels are stored top-down, each padded to a multiple of
+     * #BTREE_FANOUT with `UINT64_MAX`.
+     */
+    struct ecurve_btree
+    {
+        /** Offset of each tree in `#keys`
+         *
+         * As every tree covers at least #BTREE_MIN suffixes, at most one
+         * tree starts in each block of #BTREE_MIN suffixes. Entry `i` is the
+         * offset of the tree of the bucket starting in block `i` (if any).
+         */
+        uint32_t *offsets;
+
+        /** Keys of all trees (`#key_count` entries) */
+        uint64_t *keys;
+
+        /** Total number of keys */
+        size_t key_count;
+    } btree;
+
     /** Last non-empty prefix
      *
      * Needed by uproc_ecurve_add_prefix().
@@ -85,11 +282,284 @@ struct uproc_ecurve_s
      */
     int mmap_fd;
 
-    /** `mmap()`ed memory region */
+    /** `mmap()`ed memory region
+     *
+     * If not %NULL, all arrays point into this region (the mapped file or
+     * the anonymous mapping set up by uproc_ecurve_place()) instead of being
+     * allocated individually.
+     */
     void *mmap_ptr;
 
     /** Size of the `mmap()`ed region */
     size_t mmap_size;
+
+    /** Flags obtained by uproc_ecurve_place() */
+    unsigned memory;
+
+    /** Thread faulting in the mapping (see ::UPROC_ECURVE_PREFETCH) or
+     * %NULL; it is stopped before the mapping is released */
+    struct ecurve_prefetch *prefetch;
+
+    /** The ecurve this one is a copy of (see uproc_ecurve_replicate()), or
+     * %NULL if it is not a copy */
+    const struct uproc_ecurve_s *origin;
+};
+
+/** The ecurve whose contents `ecurve` holds, the same for all its copies */
+static inline const struct uproc_ecurve_s *ecurve_identity(
+    const struct uproc_ecurve_s *ecurve)
+{
+    return ecurve->origin ? ecurve->origin : ecurve;
+}
+
+static inline unsigned popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+/** Number of bits set in `bits` before position `pos` */
+static inline size_t ecurve_rank(const uint64_t *bits, const uint32_t *rank,
+                                 size_t pos)
+{
+    size_t w = pos / 64, i, r;
+    r = rank[w / ECURVE_RANK_WORDS];
+    for (i = w - w % ECURVE_RANK_WORDS; i < w; i++) {
+        r += popcount64(bits[i]);
+    }
+    return r + popcount64(bits[w] & ((UINT64_C(1) << pos % 64) - 1));
+}
+
+/** Fill the rank directory of a bitvector of `words` words */
+static inline void ecurve_rank_build(const uint64_t *bits, uint32_t *rank,
+                                     size_t words)
+{
+    size_t i, sum = 0;
+    for (i = 0; i < words; i++) {
+        if (i % ECURVE_RANK_WORDS == 0) {
+            rank[i / ECURVE_RANK_WORDS] = sum;
+        }
+        sum += popcount64(bits[i]);
+    }
+}
+
+/** Get the suffix at index `i` */
+static inline uproc_suffix ecurve_suffix(const struct uproc_ecurve_s *ecurve,
+                                         size_t i)
+{
+    const struct ecurve_packed *pk = &ecurve->packed;
+    size_t b = i / PACKED_BLOCK, k;
+    unsigned width, shift;
+    uint64_t bit, v;
+
+    if (ecurve->suffixes) {
+        return ecurve->suffixes[i];
+    }
+    if (ecurve->records) {
+        return ecurve->records[i / INTERLEAVE_N].suffixes[i % INTERLEAVE_N];
+    }
+    width = pk->start[b + 1] - pk->start[b];
+    if (!width) {
+        return pk->base[b];
+    }
+    bit = (uint64_t)(i % PACKED_BLOCK) * width;
+    k = pk->start[b] + bit / 64;
+    shift = bit % 64;
+    v = pk->data[k] >> shift;
+    if (shift + width > 64) {
+        v |= pk->data[k + 1] << (64 - shift);
+    }
+    if (width < 64) {
+        v &= (UINT64_C(1) << width) - 1;
+    }
+    return pk->base[b] + v;
+}
+
+/** Get the family at index `i` */
+static inline uproc_family ecurve_family(const struct uproc_ecurve_s *ecurve,
+                                         size_t i)
+{
+    const struct ecurve_packed *pk = &ecurve->packed;
+    size_t r;
+
+    if (ecurve->families) {
+        return ecurve->families[i];
+    }
+    if (ecurve->records) {
+        return ecurve->records[i / INTERLEAVE_N].families[i % INTERLEAVE_N];
+    }
+    /* number of runs starting at or before `i`, minus one */
+    r = ecurve_rank(pk->runs, pk->run_rank, i);
+    r += (pk->runs[i / 64] >> i % 64) & 1;
+    return pk->run_families[r - 1];
+}
+
+/** Identifiers of the arrays making up an ecurve
+ *
+ * Used to name the sections of the on-disk format. Never reuse a value.
+ */
+enum ecurve_section_id {
+    ECURVE_SEC_PREFIXES = 1,
+    ECURVE_SEC_SUFFIXES = 2,
+    ECURVE_SEC_FAMILIES = 3,
+    ECURVE_SEC_PFX_BITS = 4,
+    ECURVE_SEC_PFX_RANK = 5,
+    ECURVE_SEC_PFX_KEYS = 6,
+    ECURVE_SEC_PFX_FIRST = 7,
+    ECURVE_SEC_PACKED_BASE = 8,
+    ECURVE_SEC_PACKED_START = 9,
+    ECURVE_SEC_PACKED_DATA = 10,
+    ECURVE_SEC_RUNS = 11,
+    ECURVE_SEC_RUN_RANK = 12,
+    ECURVE_SEC_RUN_FAMILIES = 13,
+    ECURVE_SEC_BTREE_OFFSETS = 14,
+    ECURVE_SEC_BTREE_KEYS = 15,
+    ECURVE_SEC_RECORDS = 16,
 };
 
+/** Maximum number of sections of an ecurve */
+#define ECURVE_SECTIONS_MAX 16
+
+/** An array of an ecurve */
+struct ecurve_section
+{
+    /** What this is */
+    enum ecurve_section_id id;
+
+    /** Where the ecurve stores the pointer to the data */
+    void **ptr;
+
+    /** Size in bytes */
+    size_t size;
+};
+
+/** Allocate memory aligned to #ECURVE_CACHE_LINE (if possible)
+ *
+ * The result can be passed to free().
+ */
+void *ecurve_alloc(size_t size);
+
+/** List the sections the current layout of `ecurve` consists of
+ *
+ * Returns the number of sections stored in `sections`, which must be able to
+ * hold #ECURVE_SECTIONS_MAX elements.
+ */
+size_t ecurve_sections(struct uproc_ecurve_s *ecurve,
+                       struct ecurve_section *sections);
+
+/** Install the arrays of a loaded ecurve
+ *
+ * `ecurve->layout` and `ecurve->suffix_count` must already be set. Sets the
+ * array pointers of `ecurve` to the ones in `sections` and checks that their
+ * sizes are consistent with each other.
+ */
+int ecurve_attach_sections(struct uproc_ecurve_s *ecurve,
+                           const struct ecurve_section *sections, size_t n);
+
+/** Memory of all ecurves placed with uproc_ecurve_place() so far
+ *
+ * Sets `size` to the total size in bytes, `huge` to the part of it backed by
+ * huge pages and `locked` to the part of it locked in memory.
+ */
+void ecurve_memory_totals(size_t *size, size_t *huge, size_t *locked);
+
+/** Total size of the ecurves loaded from streams and time spent loading
+ *
+ * Only ecurves in the binary format are accounted, which are read from a
+ * stream if mmap support is disabled.
+ */
+void ecurve_load_totals(size_t *bytes, double *seconds);
+
+/** Iterate over the non-empty prefixes of an ecurve
+ *
+ * `*iter` must be 0 before the first call. Returns 1 after the last prefix.
+ */
+int ecurve_next_prefix(const struct uproc_ecurve_s *ecurve, size_t *iter,
+                       uproc_prefix *prefix, size_t *first, size_t *count);
+
+/** On-disk format with a section table
+ *
+ * Used for ecurves whose layout isn't the default one, which are stored in
+ * the traditional headerless format.
+ */
+#define ECURVE_FORMAT_MAGIC "\x89UPROCEC"
+#define ECURVE_FORMAT_VERSION 2
+
+/** Alignment of the sections in the file */
+#define ECURVE_FORMAT_ALIGN 4096
+
+struct ecurve_format_header
+{
+    /** #ECURVE_FORMAT_MAGIC (without the terminating null byte) */
+    char magic[8];
+
+    /** #ECURVE_FORMAT_VERSION */
+    uint32_t version;
+
+    /** 0x01020304 as written by the host that created the file */
+    uint32_t byte_order;
+
+    /** Alphabet string (not null-terminated) */
+    char alphabet[UPROC_ALPHABET_SIZE];
+
+    /** ::uproc_ecurve_layout flags */
+    uint32_t layout;
+
+    /** Total number of suffixes */
+    uint64_t suffix_count;
+
+    /** Number of used entries in `#sections` */
+    uint32_t section_count, reserved;
+
+    struct
+    {
+        uint32_t id, reserved;
+        /** Offset from the start of the file, in bytes */
+        uint64_t offset;
+        /** Size in bytes */
+        uint64_t size;
+    } sections[ECURVE_SECTIONS_MAX];
+};
+
+#define ECURVE_FORMAT_BYTE_ORDER 0x01020304
+
+/** Fill in the header for storing `ecurve` */
+void ecurve_format_header(struct uproc_ecurve_s *ecurve,
+                          struct ecurve_format_header *header,
+                          struct ecurve_section *sections);
+
+/** Set up an ecurve from a mapped file in the sectioned format
+ *
+ * `ec->mmap_ptr` and `ec->mmap_size` must describe the mapped file; the
+ * arrays of `ec` are pointed into it and its alphabet is created. Only
+ * available if mmap is supported and enabled.
+ */
+int ecurve_map_sections(struct uproc_ecurve_s *ec);
+
+/** Get the residency policy for a new mapping
+ *
+ * The one set with uproc_ecurve_residency_set(), or else the one in
+ * `UPROC_RESIDENCY`.
+ */
+int ecurve_residency(unsigned *residency);
+
+/** Bring the mapping of `ec` into memory according to `residency`
+ *
+ * `ec->mmap_ptr` must be page-aligned. Failures are ignored. Only available
+ * if mmap is supported and enabled.
+ */
+void ecurve_residency_apply(struct uproc_ecurve_s *ec, unsigned residency);
+
+/** Check a header and return the size of the file it describes
+ *
+ * Returns 0 (and sets the uproc error) if the header is invalid.
+ */
+size_t ecurve_format_check(const struct ecurve_format_header *header);
+
 #endif
@@ -18,15 +18,21 @@
  * along with libuproc.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* for mlock2() */
+#define _GNU_SOURCE
+
 #if HAVE_CONFIG_H
 #include <config.h>
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 
-#if HAVE_MMAP && USE_MMAP
+#if HAVE_MMAP
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -34,11 +40,17 @@
 #include <sys/mman.h>
 #endif
 
+#if HAVE_MMAP && USE_MMAP && HAVE_PTHREAD_H
+#include <pthread.h>
+#define PREFETCH_THREAD 1
+#endif
+
 #include "uproc/common.h"
 #include "uproc/error.h"
 #include "uproc/ecurve.h"
 
 #include "ecurve_internal.h"
+#include "numa_internal.h"
 
 struct mmap_header
 {
@@ -73,6 +85,264 @@ static const uint64_t magic_number = 0xd2eadfUL;
 #ifndef MAP_POPULATE
 #define MAP_POPULATE 0
 #endif
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#if HAVE_MMAP && USE_MMAP
+int ecurve_map_sections(struct uproc_ecurve_s *ec)
+{
+    size_t i;
+    char alphabet_str[UPROC_ALPHABET_SIZE + 1];
+    const struct ecurve_format_header *header = ec->mmap_ptr;
+    struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+    void *data[ECURVE_SECTIONS_MAX];
+
+    if (ec->mmap_size < sizeof *header ||
+        ec->mmap_size != ecurve_format_check(header)) {
+        return uproc_error_msg(UPROC_EINVAL, "invalid ecurve file");
+    }
+    ec->layout = header->layout;
+    ec->suffix_count = header->suffix_count;
+
+    memcpy(alphabet_str, header->alphabet, UPROC_ALPHABET_SIZE);
+    alphabet_str[UPROC_ALPHABET_SIZE] = '\0';
+    ec->alphabet = uproc_alphabet_create(alphabet_str);
+    if (!ec->alphabet) {
+        return -1;
+    }
+
+    for (i = 0; i < header->section_count; i++) {
+        data[i] = (char *)ec->mmap_ptr + header->sections[i].offset;
+        sec[i].id = header->sections[i].id;
+        sec[i].ptr = &data[i];
+        sec[i].size = header->sections[i].size;
+    }
+    if (ecurve_attach_sections(ec, sec, header->section_count)) {
+        uproc_alphabet_destroy(ec->alphabet);
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+/* Residency policy set with uproc_ecurve_residency_set(), if any */
+static unsigned residency_policy;
+static bool residency_explicit;
+
+int uproc_ecurve_residency_set(unsigned residency)
+{
+    if ((residency & ~UPROC_ECURVE_RESIDENCY_ALL) ||
+        ((residency & UPROC_ECURVE_LAZY) &&
+         (residency & UPROC_ECURVE_PREFETCH))) {
+        return uproc_error_msg(UPROC_EINVAL, "invalid residency policy");
+    }
+    residency_policy = residency;
+    residency_explicit = true;
+    return 0;
+}
+
+int ecurve_residency(unsigned *residency)
+{
+    const char *value = getenv("UPROC_RESIDENCY");
+    if (residency_explicit || !value) {
+        *residency = residency_policy;
+        return 0;
+    }
+    return uproc_ecurve_residency_parse(value, residency);
+}
+
+#if HAVE_MMAP && USE_MMAP
+/* Fault in `n` bytes of a mapping, starting at a page boundary */
+static void populate(const char *p, size_t n)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    const volatile char *v = p;
+#if HAVE_MADVISE && defined(MADV_POPULATE_READ)
+    if (!madvise((void *)p, n, MADV_POPULATE_READ)) {
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i += page) {
+        (void)v[i];
+    }
+}
+
+/* Size of the parts in which mappings are faulted in */
+#define PREFAULT_CHUNK ((size_t)4 << 20)
+
+/* Fault in the part of a mapping of `size` bytes at `ptr` that starts at
+ * `off`, and have the next part read meanwhile; returns the size of the
+ * part */
+static size_t prefault_chunk(char *ptr, size_t size, size_t off)
+{
+    size_t n = size - off < PREFAULT_CHUNK ? size - off : PREFAULT_CHUNK;
+#if HAVE_POSIX_MADVISE && defined(POSIX_MADV_WILLNEED)
+    /* the mapping is advised for random access, so read ahead explicitly */
+    if (!off) {
+        posix_madvise(ptr, n, POSIX_MADV_WILLNEED);
+    }
+    if (off + n < size) {
+        size_t next = size - off - n;
+        posix_madvise(ptr + off + n,
+                      next < PREFAULT_CHUNK ? next : PREFAULT_CHUNK,
+                      POSIX_MADV_WILLNEED);
+    }
+#endif
+    populate(ptr + off, n);
+    return n;
+}
+
+static void lock(void *p, size_t n, unsigned residency)
+{
+#if HAVE_MLOCK2 && defined(MLOCK_ONFAULT)
+    /* lock the pages as the lookups fault them in */
+    if (residency & UPROC_ECURVE_LAZY) {
+        mlock2(p, n, MLOCK_ONFAULT);
+        return;
+    }
+#endif
+#if HAVE_MLOCK
+    mlock(p, n);
+#endif
+    (void)p;
+    (void)n;
+    (void)residency;
+}
+#endif
+
+#if PREFETCH_THREAD
+struct ecurve_prefetch
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    bool stop, keep_warm;
+    char *ptr;
+    size_t size;
+};
+
+static bool prefetch_stopped(struct ecurve_prefetch *p)
+{
+    bool stop;
+    pthread_mutex_lock(&p->mutex);
+    stop = p->stop;
+    pthread_mutex_unlock(&p->mutex);
+    return stop;
+}
+
+static void *prefetch_run(void *arg)
+{
+    struct ecurve_prefetch *p = arg;
+    for (size_t off = 0; off < p->size;) {
+        if (prefetch_stopped(p)) {
+            return NULL;
+        }
+        off += prefault_chunk(p->ptr, p->size, off);
+    }
+    if (p->keep_warm && !prefetch_stopped(p)) {
+        lock(p->ptr, p->size, 0);
+    }
+    return NULL;
+}
+
+static int prefetch_start(struct uproc_ecurve_s *ec, bool keep_warm)
+{
+    struct ecurve_prefetch *p = malloc(sizeof *p);
+    if (!p) {
+        return -1;
+    }
+    *p = (struct ecurve_prefetch){
+        .keep_warm = keep_warm, .ptr = ec->mmap_ptr, .size = ec->mmap_size,
+    };
+    if (pthread_mutex_init(&p->mutex, NULL)) {
+        free(p);
+        return -1;
+    }
+    if (pthread_create(&p->thread, NULL, prefetch_run, p)) {
+        pthread_mutex_destroy(&p->mutex);
+        free(p);
+        return -1;
+    }
+    ec->prefetch = p;
+    return 0;
+}
+
+static void prefetch_stop(struct uproc_ecurve_s *ec)
+{
+    struct ecurve_prefetch *p = ec->prefetch;
+    if (!p) {
+        return;
+    }
+    pthread_mutex_lock(&p->mutex);
+    p->stop = true;
+    pthread_mutex_unlock(&p->mutex);
+    pthread_join(p->thread, NULL);
+    pthread_mutex_destroy(&p->mutex);
+    free(p);
+    ec->prefetch = NULL;
+}
+#endif
+
+#if HAVE_MMAP && USE_MMAP
+void ecurve_residency_apply(struct uproc_ecurve_s *ec, unsigned residency)
+{
+    bool keep_warm = residency & UPROC_ECURVE_KEEP_WARM;
+#if PREFETCH_THREAD
+    if ((residency & UPROC_ECURVE_PREFETCH) && !prefetch_start(ec, keep_warm)) {
+        return;
+    }
+#endif
+    /* without a thread, prefetching degrades to populating */
+    if (!(residency & UPROC_ECURVE_LAZY)) {
+        for (size_t off = 0; off < ec->mmap_size;) {
+            off += prefault_chunk(ec->mmap_ptr, ec->mmap_size, off);
+        }
+    }
+    if (keep_warm) {
+        lock(ec->mmap_ptr, ec->mmap_size, residency);
+    }
+}
+#endif
+
+double uproc_ecurve_resident(const uproc_ecurve *ecurve)
+{
+#if HAVE_MMAP && HAVE_MINCORE
+    struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+    size_t i, n, page = sysconf(_SC_PAGESIZE), pages = 0, resident = 0;
+    unsigned char *vec = NULL;
+
+    n = ecurve_sections((struct uproc_ecurve_s *)ecurve, sec);
+    for (i = 0; i < n; i++) {
+        uintptr_t start = (uintptr_t)*sec[i].ptr / page * page,
+                  end = (uintptr_t)*sec[i].ptr + sec[i].size;
+        size_t k, count = (end - start + page - 1) / page;
+        unsigned char *tmp;
+
+        if (!sec[i].size) {
+            continue;
+        }
+        tmp = realloc(vec, count);
+        if (!tmp) {
+            free(vec);
+            return -1.0;
+        }
+        vec = tmp;
+        if (mincore((void *)start, end - start, vec)) {
+            free(vec);
+            return -1.0;
+        }
+        for (k = 0; k < count; k++) {
+            resident += vec[k] & 1;
+        }
+        pages += count;
+    }
+    free(vec);
+    return pages ? 100.0 * resident / pages : 100.0;
+#else
+    (void)ecurve;
+    return 100.0;
+#endif
+}
 
 static uproc_ecurve *ecurve_map(const char *path)
 {
@@ -80,8 +350,13 @@ static uproc_ecurve *ecurve_map(const char *path)
     struct stat st;
     struct mmap_header *header;
     char alphabet_str[UPROC_ALPHABET_SIZE + 1];
-    struct uproc_ecurve_s *ec = malloc(sizeof *ec);
+    unsigned residency;
+    struct uproc_ecurve_s *ec;
 
+    if (ecurve_residency(&residency)) {
+        return NULL;
+    }
+    ec = malloc(sizeof *ec);
     if (!ec) {
         uproc_error(UPROC_ENOMEM);
         return NULL;
@@ -99,26 +374,31 @@ static uproc_ecurve *ecurve_map(const char *path)
         goto error_close;
     }
     ec->mmap_size = st.st_size;
-    ec->mmap_ptr =
-        mmap(NULL, ec->mmap_size, PROT_READ,
-             MAP_PRIVATE | MAP_NORESERVE | MAP_POPULATE, ec->mmap_fd, 0);
+    ec->mmap_ptr = mmap(NULL, ec->mmap_size, PROT_READ,
+                        MAP_PRIVATE | MAP_NORESERVE, ec->mmap_fd, 0);
 
     if (ec->mmap_ptr == MAP_FAILED) {
         uproc_error_msg(UPROC_ERRNO, "mmap failed");
         goto error_close;
     }
 
-#if HAVE_POSIX_MADVISE
-#ifdef POSIX_MADV_WILLNEED
-    posix_madvise(ec->mmap_ptr, ec->mmap_size, POSIX_MADV_WILLNEED);
-#endif
-#ifdef POSIX_MADV_RANDOM
+#if HAVE_POSIX_MADVISE && defined(POSIX_MADV_RANDOM)
     posix_madvise(ec->mmap_ptr, ec->mmap_size, POSIX_MADV_RANDOM);
 #endif
-#endif
+
+    if (ec->mmap_size >= sizeof ECURVE_FORMAT_MAGIC - 1 &&
+        !memcmp(ec->mmap_ptr, ECURVE_FORMAT_MAGIC,
+                sizeof ECURVE_FORMAT_MAGIC - 1)) {
+        if (ecurve_map_sections(ec)) {
+            goto error_munmap;
+        }
+        ecurve_residency_apply(ec, residency);
+        return ec;
+    }
 
     header = ec->mmap_ptr;
-    if (ec->mmap_size != SIZE_TOTAL(header->suffix_count)) {
+    if (ec->mmap_size < SIZE_HEADER ||
+        ec->mmap_size != SIZE_TOTAL(header->suffix_count)) {
         uproc_error(UPROC_EINVAL);
         goto error_munmap;
     }
@@ -142,6 +422,7 @@ static uproc_ecurve *ecurve_map(const char *path)
         uproc_error_msg(UPROC_EINVAL, "inconsistent magic number");
         goto error_munmap;
     }
+    ecurve_residency_apply(ec, residency);
     return ec;
 
 error_munmap:
@@ -193,14 +474,259 @@ uproc_ecurve *uproc_ecurve_mmapv(const char *pathfmt, va_list ap)
 
 void uproc_ecurve_munmap(struct uproc_ecurve_s *ecurve)
 {
-#if HAVE_MMAP && USE_MMAP
+#if PREFETCH_THREAD
+    prefetch_stop(ecurve);
+#endif
+#if HAVE_MMAP
     munmap(ecurve->mmap_ptr, ecurve->mmap_size);
-    close(ecurve->mmap_fd);
+    if (ecurve->mmap_fd > -1) {
+        close(ecurve->mmap_fd);
+    }
+#else
+    (void)ecurve;
+#endif
+}
+
+/* Size of a huge page; only the most common one is tried */
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+#define ALIGN(n, a) (((n) + (a)-1) / (a) * (a))
+
+static struct
+{
+    size_t size, huge, locked;
+} memory_totals;
+
+void ecurve_memory_totals(size_t *size, size_t *huge, size_t *locked)
+{
+    *size = memory_totals.size;
+    *huge = memory_totals.huge;
+    *locked = memory_totals.locked;
+}
+
+#if HAVE_MMAP
+/* Number of bytes of the mapping starting at `addr` that are backed by
+ * transparent huge pages */
+static size_t anon_huge_size(const void *addr)
+{
+    char line[256];
+    unsigned long start, end, kb;
+    bool found = false;
+    size_t size = 0;
+    FILE *f = fopen("/proc/self/smaps", "r");
+
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof line, f)) {
+        if (sscanf(line, "%lx-%lx", &start, &end) == 2) {
+            found = start == (uintptr_t)addr;
+        } else if (found && sscanf(line, "AnonHugePages: %lu", &kb) == 1) {
+            size = kb * 1024;
+            break;
+        }
+    }
+    fclose(f);
+    return size;
+}
+
+/* Map `size` bytes of anonymous memory aligned to a huge page boundary */
+static char *map_aligned(size_t size, size_t *map_size)
+{
+    char *p, *region;
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    /* over-allocate for the alignment and to keep an inaccessible page after
+     * the region, which prevents the kernel from merging it with adjacent
+     * mappings (so that its huge pages can be counted) */
+    *map_size = size + HUGE_PAGE_SIZE + page;
+    p = mmap(NULL, *map_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return p;
+    }
+    region = p + (HUGE_PAGE_SIZE - (uintptr_t)p % HUGE_PAGE_SIZE) %
+                     HUGE_PAGE_SIZE;
+    if (region > p) {
+        munmap(p, region - p);
+        *map_size -= region - p;
+    }
+    mprotect(region + size, *map_size - size, PROT_NONE);
+    return region;
+}
+#endif
+
+#if HAVE_MMAP
+/* Copy the arrays of `ecurve` to a new anonymous mapping as requested by
+ * `flags` and `node` and point `ecurve` to it. The old storage is released
+ * only if `release` is true. */
+static int place(struct uproc_ecurve_s *ecurve, unsigned flags, int node,
+                 bool release)
+{
+    struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+    size_t i, n, size = 0, map_size, huge = 0;
+    char *region = MAP_FAILED, *p;
+    unsigned obtained = 0;
+
+    n = ecurve_sections(ecurve, sec);
+    for (i = 0; i < n; i++) {
+        size += ALIGN(sec[i].size, ECURVE_CACHE_LINE);
+    }
+    /* hugetlbfs mappings must consist of whole huge pages */
+    size = ALIGN(size ? size : 1, HUGE_PAGE_SIZE);
+
+#ifdef MAP_HUGETLB
+    if (flags & UPROC_ECURVE_HUGETLB) {
+        region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (region != MAP_FAILED) {
+            obtained |= UPROC_ECURVE_HUGETLB;
+            map_size = size;
+            huge = size;
+        }
+    }
+#endif
+    if (region == MAP_FAILED) {
+        region = map_aligned(size, &map_size);
+        if (region == MAP_FAILED) {
+            return uproc_error_msg(UPROC_ERRNO, "mmap failed");
+        }
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+        if (flags & (UPROC_ECURVE_HUGEPAGES | UPROC_ECURVE_HUGETLB)) {
+            madvise(region, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    /* the policy applies to the pages faulted in by copying */
+    if (flags & UPROC_ECURVE_NUMA_INTERLEAVE) {
+        if (!numa_set_policy(region, size, -1)) {
+            obtained |= UPROC_ECURVE_NUMA_INTERLEAVE;
+        }
+    } else if (node > -1) {
+        numa_set_policy(region, size, node);
+    }
+
+    for (i = 0, p = region; i < n; i++) {
+        if (sec[i].size) {
+            memcpy(p, *sec[i].ptr, sec[i].size);
+        }
+        p += ALIGN(sec[i].size, ECURVE_CACHE_LINE);
+    }
+    if (release && ecurve->mmap_ptr) {
+        uproc_ecurve_munmap(ecurve);
+    } else if (release) {
+        for (i = 0; i < n; i++) {
+            free(*sec[i].ptr);
+        }
+    }
+    for (i = 0, p = region; i < n; i++) {
+        *sec[i].ptr = p;
+        p += ALIGN(sec[i].size, ECURVE_CACHE_LINE);
+    }
+    ecurve->mmap_fd = -1;
+    ecurve->mmap_ptr = region;
+    ecurve->mmap_size = map_size;
+    mprotect(region, size, PROT_READ);
+
+    if (!(obtained & UPROC_ECURVE_HUGETLB) &&
+        (flags & (UPROC_ECURVE_HUGEPAGES | UPROC_ECURVE_HUGETLB))) {
+        huge = anon_huge_size(region);
+        if (huge) {
+            obtained |= UPROC_ECURVE_HUGEPAGES;
+        }
+    }
+#if HAVE_MLOCK
+    if ((flags & UPROC_ECURVE_MLOCK) && !mlock(region, size)) {
+        obtained |= UPROC_ECURVE_MLOCK;
+        memory_totals.locked += size;
+    }
+#endif
+    memory_totals.size += size;
+    memory_totals.huge += huge;
+    ecurve->memory = obtained;
+    return obtained;
+}
+#endif
+
+int uproc_ecurve_place(uproc_ecurve *ecurve, unsigned flags)
+{
+    return uproc_ecurve_place_node(ecurve, flags, -1);
+}
+
+int uproc_ecurve_place_node(uproc_ecurve *ecurve, unsigned flags, int node)
+{
+    if (flags & ~UPROC_ECURVE_MEMORY_ALL) {
+        return uproc_error_msg(UPROC_EINVAL, "invalid memory flags");
+    }
+    if (!flags && node < 0) {
+        return 0;
+    }
+#if HAVE_MMAP
+    return place(ecurve, flags, node, true);
+#else
+    (void)ecurve;
+    return 0;
+#endif
+}
+
+uproc_ecurve *uproc_ecurve_replicate(const uproc_ecurve *ecurve,
+                                     unsigned flags, int node)
+{
+#if HAVE_MMAP
+    struct uproc_ecurve_s *ec;
+
+    if (flags & ~UPROC_ECURVE_MEMORY_ALL) {
+        uproc_error_msg(UPROC_EINVAL, "invalid memory flags");
+        return NULL;
+    }
+    ec = malloc(sizeof *ec);
+    if (!ec) {
+        uproc_error(UPROC_ENOMEM);
+        return NULL;
+    }
+    /* the copy starts out pointing to the arrays of `ecurve` */
+    *ec = *ecurve;
+    ec->prefetch = NULL;
+    ec->origin = ecurve_identity(ecurve);
+    ec->mmap_fd = -1;
+    ec->mmap_ptr = NULL;
+    ec->mmap_size = 0;
+    ec->alphabet = uproc_alphabet_create(uproc_alphabet_str(ecurve->alphabet));
+    if (!ec->alphabet) {
+        free(ec);
+        return NULL;
+    }
+    if (place(ec, flags, node, false) == -1) {
+        uproc_alphabet_destroy(ec->alphabet);
+        free(ec);
+        return NULL;
+    }
+    return ec;
 #else
     (void)ecurve;
+    (void)flags;
+    (void)node;
+    uproc_error(UPROC_ENOTSUP);
+    return NULL;
 #endif
 }
 
+#if HAVE_MMAP && USE_MMAP
+/* Write an ecurve in the sectioned format to the mapped `region` */
+static void store_sections(struct uproc_ecurve_s *ecurve, char *region)
+{
+    size_t i;
+    struct ecurve_format_header header;
+    struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+
+    ecurve_format_header(ecurve, &header, sec);
+    memcpy(region, &header, sizeof header);
+    for (i = 0; i < header.section_count; i++) {
+        memcpy(region + header.sections[i].offset, *sec[i].ptr, sec[i].size);
+    }
+}
+#endif
+
 static int mmap_store(const struct uproc_ecurve_s *ecurve, const char *path)
 {
 #if HAVE_MMAP && USE_MMAP
@@ -208,8 +734,18 @@ static int mmap_store(const struct uproc_ecurve_s *ecurve, const char *path)
     size_t size;
     char *region;
     struct mmap_header header;
-
-    size = SIZE_TOTAL(ecurve->suffix_count);
+    /* the default layout is stored in the traditional format, which older
+     * versions can read */
+    bool sectioned = ecurve->layout != UPROC_ECURVE_LAYOUT_DEFAULT;
+
+    if (sectioned) {
+        struct ecurve_format_header h;
+        struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+        ecurve_format_header((struct uproc_ecurve_s *)ecurve, &h, sec);
+        size = ecurve_format_check(&h);
+    } else {
+        size = SIZE_TOTAL(ecurve->suffix_count);
+    }
 
     fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
     if (fd == -1) {
@@ -227,6 +763,13 @@ static int mmap_store(const struct uproc_ecurve_s *ecurve, const char *path)
         goto error_close;
     }
 
+    if (sectioned) {
+        store_sections((struct uproc_ecurve_s *)ecurve, region);
+        munmap(region, size);
+        close(fd);
+        return 0;
+    }
+
     header.suffix_count = ecurve->suffix_count;
     memcpy(&header.alphabet_str, uproc_alphabet_str(ecurve->alphabet),
            UPROC_ALPHABET_SIZE);
@@ -22,11 +22,17 @@
 #include <config.h>
 #endif
 
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <string.h>
 #include <stdarg.h>
+#include <time.h>
+
+#if _OPENMP
+#include <omp.h>
+#endif
 
 #include "uproc/common.h"
 #include "uproc/error.h"
@@ -50,6 +56,20 @@
 #define SUFFIX_PRI "%." STR(UPROC_SUFFIX_LEN) "s %" UPROC_FAMILY_PRI "\n"
 #define SUFFIX_SCN "%" STR(UPROC_SUFFIX_LEN) "c %" UPROC_FAMILY_SCN
 
+/* Bytes of ecurves loaded from streams and the time it took (summed over
+ * concurrent loads) */
+static struct
+{
+    size_t bytes;
+    double seconds;
+} load_totals;
+
+void ecurve_load_totals(size_t *bytes, double *seconds)
+{
+    *bytes = load_totals.bytes;
+    *seconds = load_totals.seconds;
+}
+
 static int read_line(uproc_io_stream *stream, char *line, size_t n)
 {
     do {
@@ -231,7 +251,8 @@ static int store_plain(const struct uproc_ecurve_s *ecurve,
                        uproc_io_stream *stream, void (*progress)(double))
 {
     int res;
-    size_t p;
+    size_t iter = 0, first, suffix_count;
+    uproc_prefix p;
 
     res = store_header(stream, uproc_alphabet_str(ecurve->alphabet));
 
@@ -239,23 +260,16 @@ static int store_plain(const struct uproc_ecurve_s *ecurve,
         return res;
     }
 
-    for (p = 0; p <= UPROC_PREFIX_MAX; p++) {
-        pfxtab_count suffix_count = ecurve->prefixes[p].count;
-        pfxtab_suffix first = ecurve->prefixes[p].first;
-
-        if (!suffix_count || ECURVE_ISEDGE(ecurve->prefixes[p])) {
-            continue;
-        }
-
+    while (!ecurve_next_prefix(ecurve, &iter, &p, &first, &suffix_count)) {
         res = store_prefix(stream, ecurve->alphabet, p);
         if (res) {
             return res;
         }
 
-        for (pfxtab_count i = 0; i < suffix_count; i++) {
+        for (size_t i = 0; i < suffix_count; i++) {
             res = store_suffix(stream, ecurve->alphabet,
-                               ecurve->suffixes[first + i],
-                               ecurve->families[first + i]);
+                               ecurve_suffix(ecurve, first + i),
+                               ecurve_family(ecurve, first + i));
             if (res) {
                 return res;
             }
@@ -271,7 +285,386 @@ static int store_plain(const struct uproc_ecurve_s *ecurve,
     return 0;
 }
 
+static size_t align_offset(size_t offset)
+{
+    return (offset + ECURVE_FORMAT_ALIGN - 1) / ECURVE_FORMAT_ALIGN *
+           ECURVE_FORMAT_ALIGN;
+}
+
+void ecurve_format_header(struct uproc_ecurve_s *ecurve,
+                          struct ecurve_format_header *header,
+                          struct ecurve_section *sections)
+{
+    size_t i, n, offset = sizeof *header;
+
+    n = ecurve_sections(ecurve, sections);
+    memset(header, 0, sizeof *header);
+    memcpy(header->magic, ECURVE_FORMAT_MAGIC, sizeof header->magic);
+    header->version = ECURVE_FORMAT_VERSION;
+    header->byte_order = ECURVE_FORMAT_BYTE_ORDER;
+    memcpy(header->alphabet, uproc_alphabet_str(ecurve->alphabet),
+           UPROC_ALPHABET_SIZE);
+    header->layout = ecurve->layout;
+    header->suffix_count = ecurve->suffix_count;
+    header->section_count = n;
+    for (i = 0; i < n; i++) {
+        offset = align_offset(offset);
+        header->sections[i].id = sections[i].id;
+        header->sections[i].offset = offset;
+        header->sections[i].size = sections[i].size;
+        offset += sections[i].size;
+    }
+}
+
+size_t ecurve_format_check(const struct ecurve_format_header *header)
+{
+    size_t i, end = sizeof *header;
+
+    if (memcmp(header->magic, ECURVE_FORMAT_MAGIC, sizeof header->magic)) {
+        uproc_error_msg(UPROC_EINVAL, "not an ecurve file");
+        return 0;
+    }
+    if (header->version != ECURVE_FORMAT_VERSION) {
+        uproc_error_msg(UPROC_EINVAL, "unsupported ecurve format version %lu",
+                        (unsigned long)header->version);
+        return 0;
+    }
+    if (header->byte_order != ECURVE_FORMAT_BYTE_ORDER) {
+        uproc_error_msg(UPROC_EINVAL, "ecurve was stored on an incompatible "
+                                      "machine");
+        return 0;
+    }
+    if (header->layout & ~UPROC_ECURVE_LAYOUT_ALL) {
+        uproc_error_msg(UPROC_EINVAL, "unsupported ecurve layout");
+        return 0;
+    }
+    if (header->section_count > ECURVE_SECTIONS_MAX) {
+        uproc_error_msg(UPROC_EINVAL, "invalid ecurve header");
+        return 0;
+    }
+    /* sections are stored in order, don't overlap and their end fits into
+     * a size_t */
+    for (i = 0; i < header->section_count; i++) {
+        uint64_t offset = header->sections[i].offset,
+                 sec_size = header->sections[i].size;
+        if (offset < end || offset % ECURVE_FORMAT_ALIGN ||
+            offset > SIZE_MAX || sec_size > SIZE_MAX - offset) {
+            uproc_error_msg(UPROC_EINVAL, "invalid ecurve header");
+            return 0;
+        }
+        end = offset + sec_size;
+    }
+    return end;
+}
+
 #if !(HAVE_MMAP && USE_MMAP)
+/* uproc_io_read()/uproc_io_write() in chunks that gzread()/gzwrite() can
+ * handle in one call */
+#define IO_CHUNK (1 << 24)
+
+static int read_bytes(uproc_io_stream *stream, void *ptr, size_t n)
+{
+    char *p = ptr;
+    while (n) {
+        size_t sz = n < IO_CHUNK ? n : IO_CHUNK;
+        if (uproc_io_read(p, sz, 1, stream) != 1) {
+            return uproc_error_msg(UPROC_EIO, "unexpected end of ecurve");
+        }
+        p += sz;
+        n -= sz;
+    }
+    return 0;
+}
+
+static int write_bytes(uproc_io_stream *stream, const void *ptr, size_t n)
+{
+    const char *p = ptr;
+    while (n) {
+        size_t sz = n < IO_CHUNK ? n : IO_CHUNK;
+        if (uproc_io_write(p, sz, 1, stream) != 1) {
+            return uproc_error(UPROC_ERRNO);
+        }
+        p += sz;
+        n -= sz;
+    }
+    return 0;
+}
+
+static double now(void)
+{
+#if HAVE_CLOCK_GETTIME
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+#else
+    return (double)time(NULL);
+#endif
+}
+
+static void load_account(const struct uproc_ecurve_s *ecurve, double start)
+{
+    struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+    size_t bytes = 0, n = ecurve_sections((struct uproc_ecurve_s *)ecurve, sec);
+    for (size_t i = 0; i < n; i++) {
+        bytes += sec[i].size;
+    }
+    /* uproc_database_loadp() loads both ecurves concurrently */
+#pragma omp critical(ecurve_load_totals)
+    {
+        load_totals.bytes += bytes;
+        load_totals.seconds += now() - start;
+    }
+}
+
+/* Size of a prefix table entry in the traditional binary format */
+#define PFX_RECORD_SIZE (sizeof(pfxtab_suffix) + sizeof(pfxtab_count))
+
+/* Size of the blocks in which the arrays of an ecurve are read and written,
+ * a multiple of PFX_RECORD_SIZE */
+#define IO_BLOCK (PFX_RECORD_SIZE << 17)
+
+/* Convert between `n` bytes of the stored format at `offset` and the array */
+typedef void block_convert(void *array, void *stored, size_t offset, size_t n);
+
+static void fill_copy(void *array, void *stored, size_t offset, size_t n)
+{
+    memcpy((char *)array + offset, stored, n);
+}
+
+static void fill_prefixes(void *array, void *stored, size_t offset, size_t n)
+{
+    struct uproc_ecurve_pfxtable *p = array;
+    const char *s = stored;
+    p += offset / PFX_RECORD_SIZE;
+    for (size_t i = 0; i < n / PFX_RECORD_SIZE; i++) {
+        memcpy(&p[i].first, s, sizeof p[i].first);
+        memcpy(&p[i].count, s + sizeof p[i].first, sizeof p[i].count);
+        s += PFX_RECORD_SIZE;
+    }
+}
+
+static void pack_prefixes(void *array, void *stored, size_t offset, size_t n)
+{
+    const struct uproc_ecurve_pfxtable *p = array;
+    char *s = stored;
+    p += offset / PFX_RECORD_SIZE;
+    for (size_t i = 0; i < n / PFX_RECORD_SIZE; i++) {
+        memcpy(s, &p[i].first, sizeof p[i].first);
+        memcpy(s + sizeof p[i].first, &p[i].count, sizeof p[i].count);
+        s += PFX_RECORD_SIZE;
+    }
+}
+
+/* Whether a second thread is available to overlap (de)compression with
+ * converting the previous or next block */
+static bool io_pipelined(void)
+{
+#if _OPENMP
+    return omp_get_num_procs() > 1;
+#else
+    return false;
+#endif
+}
+
+/* Read `n` stored bytes into `array`, converting them with `fill`
+ *
+ * Stored bytes are decompressed into a double buffer: while one thread
+ * inflates the next block, another one fills the current block into the
+ * array (taking the page faults of the freshly allocated memory). */
+static int read_blocks(uproc_io_stream *stream, void *array, size_t n,
+                       block_convert *fill, void (*progress)(double),
+                       double p0, double p1)
+{
+    bool pipelined = io_pipelined();
+    size_t n_blocks = (n + IO_BLOCK - 1) / IO_BLOCK, got[2] = {0};
+    char *buf;
+
+    if (fill == fill_copy && !pipelined) {
+        int res = read_bytes(stream, array, n);
+        if (!res && progress) {
+            progress(p1);
+        }
+        return res;
+    }
+    buf = malloc(2 * IO_BLOCK);
+    if (!buf) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+#define BLOCK_SIZE(i) ((i) + 1 < n_blocks ? IO_BLOCK : n - (i)*IO_BLOCK)
+    if (n_blocks) {
+        got[0] = uproc_io_read(buf, 1, BLOCK_SIZE(0), stream);
+    }
+    for (size_t i = 0; i < n_blocks; i++) {
+        char *cur = buf + i % 2 * IO_BLOCK, *next = buf + (i + 1) % 2 * IO_BLOCK;
+        if (got[i % 2] != BLOCK_SIZE(i)) {
+            free(buf);
+            return uproc_error_msg(UPROC_EIO, "unexpected end of ecurve");
+        }
+#pragma omp parallel sections num_threads(2) if (pipelined)
+        {
+#pragma omp section
+            if (i + 1 < n_blocks) {
+                got[(i + 1) % 2] =
+                    uproc_io_read(next, 1, BLOCK_SIZE(i + 1), stream);
+            }
+#pragma omp section
+            fill(array, cur, i * IO_BLOCK, BLOCK_SIZE(i));
+        }
+        if (progress) {
+            progress(p0 + (p1 - p0) * (i + 1) / n_blocks);
+        }
+    }
+    free(buf);
+    return 0;
+}
+
+/* Write `n` stored bytes of `array`, converted with `pack`
+ *
+ * The next block is packed while the current one is being compressed. */
+static int write_blocks(uproc_io_stream *stream, void *array, size_t n,
+                        block_convert *pack, void (*progress)(double),
+                        double p0, double p1)
+{
+    size_t n_blocks = (n + IO_BLOCK - 1) / IO_BLOCK, written = 0;
+    char *buf;
+
+    if (!pack) {
+        int res = write_bytes(stream, array, n);
+        if (!res && progress) {
+            progress(p1);
+        }
+        return res;
+    }
+    buf = malloc(2 * IO_BLOCK);
+    if (!buf) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    if (n_blocks) {
+        pack(array, buf, 0, BLOCK_SIZE(0));
+    }
+    for (size_t i = 0; i < n_blocks; i++) {
+        char *cur = buf + i % 2 * IO_BLOCK, *next = buf + (i + 1) % 2 * IO_BLOCK;
+#pragma omp parallel sections num_threads(2) if (io_pipelined())
+        {
+#pragma omp section
+            written = uproc_io_write(cur, 1, BLOCK_SIZE(i), stream);
+#pragma omp section
+            if (i + 1 < n_blocks) {
+                pack(array, next, (i + 1) * IO_BLOCK, BLOCK_SIZE(i + 1));
+            }
+        }
+        if (written != BLOCK_SIZE(i)) {
+            free(buf);
+            return uproc_error(UPROC_ERRNO);
+        }
+        if (progress) {
+            progress(p0 + (p1 - p0) * (i + 1) / n_blocks);
+        }
+    }
+#undef BLOCK_SIZE
+    free(buf);
+    return 0;
+}
+
+/* Load the sectioned format; the magic number has already been read */
+static uproc_ecurve *load_sections(uproc_io_stream *stream,
+                                   void (*progress)(double))
+{
+    size_t i, n, offset;
+    struct ecurve_format_header header;
+    struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+    void *data[ECURVE_SECTIONS_MAX] = {0};
+    char alpha[UPROC_ALPHABET_SIZE + 1];
+    struct uproc_ecurve_s *ecurve;
+    char pad[ECURVE_FORMAT_ALIGN];
+
+    memcpy(header.magic, ECURVE_FORMAT_MAGIC, sizeof header.magic);
+    if (read_bytes(stream, (char *)&header + sizeof header.magic,
+                   sizeof header - sizeof header.magic) ||
+        !ecurve_format_check(&header)) {
+        return NULL;
+    }
+
+    memcpy(alpha, header.alphabet, UPROC_ALPHABET_SIZE);
+    alpha[UPROC_ALPHABET_SIZE] = '\0';
+    ecurve = uproc_ecurve_create(alpha, 0);
+    if (!ecurve) {
+        return NULL;
+    }
+    free(ecurve->prefixes);
+    ecurve->prefixes = NULL;
+    ecurve->layout = header.layout;
+    ecurve->suffix_count = header.suffix_count;
+
+    n = header.section_count;
+    offset = sizeof header;
+    for (i = 0; i < n; i++) {
+        sec[i].id = header.sections[i].id;
+        sec[i].size = header.sections[i].size;
+        sec[i].ptr = &data[i];
+        data[i] = ecurve_alloc(sec[i].size ? sec[i].size : 1);
+        if (!data[i]) {
+            uproc_error(UPROC_ENOMEM);
+            goto error;
+        }
+        if (read_bytes(stream, pad, header.sections[i].offset - offset) ||
+            read_blocks(stream, data[i], sec[i].size, fill_copy, progress,
+                        100.0 * i / n, 100.0 * (i + 1) / n)) {
+            goto error;
+        }
+        offset = header.sections[i].offset + sec[i].size;
+    }
+    if (ecurve_attach_sections(ecurve, sec, n)) {
+        goto error;
+    }
+    /* free the sections that weren't attached */
+    for (i = 0; i < n; i++) {
+        struct ecurve_section attached[ECURVE_SECTIONS_MAX];
+        size_t k, n_attached = ecurve_sections(ecurve, attached);
+        for (k = 0; k < n_attached && *attached[k].ptr != data[i]; k++) {
+            ;
+        }
+        if (k == n_attached) {
+            free(data[i]);
+        }
+    }
+    return ecurve;
+
+error:
+    for (i = 0; i < n; i++) {
+        free(data[i]);
+    }
+    *ecurve = (struct uproc_ecurve_s){.alphabet = ecurve->alphabet,
+                                      .mmap_fd = -1};
+    uproc_ecurve_destroy(ecurve);
+    return NULL;
+}
+
+static int store_sections(struct uproc_ecurve_s *ecurve,
+                          uproc_io_stream *stream, void (*progress)(double))
+{
+    int res;
+    size_t i, offset;
+    struct ecurve_format_header header;
+    struct ecurve_section sec[ECURVE_SECTIONS_MAX];
+    static const char pad[ECURVE_FORMAT_ALIGN];
+
+    ecurve_format_header(ecurve, &header, sec);
+    res = write_bytes(stream, &header, sizeof header);
+    offset = sizeof header;
+    for (i = 0; !res && i < header.section_count; i++) {
+        res = write_bytes(stream, pad, header.sections[i].offset - offset);
+        if (!res) {
+            res = write_bytes(stream, *sec[i].ptr, sec[i].size);
+        }
+        offset = header.sections[i].offset + sec[i].size;
+        if (progress) {
+            progress(100.0 * (i + 1) / header.section_count);
+        }
+    }
+    return res;
+}
+
 static uproc_ecurve *load_binary(uproc_io_stream *stream,
                                  void (*progress)(double))
 {
@@ -279,8 +672,21 @@ static uproc_ecurve *load_binary(uproc_io_stream *stream,
     size_t sz;
     size_t suffix_count;
     char alpha[UPROC_ALPHABET_SIZE + 1];
+    block_convert *fill_pfx = sizeof *ecurve->prefixes == PFX_RECORD_SIZE
+                                  ? fill_copy
+                                  : fill_prefixes;
 
-    sz = uproc_io_read(alpha, sizeof *alpha, UPROC_ALPHABET_SIZE, stream);
+    /* the traditional format starts with the alphabet string */
+    sz = uproc_io_read(alpha, 1, sizeof ECURVE_FORMAT_MAGIC - 1, stream);
+    if (sz != sizeof ECURVE_FORMAT_MAGIC - 1) {
+        uproc_error(UPROC_ERRNO);
+        return NULL;
+    }
+    if (!memcmp(alpha, ECURVE_FORMAT_MAGIC, sz)) {
+        return load_sections(stream, progress);
+    }
+    sz += uproc_io_read(alpha + sz, sizeof *alpha, UPROC_ALPHABET_SIZE - sz,
+                        stream);
     if (sz != UPROC_ALPHABET_SIZE) {
         uproc_error(UPROC_ERRNO);
         return NULL;
@@ -301,52 +707,35 @@ static uproc_ecurve *load_binary(uproc_io_stream *stream,
         return NULL;
     }
 
-    sz = uproc_io_read(ecurve->suffixes, sizeof *ecurve->suffixes, suffix_count,
-                       stream);
-    if (sz != suffix_count) {
-        goto error;
-    }
-    if (progress) {
-        progress(25.0);
-    }
-    sz = uproc_io_read(ecurve->families, sizeof *ecurve->families, suffix_count,
-                       stream);
-    if (sz != suffix_count) {
-        goto error;
-    }
-    if (progress) {
-        progress(50.0);
-    }
-
-    for (uproc_prefix i = 0; i <= UPROC_PREFIX_MAX; i++) {
-        sz = uproc_io_read(&ecurve->prefixes[i].first,
-                           sizeof ecurve->prefixes[i].first, 1, stream);
-        if (sz != 1) {
-            goto error;
-        }
-        sz = uproc_io_read(&ecurve->prefixes[i].count,
-                           sizeof ecurve->prefixes[i].count, 1, stream);
-        if (sz != 1) {
-            goto error;
-        }
-        if (progress) {
-            progress(50.0 + 50.0 / UPROC_PREFIX_MAX * i);
-        }
+    if (read_blocks(stream, ecurve->suffixes,
+                    suffix_count * sizeof *ecurve->suffixes, fill_copy,
+                    progress, 0.1, 25.0) ||
+        read_blocks(stream, ecurve->families,
+                    suffix_count * sizeof *ecurve->families, fill_copy,
+                    progress, 25.0, 50.0) ||
+        read_blocks(stream, ecurve->prefixes,
+                    (UPROC_PREFIX_MAX + 1) * PFX_RECORD_SIZE, fill_pfx,
+                    progress, 50.0, 100.0)) {
+        uproc_ecurve_destroy(ecurve);
+        return NULL;
     }
     if (progress) {
         progress(100.0);
     }
     return ecurve;
-error:
-    uproc_error(UPROC_ERRNO);
-    uproc_ecurve_destroy(ecurve);
-    return NULL;
 }
 
 static int store_binary(const struct uproc_ecurve_s *ecurve,
                         uproc_io_stream *stream, void (*progress)(double))
 {
     size_t sz;
+    block_convert *pack_pfx =
+        sizeof *ecurve->prefixes == PFX_RECORD_SIZE ? NULL : pack_prefixes;
+
+    if (ecurve->layout != UPROC_ECURVE_LAYOUT_DEFAULT) {
+        return store_sections((struct uproc_ecurve_s *)ecurve, stream,
+                              progress);
+    }
     sz = uproc_io_write(uproc_alphabet_str(ecurve->alphabet), 1,
                         UPROC_ALPHABET_SIZE, stream);
     if (sz != UPROC_ALPHABET_SIZE) {
@@ -361,37 +750,16 @@ static int store_binary(const struct uproc_ecurve_s *ecurve,
         progress(0.1);
     }
 
-    sz = uproc_io_write(ecurve->suffixes, sizeof *ecurve->suffixes,
-                        ecurve->suffix_count, stream);
-    if (sz != ecurve->suffix_count) {
-        return uproc_error(UPROC_ERRNO);
-    }
-    if (progress) {
-        progress(25.0);
-    }
-    sz = uproc_io_write(ecurve->families, sizeof *ecurve->families,
-                        ecurve->suffix_count, stream);
-    if (sz != ecurve->suffix_count) {
-        return uproc_error(UPROC_ERRNO);
-    }
-    if (progress) {
-        progress(50.0);
-    }
-
-    for (uproc_prefix i = 0; i <= UPROC_PREFIX_MAX; i++) {
-        sz = uproc_io_write(&ecurve->prefixes[i].first,
-                            sizeof ecurve->prefixes[i].first, 1, stream);
-        if (sz != 1) {
-            return uproc_error(UPROC_ERRNO);
-        }
-        sz = uproc_io_write(&ecurve->prefixes[i].count,
-                            sizeof ecurve->prefixes[i].count, 1, stream);
-        if (sz != 1) {
-            return uproc_error(UPROC_ERRNO);
-        }
-        if (progress) {
-            progress(50.0 + 50.0 / UPROC_PREFIX_MAX * i);
-        }
+    if (write_blocks(stream, ecurve->suffixes,
+                     ecurve->suffix_count * sizeof *ecurve->suffixes, NULL,
+                     progress, 0.1, 25.0) ||
+        write_blocks(stream, ecurve->families,
+                     ecurve->suffix_count * sizeof *ecurve->families, NULL,
+                     progress, 25.0, 50.0) ||
+        write_blocks(stream, ecurve->prefixes,
+                     (UPROC_PREFIX_MAX + 1) * PFX_RECORD_SIZE, pack_pfx,
+                     progress, 50.0, 100.0)) {
+        return -1;
     }
     if (progress) {
         progress(100.0);
@@ -416,7 +784,12 @@ uproc_ecurve *uproc_ecurve_loadps(enum uproc_ecurve_format format,
         uproc_error_msg(UPROC_EINVAL, "can't load mmap format from stream");
         return NULL;
 #else
-        return load_binary(stream, progress);
+        double start = now();
+        struct uproc_ecurve_s *ecurve = load_binary(stream, progress);
+        if (ecurve) {
+            load_account(ecurve, start);
+        }
+        return ecurve;
 #endif
     }
     return load_plain(stream, progress);
@@ -29,11 +29,18 @@
 
 #include "uproc/error.h"
 
+#include "error_internal.h"
+
+#ifdef THREAD_LOCAL
+static THREAD_LOCAL int error_num;
+static THREAD_LOCAL char error_loc[ERROR_STR_SIZE], error_msg[ERROR_STR_SIZE];
+#else
 static int error_num;
-static char error_loc[256], error_msg[256];
+static char error_loc[ERROR_STR_SIZE], error_msg[ERROR_STR_SIZE];
 #if _OPENMP
 #pragma omp threadprivate(error_num, error_loc, error_msg)
 #endif
+#endif
 
 static uproc_error_handler *error_handler = NULL;
 static void *error_context = NULL;
@@ -107,6 +114,20 @@ const char *uproc_error_errloc_(void)
     return error_loc;
 }
 
+void error_save(struct error_state *e)
+{
+    e->num = error_num;
+    memcpy(e->loc, error_loc, sizeof e->loc);
+    memcpy(e->msg, error_msg, sizeof e->msg);
+}
+
+void error_restore(const struct error_state *e)
+{
+    error_num = e->num;
+    memcpy(error_loc, e->loc, sizeof error_loc);
+    memcpy(error_msg, e->msg, sizeof error_msg);
+}
+
 void uproc_error_set_handler(uproc_error_handler *handler, void *context)
 {
     error_handler = handler;
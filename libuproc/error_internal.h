@@ -0,0 +1,28 @@
+#ifndef UPROC_ERROR_INTERNAL_H
+#define UPROC_ERROR_INTERNAL_H
+
+#include "uproc/error.h"
+
+#define ERROR_STR_SIZE 256
+
+/** Error state of a thread, see error_save() */
+struct error_state
+{
+    int num;
+    char loc[ERROR_STR_SIZE], msg[ERROR_STR_SIZE];
+};
+
+/** Copy the error state of the calling thread to `e`
+ *
+ * The error state is thread-local; this and error_restore() hand an error
+ * from a worker thread to the thread that started it.
+ */
+void error_save(struct error_state *e);
+
+/** Make `e` the error state of the calling thread
+ *
+ * The error handler is not invoked again.
+ */
+void error_restore(const struct error_state *e);
+
+#endif
@@ -23,12 +23,18 @@
 #endif
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
 #if HAVE_ZLIB_H
 #include <zlib.h>
 #endif
 
+#include "uproc/ecurve.h"
 #include "uproc/features.h"
+#include "uproc/numa.h"
+
+#include "ecurve_internal.h"
 
 void uproc_features_print(uproc_io_stream *stream)
 {
@@ -37,6 +43,24 @@ void uproc_features_print(uproc_io_stream *stream)
     uproc_io_printf(stream, "OpenMP: %d\n", uproc_features_openmp());
     uproc_io_printf(stream, "mmap:   %s\n",
                     uproc_features_mmap() ? "yes" : "no");
+    uproc_io_printf(stream, "THP:    %s\n", uproc_features_hugepages());
+    uproc_io_printf(stream, "NUMA:   %d node(s)\n", uproc_numa_nodes());
+
+    size_t size, huge, locked;
+    ecurve_memory_totals(&size, &huge, &locked);
+    if (size) {
+        uproc_io_printf(stream,
+                        "ecurve memory: %zu MB, %zu MB huge pages, "
+                        "%zu MB locked\n",
+                        size >> 20, huge >> 20, locked >> 20);
+    }
+
+    double seconds;
+    ecurve_load_totals(&size, &seconds);
+    if (size) {
+        uproc_io_printf(stream, "ecurve load:   %zu MB in %.2f s\n",
+                        size >> 20, seconds);
+    }
 }
 
 const char *uproc_features_version(void)
@@ -67,6 +91,25 @@ bool uproc_features_mmap(void)
 #endif
 }
 
+const char *uproc_features_hugepages(void)
+{
+    static char mode[16] = "no";
+    char line[128], *start, *end;
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+
+    if (!f) {
+        return mode;
+    }
+    /* the active mode is enclosed in brackets, e.g. "always [madvise] never" */
+    if (fgets(line, sizeof line, f) && (start = strchr(line, '[')) &&
+        (end = strchr(start, ']')) && end - start - 1 < (int)sizeof mode) {
+        memcpy(mode, start + 1, end - start - 1);
+        mode[end - start - 1] = '\0';
+    }
+    fclose(f);
+    return mode;
+}
+
 int uproc_features_openmp(void)
 {
 #if _OPENMP
@@ -29,6 +29,8 @@
 #include "uproc/io.h"
 #include "uproc/error.h"
 
+#include "idmap_internal.h"
+
 struct uproc_idmap_s
 {
     uproc_family n;
@@ -80,6 +82,26 @@ uproc_family uproc_idmap_family(uproc_idmap *map, const char *s)
     return i;
 }
 
+int idmap_append(uproc_idmap *map, const char *s)
+{
+    size_t len = strlen(s);
+    if (map->n == UPROC_FAMILY_MAX) {
+        return uproc_error_msg(UPROC_ENOENT, "idmap exhausted");
+    }
+    map->s[map->n] = malloc(len + 1);
+    if (!map->s[map->n]) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    memcpy(map->s[map->n], s, len + 1);
+    map->n += 1;
+    return 0;
+}
+
+uproc_family idmap_size(const uproc_idmap *map)
+{
+    return map->n;
+}
+
 char *uproc_idmap_str(const uproc_idmap *map, uproc_family family)
 {
     return map->s[family];
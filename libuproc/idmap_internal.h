@@ -0,0 +1,16 @@
+#ifndef UPROC_IDMAP_INTERNAL_H
+#define UPROC_IDMAP_INTERNAL_H
+
+#include "uproc/idmap.h"
+
+/** Append `s` as the next family without checking for duplicates
+ *
+ * For building an idmap from a source that is known to be consistent, where
+ * the linear search of uproc_idmap_family() would dominate.
+ */
+int idmap_append(uproc_idmap *map, const char *s);
+
+/** Number of families in `map` */
+uproc_family idmap_size(const uproc_idmap *map);
+
+#endif
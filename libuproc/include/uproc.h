@@ -147,6 +147,9 @@
  *
  *   \defgroup grp_datastructs_idmap ID map
  *     <!-- idmap.h -->
+ *
+ *   \defgroup grp_datastructs_wordcache Word lookup cache
+ *     <!-- wordcache.h -->
  * \}
  *
  * \defgroup grp_intern Lower-level modules
@@ -184,11 +187,13 @@
 #include <uproc/io.h>
 #include <uproc/list.h>
 #include <uproc/matrix.h>
+#include <uproc/numa.h>
 #include <uproc/orf.h>
 #include <uproc/protclass.h>
 #include <uproc/substmat.h>
 #include <uproc/seqio.h>
 #include <uproc/word.h>
+#include <uproc/wordcache.h>
 #include <uproc/model.h>
 #include <uproc/database.h>
 
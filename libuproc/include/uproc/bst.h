@@ -120,6 +120,14 @@ uproc_bst *uproc_bst_create(enum uproc_bst_keytype key_type, size_t value_size);
 /** Destroy BST and all contained nodes */
 void uproc_bst_destroy(uproc_bst *t);
 
+/** Remove all items
+ *
+ * The nodes are kept and reused by subsequent insertions, so a tree that is
+ * cleared and refilled with a similar number of items does not allocate any
+ * memory.
+ */
+void uproc_bst_clear(uproc_bst *t);
+
 /** Return non-zero if the tree is empty */
 int uproc_bst_isempty(uproc_bst *t);
 
@@ -52,16 +52,71 @@ typedef struct uproc_database_s uproc_database;
   * Loads all required data of a UProC database from files in the given
   *directory and returns a database object.
   *
-  * \param path an existing directory containing a UProC database.
+  * \param path an existing directory containing a UProC database, or a
+  *database bundle created by uproc_database_bundle().
   * \param prot_thres_level the protein threshold to be used. Note that the
   *corresponding file "prot_thresh_e%d" has to exist in the directory.
-  * \param format the format of the ecurves
+  * \param format the format of the ecurves (ignored for bundles)
   *
   * \returns the object on success or %NULL on error
   */
 uproc_database *uproc_database_load(const char *path, int prot_thresh_level,
                                     enum uproc_ecurve_format format);
 
+/**
+  * Like uproc_database_load(), but moves the ecurves to memory with the given
+  * properties using uproc_ecurve_place().
+  *
+  * uproc_database_load() takes these flags from the environment variable
+  * \c UPROC_MEMORY (see uproc_ecurve_memory_parse()), e.g.
+  * "UPROC_MEMORY=hugepages,mlock".
+  *
+  * \param memory bitwise OR of ::uproc_ecurve_memory flags
+  */
+uproc_database *uproc_database_load_memory(const char *path,
+                                           int prot_thresh_level,
+                                           enum uproc_ecurve_format format,
+                                           unsigned memory);
+
+/**
+  * Like uproc_database_load_memory(), with progress reporting.
+  *
+  * The ecurves, the ID map and the protein thresholds are loaded
+  *concurrently if OpenMP is enabled and more than one processor is available,
+  *so loading takes about as long as loading the larger ecurve.
+  *
+  * \param progress called with the combined progress of both ecurves in
+  *percent, from the loading threads but never concurrently; may be %NULL
+  */
+uproc_database *uproc_database_loadp(const char *path, int prot_thresh_level,
+                                     enum uproc_ecurve_format format,
+                                     unsigned memory,
+                                     void (*progress)(double));
+
+/** Flags for uproc_database_bundle() */
+enum uproc_database_bundle_flags {
+    /** Store a checksum of each section, which is verified on every load */
+    UPROC_DATABASE_BUNDLE_CHECKSUMS = 1 << 0,
+};
+
+/**
+  * Writes the database in directory \c dir (with ecurves in binary format)
+  *to the single file \c path.
+  *
+  * The file can be passed to uproc_database_load() instead of the directory.
+  *It contains both ecurves in a form that can be mapped into memory as a
+  *whole, so that loading it involves no parsing or copying of the large
+  *arrays. The ID map, both protein threshold matrices and "info.txt" (if it
+  *exists) are included.
+  *
+  * Bundles can only be loaded on hosts with the same byte order.
+  *
+  * \param flags bitwise OR of ::uproc_database_bundle_flags
+  *
+  * \returns 0 on success or -1 on error
+  */
+int uproc_database_bundle(const char *dir, const char *path, unsigned flags);
+
 /**
   * Returns the forward matching ecurve of the database. Note that the returned
   *object will
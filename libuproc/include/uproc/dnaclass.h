@@ -79,12 +79,16 @@ struct uproc_dnaresult
 
     /** ORF from which the prediction was made */
     struct uproc_orf orf;
+
+    /** Size of the buffer holding \c orf.data if a classifier allocated it,
+     * otherwise 0 (must be reset to 0 if \c orf.data is replaced) */
+    size_t orf_alloc;
 };
 
 /** Initializer for ::uproc_dnaresult structs */
-#define UPROC_DNARESULT_INITIALIZER \
-    {                               \
-        0, 0, UPROC_ORF_INITIALIZER \
+#define UPROC_DNARESULT_INITIALIZER    \
+    {                                  \
+        0, 0, UPROC_ORF_INITIALIZER, 0 \
     }
 
 /** Initialize a ::uproc_dnaresult struct */
@@ -170,6 +174,42 @@ void uproc_dnaclass_destroy(uproc_dnaclass *dc);
  */
 int uproc_dnaclass_classify(const uproc_dnaclass *dc, const char *seq,
                             uproc_list **results);
+
+/** Classify DNA sequence using a workspace
+ *
+ * Like uproc_dnaclass_classify(), but takes its scratch memory from \c ws
+ * instead of allocating it. The ORF data of the elements of \c *results is
+ * recycled into \c ws instead of being freed, so it is reused for the ORFs
+ * of later results.
+ *
+ * \param dc        DNA classifier
+ * \param ws        workspace of the calling thread, or NULL to use a
+ *                  temporary one
+ * \param seq       sequence to classify
+ * \param results   _OUT_: classification results
+ */
+int uproc_dnaclass_classify_ws(const uproc_dnaclass *dc,
+                               uproc_classify_workspace *ws, const char *seq,
+                               uproc_list **results);
+
+/** Classify many DNA sequences at once
+ *
+ * Produces the same results as calling uproc_dnaclass_classify() on each
+ * sequence, but classifies the ORFs of all sequences together using
+ * uproc_protclass_classify_many().
+ *
+ * \param dc        DNA classifier
+ * \param ws        workspace of the calling thread, or NULL to use a
+ *                  temporary one
+ * \param seqs      array of \c n sequences to classify
+ * \param n         number of sequences
+ * \param results   array of \c n list pointers, each of which is treated like
+ *                  the \c results argument of uproc_dnaclass_classify()
+ */
+int uproc_dnaclass_classify_many(const uproc_dnaclass *dc,
+                                 uproc_classify_workspace *ws,
+                                 const char *const *seqs, size_t n,
+                                 uproc_list **results);
 /** \} */
 
 /**
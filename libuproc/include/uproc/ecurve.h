@@ -75,6 +75,71 @@ enum uproc_ecurve_format {
     UPROC_ECURVE_BINARY,
 };
 
+/** Ecurve layouts
+ *
+ * Flags selecting alternative representations of an ecurve in memory and in
+ * the ::UPROC_ECURVE_BINARY format. They trade build time for less memory or
+ * faster lookups; all of them produce exactly the same lookup results.
+ */
+enum uproc_ecurve_layout {
+    /** Prefix table with an entry for every possible prefix, followed by
+     * sorted suffix and family arrays */
+    UPROC_ECURVE_LAYOUT_DEFAULT = 0,
+
+    /** Replace the prefix table (which has a fixed size of several hundred
+     * MB) by a rank/select index whose size depends on the number of
+     * non-empty prefixes */
+    UPROC_ECURVE_COMPACT_PREFIXES = 1 << 0,
+
+    /** Store the suffixes bit-packed relative to a per-block base value and
+     * the families run-length encoded, trading a few extra instructions per
+     * lookup for less memory */
+    UPROC_ECURVE_PACKED_SUFFIXES = 1 << 1,
+
+    /** Add a B+-tree with cache line sized nodes to every large prefix
+     * bucket, replacing the binary search over its suffixes */
+    UPROC_ECURVE_BTREE_BUCKETS = 1 << 2,
+
+    /** Store each suffix in the same cache line as its family, saving a
+     * cache miss per neighbour (can't be combined with
+     * ::UPROC_ECURVE_PACKED_SUFFIXES) */
+    UPROC_ECURVE_INTERLEAVED = 1 << 3,
+
+    /** All valid flags */
+    UPROC_ECURVE_LAYOUT_ALL =
+        UPROC_ECURVE_COMPACT_PREFIXES | UPROC_ECURVE_PACKED_SUFFIXES |
+        UPROC_ECURVE_BTREE_BUCKETS | UPROC_ECURVE_INTERLEAVED,
+};
+
+/** Memory placement of an ecurve
+ *
+ * Flags for uproc_ecurve_place(). Lookups access the ecurve's arrays at
+ * random, so with several GB of data nearly every lookup misses the TLB if
+ * they are backed by normal 4 KB pages.
+ */
+enum uproc_ecurve_memory {
+    /** Leave the ecurve where it was loaded */
+    UPROC_ECURVE_MEMORY_DEFAULT = 0,
+
+    /** Copy the ecurve to anonymous memory backed by transparent huge
+     * pages */
+    UPROC_ECURVE_HUGEPAGES = 1 << 0,
+
+    /** Copy the ecurve to pages from the hugetlbfs pool, falling back to
+     * transparent huge pages if the pool is too small */
+    UPROC_ECURVE_HUGETLB = 1 << 1,
+
+    /** Lock the ecurve in memory (subject to `RLIMIT_MEMLOCK`) */
+    UPROC_ECURVE_MLOCK = 1 << 2,
+
+    /** Interleave the pages of the ecurve over all NUMA nodes */
+    UPROC_ECURVE_NUMA_INTERLEAVE = 1 << 3,
+
+    /** All valid flags */
+    UPROC_ECURVE_MEMORY_ALL = UPROC_ECURVE_HUGEPAGES | UPROC_ECURVE_HUGETLB |
+                              UPROC_ECURVE_MLOCK | UPROC_ECURVE_NUMA_INTERLEAVE,
+};
+
 /** Lookup return codes */
 enum {
     /** Exact match */
@@ -183,6 +248,186 @@ int uproc_ecurve_lookup(const uproc_ecurve *ecurve,
                         struct uproc_word *upper_neighbour,
                         uproc_family *upper_class);
 
+/** Find the closest neighbours of many words in the ecurve
+ *
+ * Equivalent to calling uproc_ecurve_lookup() on each of the \c n words, but
+ * processes them in a software pipeline that prefetches the prefix table
+ * entries and suffix buckets of upcoming words while the current one is being
+ * searched. This hides most of the memory latency of the (very large) prefix
+ * and suffix tables.
+ *
+ * All output arrays must be able to hold \c n elements; element \c i
+ * corresponds to \c words[i].
+ *
+ * \param ecurve            ecurve object
+ * \param words             array of words to search
+ * \param n                 number of words
+ * \param lower_neighbours  _OUT_: lower neighbour words
+ * \param lower_classes     _OUT_: classes of the lower neighbours
+ * \param upper_neighbours  _OUT_: upper neighbour words
+ * \param upper_classes     _OUT_: classes of the upper neighbours
+ * \param results           _OUT_: return values of the individual lookups as
+ *                          described in uproc_ecurve_lookup(), may be NULL
+ */
+void uproc_ecurve_lookup_batch(const uproc_ecurve *ecurve,
+                               const struct uproc_word *words, size_t n,
+                               struct uproc_word *lower_neighbours,
+                               uproc_family *lower_classes,
+                               struct uproc_word *upper_neighbours,
+                               uproc_family *upper_classes, int *results);
+
+/** Find the closest neighbours of many words sorted by prefix
+ *
+ * Equivalent to uproc_ecurve_lookup_batch(), but meant for input that is
+ * sorted in ascending order of \c uproc_word::prefix (the order of suffixes
+ * doesn't matter). Consecutive words with the same prefix share the prefix
+ * table lookup; each word is still searched for in the suffix table on its
+ * own.
+ *
+ * Unsorted input yields the same results, only slower.
+ */
+void uproc_ecurve_lookup_sorted(const uproc_ecurve *ecurve,
+                                const struct uproc_word *words, size_t n,
+                                struct uproc_word *lower_neighbours,
+                                uproc_family *lower_classes,
+                                struct uproc_word *upper_neighbours,
+                                uproc_family *upper_classes, int *results);
+
+/** Convert an ecurve to a different layout
+ *
+ * Not supported for ecurves that were loaded with uproc_ecurve_mmap().
+ *
+ * \param ecurve    ecurve to convert
+ * \param layout    bitwise OR of ::uproc_ecurve_layout flags
+ */
+int uproc_ecurve_convert(uproc_ecurve *ecurve, unsigned layout);
+
+/** Return the layout flags of an ecurve */
+unsigned uproc_ecurve_layout(const uproc_ecurve *ecurve);
+
+/** Parse a layout description
+ *
+ * \c str is a comma-separated list of layout names: "compact" for
+ * ::UPROC_ECURVE_COMPACT_PREFIXES or "default".
+ *
+ * \param str       string to parse
+ * \param layout    _OUT_: bitwise OR of the corresponding flags
+ */
+int uproc_ecurve_layout_parse(const char *str, unsigned *layout);
+
+/** Describe layout flags in the format accepted by uproc_ecurve_layout_parse()
+ *
+ * Behaves like snprintf().
+ */
+int uproc_ecurve_layout_str(unsigned layout, char *buf, size_t n);
+
+/** Move an ecurve to memory with the given properties
+ *
+ * Copies the arrays of \c ecurve to a single anonymous mapping aligned to a
+ * huge page boundary and releases the old memory (or file mapping). The
+ * requested properties are applied on a best-effort basis: huge pages may
+ * not be available and locking may exceed the resource limit, which is not
+ * considered an error.
+ *
+ * Afterwards, the ecurve can't be modified with uproc_ecurve_convert().
+ *
+ * \param ecurve    ecurve to move
+ * \param flags     bitwise OR of ::uproc_ecurve_memory flags
+ *
+ * \returns the flags that were actually obtained, or -1 on error
+ */
+int uproc_ecurve_place(uproc_ecurve *ecurve, unsigned flags);
+
+/** Move an ecurve to memory on a NUMA node
+ *
+ * Like uproc_ecurve_place(), but the pages are preferably taken from NUMA
+ * node \c node. If \c node is -1, this is identical to uproc_ecurve_place().
+ */
+int uproc_ecurve_place_node(uproc_ecurve *ecurve, unsigned flags, int node);
+
+/** Create a copy of an ecurve on a NUMA node
+ *
+ * The copy is placed like with uproc_ecurve_place_node() and is independent
+ * of \c ecurve, which is left unchanged. Useful to give the threads running
+ * on each node a local copy of a read-only ecurve.
+ *
+ * \returns the copy, or %NULL on error
+ */
+uproc_ecurve *uproc_ecurve_replicate(const uproc_ecurve *ecurve,
+                                     unsigned flags, int node);
+
+/** Return the memory flags obtained by uproc_ecurve_place() */
+unsigned uproc_ecurve_memory(const uproc_ecurve *ecurve);
+
+/** Parse a memory placement description
+ *
+ * Like uproc_ecurve_layout_parse(), with the names "hugepages", "hugetlb",
+ * "mlock" and "numa-interleave".
+ */
+int uproc_ecurve_memory_parse(const char *str, unsigned *flags);
+
+/** Describe memory flags in the format accepted by
+ * uproc_ecurve_memory_parse()
+ *
+ * Behaves like snprintf().
+ */
+int uproc_ecurve_memory_str(unsigned flags, char *buf, size_t n);
+
+/** Residency policies for mapped ecurves
+ *
+ * If mmap support is enabled, ecurves in the binary format are mapped from
+ * their files instead of being read. These flags determine how the pages of
+ * the mapping are brought into memory, see uproc_ecurve_residency_set().
+ */
+enum uproc_ecurve_residency {
+    /** Fault in all pages before returning from loading (default) */
+    UPROC_ECURVE_POPULATE = 0,
+
+    /** Leave the pages to be faulted in by the lookups that need them */
+    UPROC_ECURVE_LAZY = 1 << 0,
+
+    /** Fault in all pages from a background thread, so that the ecurve can
+     * be used right away */
+    UPROC_ECURVE_PREFETCH = 1 << 1,
+
+    /** Lock the pages in memory once they are resident (subject to
+     * `RLIMIT_MEMLOCK`), to keep them from being evicted between jobs */
+    UPROC_ECURVE_KEEP_WARM = 1 << 2,
+
+    /** All valid flags */
+    UPROC_ECURVE_RESIDENCY_ALL =
+        UPROC_ECURVE_LAZY | UPROC_ECURVE_PREFETCH | UPROC_ECURVE_KEEP_WARM,
+};
+
+/** Set the residency policy of ecurves mapped from now on
+ *
+ * Until this is called, the policy is taken from the environment variable
+ * \c UPROC_RESIDENCY (see uproc_ecurve_residency_parse()), e.g.
+ * "UPROC_RESIDENCY=prefetch,keep-warm".
+ *
+ * \param residency bitwise OR of ::uproc_ecurve_residency flags; at most one
+ * of ::UPROC_ECURVE_LAZY and ::UPROC_ECURVE_PREFETCH may be set
+ *
+ * \returns 0 on success or -1 if \c residency is invalid
+ */
+int uproc_ecurve_residency_set(unsigned residency);
+
+/** Parse a residency policy description
+ *
+ * Like uproc_ecurve_layout_parse(), with the names "populate", "lazy",
+ * "prefetch" and "keep-warm".
+ */
+int uproc_ecurve_residency_parse(const char *str, unsigned *residency);
+
+/** Return the percentage of the pages of an ecurve that are resident
+ *
+ * Determined with `mincore()` where available, otherwise all ecurves are
+ * considered to be resident.
+ *
+ * \returns the percentage, or a negative value on error
+ */
+double uproc_ecurve_resident(const uproc_ecurve *ecurve);
+
 /** Return the internal alphabet */
 uproc_alphabet *uproc_ecurve_alphabet(const uproc_ecurve *ecurve);
 
@@ -31,7 +31,11 @@
 
 #include "uproc/io.h"
 
-/** Print formatted info about features */
+/** Print formatted info about features
+ *
+ * Also reports the memory obtained for ecurves moved with
+ * uproc_ecurve_place(), if any.
+ */
 void uproc_features_print(uproc_io_stream *stream);
 
 /** Version name */
@@ -46,6 +50,14 @@ const char *uproc_features_zlib_version(void);
 /** Check mmap() support */
 bool uproc_features_mmap(void);
 
+/** Transparent huge page support
+ *
+ * \return
+ * the mode configured in the kernel ("always", "madvise" or "never"), or
+ * "no" if transparent huge pages are not supported.
+ */
+const char *uproc_features_hugepages(void);
+
 /** Obtain OpenMP version
  *
  * \return
@@ -99,6 +99,12 @@ uproc_io_stream *uproc_io_open(const char *mode, enum uproc_io_type type,
 uproc_io_stream *uproc_io_openv(const char *mode, enum uproc_io_type type,
                                 const char *pathfmt, va_list ap);
 
+/** Open a stream on a file descriptor
+ *
+ * Like \c fdopen(), the stream is uncompressed and closing it closes \c fd.
+ */
+uproc_io_stream *uproc_io_fdopen(int fd, const char *mode);
+
 /** Close a file stream */
 int uproc_io_close(uproc_io_stream *stream);
 
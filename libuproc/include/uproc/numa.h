@@ -0,0 +1,64 @@
+/* Copyright 2014 Peter Meinicke, Robin Martinjak
+ *
+ * This file is part of libuproc.
+ *
+ * libuproc is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libuproc is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libuproc.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file uproc/numa.h
+ *
+ * Module: \ref grp_features
+ *
+ * \weakgroup grp_features
+ * \{
+ */
+
+#ifndef UPROC_NUMA_H
+#define UPROC_NUMA_H
+
+#include <stddef.h>
+
+/** Maximum number of NUMA nodes supported */
+#define UPROC_NUMA_NODES_MAX 64
+
+/** Number of NUMA nodes
+ *
+ * \return
+ * the number of memory nodes the kernel reports, or 1 if the system doesn't
+ * support NUMA.
+ */
+int uproc_numa_nodes(void);
+
+/** NUMA node the calling thread is currently running on
+ *
+ * \return
+ * the node number, or -1 if unknown.
+ */
+int uproc_numa_node(void);
+
+/** Restrict the calling thread to the CPUs of a NUMA node */
+int uproc_numa_bind_thread(int node);
+
+/** Set the memory policy of a range of pages
+ *
+ * Pages of the range that are allocated afterwards will be taken from \c node,
+ * or interleaved over all nodes if \c node is -1. \c addr must be page
+ * aligned.
+ */
+int uproc_numa_bind_memory(void *addr, size_t size, int node);
+
+/**
+ * \}
+ */
+#endif
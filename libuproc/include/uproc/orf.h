@@ -140,6 +140,22 @@ typedef struct uproc_orfiter_s uproc_orfiter;
 uproc_orfiter *uproc_orfiter_create(const char *seq, const double *codon_scores,
                                     uproc_orffilter *filter, void *filter_arg);
 
+/** Restart an orfiter on another sequence
+ *
+ * Puts \c iter into the state of an iterator freshly created with the same
+ * arguments, but keeps its ORF buffers, so that iterating over sequences of
+ * similar length does not allocate memory.
+ *
+ * \param iter          iterator
+ * \param seq           sequence to iterate over
+ * \param codon_scores  codon scores, see uproc_orfiter_create()
+ * \param filter        filter function
+ * \param filter_arg    additional argument to \c filter
+ */
+void uproc_orfiter_reset(uproc_orfiter *iter, const char *seq,
+                         const double *codon_scores, uproc_orffilter *filter,
+                         void *filter_arg);
+
 /** Destroy orfiter object */
 void uproc_orfiter_destroy(uproc_orfiter *iter);
 
@@ -34,6 +34,7 @@
 #include "uproc/ecurve.h"
 #include "uproc/substmat.h"
 #include "uproc/list.h"
+#include "uproc/wordcache.h"
 
 /** \defgroup struct_protresult struct uproc_protresult
  * Protein classification result
@@ -97,6 +98,57 @@ typedef struct uproc_protclass_s uproc_protclass;
 typedef bool uproc_protfilter(const char *seq, size_t seq_len,
                               uproc_family family, double score, void *arg);
 
+/** \struct uproc_classify_workspace
+ * Scratch memory for classifying sequences
+ *
+ * Holds the score table, iterators, word table and intermediate result lists
+ * that uproc_protclass_classify() and uproc_dnaclass_classify() would
+ * otherwise allocate and free for every sequence. Once it has grown to the
+ * size the input requires, classifying with uproc_protclass_classify_ws() or
+ * uproc_dnaclass_classify_ws() does not allocate any memory (provided that
+ * the \c results lists are reused as well).
+ *
+ * A workspace can be used with any classifier, but only by one thread at a
+ * time; multi-threaded callers create one per thread.
+ */
+typedef struct uproc_classify_workspace_s uproc_classify_workspace;
+
+/** Create empty classifier workspace */
+uproc_classify_workspace *uproc_classify_workspace_create(void);
+
+/** Destroy classifier workspace */
+void uproc_classify_workspace_destroy(uproc_classify_workspace *ws);
+
+/** Statistics of a workspace
+ *
+ * Counted over all sequences classified with the workspace, see
+ * uproc_protclass_set_pruning() and uproc_protclass_set_cache().
+ */
+struct uproc_protclass_stats
+{
+    /** Neighbouring database words whose suffixes were aligned and added to
+     * the scores */
+    unsigned long long aligned;
+
+    /** Neighbouring database words skipped because their family was pruned
+     * (each saving a substmat lookup and a score update) */
+    unsigned long long skipped;
+
+    /** Families that were pruned */
+    unsigned long long pruned;
+
+    /** Words found in the word cache */
+    unsigned long long cache_hits;
+
+    /** Words looked up in the ecurves because they were not in the word
+     * cache */
+    unsigned long long cache_misses;
+};
+
+/** Return the statistics of a workspace */
+void uproc_classify_workspace_stats(const uproc_classify_workspace *ws,
+                                    struct uproc_protclass_stats *stats);
+
 /** Classification mode
  *
  * Determines which results uproc_protclass_classify() produces.
@@ -136,6 +188,10 @@ void uproc_protclass_destroy(uproc_protclass *pc);
  * is not NULL, all its elements will be passed to uproc_protresult_free() in
  * the beginning.
  *
+ * Every call sets up a temporary ::uproc_classify_workspace, which includes a
+ * table with an entry for each possible family; to classify many sequences,
+ * use uproc_protclass_classify_ws().
+ *
  * \param pc        protein classifier
  * \param seq       sequence to classify
  * \param results   _OUT_: classification results
@@ -143,6 +199,80 @@ void uproc_protclass_destroy(uproc_protclass *pc);
 int uproc_protclass_classify(const uproc_protclass *pc, const char *seq,
                              uproc_list **results);
 
+/** Classify protein sequence using a workspace
+ *
+ * Like uproc_protclass_classify(), but takes its scratch memory from \c ws
+ * instead of allocating it.
+ *
+ * \param pc        protein classifier
+ * \param ws        workspace of the calling thread, or NULL to use a
+ *                  temporary one
+ * \param seq       sequence to classify
+ * \param results   _OUT_: classification results
+ */
+int uproc_protclass_classify_ws(const uproc_protclass *pc,
+                                uproc_classify_workspace *ws, const char *seq,
+                                uproc_list **results);
+
+/** Classify many protein sequences at once
+ *
+ * Produces the same results as calling uproc_protclass_classify() on each
+ * sequence, but extracts the words of all sequences first, sorts them by
+ * prefix and looks them up in that order. Words with the same prefix share
+ * the prefix table lookup, and the accesses into the (large) ecurve tables
+ * move forward instead of jumping around, which pays off for large numbers of
+ * sequences.
+ *
+ * \param pc        protein classifier
+ * \param ws        workspace of the calling thread, or NULL to use a
+ *                  temporary one
+ * \param seqs      array of \c n sequences to classify
+ * \param n         number of sequences
+ * \param results   array of \c n list pointers, each of which is treated like
+ *                  the \c results argument of uproc_protclass_classify()
+ */
+int uproc_protclass_classify_many(const uproc_protclass *pc,
+                                  uproc_classify_workspace *ws,
+                                  const char *const *seqs, size_t n,
+                                  uproc_list **results);
+
+/** Enable or disable pruning
+ *
+ * While the words of a sequence are scored, the score of each family is
+ * bounded from above by its score so far plus the highest distance in the
+ * substitution matrix for every remaining position. Families whose upper
+ * bound is rejected by the filter function, or (with ::UPROC_PROTCLASS_MAX)
+ * is lower than what another family is certain to reach, are no longer
+ * scored. This requires a filter that accepts every score higher than one it
+ * accepts, like a threshold does; then the results are the same as without
+ * pruning. The trace callback is not called for the words of pruned
+ * families.
+ *
+ * Pruning is disabled by default.
+ *
+ * \param pc        protein classifier
+ * \param prune     whether to prune families
+ */
+void uproc_protclass_set_pruning(uproc_protclass *pc, bool prune);
+
+/** Use a word cache
+ *
+ * Words found in \c cache are neither looked up in the ecurves nor aligned,
+ * the others are added to it after the lookup. The results are the same as
+ * without a cache. One cache can be shared by all classifiers and threads;
+ * its entries belong to an ecurve (and the copies made of it with
+ * uproc_ecurve_replicate()) and a substitution matrix, which must not be
+ * changed while the cache is in use.
+ *
+ * uproc_protclass_classify_many() takes the words of all its sequences from
+ * the cache before it looks up the rest; words that occur more than once in
+ * the batch are looked up each time unless they were cached before.
+ *
+ * \param pc        protein classifier
+ * \param cache     word cache, or NULL to stop using one
+ */
+void uproc_protclass_set_cache(uproc_protclass *pc, uproc_wordcache *cache);
+
 /** Tracing callback type
  *
  * Additionally to the normal classification, it's possible to get information
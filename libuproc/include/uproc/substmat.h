@@ -104,6 +104,69 @@ void uproc_substmat_set(uproc_substmat *mat, unsigned pos, uproc_amino x,
 void uproc_substmat_align_suffixes(const uproc_substmat *mat, uproc_suffix s1,
                                    uproc_suffix s2, double *dist);
 
+/** Modes of uproc_substmat_align_suffixes()
+ *
+ * At most one kernel flag can be combined with ::UPROC_SUBSTMAT_FLOAT, see
+ * uproc_substmat_mode_set().
+ */
+enum uproc_substmat_mode {
+    /** Look up the distances one at a time */
+    UPROC_SUBSTMAT_SCALAR = 1 << 0,
+
+    /** Decode the suffixes and gather four distances at a time (x86 CPUs
+     * with AVX2) */
+    UPROC_SUBSTMAT_AVX2 = 1 << 1,
+
+    /** Like ::UPROC_SUBSTMAT_AVX2, eight at a time (AVX-512) */
+    UPROC_SUBSTMAT_AVX512 = 1 << 2,
+
+    /** Look up single precision copies of the distances, which halves the
+     * size of the table at the cost of rounding the scores */
+    UPROC_SUBSTMAT_FLOAT = 1 << 3,
+};
+
+/** Select how a substmat aligns suffixes
+ *
+ * Without a kernel flag in \c mode, the widest kernel supported by the CPU is
+ * used. All kernels of the same precision return identical distances. Newly
+ * created substmats take their mode from the environment variable
+ * \c UPROC_SUBSTMAT (see uproc_substmat_mode_parse()), e.g.
+ * "UPROC_SUBSTMAT=avx2,float".
+ *
+ * \param mat   substitution matrix
+ * \param mode  bitwise OR of ::uproc_substmat_mode flags
+ *
+ * \returns 0 on success or -1 if \c mode is invalid or the kernel is not
+ * supported by the CPU
+ */
+int uproc_substmat_mode_set(uproc_substmat *mat, unsigned mode);
+
+/** Return the mode of a substmat, including the selected kernel */
+unsigned uproc_substmat_mode(const uproc_substmat *mat);
+
+/** Parse a substmat mode description
+ *
+ * Like uproc_ecurve_layout_parse(), with the names "scalar", "avx2",
+ * "avx512" and "float".
+ */
+int uproc_substmat_mode_parse(const char *str, unsigned *mode);
+
+/** Describe a mode in the format accepted by uproc_substmat_mode_parse()
+ *
+ * Behaves like snprintf().
+ */
+int uproc_substmat_mode_str(unsigned mode, char *buf, size_t n);
+
+/** Validate the mode of a substmat
+ *
+ * Aligns \c samples pseudo-random pairs of suffixes in the current mode and
+ * with the scalar double precision lookup.
+ *
+ * \returns the largest difference between the summed distances of a pair
+ */
+double uproc_substmat_deviation(const uproc_substmat *mat,
+                                unsigned long samples);
+
 /** Load substmat from file
  *
  * \param iotype    IO type, see ::uproc_io_type
@@ -159,6 +159,18 @@ typedef struct uproc_worditer_s uproc_worditer;
 uproc_worditer *uproc_worditer_create(const char *seq,
                                       const uproc_alphabet *alpha);
 
+/** Restart a worditer on another sequence
+ *
+ * Puts \c iter into the state of a freshly created iterator, without
+ * allocating a new one.
+ *
+ * \param iter      iterator
+ * \param seq       sequence to iterate
+ * \param alpha     translation alphabet
+ */
+void uproc_worditer_reset(uproc_worditer *iter, const char *seq,
+                          const uproc_alphabet *alpha);
+
 /** Obtain the next word(s) from a word iterator
  *
  * Invalid characters are not simply skipped, instead the first complete word
@@ -0,0 +1,81 @@
+/* Copyright 2014 Peter Meinicke, Robin Martinjak
+ *
+ * This file is part of libuproc.
+ *
+ * libuproc is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libuproc is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libuproc.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file uproc/wordcache.h
+ *
+ * Module: \ref grp_datastructs_wordcache
+ *
+ * \weakgroup grp_datastructs
+ * \{
+ * \weakgroup grp_datastructs_wordcache
+ * \{
+ */
+
+#ifndef UPROC_WORDCACHE_H
+#define UPROC_WORDCACHE_H
+
+#include <stddef.h>
+
+/** \defgroup obj_wordcache object uproc_wordcache
+ *
+ * Cache of word lookups shared by several threads
+ *
+ * Stores the neighbours of words found in an ecurve, together with their
+ * families and the distances of their suffixes, so that recurring words of
+ * a protein classifier (see uproc_protclass_set_cache()) skip the ecurve
+ * lookup and the alignment. Worthwhile if the input contains the same words
+ * many times, e.g. for deeply sequenced samples.
+ *
+ * The cache has a fixed number of entries; a new word replaces one of the
+ * two entries it may occupy. Reading and replacing entries does not take any
+ * locks, a thread that finds an entry being replaced treats it as missing.
+ *
+ * \{
+ */
+
+/** \struct uproc_wordcache
+ * \copybrief obj_wordcache
+ *
+ * See \ref obj_wordcache for details.
+ */
+typedef struct uproc_wordcache_s uproc_wordcache;
+
+/** Create word cache
+ *
+ * \param max_bytes     memory limit, at least enough for a few entries
+ *
+ * \returns the cache, or NULL on error (including compilers without atomic
+ * builtins)
+ */
+uproc_wordcache *uproc_wordcache_create(size_t max_bytes);
+
+/** Destroy word cache */
+void uproc_wordcache_destroy(uproc_wordcache *cache);
+
+/** Return the number of entries of a cache */
+size_t uproc_wordcache_capacity(const uproc_wordcache *cache);
+
+/** Return the number of entries that are in use */
+size_t uproc_wordcache_used(const uproc_wordcache *cache);
+/** \} */
+
+/**
+ * \}
+ * \}
+ */
+#endif
@@ -39,6 +39,10 @@
 
 #define GZIP_BUFSZ (512 * (1 << 10))
 
+/* Largest length passed to gzread()/gzwrite() at once (they take an unsigned
+ * int) */
+#define GZIP_CHUNK (1u << 30)
+
 struct uproc_io_stream
 {
     enum uproc_io_type type;
@@ -225,6 +229,32 @@ uproc_io_stream *uproc_io_openv(const char *mode, enum uproc_io_type type,
     return stream;
 }
 
+uproc_io_stream *uproc_io_fdopen(int fd, const char *mode)
+{
+#if HAVE_FDOPEN
+    uproc_io_stream *stream = malloc(sizeof *stream);
+    if (!stream) {
+        uproc_error(UPROC_ENOMEM);
+        return NULL;
+    }
+    stream->type = UPROC_IO_STDIO;
+    stream->stdstream = false;
+    stream->s.fp = fdopen(fd, mode);
+    if (!stream->s.fp) {
+        uproc_error_msg(UPROC_ERRNO,
+                        "can't open descriptor %d with mode \"%s\"", fd, mode);
+        free(stream);
+        return NULL;
+    }
+    return stream;
+#else
+    (void)fd;
+    (void)mode;
+    uproc_error_msg(UPROC_ENOTSUP, "fdopen not available");
+    return NULL;
+#endif
+}
+
 int uproc_io_close(uproc_io_stream *stream)
 {
     int res = 1;
@@ -292,14 +322,20 @@ size_t uproc_io_read(void *ptr, size_t size, size_t nmemb,
         case UPROC_IO_GZIP:
 #if HAVE_ZLIB_H
         {
-            size_t i, n;
-            for (i = 0; i < nmemb; i++) {
-                n = gzread(stream->s.gz, (char *)ptr + i * size, size);
-                if (n != size) {
+            /* read all elements at once instead of calling gzread() for
+             * every single one; like fread(), a trailing partial element is
+             * not counted */
+            size_t total = size * nmemb, done = 0;
+            while (done < total) {
+                size_t len = total - done < GZIP_CHUNK ? total - done
+                                                       : GZIP_CHUNK;
+                int n = gzread(stream->s.gz, (char *)ptr + done, len);
+                if (n <= 0) {
                     break;
                 }
+                done += n;
             }
-            return i;
+            return size ? done / size : 0;
         }
 #endif
         case UPROC_IO_STDIO:
@@ -316,14 +352,17 @@ size_t uproc_io_write(const void *ptr, size_t size, size_t nmemb,
         case UPROC_IO_GZIP:
 #if HAVE_ZLIB_H
         {
-            size_t i, n;
-            for (i = 0; i < nmemb; i++) {
-                n = gzwrite(stream->s.gz, (char *)ptr + i * size, size);
-                if (n != size) {
+            size_t total = size * nmemb, done = 0;
+            while (done < total) {
+                size_t len = total - done < GZIP_CHUNK ? total - done
+                                                       : GZIP_CHUNK;
+                int n = gzwrite(stream->s.gz, (const char *)ptr + done, len);
+                if (n <= 0) {
                     break;
                 }
+                done += n;
             }
-            return i;
+            return size ? done / size : 0;
         }
 #endif
         case UPROC_IO_STDIO:
@@ -0,0 +1,195 @@
+/* Minimal NUMA support without libnuma
+ *
+ * Copyright 2014 Peter Meinicke, Robin Martinjak
+ *
+ * This file is part of libuproc.
+ *
+ * libuproc is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libuproc is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libuproc.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_SCHED_H && HAVE_SYS_SYSCALL_H && HAVE_UNISTD_H
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "uproc/error.h"
+#include "uproc/numa.h"
+
+#include "numa_internal.h"
+
+/* memory policies, see set_mempolicy(2) (numaif.h is part of libnuma) */
+#define MPOL_PREFERRED 1
+#define MPOL_INTERLEAVE 3
+
+#define NODE_PATH "/sys/devices/system/node/"
+
+#if defined(SYS_mbind) && defined(SYS_getcpu) && HAVE_SCHED_SETAFFINITY
+#define HAVE_NUMA 1
+#endif
+
+#if HAVE_NUMA
+/* Parse a list like "0-3,8-11" from sysfs, calling `fn` for every number */
+static int parse_list(const char *path, void (*fn)(int, void *), void *opaque)
+{
+    char buf[4096], *p, *end;
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        return -1;
+    }
+    if (!fgets(buf, sizeof buf, f)) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    for (p = buf; *p && *p != '\n'; p = end + (*end == ',')) {
+        long i, from, to;
+        from = to = strtol(p, &end, 10);
+        if (end == p) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            to = strtol(p, &end, 10);
+        }
+        for (i = from; i <= to; i++) {
+            fn(i, opaque);
+        }
+    }
+    return 0;
+}
+
+static void max_node(int node, void *opaque)
+{
+    int *n = opaque;
+    if (node + 1 > *n) {
+        *n = node + 1;
+    }
+}
+
+static void add_cpu(int cpu, void *opaque)
+{
+    if (cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, (cpu_set_t *)opaque);
+    }
+}
+#endif
+
+int uproc_numa_nodes(void)
+{
+#if HAVE_NUMA
+    int n = 0;
+    if (parse_list(NODE_PATH "online", max_node, &n) || n < 1) {
+        return 1;
+    }
+    return n < UPROC_NUMA_NODES_MAX ? n : UPROC_NUMA_NODES_MAX;
+#else
+    return 1;
+#endif
+}
+
+int uproc_numa_node(void)
+{
+#if HAVE_NUMA
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL)) {
+        return -1;
+    }
+    return node;
+#else
+    return -1;
+#endif
+}
+
+int uproc_numa_bind_thread(int node)
+{
+#if HAVE_NUMA
+    char path[64];
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    sprintf(path, NODE_PATH "node%d/cpulist", node);
+    if (parse_list(path, add_cpu, &set) || !CPU_COUNT(&set)) {
+        return uproc_error_msg(UPROC_EINVAL, "no CPUs on NUMA node %d", node);
+    }
+    if (sched_setaffinity(0, sizeof set, &set)) {
+        return uproc_error_msg(UPROC_ERRNO, "sched_setaffinity failed");
+    }
+    return 0;
+#else
+    (void)node;
+    return uproc_error_msg(UPROC_ENOTSUP, "NUMA not supported");
+#endif
+}
+
+int numa_set_policy(void *addr, size_t size, int node)
+{
+#if HAVE_NUMA
+    unsigned long mask[UPROC_NUMA_NODES_MAX / (8 * sizeof(unsigned long))] =
+        {0};
+    int mode = MPOL_PREFERRED;
+
+    if (node < 0) {
+        int i, n = uproc_numa_nodes();
+        for (i = 0; i < n; i++) {
+            mask[i / (8 * sizeof *mask)] |= 1UL << i % (8 * sizeof *mask);
+        }
+        mode = MPOL_INTERLEAVE;
+    } else if (node < UPROC_NUMA_NODES_MAX) {
+        mask[node / (8 * sizeof *mask)] |= 1UL << node % (8 * sizeof *mask);
+    } else {
+        return -1;
+    }
+    /* maxnode is one more than the number of bits in the mask */
+    return syscall(SYS_mbind, addr, size, mode, mask, UPROC_NUMA_NODES_MAX + 1,
+                   0)
+               ? -1
+               : 0;
+#else
+    (void)addr;
+    (void)size;
+    (void)node;
+    return -1;
+#endif
+}
+
+int uproc_numa_bind_memory(void *addr, size_t size, int node)
+{
+#if HAVE_NUMA
+    if (node >= UPROC_NUMA_NODES_MAX) {
+        return uproc_error_msg(UPROC_EINVAL, "invalid NUMA node %d", node);
+    }
+    if (numa_set_policy(addr, size, node)) {
+        return uproc_error_msg(UPROC_ERRNO, "mbind failed");
+    }
+    return 0;
+#else
+    (void)addr;
+    (void)size;
+    (void)node;
+    return uproc_error_msg(UPROC_ENOTSUP, "NUMA not supported");
+#endif
+}
@@ -0,0 +1,12 @@
+#ifndef UPROC_NUMA_INTERNAL_H
+#define UPROC_NUMA_INTERNAL_H
+
+#include <stddef.h>
+
+/** Like uproc_numa_bind_memory(), but without reporting errors
+ *
+ * For best-effort use where a failure is not an error.
+ */
+int numa_set_policy(void *addr, size_t size, int node);
+
+#endif
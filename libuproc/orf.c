@@ -201,11 +201,7 @@ uproc_orfiter *uproc_orfiter_create(
         uproc_error(UPROC_ENOMEM);
         return NULL;
     }
-    *iter = (struct uproc_orfiter_s){
-        .seq = seq, .pos = seq, .filter = filter, .filter_arg = filter_arg,
-    };
-    gc_content(seq, &iter->seq_len, &iter->seq_gc);
-
+    *iter = (struct uproc_orfiter_s){0};
     for (i = 0; i < UPROC_ORF_FRAMES; i++) {
         iter->data_sz[i] = BUFSZ_INIT;
         iter->orf[i].data = malloc(BUFSZ_INIT);
@@ -217,11 +213,36 @@ uproc_orfiter *uproc_orfiter_create(
             uproc_error(UPROC_ENOMEM);
             return NULL;
         }
+    }
+    uproc_orfiter_reset(iter, seq, codon_scores, filter, filter_arg);
+    return iter;
+}
+
+void uproc_orfiter_reset(uproc_orfiter *iter, const char *seq,
+                         const double *codon_scores, uproc_orffilter *filter,
+                         void *filter_arg)
+{
+    unsigned i;
+
+    iter->seq = iter->pos = seq;
+    iter->filter = filter;
+    iter->filter_arg = filter_arg;
+    iter->codon_scores = codon_scores;
+    iter->nt_count = 0;
+    iter->frame = 0;
+    gc_content(seq, &iter->seq_len, &iter->seq_gc);
+
+    /* keep the ORF buffers, they are grown as needed */
+    for (i = 0; i < UPROC_ORF_FRAMES; i++) {
+        if (i < FRAMES) {
+            iter->codon[i] = 0;
+        }
+        iter->orf[i].length = 0;
+        iter->orf[i].score = 0.0;
         iter->orf[i].frame = i;
         iter->orf[i].start = i % FRAMES;
+        iter->yield[i] = false;
     }
-    iter->codon_scores = codon_scores;
-    return iter;
 }
 
 void uproc_orfiter_destroy(uproc_orfiter *iter)
@@ -23,6 +23,7 @@
 #endif
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "uproc/common.h"
@@ -31,6 +32,9 @@
 #include "uproc/list.h"
 #include "uproc/protclass.h"
 
+#include "classify_internal.h"
+#include "ecurve_internal.h"
+
 struct uproc_protclass_s
 {
     enum uproc_protclass_mode mode;
@@ -44,37 +48,48 @@ struct uproc_protclass_s
         uproc_protclass_trace_cb *cb;
         void *cb_arg;
     } trace;
+
+    /* Pruning (see uproc_protclass_set_pruning()) and the bounds of the
+     * score of a single position */
+    bool prune;
+    double pos_max, pos_min;
+
+    uproc_wordcache *cache;
 };
 
 /*********************
  * score computation *
  *********************/
 
+#define MAX(a, b) (a > b ? a : b)
+
+/* Scores of one family
+ *
+ * `dist` is a ring buffer holding the maximum score of each of the
+ * ::UPROC_WORD_LEN positions covered by the word added last, which starts at
+ * `index`. Position `p` is stored at `dist[p % UPROC_WORD_LEN]`.
+ *
+ * When pruning, `pending` is the number of database words of the family that
+ * are still to be added, the last of them at `last`. */
 struct sc
 {
+    uproc_family family;
+    bool pruned;
+    size_t pending, last;
     size_t index;
     double total, dist[UPROC_WORD_LEN];
 };
 
-static void reverse_array(void *p, size_t n, size_t sz)
+static size_t ring_next(size_t slot)
 {
-    unsigned char *s = p, tmp;
-    size_t i, k, i1, i2;
-
-    for (i = 0; i < n / 2; i++) {
-        for (k = 0; k < sz; k++) {
-            i1 = sz * i + k;
-            i2 = sz * (n - i - 1) + k;
-            tmp = s[i1];
-            s[i1] = s[i2];
-            s[i2] = tmp;
-        }
-    }
+    return slot + 1 == UPROC_WORD_LEN ? 0 : slot + 1;
 }
 
 static void sc_init(struct sc *s)
 {
     size_t i;
+    s->pruned = false;
+    s->pending = s->last = 0;
     s->index = -1;
     s->total = 0.0;
     for (i = 0; i < UPROC_WORD_LEN; i++) {
@@ -82,177 +97,682 @@ static void sc_init(struct sc *s)
     }
 }
 
+/* Sum up the finite scores of the `n` positions starting at the window
+ * start, in order of their position, and clear their slots */
+static void sc_flush(struct sc *score, size_t n)
+{
+    size_t i, slot = score->index % UPROC_WORD_LEN;
+    for (i = 0; i < n; i++) {
+        if (isfinite(score->dist[slot])) {
+            score->total += score->dist[slot];
+        }
+        score->dist[slot] = -INFINITY;
+        slot = ring_next(slot);
+    }
+}
+
 static void sc_add(struct sc *score, size_t index,
                    double dist[static UPROC_SUFFIX_LEN], bool reverse)
 {
-    size_t i, diff;
-    double tmp[UPROC_WORD_LEN];
+    size_t i, slot;
 
-    for (i = 0; i < UPROC_PREFIX_LEN; i++) {
-        tmp[i] = -INFINITY;
-    }
-    memcpy(tmp + UPROC_PREFIX_LEN, dist, sizeof *dist * UPROC_SUFFIX_LEN);
-    if (reverse) {
-        reverse_array(tmp, UPROC_WORD_LEN, sizeof *tmp);
+    /* move the window to `index` */
+    if (score->index != (size_t)-1) {
+        size_t diff = index - score->index;
+        sc_flush(score, diff > UPROC_WORD_LEN ? UPROC_WORD_LEN : diff);
     }
+    score->index = index;
 
-    if (score->index != (size_t)-1) {
-        diff = index - score->index;
-        if (diff > UPROC_WORD_LEN) {
-            diff = UPROC_WORD_LEN;
-        }
-        for (i = 0; i < diff; i++) {
-            if (isfinite(score->dist[i])) {
-                score->total += score->dist[i];
-                score->dist[i] = -INFINITY;
-            }
+    /* the suffix of a forward word covers the last UPROC_SUFFIX_LEN positions
+     * of the window, the one of a reverse word the first ones, backwards */
+    if (!reverse) {
+        slot = (index + UPROC_PREFIX_LEN) % UPROC_WORD_LEN;
+        for (i = 0; i < UPROC_SUFFIX_LEN; i++) {
+            score->dist[slot] = MAX(score->dist[slot], dist[i]);
+            slot = ring_next(slot);
         }
     } else {
-        diff = 0;
+        slot = index % UPROC_WORD_LEN;
+        for (i = UPROC_SUFFIX_LEN; i--;) {
+            score->dist[slot] = MAX(score->dist[slot], dist[i]);
+            slot = ring_next(slot);
+        }
     }
+}
 
-    for (i = 0; i + diff < UPROC_WORD_LEN; i++) {
-#define MAX(a, b) (a > b ? a : b)
-        score->dist[i] = MAX(score->dist[i + diff], tmp[i]);
+static double sc_finalize(struct sc *score)
+{
+    sc_flush(score, UPROC_WORD_LEN);
+    return score->total;
+}
+
+/* Bounds of the final score of a sequence of `len` positions, once all words
+ * before `index` have been added.
+ *
+ * No later word covers a position before `index`, so their scores are final.
+ * The scores in the window can only grow, and the pending words cover at
+ * most ::UPROC_SUFFIX_LEN positions each, with scores between `pos_min` and
+ * `pos_max`. */
+static void sc_bounds(const struct sc *score, size_t index, size_t len,
+                      double pos_min, double pos_max, double *lower,
+                      double *upper)
+{
+    size_t i, covered = 0, uncovered = len - index,
+              slot = score->index % UPROC_WORD_LEN;
+    double final = score->total, open = 0.0, open_max = 0.0;
+
+    if (score->pending) {
+        size_t end = score->last + UPROC_WORD_LEN;
+        covered = score->pending * UPROC_SUFFIX_LEN;
+        if (end - index < covered) {
+            covered = end - index;
+        }
     }
-    for (; i < UPROC_WORD_LEN; i++) {
-        score->dist[i] = tmp[i];
+    for (i = 0; i < UPROC_WORD_LEN && score->index != (size_t)-1; i++) {
+        if (isfinite(score->dist[slot])) {
+            if (score->index + i < index) {
+                final += score->dist[slot];
+            } else {
+                open += score->dist[slot];
+                open_max += MAX(score->dist[slot], 0.0);
+                uncovered--;
+            }
+        }
+        slot = ring_next(slot);
     }
-    score->index = index;
+    *lower = final + open + (uncovered < covered ? uncovered : covered) * pos_min;
+    *upper = final + open_max + covered * pos_max;
 }
 
-static double sc_finalize(struct sc *score)
+/* Margin by which an upper bound has to fall short, so that rounding errors
+ * (or single precision distances) never prune a family that would be
+ * reported */
+#define PRUNE_MARGIN 1e-3
+
+/* Number of word indices between two pruning passes */
+#define PRUNE_INTERVAL UPROC_WORD_LEN
+
+/* Whether a family whose score will not exceed `upper` can not be reported */
+static bool prunable(const struct uproc_protclass_s *pc,
+                     const struct scoretab *scores, uproc_family family,
+                     double upper)
+{
+    upper += PRUNE_MARGIN;
+    return upper < scores->best ||
+           (pc->filter && !pc->filter(scores->seq, scores->seq_len, family,
+                                      upper, pc->filter_arg));
+}
+
+/* Prune the families that can not be reported any more, once all words
+ * before `index` have been added */
+static void scores_prune(const struct uproc_protclass_s *pc,
+                         struct scoretab *scores, size_t index)
 {
     size_t i;
-    for (i = 0; i < UPROC_WORD_LEN; i++) {
-        if (isfinite(score->dist[i])) {
-            score->total += score->dist[i];
+    double lower, upper;
+
+    /* a family whose lower bound passes the filter is reported unless
+     * another one scores higher */
+    if (pc->mode == UPROC_PROTCLASS_MAX) {
+        for (i = 0; i < scores->n; i++) {
+            struct sc *sc = &scores->sc[i];
+            if (sc->pruned) {
+                continue;
+            }
+            sc_bounds(sc, index, scores->seq_len, pc->pos_min, pc->pos_max,
+                      &lower, &upper);
+            if (lower > scores->best &&
+                (!pc->filter || pc->filter(scores->seq, scores->seq_len,
+                                           sc->family, lower,
+                                           pc->filter_arg))) {
+                scores->best = lower;
+            }
         }
     }
-    return score->total;
+    /* families without pending words are left to the filter */
+    for (i = 0; i < scores->n; i++) {
+        struct sc *sc = &scores->sc[i];
+        if (sc->pruned || !sc->pending) {
+            continue;
+        }
+        sc_bounds(sc, index, scores->seq_len, pc->pos_min, pc->pos_max,
+                  &lower, &upper);
+        if (prunable(pc, scores, sc->family, upper)) {
+            sc->pruned = true;
+            scores->stats.pruned++;
+        }
+    }
+    scores->next_check = index + PRUNE_INTERVAL;
+}
+
+/* Find the scores of `family`, or add them if the family is touched for the
+ * first time */
+static int scores_get(struct scoretab *scores, uproc_family family,
+                      struct sc **score)
+{
+    struct sc *sc;
+    uint32_t slot = scores->slot[family];
+
+    if (!slot) {
+        if (scores->n == scores->alloc) {
+            size_t alloc = scores->alloc ? scores->alloc * 2 : 64;
+            struct sc *tmp = realloc(scores->sc, alloc * sizeof *tmp);
+            if (!tmp) {
+                return uproc_error(UPROC_ENOMEM);
+            }
+            scores->sc = tmp;
+            scores->alloc = alloc;
+        }
+        sc = &scores->sc[scores->n++];
+        sc_init(sc);
+        sc->family = family;
+        scores->slot[family] = scores->n;
+    } else {
+        sc = &scores->sc[slot - 1];
+    }
+    *score = sc;
+    return 0;
+}
+
+static int lookup_dir_realloc(struct lookup_dir *dir, size_t n)
+{
+#define R(member)                                                 \
+    do {                                                          \
+        void *tmp = realloc(dir->member, n * sizeof *dir->member); \
+        if (!tmp) {                                               \
+            return uproc_error(UPROC_ENOMEM);                     \
+        }                                                         \
+        dir->member = tmp;                                        \
+    } while (0)
+    R(word);
+    R(lower_nb);
+    R(upper_nb);
+    R(lower_family);
+    R(upper_family);
+#undef R
+    return 0;
+}
+
+static void lookup_dir_free(struct lookup_dir *dir)
+{
+    free(dir->word);
+    free(dir->lower_nb);
+    free(dir->upper_nb);
+    free(dir->lower_family);
+    free(dir->upper_family);
+}
+
+static void wordtab_free(struct wordtab *tab)
+{
+    free(tab->index);
+    lookup_dir_free(&tab->fwd);
+    lookup_dir_free(&tab->rev);
+}
+
+static int wordtab_append(struct wordtab *tab, size_t index,
+                          const struct uproc_word *fwd_word,
+                          const struct uproc_word *rev_word)
+{
+    if (tab->n == tab->alloc) {
+        size_t *tmp, alloc = tab->alloc ? tab->alloc * 2 : 64;
+        tmp = realloc(tab->index, alloc * sizeof *tmp);
+        if (!tmp) {
+            return uproc_error(UPROC_ENOMEM);
+        }
+        tab->index = tmp;
+        if (lookup_dir_realloc(&tab->fwd, alloc) ||
+            lookup_dir_realloc(&tab->rev, alloc)) {
+            return -1;
+        }
+        tab->alloc = alloc;
+    }
+    tab->index[tab->n] = index;
+    tab->fwd.word[tab->n] = *fwd_word;
+    tab->rev.word[tab->n] = *rev_word;
+    tab->n++;
+    return 0;
 }
 
-static int scores_add(uproc_bst *scores, uproc_family family, size_t index,
-                      double dist[static UPROC_SUFFIX_LEN], bool reverse)
+/* Append all words of `seq` to the word table of `ws` */
+static int wordtab_extract(struct uproc_classify_workspace_s *ws,
+                           const struct uproc_protclass_s *pc,
+                           const char *seq)
 {
-    struct sc sc;
-    union uproc_bst_key key = {.uint = family};
-    sc_init(&sc);
-    (void)uproc_bst_get(scores, key, &sc);
-    sc_add(&sc, index, dist, reverse);
-    return uproc_bst_update(scores, key, &sc);
+    int res;
+    size_t index;
+    const uproc_alphabet *alpha = uproc_ecurve_alphabet(pc->fwd);
+    struct uproc_word fwd_word = UPROC_WORD_INITIALIZER,
+                      rev_word = UPROC_WORD_INITIALIZER;
+
+    if (ws->words) {
+        uproc_worditer_reset(ws->words, seq, alpha);
+    } else {
+        ws->words = uproc_worditer_create(seq, alpha);
+        if (!ws->words) {
+            return -1;
+        }
+    }
+    while (res = uproc_worditer_next(ws->words, &index, &fwd_word, &rev_word),
+           !res) {
+        res = wordtab_append(&ws->tab, index, &fwd_word, &rev_word);
+        if (res) {
+            break;
+        }
+    }
+    return res == -1 ? -1 : 0;
 }
 
-static int scores_add_word(const uproc_protclass *pc, uproc_bst *scores,
-                           const struct uproc_word *word, size_t index,
-                           bool reverse, const uproc_ecurve *ecurve,
-                           const uproc_substmat *substmat)
+static void lookup_dir_batch(struct lookup_dir *dir, size_t n,
+                             const uproc_ecurve *ecurve)
+{
+    if (!ecurve) {
+        return;
+    }
+    uproc_ecurve_lookup_batch(ecurve, dir->word, n, dir->lower_nb,
+                              dir->lower_family, dir->upper_nb,
+                              dir->upper_family, NULL);
+}
+
+static int cachetab_reserve(struct cachetab *ct, size_t n)
+{
+    size_t alloc = ct->alloc ? ct->alloc : 64;
+    void *tmp;
+
+    if (n <= ct->alloc) {
+        return 0;
+    }
+    while (alloc < n) {
+        alloc *= 2;
+    }
+#define R(member)                                                     \
+    do {                                                              \
+        tmp = realloc(ct->member, alloc * sizeof *ct->member);         \
+        if (!tmp) {                                                   \
+            return uproc_error(UPROC_ENOMEM);                         \
+        }                                                             \
+        ct->member = tmp;                                             \
+    } while (0)
+    R(hit[0]);
+    R(hit[1]);
+    R(entry[0]);
+    R(entry[1]);
+    R(miss);
+#undef R
+    if (lookup_dir_realloc(&ct->missed, alloc)) {
+        return -1;
+    }
+    ct->alloc = alloc;
+    return 0;
+}
+
+static void cachetab_free(struct cachetab *ct)
+{
+    for (int d = 0; d < 2; d++) {
+        free(ct->hit[d]);
+        free(ct->entry[d]);
+    }
+    free(ct->miss);
+    lookup_dir_free(&ct->missed);
+}
+
+/* Stable LSD radix sort of the indices of `words` by prefix */
+static int sort_by_prefix(const struct uproc_word *words, size_t n,
+                          size_t *perm)
+{
+    enum { BITS = 13, BUCKETS = 1 << BITS };
+    size_t i, *tmp, *count;
+
+    tmp = malloc(n * sizeof *tmp);
+    count = malloc(BUCKETS * sizeof *count);
+    if (!tmp || !count) {
+        free(tmp);
+        free(count);
+        return uproc_error(UPROC_ENOMEM);
+    }
+
+    /* UPROC_PREFIX_MAX < 2^26, so two passes cover all prefixes */
+    for (int pass = 0; pass < 2; pass++) {
+        size_t *src = pass ? tmp : NULL, *dest = pass ? perm : tmp, sum = 0;
+        unsigned shift = pass * BITS;
+        memset(count, 0, BUCKETS * sizeof *count);
+        for (i = 0; i < n; i++) {
+            count[(words[i].prefix >> shift) & (BUCKETS - 1)]++;
+        }
+        for (i = 0; i < BUCKETS; i++) {
+            size_t c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+        for (i = 0; i < n; i++) {
+            size_t k = src ? src[i] : i;
+            dest[count[(words[k].prefix >> shift) & (BUCKETS - 1)]++] = k;
+        }
+    }
+    free(tmp);
+    free(count);
+    return 0;
+}
+
+/* Look up the words of `dir` in ascending order of their prefixes and
+ * scatter the neighbours back to the original positions */
+static int lookup_dir_sweep(struct lookup_dir *dir, size_t n,
+                            const uproc_ecurve *ecurve)
 {
     int res;
-    struct uproc_word lower_nb = UPROC_WORD_INITIALIZER,
-                      upper_nb = UPROC_WORD_INITIALIZER;
-    uproc_family lower_family, upper_family;
-    double dist[UPROC_SUFFIX_LEN];
+    size_t i, *perm;
+    struct lookup_dir sorted = {0};
+
+    if (!ecurve || !n) {
+        return 0;
+    }
+    perm = malloc(n * sizeof *perm);
+    if (!perm) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    res = sort_by_prefix(dir->word, n, perm);
+    if (res || (res = lookup_dir_realloc(&sorted, n))) {
+        goto error;
+    }
+    for (i = 0; i < n; i++) {
+        sorted.word[i] = dir->word[perm[i]];
+    }
+    uproc_ecurve_lookup_sorted(ecurve, sorted.word, n, sorted.lower_nb,
+                               sorted.lower_family, sorted.upper_nb,
+                               sorted.upper_family, NULL);
+    for (i = 0; i < n; i++) {
+        size_t k = perm[i];
+        dir->lower_nb[k] = sorted.lower_nb[i];
+        dir->lower_family[k] = sorted.lower_family[i];
+        dir->upper_nb[k] = sorted.upper_nb[i];
+        dir->upper_family[k] = sorted.upper_family[i];
+    }
+error:
+    lookup_dir_free(&sorted);
+    free(perm);
+    return res;
+}
+
+/* Take the neighbours of the words of direction `d` from the word cache and
+ * look up the others in `ecurve`, in order of their prefixes if `sweep` */
+static int lookup_dir_cached(const struct uproc_protclass_s *pc,
+                             struct uproc_classify_workspace_s *ws, int d,
+                             const uproc_ecurve *ecurve, bool sweep)
+{
+    struct wordtab *tab = &ws->tab;
+    struct lookup_dir *dir = d ? &tab->rev : &tab->fwd;
+    struct cachetab *ct = &ws->cache;
+    size_t i, k, n = 0;
 
     if (!ecurve) {
+        memset(ct->hit[d], 0, tab->n * sizeof *ct->hit[d]);
+        return 0;
+    }
+    for (i = 0; i < tab->n; i++) {
+        struct wordcache_entry *e = &ct->entry[d][i];
+        ct->hit[d][i] = wordcache_get(pc->cache, ecurve_identity(ecurve),
+                                      pc->substmat, &dir->word[i], e);
+        if (ct->hit[d][i]) {
+            dir->lower_nb[i] = e->lower_nb;
+            dir->lower_family[i] = e->lower_family;
+            dir->upper_nb[i] = e->upper_nb;
+            dir->upper_family[i] = e->upper_family;
+        } else {
+            ct->miss[n] = i;
+            ct->missed.word[n++] = dir->word[i];
+        }
+    }
+    ws->scores.stats.cache_hits += tab->n - n;
+    ws->scores.stats.cache_misses += n;
+
+    if (sweep) {
+        if (lookup_dir_sweep(&ct->missed, n, ecurve)) {
+            return -1;
+        }
+    } else {
+        lookup_dir_batch(&ct->missed, n, ecurve);
+    }
+    for (k = 0; k < n; k++) {
+        i = ct->miss[k];
+        dir->lower_nb[i] = ct->missed.lower_nb[k];
+        dir->lower_family[i] = ct->missed.lower_family[k];
+        dir->upper_nb[i] = ct->missed.upper_nb[k];
+        dir->upper_family[i] = ct->missed.upper_family[k];
+    }
+    return 0;
+}
+
+/* Align `word` with its neighbour `nb` from the database (unless the
+ * distances `cached` are given) and add the distances to the scores of
+ * `family`, unless it has been pruned */
+static int scores_add_neighbour(const uproc_protclass *pc,
+                                struct scoretab *scores,
+                                const struct uproc_word *word,
+                                const struct uproc_word *nb,
+                                uproc_family family, size_t index,
+                                bool reverse, const double *cached)
+{
+    struct sc *sc;
+    double dist[UPROC_SUFFIX_LEN];
+
+    if (scores_get(scores, family, &sc)) {
+        return -1;
+    }
+    if (pc->prune) {
+        sc->pending--;
+    }
+    if (sc->pruned) {
+        scores->stats.skipped++;
         return 0;
     }
-    uproc_ecurve_lookup(ecurve, word, &lower_nb, &lower_family, &upper_nb,
-                        &upper_family);
-    uproc_substmat_align_suffixes(substmat, word->suffix, lower_nb.suffix,
-                                  dist);
+    if (cached) {
+        memcpy(dist, cached, sizeof dist);
+    } else {
+        uproc_substmat_align_suffixes(pc->substmat, word->suffix, nb->suffix,
+                                      dist);
+    }
     if (pc->trace.cb) {
-        pc->trace.cb(&lower_nb, lower_family, index, reverse, dist,
-                     pc->trace.cb_arg);
+        pc->trace.cb(nb, family, index, reverse, dist, pc->trace.cb_arg);
     }
-    res = scores_add(scores, lower_family, index, dist, reverse);
-    if (res || !uproc_word_cmp(&lower_nb, &upper_nb)) {
+    sc_add(sc, index, dist, reverse);
+    scores->stats.aligned++;
+    return 0;
+}
+
+/* Add the scores of the `i`th word of `dir`. With a word cache, `cached` is
+ * its entry, which is filled in and stored unless `hit`. */
+static int scores_add_word(const uproc_protclass *pc,
+                           struct scoretab *scores,
+                           const struct lookup_dir *dir, size_t i,
+                           size_t index, bool reverse,
+                           const uproc_ecurve *ecurve,
+                           struct wordcache_entry *cached, bool hit)
+{
+    int res;
+    const struct uproc_word *word = &dir->word[i],
+                            *lower_nb = &dir->lower_nb[i],
+                            *upper_nb = &dir->upper_nb[i];
+    bool same = !uproc_word_cmp(lower_nb, upper_nb);
+
+    if (!ecurve) {
+        return 0;
+    }
+    if (cached && !hit) {
+        cached->lower_nb = *lower_nb;
+        cached->lower_family = dir->lower_family[i];
+        cached->upper_nb = *upper_nb;
+        cached->upper_family = dir->upper_family[i];
+        uproc_substmat_align_suffixes(pc->substmat, word->suffix,
+                                      lower_nb->suffix, cached->lower_dist);
+        if (!same) {
+            uproc_substmat_align_suffixes(pc->substmat, word->suffix,
+                                          upper_nb->suffix,
+                                          cached->upper_dist);
+        }
+        wordcache_put(pc->cache, ecurve_identity(ecurve), pc->substmat, word,
+                      cached);
+    }
+    res = scores_add_neighbour(pc, scores, word, lower_nb,
+                               dir->lower_family[i], index, reverse,
+                               cached ? cached->lower_dist : NULL);
+    if (res || same) {
         return res;
     }
-    uproc_substmat_align_suffixes(substmat, word->suffix, upper_nb.suffix,
-                                  dist);
-    if (pc->trace.cb) {
-        pc->trace.cb(&upper_nb, upper_family, index, reverse, dist,
-                     pc->trace.cb_arg);
+    return scores_add_neighbour(pc, scores, word, upper_nb,
+                                dir->upper_family[i], index, reverse,
+                                cached ? cached->upper_dist : NULL);
+}
+
+/* Count the pending words of each family touched by `dir[from:to]` */
+static int scores_count_dir(struct scoretab *scores,
+                            const struct wordtab *tab,
+                            const struct lookup_dir *dir, size_t from,
+                            size_t to)
+{
+    struct sc *sc;
+
+    for (size_t i = from; i < to; i++) {
+        if (scores_get(scores, dir->lower_family[i], &sc)) {
+            return -1;
+        }
+        sc->pending++;
+        sc->last = MAX(sc->last, tab->index[i]);
+        if (!uproc_word_cmp(&dir->lower_nb[i], &dir->upper_nb[i])) {
+            continue;
+        }
+        if (scores_get(scores, dir->upper_family[i], &sc)) {
+            return -1;
+        }
+        sc->pending++;
+        sc->last = MAX(sc->last, tab->index[i]);
     }
-    res = scores_add(scores, upper_family, index, dist, reverse);
-    return res;
+    return 0;
 }
 
-static int scores_compute(const struct uproc_protclass_s *pc, const char *seq,
-                          uproc_bst *scores)
+/* Add the scores of the words `tab[from:to]`, whose neighbours have already
+ * been looked up (or taken from the word cache, if `ct` is not NULL) */
+static int scores_add_words(const struct uproc_protclass_s *pc,
+                            struct scoretab *scores,
+                            const struct wordtab *tab, struct cachetab *ct,
+                            size_t from, size_t to)
 {
     int res;
-    uproc_worditer *iter;
-    size_t index;
-    struct uproc_word fwd_word = UPROC_WORD_INITIALIZER,
-                      rev_word = UPROC_WORD_INITIALIZER;
+    size_t i;
 
-    iter = uproc_worditer_create(seq, uproc_ecurve_alphabet(pc->fwd));
-    if (!iter) {
+    if (pc->prune &&
+        ((pc->fwd && scores_count_dir(scores, tab, &tab->fwd, from, to)) ||
+         (pc->rev && scores_count_dir(scores, tab, &tab->rev, from, to)))) {
         return -1;
     }
-
-    while (res = uproc_worditer_next(iter, &index, &fwd_word, &rev_word),
-           !res) {
-        res = scores_add_word(pc, scores, &fwd_word, index, false, pc->fwd,
-                              pc->substmat);
+    for (i = from; i < to; i++) {
+        if (pc->prune && tab->index[i] >= scores->next_check) {
+            scores_prune(pc, scores, tab->index[i]);
+        }
+        res = scores_add_word(pc, scores, &tab->fwd, i, tab->index[i], false,
+                              pc->fwd, ct ? &ct->entry[0][i] : NULL,
+                              ct && ct->hit[0][i]);
         if (res) {
-            break;
+            return res;
         }
-        res = scores_add_word(pc, scores, &rev_word, index, true, pc->rev,
-                              pc->substmat);
+        res = scores_add_word(pc, scores, &tab->rev, i, tab->index[i], true,
+                              pc->rev, ct ? &ct->entry[1][i] : NULL,
+                              ct && ct->hit[1][i]);
         if (res) {
-            break;
+            return res;
         }
     }
-    uproc_worditer_destroy(iter);
-    return res == -1 ? -1 : 0;
+    return 0;
+}
+
+/* Prepare the score table of `ws` for the sequence `seq` */
+static int scores_prepare(struct uproc_classify_workspace_s *ws,
+                          const char *seq)
+{
+    struct scoretab *scores = &ws->scores;
+
+    if (!scores->slot) {
+        scores->slot = calloc(UPROC_FAMILY_MAX + 1, sizeof *scores->slot);
+        if (!scores->slot) {
+            return uproc_error(UPROC_ENOMEM);
+        }
+    }
+    for (size_t i = 0; i < scores->n; i++) {
+        scores->slot[scores->sc[i].family] = 0;
+    }
+    scores->n = 0;
+    scores->seq = seq;
+    scores->seq_len = strlen(seq);
+    scores->next_check = 0;
+    scores->best = -INFINITY;
+    return 0;
+}
+
+static int scores_compute(const struct uproc_protclass_s *pc, const char *seq,
+                          struct uproc_classify_workspace_s *ws)
+{
+    int res;
+    struct wordtab *tab = &ws->tab;
+
+    tab->n = 0;
+    res = wordtab_extract(ws, pc, seq);
+    if (res) {
+        return res;
+    }
+    if (pc->cache) {
+        if (cachetab_reserve(&ws->cache, tab->n)) {
+            return -1;
+        }
+        if (lookup_dir_cached(pc, ws, 0, pc->fwd, false) ||
+            lookup_dir_cached(pc, ws, 1, pc->rev, false)) {
+            return -1;
+        }
+        return scores_add_words(pc, &ws->scores, tab, &ws->cache, 0, tab->n);
+    }
+    lookup_dir_batch(&tab->fwd, tab->n, pc->fwd);
+    lookup_dir_batch(&tab->rev, tab->n, pc->rev);
+    return scores_add_words(pc, &ws->scores, tab, NULL, 0, tab->n);
 }
 
 /****************
  * finalization *
  ****************/
 
+static int sc_cmp_family(const void *p1, const void *p2)
+{
+    const struct sc *s1 = p1, *s2 = p2;
+    return (s1->family > s2->family) - (s1->family < s2->family);
+}
+
 static int scores_finalize(const struct uproc_protclass_s *pc, const char *seq,
-                           uproc_bst *score_tree, uproc_list *results)
+                           struct scoretab *scores, uproc_list *results)
 {
     int res = 0;
-    uproc_bstiter *iter;
-    union uproc_bst_key key;
-    struct sc value;
     size_t seq_len = strlen(seq);
     struct uproc_protresult pred, pred_max = {.score = -INFINITY};
 
-    iter = uproc_bstiter_create(score_tree);
-    if (!iter) {
-        return -1;
-    }
-    while (!uproc_bstiter_next(iter, &key, &value)) {
-        uproc_family family = key.uint;
-        double score = sc_finalize(&value);
-        if (pc->filter &&
-            !pc->filter(seq, seq_len, family, score, pc->filter_arg)) {
+    /* report the families in ascending order */
+    qsort(scores->sc, scores->n, sizeof *scores->sc, sc_cmp_family);
+    for (size_t i = 0; i < scores->n && !res; i++) {
+        if (scores->sc[i].pruned) {
+            continue;
+        }
+        pred.family = scores->sc[i].family;
+        pred.score = sc_finalize(&scores->sc[i]);
+        if (pc->filter && !pc->filter(seq, seq_len, pred.family, pred.score,
+                                      pc->filter_arg)) {
             continue;
         }
-        pred.score = score;
-        pred.family = family;
         if (pc->mode == UPROC_PROTCLASS_MAX) {
             if (!uproc_list_size(results)) {
                 pred_max = pred;
                 res = uproc_list_append(results, &pred);
-                if (res) {
-                    break;
-                }
             } else if (pred.score > pred_max.score) {
                 pred_max = pred;
                 uproc_list_set(results, 0, &pred_max);
             }
         } else {
-            uproc_list_append(results, &pred);
+            res = uproc_list_append(results, &pred);
         }
     }
-    uproc_bstiter_destroy(iter);
     return res;
 }
 
@@ -288,6 +808,8 @@ uproc_protclass *uproc_protclass_create(enum uproc_protclass_mode mode,
         .trace = {
             .cb = NULL, .cb_arg = NULL,
         },
+        .prune = false,
+        .cache = NULL,
     };
     return pc;
 }
@@ -303,12 +825,8 @@ static void map_list_protresult_free(void *value, void *opaque)
     uproc_protresult_free(value);
 }
 
-int uproc_protclass_classify(const uproc_protclass *pc, const char *seq,
-                             uproc_list **results)
+static int results_prepare(uproc_list **results)
 {
-    int res;
-    uproc_bst *scores;
-
     if (!*results) {
         *results = uproc_list_create(sizeof(struct uproc_protresult));
         if (!*results) {
@@ -318,21 +836,171 @@ int uproc_protclass_classify(const uproc_protclass *pc, const char *seq,
         uproc_list_map(*results, map_list_protresult_free, NULL);
         uproc_list_clear(*results);
     }
+    return 0;
+}
+
+uproc_classify_workspace *uproc_classify_workspace_create(void)
+{
+    struct uproc_classify_workspace_s *ws = calloc(1, sizeof *ws);
+    if (!ws) {
+        uproc_error(UPROC_ENOMEM);
+    }
+    return ws;
+}
+
+void uproc_classify_workspace_destroy(uproc_classify_workspace *ws)
+{
+    if (!ws) {
+        return;
+    }
+    free(ws->scores.slot);
+    free(ws->scores.sc);
+    uproc_worditer_destroy(ws->words);
+    wordtab_free(&ws->tab);
+    cachetab_free(&ws->cache);
+    uproc_bst_destroy(ws->max_scores);
+    uproc_orfiter_destroy(ws->orfs);
+    uproc_list_destroy(ws->orf_results);
+    for (size_t i = 0; i < ws->orf_pool_n; i++) {
+        free(ws->orf_pool[i].data);
+    }
+    free(ws->orf_pool);
+    free(ws);
+}
 
-    scores = uproc_bst_create(UPROC_BST_UINT, sizeof(struct sc));
-    if (!scores) {
+int uproc_protclass_classify(const uproc_protclass *pc, const char *seq,
+                             uproc_list **results)
+{
+    return uproc_protclass_classify_ws(pc, NULL, seq, results);
+}
+
+int uproc_protclass_classify_ws(const uproc_protclass *pc,
+                                uproc_classify_workspace *ws, const char *seq,
+                                uproc_list **results)
+{
+    int res;
+
+    if (!ws) {
+        ws = uproc_classify_workspace_create();
+        if (!ws) {
+            return -1;
+        }
+        res = uproc_protclass_classify_ws(pc, ws, seq, results);
+        uproc_classify_workspace_destroy(ws);
+        return res;
+    }
+
+    if (results_prepare(results) || scores_prepare(ws, seq)) {
         return -1;
     }
-    res = scores_compute(pc, seq, scores);
-    if (res || uproc_bst_isempty(scores)) {
-        goto error;
+    res = scores_compute(pc, seq, ws);
+    if (res || !ws->scores.n) {
+        return res;
+    }
+    return scores_finalize(pc, seq, &ws->scores, *results);
+}
+
+int uproc_protclass_classify_many(const uproc_protclass *pc,
+                                  uproc_classify_workspace *ws,
+                                  const char *const *seqs, size_t n,
+                                  uproc_list **results)
+{
+    int res = 0;
+    size_t i, *start;
+    struct wordtab *tab;
+    struct cachetab *ct = NULL;
+
+    if (!ws) {
+        ws = uproc_classify_workspace_create();
+        if (!ws) {
+            return -1;
+        }
+        res = uproc_protclass_classify_many(pc, ws, seqs, n, results);
+        uproc_classify_workspace_destroy(ws);
+        return res;
+    }
+
+    start = malloc((n + 1) * sizeof *start);
+    if (!start) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    tab = &ws->tab;
+    tab->n = 0;
+    for (i = 0; i < n; i++) {
+        start[i] = tab->n;
+        res = wordtab_extract(ws, pc, seqs[i]);
+        if (res) {
+            goto error;
+        }
+    }
+    start[n] = tab->n;
+
+    if (pc->cache) {
+        ct = &ws->cache;
+        res = cachetab_reserve(ct, tab->n);
+        if (res || (res = lookup_dir_cached(pc, ws, 0, pc->fwd, true)) ||
+            (res = lookup_dir_cached(pc, ws, 1, pc->rev, true))) {
+            goto error;
+        }
+    } else {
+        res = lookup_dir_sweep(&tab->fwd, tab->n, pc->fwd);
+        if (res || (res = lookup_dir_sweep(&tab->rev, tab->n, pc->rev))) {
+            goto error;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        res = results_prepare(&results[i]);
+        if (res || (res = scores_prepare(ws, seqs[i]))) {
+            goto error;
+        }
+        res = scores_add_words(pc, &ws->scores, tab, ct, start[i],
+                               start[i + 1]);
+        if (res) {
+            goto error;
+        }
+        if (ws->scores.n) {
+            res = scores_finalize(pc, seqs[i], &ws->scores, results[i]);
+            if (res) {
+                goto error;
+            }
+        }
     }
-    res = scores_finalize(pc, seq, scores, *results);
 error:
-    uproc_bst_destroy(scores);
+    free(start);
     return res;
 }
 
+void uproc_classify_workspace_stats(const uproc_classify_workspace *ws,
+                                    struct uproc_protclass_stats *stats)
+{
+    *stats = ws->scores.stats;
+}
+
+void uproc_protclass_set_pruning(uproc_protclass *pc, bool prune)
+{
+    double d, max = 0.0, min = 0.0;
+
+    for (unsigned pos = 0; prune && pos < UPROC_SUFFIX_LEN; pos++) {
+        for (uproc_amino x = 0; x < UPROC_ALPHABET_SIZE; x++) {
+            for (uproc_amino y = 0; y < UPROC_ALPHABET_SIZE; y++) {
+                d = uproc_substmat_get(pc->substmat, pos, x, y);
+                max = MAX(max, d);
+                min = d < min ? d : min;
+            }
+        }
+    }
+    /* without a filter, only the maximum mode has anything to prune */
+    pc->prune = prune && (pc->filter || pc->mode == UPROC_PROTCLASS_MAX);
+    pc->pos_max = max;
+    pc->pos_min = min;
+}
+
+void uproc_protclass_set_cache(uproc_protclass *pc, uproc_wordcache *cache)
+{
+    pc->cache = cache;
+}
+
 void uproc_protclass_set_trace(uproc_protclass *pc,
                                uproc_protclass_trace_cb *cb, void *cb_arg)
 {
@@ -22,6 +22,8 @@
 #include <config.h>
 #endif
 
+#include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,27 +35,230 @@
 #include "uproc/matrix.h"
 #include "uproc/substmat.h"
 
+#if HAVE_IMMINTRIN_H && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__)) && UPROC_SUFFIX_LEN == 12
+#define SUBSTMAT_HAVE_X86_DISPATCH 1
+#include <immintrin.h>
+#else
+#define SUBSTMAT_HAVE_X86_DISPATCH 0
+#endif
+
+/** Number of entries of the distance matrix of one suffix position */
+#define SUBSTMAT_ROW (UPROC_ALPHABET_SIZE << UPROC_AMINO_BITS)
+
 struct uproc_substmat_s
 {
     /** Matrix containing distances */
-    double dists[UPROC_SUFFIX_LEN][UPROC_ALPHABET_SIZE << UPROC_AMINO_BITS];
+    double dists[UPROC_SUFFIX_LEN][SUBSTMAT_ROW];
+
+    /** Single precision copy of `dists` (`UPROC_SUFFIX_LEN` rows), only
+     * allocated in ::UPROC_SUBSTMAT_FLOAT mode */
+    float (*dists_float)[SUBSTMAT_ROW];
+
+    /** Mode set with uproc_substmat_mode_set() and the kernel implementing
+     * it */
+    unsigned mode;
+    void (*align)(const struct uproc_substmat_s *, uproc_suffix, uproc_suffix,
+                  double *);
 };
 
 #define SUBSTMAT_INDEX(x, y) ((x) << UPROC_AMINO_BITS | (y))
 
+#define ELEMENTS(a) (sizeof(a) / sizeof(a)[0])
+
+#define SUBSTMAT_KERNELS \
+    (UPROC_SUBSTMAT_SCALAR | UPROC_SUBSTMAT_AVX2 | UPROC_SUBSTMAT_AVX512)
+
+static const struct
+{
+    unsigned flag;
+    const char *name;
+} mode_names[] = {
+    {UPROC_SUBSTMAT_SCALAR, "scalar"},
+    {UPROC_SUBSTMAT_AVX2, "avx2"},
+    {UPROC_SUBSTMAT_AVX512, "avx512"},
+    {UPROC_SUBSTMAT_FLOAT, "float"},
+};
+
+static void align_scalar(const struct uproc_substmat_s *mat, uproc_suffix s1,
+                         uproc_suffix s2, double *dist)
+{
+    size_t i, idx;
+    uproc_amino a1, a2;
+    for (i = 0; i < UPROC_SUFFIX_LEN; i++) {
+        a1 = s1 & UPROC_BITMASK(UPROC_AMINO_BITS);
+        a2 = s2 & UPROC_BITMASK(UPROC_AMINO_BITS);
+        s1 >>= UPROC_AMINO_BITS;
+        s2 >>= UPROC_AMINO_BITS;
+        idx = UPROC_SUFFIX_LEN - i - 1;
+        dist[idx] = mat->dists[idx][SUBSTMAT_INDEX(a1, a2)];
+    }
+}
+
+static void align_scalar_float(const struct uproc_substmat_s *mat,
+                               uproc_suffix s1, uproc_suffix s2, double *dist)
+{
+    size_t i, idx;
+    uproc_amino a1, a2;
+    for (i = 0; i < UPROC_SUFFIX_LEN; i++) {
+        a1 = s1 & UPROC_BITMASK(UPROC_AMINO_BITS);
+        a2 = s2 & UPROC_BITMASK(UPROC_AMINO_BITS);
+        s1 >>= UPROC_AMINO_BITS;
+        s2 >>= UPROC_AMINO_BITS;
+        idx = UPROC_SUFFIX_LEN - i - 1;
+        dist[idx] = mat->dists_float[idx][SUBSTMAT_INDEX(a1, a2)];
+    }
+}
+
+#if SUBSTMAT_HAVE_X86_DISPATCH
+/* The amino acid at suffix position `i` is found `shifts[i]` bits from the
+ * LSB, its distances start at the `rows[i]`th entry of the matrix. Padded to
+ * two vectors of eight lanes. */
+#define SHIFT(i) (UPROC_AMINO_BITS * (UPROC_SUFFIX_LEN - 1 - (i)))
+static const long long shifts[16] = {
+    SHIFT(0), SHIFT(1), SHIFT(2), SHIFT(3), SHIFT(4),  SHIFT(5),
+    SHIFT(6), SHIFT(7), SHIFT(8), SHIFT(9), SHIFT(10), SHIFT(11),
+};
+#undef SHIFT
+#define ROW(i) ((i) * SUBSTMAT_ROW)
+static const long long rows[16] = {
+    ROW(0), ROW(1), ROW(2), ROW(3), ROW(4),  ROW(5),
+    ROW(6), ROW(7), ROW(8), ROW(9), ROW(10), ROW(11),
+};
+#undef ROW
+
+/* Matrix entries of suffix positions `i` to `i + 3` */
+__attribute__((target("avx2"))) static inline __m256i index_avx2(
+    __m256i s1, __m256i s2, size_t i)
+{
+    __m256i mask = _mm256_set1_epi64x(UPROC_BITMASK(UPROC_AMINO_BITS));
+    __m256i shift = _mm256_loadu_si256((const __m256i *)(shifts + i));
+    __m256i row = _mm256_loadu_si256((const __m256i *)(rows + i));
+    __m256i a1 = _mm256_and_si256(_mm256_srlv_epi64(s1, shift), mask);
+    __m256i a2 = _mm256_and_si256(_mm256_srlv_epi64(s2, shift), mask);
+    a1 = _mm256_slli_epi64(a1, UPROC_AMINO_BITS);
+    return _mm256_add_epi64(row, _mm256_or_si256(a1, a2));
+}
+
+__attribute__((target("avx2"))) static void align_avx2(
+    const struct uproc_substmat_s *mat, uproc_suffix s1, uproc_suffix s2,
+    double *dist)
+{
+    __m256i v1 = _mm256_set1_epi64x(s1), v2 = _mm256_set1_epi64x(s2);
+    for (size_t i = 0; i < UPROC_SUFFIX_LEN; i += 4) {
+        __m256d d = _mm256_i64gather_pd(&mat->dists[0][0],
+                                        index_avx2(v1, v2, i), 8);
+        _mm256_storeu_pd(dist + i, d);
+    }
+}
+
+__attribute__((target("avx2"))) static void align_avx2_float(
+    const struct uproc_substmat_s *mat, uproc_suffix s1, uproc_suffix s2,
+    double *dist)
+{
+    __m256i v1 = _mm256_set1_epi64x(s1), v2 = _mm256_set1_epi64x(s2);
+    for (size_t i = 0; i < UPROC_SUFFIX_LEN; i += 4) {
+        __m128 d = _mm256_i64gather_ps(&mat->dists_float[0][0],
+                                       index_avx2(v1, v2, i), 4);
+        _mm256_storeu_pd(dist + i, _mm256_cvtps_pd(d));
+    }
+}
+
+/* Matrix entries of suffix positions `i` to `i + 7` */
+__attribute__((target("avx512f"))) static inline __m512i index_avx512(
+    __m512i s1, __m512i s2, size_t i)
+{
+    __m512i mask = _mm512_set1_epi64(UPROC_BITMASK(UPROC_AMINO_BITS));
+    __m512i shift = _mm512_loadu_si512(shifts + i);
+    __m512i row = _mm512_loadu_si512(rows + i);
+    __m512i a1 = _mm512_and_si512(_mm512_srlv_epi64(s1, shift), mask);
+    __m512i a2 = _mm512_and_si512(_mm512_srlv_epi64(s2, shift), mask);
+    a1 = _mm512_slli_epi64(a1, UPROC_AMINO_BITS);
+    return _mm512_add_epi64(row, _mm512_or_si512(a1, a2));
+}
+
+/* Positions 8 to 11 are gathered with AVX2, which is faster than a masked
+ * gather of half a vector */
+__attribute__((target("avx512f,avx2"))) static void align_avx512(
+    const struct uproc_substmat_s *mat, uproc_suffix s1, uproc_suffix s2,
+    double *dist)
+{
+    const double *base = &mat->dists[0][0];
+    __m512i v1 = _mm512_set1_epi64(s1), v2 = _mm512_set1_epi64(s2);
+    __m512d d = _mm512_i64gather_pd(index_avx512(v1, v2, 0), base, 8);
+    __m256i idx = index_avx2(_mm512_castsi512_si256(v1),
+                             _mm512_castsi512_si256(v2), 8);
+    _mm512_storeu_pd(dist, d);
+    _mm256_storeu_pd(dist + 8, _mm256_i64gather_pd(base, idx, 8));
+}
+
+__attribute__((target("avx512f,avx2"))) static void align_avx512_float(
+    const struct uproc_substmat_s *mat, uproc_suffix s1, uproc_suffix s2,
+    double *dist)
+{
+    const float *base = &mat->dists_float[0][0];
+    __m512i v1 = _mm512_set1_epi64(s1), v2 = _mm512_set1_epi64(s2);
+    __m256 d = _mm512_i64gather_ps(index_avx512(v1, v2, 0), base, 4);
+    __m256i idx = index_avx2(_mm512_castsi512_si256(v1),
+                             _mm512_castsi512_si256(v2), 8);
+    _mm512_storeu_pd(dist, _mm512_cvtps_pd(d));
+    _mm256_storeu_pd(dist + 8,
+                     _mm256_cvtps_pd(_mm256_i64gather_ps(base, idx, 4)));
+}
+#endif
+
+/* Widest kernel supported by the CPU */
+static unsigned kernel_best(void)
+{
+#if SUBSTMAT_HAVE_X86_DISPATCH
+    if (__builtin_cpu_supports("avx512f")) {
+        return UPROC_SUBSTMAT_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return UPROC_SUBSTMAT_AVX2;
+    }
+#endif
+    return UPROC_SUBSTMAT_SCALAR;
+}
+
+static bool kernel_supported(unsigned kernel)
+{
+#if SUBSTMAT_HAVE_X86_DISPATCH
+    if (kernel == UPROC_SUBSTMAT_AVX512) {
+        return __builtin_cpu_supports("avx512f");
+    }
+    if (kernel == UPROC_SUBSTMAT_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return kernel == UPROC_SUBSTMAT_SCALAR;
+}
+
 uproc_substmat *uproc_substmat_create(void)
 {
     struct uproc_substmat_s *mat = malloc(sizeof *mat);
+    const char *value = getenv("UPROC_SUBSTMAT");
+    unsigned mode = 0;
+
     if (!mat) {
         uproc_error(UPROC_ENOMEM);
         return NULL;
     }
-    *mat = (struct uproc_substmat_s){{{0.0}}};
+    *mat = (struct uproc_substmat_s){.align = align_scalar};
+    if ((value && uproc_substmat_mode_parse(value, &mode)) ||
+        uproc_substmat_mode_set(mat, mode)) {
+        free(mat);
+        return NULL;
+    }
     return mat;
 }
 
 void uproc_substmat_destroy(uproc_substmat *mat)
 {
+    if (!mat) {
+        return;
+    }
+    free(mat->dists_float);
     free(mat);
 }
 
@@ -67,22 +272,142 @@ void uproc_substmat_set(uproc_substmat *mat, unsigned pos, uproc_amino x,
                         uproc_amino y, double dist)
 {
     mat->dists[pos][SUBSTMAT_INDEX(x, y)] = dist;
+    if (mat->dists_float) {
+        mat->dists_float[pos][SUBSTMAT_INDEX(x, y)] = dist;
+    }
 }
 
 void uproc_substmat_align_suffixes(const uproc_substmat *mat, uproc_suffix s1,
                                    uproc_suffix s2,
                                    double dist[static UPROC_SUFFIX_LEN])
 {
-    size_t i, idx;
-    uproc_amino a1, a2;
-    for (i = 0; i < UPROC_SUFFIX_LEN; i++) {
-        a1 = s1 & UPROC_BITMASK(UPROC_AMINO_BITS);
-        a2 = s2 & UPROC_BITMASK(UPROC_AMINO_BITS);
-        s1 >>= UPROC_AMINO_BITS;
-        s2 >>= UPROC_AMINO_BITS;
-        idx = UPROC_SUFFIX_LEN - i - 1;
-        dist[idx] = uproc_substmat_get(mat, idx, a1, a2);
+    mat->align(mat, s1, s2, dist);
+}
+
+int uproc_substmat_mode_set(uproc_substmat *mat, unsigned mode)
+{
+    unsigned kernel = mode & SUBSTMAT_KERNELS;
+    bool single = mode & UPROC_SUBSTMAT_FLOAT;
+
+    if (mode & ~(SUBSTMAT_KERNELS | UPROC_SUBSTMAT_FLOAT) ||
+        (kernel & (kernel - 1))) {
+        return uproc_error_msg(UPROC_EINVAL, "invalid substmat mode");
+    }
+    if (!kernel) {
+        kernel = kernel_best();
+    } else if (!kernel_supported(kernel)) {
+        return uproc_error_msg(UPROC_EINVAL,
+                               "substmat kernel not supported by this CPU");
+    }
+
+    if (single && !mat->dists_float) {
+        mat->dists_float = malloc(UPROC_SUFFIX_LEN * sizeof *mat->dists_float);
+        if (!mat->dists_float) {
+            return uproc_error(UPROC_ENOMEM);
+        }
+        for (size_t i = 0; i < UPROC_SUFFIX_LEN; i++) {
+            for (size_t k = 0; k < SUBSTMAT_ROW; k++) {
+                mat->dists_float[i][k] = mat->dists[i][k];
+            }
+        }
+    } else if (!single) {
+        free(mat->dists_float);
+        mat->dists_float = NULL;
+    }
+    mat->align = single ? align_scalar_float : align_scalar;
+#if SUBSTMAT_HAVE_X86_DISPATCH
+    if (kernel == UPROC_SUBSTMAT_AVX512) {
+        mat->align = single ? align_avx512_float : align_avx512;
+    } else if (kernel == UPROC_SUBSTMAT_AVX2) {
+        mat->align = single ? align_avx2_float : align_avx2;
+    }
+#endif
+    mat->mode = kernel | (single ? UPROC_SUBSTMAT_FLOAT : 0);
+    return 0;
+}
+
+unsigned uproc_substmat_mode(const uproc_substmat *mat)
+{
+    return mat->mode;
+}
+
+int uproc_substmat_mode_parse(const char *str, unsigned *mode)
+{
+    unsigned result = 0;
+
+    while (*str) {
+        size_t i, len = strcspn(str, ",");
+        for (i = 0; i < ELEMENTS(mode_names); i++) {
+            if (strlen(mode_names[i].name) == len &&
+                !strncmp(str, mode_names[i].name, len)) {
+                result |= mode_names[i].flag;
+                break;
+            }
+        }
+        if (i == ELEMENTS(mode_names) &&
+            !(len == strlen("default") && !strncmp(str, "default", len))) {
+            return uproc_error_msg(UPROC_EINVAL, "unknown substmat mode \"%.*s\"",
+                                   (int)len, str);
+        }
+        str += len + !!str[len];
+    }
+    *mode = result;
+    return 0;
+}
+
+int uproc_substmat_mode_str(unsigned mode, char *buf, size_t n)
+{
+    int len = 0;
+
+    if (!mode) {
+        return snprintf(buf, n, "default");
+    }
+    if (n) {
+        buf[0] = '\0';
+    }
+    for (size_t i = 0; i < ELEMENTS(mode_names); i++) {
+        if (mode & mode_names[i].flag) {
+            size_t left = (size_t)len < n ? n - len : 0;
+            len += snprintf(left ? buf + len : NULL, left, "%s%s",
+                            len ? "," : "", mode_names[i].name);
+        }
+    }
+    return len;
+}
+
+double uproc_substmat_deviation(const uproc_substmat *mat,
+                                unsigned long samples)
+{
+    /* xorshift64, fixed seed for reproducible reports */
+    uint_least64_t x = 0x9e3779b97f4a7c15;
+    double max = 0.0;
+
+    while (samples--) {
+        uproc_suffix s[2];
+        double dist[UPROC_SUFFIX_LEN], ref[UPROC_SUFFIX_LEN];
+        double score = 0.0, ref_score = 0.0;
+
+        /* random amino acids in each position */
+        for (int k = 0; k < 2; k++) {
+            s[k] = 0;
+            for (size_t i = 0; i < UPROC_SUFFIX_LEN; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                s[k] = s[k] << UPROC_AMINO_BITS | (x >> 32) % UPROC_ALPHABET_SIZE;
+            }
+        }
+        uproc_substmat_align_suffixes(mat, s[0], s[1], dist);
+        align_scalar(mat, s[0], s[1], ref);
+        for (size_t i = 0; i < UPROC_SUFFIX_LEN; i++) {
+            score += dist[i];
+            ref_score += ref[i];
+        }
+        if (fabs(score - ref_score) > max) {
+            max = fabs(score - ref_score);
+        }
     }
+    return max;
 }
 
 uproc_substmat *uproc_substmat_loadv(enum uproc_io_type iotype,
@@ -176,6 +176,39 @@ START_TEST(test_iter)
 }
 END_TEST
 
+START_TEST(test_clear)
+{
+    int res, i, k;
+
+    for (k = 0; k < 3; k++) {
+        /* refill with different values every round */
+        for (i = 0; i < N_TESTS - k; i++) {
+            key.uint = test_data[idx[i]].key;
+            value = test_data[idx[i]].value;
+            value.x += k;
+            res = uproc_bst_insert(bst, key, &value);
+            ck_assert_int_eq(res, 0);
+        }
+        ck_assert_uint_eq(uproc_bst_size(bst), N_TESTS - k);
+
+        for (i = 0; i < N_TESTS; i++) {
+            key.uint = test_data[idx[i]].key;
+            res = uproc_bst_get(bst, key, &value);
+            if (i < N_TESTS - k) {
+                ck_assert_int_eq(res, 0);
+                ck_assert_int_eq(test_data[idx[i]].value.x + k, value.x);
+            } else {
+                ck_assert_int_eq(res, UPROC_BST_KEY_NOT_FOUND);
+            }
+        }
+
+        uproc_bst_clear(bst);
+        ck_assert(uproc_bst_isempty(bst));
+        ck_assert_uint_eq(uproc_bst_size(bst), 0);
+    }
+}
+END_TEST
+
 int main(void)
 {
     Suite *s = suite_create("bst");
@@ -184,6 +217,7 @@ int main(void)
     tcase_add_test(tc, test_insert);
     tcase_add_test(tc, test_update);
     tcase_add_test(tc, test_iter);
+    tcase_add_test(tc, test_clear);
     tcase_add_checked_fixture(tc, setup, teardown);
     suite_add_tcase(s, tc);
 
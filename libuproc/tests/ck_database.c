@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+#include "uproc.h"
+#include "fixture.h"
+#include "../database_internal.h"
+
+#define BUNDLE TMPDATADIR "test.bundle"
+
+struct fixture_entry entries[] = {
+      {100, 10, 0},
+      {100, 20, 1},
+      {101, 5, 2},
+      {4711, 1, 0},
+      {4711, 1000, 1},
+      {50000000, 77, 2},
+};
+
+const char *ids[] = {"PF00001", "PF00002", "PF00003"};
+
+static uproc_ecurve *build(void)
+{
+    int res;
+    uproc_ecurve *ec = fixture_ecurve(entries, ELEMENTS(entries));
+
+    /* keep the files small */
+    res = uproc_ecurve_convert(ec, UPROC_ECURVE_COMPACT_PREFIXES);
+    ck_assert_int_eq(res, 0);
+    return ec;
+}
+
+static void store_matrix(int level)
+{
+    int res;
+    double values[6];
+    uproc_matrix *mat;
+
+    for (size_t i = 0; i < ELEMENTS(values); i++) {
+        values[i] = level * 10 + i;
+    }
+    mat = uproc_matrix_create(2, 3, values);
+    ck_assert_ptr_ne(mat, NULL);
+    res = uproc_matrix_store(mat, UPROC_IO_GZIP, TMPDATADIR "prot_thresh_e%d",
+                             level);
+    ck_assert_int_eq(res, 0);
+    uproc_matrix_destroy(mat);
+}
+
+void setup(void)
+{
+    int res;
+    uproc_ecurve *ec;
+    uproc_idmap *map;
+
+    ec = build();
+    res = uproc_ecurve_store(ec, UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                             TMPDATADIR "fwd.ecurve");
+    ck_assert_int_eq(res, 0);
+    res = uproc_ecurve_store(ec, UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                             TMPDATADIR "rev.ecurve");
+    ck_assert_int_eq(res, 0);
+    uproc_ecurve_destroy(ec);
+
+    map = uproc_idmap_create();
+    ck_assert_ptr_ne(map, NULL);
+    for (size_t i = 0; i < ELEMENTS(ids); i++) {
+        ck_assert_uint_eq(uproc_idmap_family(map, ids[i]), i);
+    }
+    res = uproc_idmap_store(map, UPROC_IO_GZIP, TMPDATADIR "idmap");
+    ck_assert_int_eq(res, 0);
+    uproc_idmap_destroy(map);
+
+    store_matrix(2);
+    store_matrix(3);
+}
+
+void teardown(void)
+{
+}
+
+static void check_database(uproc_database *db, int level)
+{
+    int res;
+    unsigned long rows, cols;
+    struct uproc_word word, lower, upper;
+    uproc_family lower_family, upper_family;
+    uproc_idmap *map;
+    uproc_matrix *mat;
+    uproc_ecurve *ecurves[2];
+
+    ck_assert_ptr_ne(db, NULL);
+
+    ecurves[0] = uproc_database_ecurve_forward(db);
+    ecurves[1] = uproc_database_ecurve_reverse(db);
+    for (int k = 0; k < 2; k++) {
+        ck_assert_uint_eq(uproc_ecurve_layout(ecurves[k]),
+                          UPROC_ECURVE_COMPACT_PREFIXES);
+        for (size_t i = 0; i < ELEMENTS(entries); i++) {
+            word.prefix = entries[i].prefix;
+            word.suffix = entries[i].suffix;
+            res = uproc_ecurve_lookup(ecurves[k], &word, &lower, &lower_family,
+                                      &upper, &upper_family);
+            ck_assert_int_eq(res, UPROC_ECURVE_EXACT);
+            ck_assert_uint_eq(lower_family, entries[i].family);
+        }
+    }
+
+    map = uproc_database_idmap(db);
+    for (size_t i = 0; i < ELEMENTS(ids); i++) {
+        ck_assert_str_eq(uproc_idmap_str(map, i), ids[i]);
+    }
+
+    mat = uproc_database_protein_threshold(db);
+    if (!level) {
+        ck_assert_ptr_eq(mat, NULL);
+        return;
+    }
+    ck_assert_ptr_ne(mat, NULL);
+    uproc_matrix_dimensions(mat, &rows, &cols);
+    ck_assert_uint_eq(rows, 2);
+    ck_assert_uint_eq(cols, 3);
+    ck_assert(uproc_matrix_get(mat, 1, 2) == level * 10 + 5);
+}
+
+static double last_percent;
+
+static void progress(double percent)
+{
+    ck_assert(percent >= last_percent);
+    last_percent = percent;
+}
+
+START_TEST(test_loadp)
+{
+    uproc_database *db;
+
+    last_percent = 0.0;
+    db = uproc_database_loadp(TMPDATADIR, 3, UPROC_ECURVE_BINARY, 0, progress);
+    check_database(db, 3);
+    ck_assert(last_percent == 100.0);
+    uproc_database_destroy(db);
+
+    /* the error of a failed component reaches the caller */
+    db = uproc_database_loadp(TMPDATADIR "nonexistent", 2, UPROC_ECURVE_BINARY,
+                              0, NULL);
+    ck_assert_ptr_eq(db, NULL);
+    ck_assert_int_eq(uproc_errno, UPROC_ERRNO);
+}
+END_TEST
+
+START_TEST(test_bundle)
+{
+    int res;
+    uproc_database *db;
+
+    res = uproc_database_bundle(TMPDATADIR, BUNDLE, 0);
+    ck_assert_int_eq(res, 0);
+
+    db = uproc_database_load_memory(BUNDLE, 2, UPROC_ECURVE_BINARY, 0);
+    check_database(db, 2);
+    uproc_database_destroy(db);
+
+    db = uproc_database_load_memory(BUNDLE, 3, UPROC_ECURVE_BINARY, 0);
+    check_database(db, 3);
+    uproc_database_destroy(db);
+
+    db = uproc_database_load_memory(BUNDLE, 0, UPROC_ECURVE_BINARY, 0);
+    check_database(db, 0);
+    uproc_database_destroy(db);
+
+    db = uproc_database_load_memory(BUNDLE, 1, UPROC_ECURVE_BINARY, 0);
+    ck_assert_ptr_eq(db, NULL);
+
+    /* same contents as the directory */
+    db = uproc_database_load_memory(TMPDATADIR, 2, UPROC_ECURVE_BINARY, 0);
+    check_database(db, 2);
+    uproc_database_destroy(db);
+}
+END_TEST
+
+START_TEST(test_bundle_place)
+{
+    int res;
+    uproc_database *db;
+
+    res = uproc_database_bundle(TMPDATADIR, BUNDLE, 0);
+    ck_assert_int_eq(res, 0);
+    db = uproc_database_load_memory(BUNDLE, 2, UPROC_ECURVE_BINARY,
+                                    UPROC_ECURVE_HUGEPAGES);
+    check_database(db, 2);
+    uproc_database_destroy(db);
+}
+END_TEST
+
+START_TEST(test_bundle_checksums)
+{
+    int res;
+    long size;
+    FILE *f;
+    uproc_database *db;
+
+    res = uproc_database_bundle(TMPDATADIR, BUNDLE,
+                                UPROC_DATABASE_BUNDLE_CHECKSUMS);
+    ck_assert_int_eq(res, 0);
+    db = uproc_database_load_memory(BUNDLE, 2, UPROC_ECURVE_BINARY, 0);
+    check_database(db, 2);
+    uproc_database_destroy(db);
+
+    /* flip a bit in the last section */
+    f = fopen(BUNDLE, "r+b");
+    ck_assert_ptr_ne(f, NULL);
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, size - 1, SEEK_SET);
+    res = fgetc(f);
+    fseek(f, size - 1, SEEK_SET);
+    fputc(res ^ 1, f);
+    fclose(f);
+
+    db = uproc_database_load_memory(BUNDLE, 2, UPROC_ECURVE_BINARY, 0);
+    ck_assert_ptr_eq(db, NULL);
+    ck_assert_int_eq(uproc_errno, UPROC_EINVAL);
+}
+END_TEST
+
+START_TEST(test_bundle_wrapped)
+{
+    int res;
+    FILE *f;
+    uproc_database *db;
+    struct database_bundle_header header;
+
+    res = uproc_database_bundle(TMPDATADIR, BUNDLE, 0);
+    ck_assert_int_eq(res, 0);
+
+    /* a section whose end wraps around must not pass as lying in the file */
+    f = fopen(BUNDLE, "r+b");
+    ck_assert_ptr_ne(f, NULL);
+    ck_assert_uint_eq(fread(&header, sizeof header, 1, f), 1);
+    header.sections[0].size = UINT64_MAX - header.sections[0].offset + 1;
+    rewind(f);
+    ck_assert_uint_eq(fwrite(&header, sizeof header, 1, f), 1);
+    fclose(f);
+
+    db = uproc_database_load_memory(BUNDLE, 2, UPROC_ECURVE_BINARY, 0);
+    ck_assert_ptr_eq(db, NULL);
+    ck_assert_int_eq(uproc_errno, UPROC_EINVAL);
+}
+END_TEST
+
+START_TEST(test_bundle_truncated)
+{
+    int res;
+    FILE *f;
+    uproc_database *db;
+
+    f = fopen(BUNDLE, "wb");
+    ck_assert_ptr_ne(f, NULL);
+    fputs("\x89UPROCDB", f);
+    fclose(f);
+    db = uproc_database_load_memory(BUNDLE, 2, UPROC_ECURVE_BINARY, 0);
+    ck_assert_ptr_eq(db, NULL);
+
+    res = uproc_database_bundle(TMPDATADIR "nonexistent", BUNDLE, 0);
+    ck_assert_int_eq(res, -1);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("database");
+
+    TCase *tc = tcase_create("database loading");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, test_loadp);
+    tcase_add_test(tc, test_bundle);
+    tcase_add_test(tc, test_bundle_place);
+    tcase_add_test(tc, test_bundle_checksums);
+    tcase_add_test(tc, test_bundle_wrapped);
+    tcase_add_test(tc, test_bundle_truncated);
+    suite_add_tcase(s, tc);
+
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int n_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,600 @@
+#include <stdlib.h>
+
+#include <check.h>
+#include "uproc.h"
+#include "fixture.h"
+
+uproc_ecurve *ec;
+
+struct fixture_entry entries[] = {
+      {100, 10, 1},
+      {100, 20, 2},
+      {100, 30, 3},
+      {101, 5, 4},
+      {4711, 1, 5},
+      {4711, 1000, 6},
+      {4711, 1001, 7},
+      {4711, 123456789, 8},
+      {4712, 42, 9},
+      {3000000, 0, 10},
+      {3000000, 4000000000000000ull, 11},
+      {50000000, 77, 12},
+};
+
+uproc_ecurve *build(void)
+{
+    return fixture_ecurve(entries, ELEMENTS(entries));
+}
+
+void setup(void)
+{
+    ec = build();
+}
+
+void teardown(void)
+{
+    uproc_ecurve_destroy(ec);
+}
+
+START_TEST(test_lookup)
+{
+    int res;
+    size_t i;
+    struct uproc_word word, lower, upper;
+    uproc_family lower_family, upper_family;
+
+    for (i = 0; i < ELEMENTS(entries); i++) {
+        word.prefix = entries[i].prefix;
+        word.suffix = entries[i].suffix;
+        res = uproc_ecurve_lookup(ec, &word, &lower, &lower_family, &upper,
+                                  &upper_family);
+        ck_assert_int_eq(res, UPROC_ECURVE_EXACT);
+        ck_assert_int_eq(uproc_word_cmp(&word, &lower), 0);
+        ck_assert_int_eq(uproc_word_cmp(&word, &upper), 0);
+        ck_assert_uint_eq(lower_family, entries[i].family);
+        ck_assert_uint_eq(upper_family, entries[i].family);
+    }
+
+    word.prefix = 4711;
+    word.suffix = 500;
+    res = uproc_ecurve_lookup(ec, &word, &lower, &lower_family, &upper,
+                              &upper_family);
+    ck_assert_int_eq(res, UPROC_ECURVE_INEXACT);
+    ck_assert_uint_eq(lower.suffix, 1);
+    ck_assert_uint_eq(upper.suffix, 1000);
+    ck_assert_uint_eq(lower_family, 5);
+    ck_assert_uint_eq(upper_family, 6);
+
+    word.prefix = 2000;
+    word.suffix = 0;
+    res = uproc_ecurve_lookup(ec, &word, &lower, &lower_family, &upper,
+                              &upper_family);
+    ck_assert_int_eq(res, UPROC_ECURVE_INEXACT);
+    ck_assert_uint_eq(lower.prefix, 101);
+    ck_assert_uint_eq(upper.prefix, 4711);
+    ck_assert_uint_eq(lower_family, 4);
+    ck_assert_uint_eq(upper_family, 5);
+
+    word.prefix = 3;
+    res = uproc_ecurve_lookup(ec, &word, &lower, &lower_family, &upper,
+                              &upper_family);
+    ck_assert_int_eq(res, UPROC_ECURVE_OOB);
+    ck_assert_uint_eq(lower_family, 1);
+    ck_assert_uint_eq(upper_family, 1);
+
+    word.prefix = UPROC_PREFIX_MAX;
+    res = uproc_ecurve_lookup(ec, &word, &lower, &lower_family, &upper,
+                              &upper_family);
+    ck_assert_int_eq(res, UPROC_ECURVE_OOB);
+    ck_assert_uint_eq(lower_family, 12);
+    ck_assert_uint_eq(upper_family, 12);
+}
+END_TEST
+
+START_TEST(test_lookup_batch)
+{
+#define N_WORDS 1000
+    size_t i, n;
+    static struct uproc_word words[N_WORDS], lower[N_WORDS], upper[N_WORDS];
+    static uproc_family lower_family[N_WORDS], upper_family[N_WORDS];
+    static int results[N_WORDS];
+
+    srand(42);
+    for (i = 0; i < N_WORDS; i++) {
+        if (i % 3 == 0) {
+            size_t k = rand() % ELEMENTS(entries);
+            words[i].prefix = entries[k].prefix;
+            words[i].suffix = entries[k].suffix + (i % 2);
+        } else {
+            words[i].prefix = rand() % (UPROC_PREFIX_MAX + 1);
+            words[i].suffix = rand();
+        }
+    }
+
+    /* batches of growing size, starting shorter than the prefetch distance */
+    for (i = 0; i < N_WORDS; i += n) {
+        n = i + 1;
+        if (n > N_WORDS - i) {
+            n = N_WORDS - i;
+        }
+        uproc_ecurve_lookup_batch(ec, words + i, n, lower + i,
+                                  lower_family + i, upper + i,
+                                  upper_family + i, results + i);
+    }
+
+    for (i = 0; i < N_WORDS; i++) {
+        int res;
+        struct uproc_word l, u;
+        uproc_family lf, uf;
+        res = uproc_ecurve_lookup(ec, &words[i], &l, &lf, &u, &uf);
+        ck_assert_int_eq(res, results[i]);
+        ck_assert_int_eq(uproc_word_cmp(&l, &lower[i]), 0);
+        ck_assert_int_eq(uproc_word_cmp(&u, &upper[i]), 0);
+        ck_assert_uint_eq(lf, lower_family[i]);
+        ck_assert_uint_eq(uf, upper_family[i]);
+    }
+
+    /* results may be NULL */
+    uproc_ecurve_lookup_batch(ec, words, 5, lower, lower_family, upper,
+                              upper_family, NULL);
+    uproc_ecurve_lookup_batch(ec, words, 0, lower, lower_family, upper,
+                              upper_family, NULL);
+}
+END_TEST
+
+static int cmp_prefix(const void *p1, const void *p2)
+{
+    const struct uproc_word *w1 = p1, *w2 = p2;
+    return (w1->prefix > w2->prefix) - (w1->prefix < w2->prefix);
+}
+
+START_TEST(test_lookup_sorted)
+{
+    size_t i;
+    static struct uproc_word words[N_WORDS], lower[N_WORDS], upper[N_WORDS];
+    static uproc_family lower_family[N_WORDS], upper_family[N_WORDS];
+    static int results[N_WORDS];
+
+    srand(23);
+    for (i = 0; i < N_WORDS; i++) {
+        size_t k = rand() % ELEMENTS(entries);
+        words[i].prefix = entries[k].prefix + (i % 3 == 0 ? rand() % 3 : 0);
+        words[i].suffix = entries[k].suffix + (i % 2);
+    }
+    qsort(words, N_WORDS, sizeof *words, cmp_prefix);
+
+    uproc_ecurve_lookup_sorted(ec, words, N_WORDS, lower, lower_family,
+                               upper, upper_family, results);
+
+    for (i = 0; i < N_WORDS; i++) {
+        int res;
+        struct uproc_word l, u;
+        uproc_family lf, uf;
+        res = uproc_ecurve_lookup(ec, &words[i], &l, &lf, &u, &uf);
+        ck_assert_int_eq(res, results[i]);
+        ck_assert_int_eq(uproc_word_cmp(&l, &lower[i]), 0);
+        ck_assert_int_eq(uproc_word_cmp(&u, &upper[i]), 0);
+        ck_assert_uint_eq(lf, lower_family[i]);
+        ck_assert_uint_eq(uf, upper_family[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_lookup_sizes)
+{
+    /* bucket sizes around the thresholds of the search strategies */
+    static const size_t sizes[] = {1,  2,  3,   5,   8,   15,  16,   17,
+                                   31, 64, 100, 511, 512, 513, 2000, 5000};
+    int res;
+    size_t i, k, n;
+    uproc_list *list;
+    struct uproc_ecurve_suffixentry e;
+    struct uproc_word word, lower, upper;
+    uproc_family lower_family, upper_family;
+    uproc_ecurve *sized;
+
+    sized = uproc_ecurve_create("AGSTPKRQEDNHYWFMLIVC", 0);
+    ck_assert_ptr_ne(sized, NULL);
+    list = uproc_list_create(sizeof e);
+    ck_assert_ptr_ne(list, NULL);
+    for (i = 0; i < ELEMENTS(sizes); i++) {
+        uproc_list_clear(list);
+        /* not uniformly distributed, to give interpolation search a hard
+         * time */
+        for (k = 0; k < sizes[i]; k++) {
+            e.suffix = 3 * k * k;
+            e.family = k % 7;
+            res = uproc_list_append(list, &e);
+            ck_assert_int_eq(res, 0);
+        }
+        res = uproc_ecurve_add_prefix(sized, 100 * (i + 1), list);
+        ck_assert_int_eq(res, 0);
+    }
+    uproc_list_destroy(list);
+    ck_assert_int_eq(uproc_ecurve_finalize(sized), 0);
+
+    for (i = 0; i < ELEMENTS(sizes); i++) {
+        n = sizes[i];
+        word.prefix = 100 * (i + 1);
+        for (word.suffix = 0; word.suffix < 3 * n * n;
+             word.suffix += 1 + word.suffix / 50) {
+            res = uproc_ecurve_lookup(sized, &word, &lower, &lower_family,
+                                      &upper, &upper_family);
+            /* greatest k with 3 * k * k <= suffix */
+            for (k = 0; k + 1 < n && 3 * (k + 1) * (k + 1) <= word.suffix;
+                 k++) {
+                ;
+            }
+            ck_assert_uint_eq(lower.suffix, 3 * k * k);
+            ck_assert_uint_eq(lower_family, k % 7);
+            if (lower.suffix == word.suffix) {
+                ck_assert_int_eq(res, UPROC_ECURVE_EXACT);
+                ck_assert_uint_eq(upper.suffix, lower.suffix);
+            } else if (k + 1 == n) {
+                /* above the last suffix of the bucket */
+                ck_assert_int_eq(res, UPROC_ECURVE_INEXACT);
+                ck_assert_uint_eq(upper.suffix, lower.suffix);
+            } else {
+                ck_assert_int_eq(res, UPROC_ECURVE_INEXACT);
+                ck_assert_uint_eq(upper.suffix, 3 * (k + 1) * (k + 1));
+                ck_assert_uint_eq(upper_family, (k + 1) % 7);
+            }
+        }
+    }
+    uproc_ecurve_destroy(sized);
+}
+END_TEST
+
+/* check that `a` and `b` produce the same lookup results */
+static void check_same(uproc_ecurve *a, uproc_ecurve *b)
+{
+    size_t i;
+    struct uproc_word word, la, ua, lb, ub;
+    uproc_family lfa, ufa, lfb, ufb;
+
+    srand(4711);
+    for (i = 0; i < N_WORDS; i++) {
+        int ra, rb;
+        if (i < ELEMENTS(entries)) {
+            word.prefix = entries[i].prefix;
+            word.suffix = entries[i].suffix;
+        } else if (i % 2) {
+            size_t k = rand() % ELEMENTS(entries);
+            word.prefix = entries[k].prefix + rand() % 3 - 1;
+            word.suffix = entries[k].suffix + rand() % 3 - 1;
+        } else {
+            word.prefix = rand() % (UPROC_PREFIX_MAX + 1);
+            word.suffix = rand();
+        }
+        ra = uproc_ecurve_lookup(a, &word, &la, &lfa, &ua, &ufa);
+        rb = uproc_ecurve_lookup(b, &word, &lb, &lfb, &ub, &ufb);
+        ck_assert_int_eq(ra, rb);
+        ck_assert_int_eq(uproc_word_cmp(&la, &lb), 0);
+        ck_assert_int_eq(uproc_word_cmp(&ua, &ub), 0);
+        ck_assert_uint_eq(lfa, lfb);
+        ck_assert_uint_eq(ufa, ufb);
+    }
+}
+
+/* convert `ec` to `layout`, store and load it and convert it back */
+static void check_layout(unsigned layout)
+{
+    int res;
+    uproc_ecurve *ref = build(), *loaded;
+
+    res = uproc_ecurve_convert(ec, layout);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(uproc_ecurve_layout(ec), layout);
+    check_same(ref, ec);
+
+    res = uproc_ecurve_store(ec, UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                             TMPDATADIR "test.ecurve");
+    ck_assert_int_eq(res, 0);
+    loaded = uproc_ecurve_load(UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                               TMPDATADIR "test.ecurve");
+    ck_assert_ptr_ne(loaded, NULL);
+    ck_assert_uint_eq(uproc_ecurve_layout(loaded), layout);
+    check_same(ref, loaded);
+    uproc_ecurve_destroy(loaded);
+
+    res = uproc_ecurve_convert(ec, UPROC_ECURVE_LAYOUT_DEFAULT);
+    ck_assert_int_eq(res, 0);
+    check_same(ref, ec);
+    uproc_ecurve_destroy(ref);
+}
+
+START_TEST(test_layout_compact)
+{
+    check_layout(UPROC_ECURVE_COMPACT_PREFIXES);
+}
+END_TEST
+
+START_TEST(test_layout_packed)
+{
+    check_layout(UPROC_ECURVE_PACKED_SUFFIXES);
+    check_layout(UPROC_ECURVE_COMPACT_PREFIXES | UPROC_ECURVE_PACKED_SUFFIXES);
+}
+END_TEST
+
+START_TEST(test_layout_btree)
+{
+    check_layout(UPROC_ECURVE_BTREE_BUCKETS);
+    check_layout(UPROC_ECURVE_COMPACT_PREFIXES | UPROC_ECURVE_PACKED_SUFFIXES |
+                 UPROC_ECURVE_BTREE_BUCKETS);
+}
+END_TEST
+
+START_TEST(test_layout_interleaved)
+{
+    int res;
+
+    check_layout(UPROC_ECURVE_INTERLEAVED);
+    check_layout(UPROC_ECURVE_COMPACT_PREFIXES | UPROC_ECURVE_BTREE_BUCKETS |
+                 UPROC_ECURVE_INTERLEAVED);
+
+    res = uproc_ecurve_convert(
+        ec, UPROC_ECURVE_PACKED_SUFFIXES | UPROC_ECURVE_INTERLEAVED);
+    ck_assert_int_eq(res, -1);
+}
+END_TEST
+
+/* check that `a` and `b` produce the same lookup results for words near the
+ * ones built by test_layout_large() */
+static void check_same_large(uproc_ecurve *a, uproc_ecurve *b)
+{
+    int res;
+    size_t k;
+    struct uproc_word word, l1, u1, l2, u2;
+    uproc_family lf1, uf1, lf2, uf2;
+
+    for (k = 0; k < 20000; k++) {
+        word.prefix = 990 + rand() % (300 * 97 + 20);
+        word.suffix = rand() % 500000;
+        res = uproc_ecurve_lookup(a, &word, &l1, &lf1, &u1, &uf1);
+        if (res == UPROC_ECURVE_INEXACT && k % 2) {
+            /* make it an exact hit */
+            word = l1;
+            res = uproc_ecurve_lookup(a, &word, &l1, &lf1, &u1, &uf1);
+        }
+        ck_assert_int_eq(uproc_ecurve_lookup(b, &word, &l2, &lf2, &u2, &uf2),
+                         res);
+        ck_assert_int_eq(uproc_word_cmp(&l1, &l2), 0);
+        ck_assert_int_eq(uproc_word_cmp(&u1, &u2), 0);
+        ck_assert_uint_eq(lf1, lf2);
+        ck_assert_uint_eq(uf1, uf2);
+    }
+}
+
+START_TEST(test_layout_large)
+{
+    int res;
+    size_t i, k;
+    uproc_prefix p;
+    uproc_list *list;
+    struct uproc_ecurve_suffixentry e;
+    uproc_ecurve *big, *conv;
+    unsigned layouts[] = {
+        UPROC_ECURVE_PACKED_SUFFIXES,
+        UPROC_ECURVE_BTREE_BUCKETS,
+        UPROC_ECURVE_PACKED_SUFFIXES | UPROC_ECURVE_BTREE_BUCKETS,
+        UPROC_ECURVE_INTERLEAVED,
+        UPROC_ECURVE_COMPACT_PREFIXES | UPROC_ECURVE_PACKED_SUFFIXES |
+            UPROC_ECURVE_BTREE_BUCKETS,
+        UPROC_ECURVE_INTERLEAVED | UPROC_ECURVE_BTREE_BUCKETS,
+        UPROC_ECURVE_LAYOUT_DEFAULT,
+    };
+
+    /* many blocks, with dense and sparse buckets and runs of families */
+    list = uproc_list_create(sizeof e);
+    ck_assert_ptr_ne(list, NULL);
+    big = uproc_ecurve_create("AGSTPKRQEDNHYWFMLIVC", 0);
+    conv = uproc_ecurve_create("AGSTPKRQEDNHYWFMLIVC", 0);
+    ck_assert_ptr_ne(big, NULL);
+    ck_assert_ptr_ne(conv, NULL);
+    srand(1234);
+    for (p = 1000; p < 1000 + 300 * 97; p += 97) {
+        size_t n = rand() % 3 ? 1 + rand() % 4 : 60 + rand() % 3000;
+        e.suffix = rand() % 1000;
+        e.family = rand() % 50;
+        uproc_list_clear(list);
+        for (i = 0; i < n; i++) {
+            e.suffix += 1 + rand() % (n > 50 ? 300 : 1 << 30);
+            if (rand() % 8 == 0) {
+                e.family = rand() % 50;
+            }
+            res = uproc_list_append(list, &e);
+            ck_assert_int_eq(res, 0);
+        }
+        res = uproc_ecurve_add_prefix(big, p, list);
+        ck_assert_int_eq(res, 0);
+        res = uproc_ecurve_add_prefix(conv, p, list);
+        ck_assert_int_eq(res, 0);
+    }
+    uproc_list_destroy(list);
+    ck_assert_int_eq(uproc_ecurve_finalize(big), 0);
+    ck_assert_int_eq(uproc_ecurve_finalize(conv), 0);
+
+    for (k = 0; k < ELEMENTS(layouts); k++) {
+        res = uproc_ecurve_convert(conv, layouts[k]);
+        ck_assert_int_eq(res, 0);
+        check_same_large(big, conv);
+    }
+    uproc_ecurve_destroy(big);
+    uproc_ecurve_destroy(conv);
+}
+END_TEST
+
+START_TEST(test_layout_parse)
+{
+    int res;
+    unsigned layout;
+    char buf[64];
+
+    res = uproc_ecurve_layout_parse("compact", &layout);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(layout, UPROC_ECURVE_COMPACT_PREFIXES);
+    uproc_ecurve_layout_str(layout, buf, sizeof buf);
+    ck_assert_str_eq(buf, "compact");
+
+    res = uproc_ecurve_layout_parse("packed,compact", &layout);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(layout, UPROC_ECURVE_COMPACT_PREFIXES |
+                                  UPROC_ECURVE_PACKED_SUFFIXES);
+    uproc_ecurve_layout_str(layout, buf, sizeof buf);
+    ck_assert_str_eq(buf, "compact,packed");
+
+    res = uproc_ecurve_layout_parse("default", &layout);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(layout, UPROC_ECURVE_LAYOUT_DEFAULT);
+
+    res = uproc_ecurve_layout_parse("compact,bogus", &layout);
+    ck_assert_int_eq(res, -1);
+}
+END_TEST
+
+START_TEST(test_place)
+{
+    int res;
+    uproc_ecurve *ref = build(), *loaded;
+
+    /* keep the copies small */
+    res = uproc_ecurve_convert(ec, UPROC_ECURVE_COMPACT_PREFIXES);
+    ck_assert_int_eq(res, 0);
+
+    res = uproc_ecurve_place(ec, UPROC_ECURVE_HUGEPAGES | UPROC_ECURVE_MLOCK);
+    ck_assert_int_ne(res, -1);
+    ck_assert_uint_eq(uproc_ecurve_memory(ec), res);
+    check_same(ref, ec);
+    res = uproc_ecurve_convert(ec, UPROC_ECURVE_LAYOUT_DEFAULT);
+    ck_assert_int_eq(res, -1);
+
+    res = uproc_ecurve_store(ec, UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                             TMPDATADIR "test.ecurve");
+    ck_assert_int_eq(res, 0);
+    loaded = uproc_ecurve_load(UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                               TMPDATADIR "test.ecurve");
+    ck_assert_ptr_ne(loaded, NULL);
+    res = uproc_ecurve_place(loaded, UPROC_ECURVE_HUGETLB);
+    ck_assert_int_ne(res, -1);
+    check_same(ref, loaded);
+    uproc_ecurve_destroy(loaded);
+
+    res = uproc_ecurve_place(ec, UPROC_ECURVE_MEMORY_ALL + 1);
+    ck_assert_int_eq(res, -1);
+    uproc_ecurve_destroy(ref);
+}
+END_TEST
+
+START_TEST(test_place_numa)
+{
+    int res;
+    uproc_ecurve *ref = build(), *copy;
+
+    res = uproc_ecurve_convert(ec, UPROC_ECURVE_COMPACT_PREFIXES);
+    ck_assert_int_eq(res, 0);
+
+    copy = uproc_ecurve_replicate(ec, UPROC_ECURVE_MEMORY_DEFAULT,
+                                  uproc_numa_nodes() - 1);
+    ck_assert_ptr_ne(copy, NULL);
+    check_same(ref, copy);
+
+    /* the copy doesn't depend on the original */
+    res = uproc_ecurve_convert(ec, UPROC_ECURVE_LAYOUT_DEFAULT);
+    ck_assert_int_eq(res, 0);
+    check_same(ref, copy);
+
+    res = uproc_ecurve_place_node(ec, UPROC_ECURVE_NUMA_INTERLEAVE, -1);
+    ck_assert_int_ne(res, -1);
+    check_same(ref, ec);
+    uproc_ecurve_destroy(copy);
+    uproc_ecurve_destroy(ref);
+}
+END_TEST
+
+START_TEST(test_memory_parse)
+{
+    int res;
+    unsigned flags;
+
+    res = uproc_ecurve_memory_parse("mlock,hugepages", &flags);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(flags, UPROC_ECURVE_HUGEPAGES | UPROC_ECURVE_MLOCK);
+    res = uproc_ecurve_memory_parse("numa-interleave", &flags);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(flags, UPROC_ECURVE_NUMA_INTERLEAVE);
+    res = uproc_ecurve_memory_parse("compact", &flags);
+    ck_assert_int_eq(res, -1);
+}
+END_TEST
+
+START_TEST(test_residency)
+{
+    int res;
+    unsigned flags;
+    double resident;
+    static const unsigned policies[] = {
+        UPROC_ECURVE_LAZY | UPROC_ECURVE_KEEP_WARM, UPROC_ECURVE_PREFETCH,
+        UPROC_ECURVE_PREFETCH | UPROC_ECURVE_KEEP_WARM, UPROC_ECURVE_POPULATE,
+    };
+    uproc_ecurve *ref = build(), *loaded;
+
+    res = uproc_ecurve_residency_parse("prefetch,keep-warm", &flags);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(flags, UPROC_ECURVE_PREFETCH | UPROC_ECURVE_KEEP_WARM);
+    res = uproc_ecurve_residency_parse("populate", &flags);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(flags, UPROC_ECURVE_POPULATE);
+    res = uproc_ecurve_residency_parse("lazy,prefetch", &flags);
+    ck_assert_int_eq(res, -1);
+    res = uproc_ecurve_residency_set(UPROC_ECURVE_RESIDENCY_ALL);
+    ck_assert_int_eq(res, -1);
+
+    res = uproc_ecurve_convert(ec, UPROC_ECURVE_COMPACT_PREFIXES);
+    ck_assert_int_eq(res, 0);
+    res = uproc_ecurve_store(ec, UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                             TMPDATADIR "test.ecurve");
+    ck_assert_int_eq(res, 0);
+    for (size_t i = 0; i < ELEMENTS(policies); i++) {
+        res = uproc_ecurve_residency_set(policies[i]);
+        ck_assert_int_eq(res, 0);
+        loaded = uproc_ecurve_load(UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
+                                   TMPDATADIR "test.ecurve");
+        ck_assert_ptr_ne(loaded, NULL);
+        check_same(ref, loaded);
+        /* all pages have been touched by now */
+        resident = uproc_ecurve_resident(loaded);
+        ck_assert(resident > 0.0 && resident <= 100.0);
+        uproc_ecurve_destroy(loaded);
+    }
+    uproc_ecurve_destroy(ref);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("ecurve");
+
+    TCase *tc = tcase_create("ecurve lookup");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, test_lookup);
+    tcase_add_test(tc, test_lookup_batch);
+    tcase_add_test(tc, test_lookup_sorted);
+    tcase_add_test(tc, test_lookup_sizes);
+    tcase_add_test(tc, test_layout_compact);
+    tcase_add_test(tc, test_layout_packed);
+    tcase_add_test(tc, test_layout_btree);
+    tcase_add_test(tc, test_layout_interleaved);
+    tcase_add_test(tc, test_layout_large);
+    tcase_add_test(tc, test_layout_parse);
+    tcase_add_test(tc, test_place);
+    tcase_add_test(tc, test_place_numa);
+    tcase_add_test(tc, test_memory_parse);
+    tcase_add_test(tc, test_residency);
+    suite_add_tcase(s, tc);
+
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int n_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
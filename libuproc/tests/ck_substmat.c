@@ -0,0 +1,127 @@
+#include <stdlib.h>
+
+#include <check.h>
+#include "uproc.h"
+
+#define ELEMENTS(x) (sizeof(x) / sizeof(x)[0])
+
+uproc_substmat *mat;
+
+void setup(void)
+{
+    mat = uproc_substmat_create();
+    ck_assert_ptr_ne(mat, NULL);
+    srand(42);
+    for (unsigned pos = 0; pos < UPROC_SUFFIX_LEN; pos++) {
+        for (uproc_amino x = 0; x < UPROC_ALPHABET_SIZE; x++) {
+            for (uproc_amino y = 0; y < UPROC_ALPHABET_SIZE; y++) {
+                uproc_substmat_set(mat, pos, x, y,
+                                   (double)rand() / RAND_MAX - 0.5);
+            }
+        }
+    }
+}
+
+void teardown(void)
+{
+    uproc_substmat_destroy(mat);
+}
+
+static uproc_suffix random_suffix(void)
+{
+    uproc_suffix s = 0;
+    for (int i = 0; i < UPROC_SUFFIX_LEN; i++) {
+        s = s << UPROC_AMINO_BITS | rand() % UPROC_ALPHABET_SIZE;
+    }
+    return s;
+}
+
+START_TEST(test_align_suffixes)
+{
+    unsigned modes[] = {
+        UPROC_SUBSTMAT_SCALAR, UPROC_SUBSTMAT_AVX2, UPROC_SUBSTMAT_AVX512,
+    };
+    double dist[UPROC_SUFFIX_LEN];
+
+    for (size_t m = 0; m < ELEMENTS(modes) * 2; m++) {
+        unsigned mode = modes[m / 2] | (m % 2 ? UPROC_SUBSTMAT_FLOAT : 0);
+        if (uproc_substmat_mode_set(mat, mode)) {
+            /* not supported by this CPU */
+            ck_assert_int_ne(modes[m / 2], UPROC_SUBSTMAT_SCALAR);
+            continue;
+        }
+        ck_assert_uint_eq(uproc_substmat_mode(mat), mode);
+        for (int k = 0; k < 1000; k++) {
+            uproc_suffix s1 = random_suffix(), s2 = random_suffix();
+            uproc_substmat_align_suffixes(mat, s1, s2, dist);
+            for (int i = UPROC_SUFFIX_LEN - 1; i >= 0; i--) {
+                double d = uproc_substmat_get(
+                    mat, i, s1 & UPROC_BITMASK(UPROC_AMINO_BITS),
+                    s2 & UPROC_BITMASK(UPROC_AMINO_BITS));
+                if (mode & UPROC_SUBSTMAT_FLOAT) {
+                    d = (float)d;
+                }
+                ck_assert(dist[i] == d);
+                s1 >>= UPROC_AMINO_BITS;
+                s2 >>= UPROC_AMINO_BITS;
+            }
+        }
+        if (mode & UPROC_SUBSTMAT_FLOAT) {
+            ck_assert(uproc_substmat_deviation(mat, 1000) > 0.0);
+            ck_assert(uproc_substmat_deviation(mat, 1000) < 1e-5);
+        } else {
+            ck_assert(uproc_substmat_deviation(mat, 1000) == 0.0);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_mode)
+{
+    int res;
+    unsigned mode;
+    char buf[64];
+
+    /* the default picks a kernel */
+    res = uproc_substmat_mode_set(mat, 0);
+    ck_assert_int_eq(res, 0);
+    mode = uproc_substmat_mode(mat);
+    ck_assert(mode & (UPROC_SUBSTMAT_SCALAR | UPROC_SUBSTMAT_AVX2 |
+                      UPROC_SUBSTMAT_AVX512));
+    ck_assert(!(mode & UPROC_SUBSTMAT_FLOAT));
+
+    res = uproc_substmat_mode_parse("scalar,float", &mode);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(mode, UPROC_SUBSTMAT_SCALAR | UPROC_SUBSTMAT_FLOAT);
+    uproc_substmat_mode_str(mode, buf, sizeof buf);
+    ck_assert_str_eq(buf, "scalar,float");
+    res = uproc_substmat_mode_parse("default", &mode);
+    ck_assert_int_eq(res, 0);
+    ck_assert_uint_eq(mode, 0);
+    res = uproc_substmat_mode_parse("int16", &mode);
+    ck_assert_int_eq(res, -1);
+
+    /* only one kernel */
+    res = uproc_substmat_mode_set(mat,
+                                  UPROC_SUBSTMAT_SCALAR | UPROC_SUBSTMAT_AVX2);
+    ck_assert_int_eq(res, -1);
+    ck_assert_int_eq(uproc_errno, UPROC_EINVAL);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("substmat");
+
+    TCase *tc = tcase_create("");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, test_align_suffixes);
+    tcase_add_test(tc, test_mode);
+    suite_add_tcase(s, tc);
+
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int n_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -166,6 +166,13 @@ START_TEST(test_worditer)
 
     res = uproc_worditer_next(iter, &index, &fwd, &rev);
     ck_assert_int_eq(res, 1);
+
+    /* a reset iterator starts over */
+    uproc_worditer_reset(iter, seq + 21, alpha);
+    TEST(0, "VVVVVVVVVVVVVVVVVV", "VVVVVVVVVVVVVVVVVV");
+    uproc_worditer_reset(iter, seq, alpha);
+    TEST(0, "RAAAAAAAAAAAAAAAAA", "AAAAAAAAAAAAAAAAAR");
+    uproc_worditer_destroy(iter);
 #undef TEST
 }
 END_TEST
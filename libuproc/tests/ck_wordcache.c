@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+#include "uproc.h"
+
+#define ALPHABET "AGSTPKRQEDNHYWFMLIVC"
+
+uproc_ecurve *ec;
+uproc_substmat *mat;
+uproc_protclass *pc;
+
+void setup(void)
+{
+    int res;
+    uproc_list *list;
+    struct uproc_ecurve_suffixentry e;
+
+    srand(4711);
+    ec = uproc_ecurve_create(ALPHABET, 0);
+    ck_assert_ptr_ne(ec, NULL);
+    list = uproc_list_create(sizeof e);
+    ck_assert_ptr_ne(list, NULL);
+    for (uproc_prefix p = 0; p < UPROC_PREFIX_MAX; p += 997) {
+        uproc_list_clear(list);
+        e.suffix = rand() % 1000;
+        for (int i = 0; i < 3; i++) {
+            e.suffix += 1 + rand() % 100000;
+            e.family = rand() % 50;
+            res = uproc_list_append(list, &e);
+            ck_assert_int_eq(res, 0);
+        }
+        res = uproc_ecurve_add_prefix(ec, p, list);
+        ck_assert_int_eq(res, 0);
+    }
+    uproc_list_destroy(list);
+    res = uproc_ecurve_finalize(ec);
+    ck_assert_int_eq(res, 0);
+
+    mat = uproc_substmat_create();
+    ck_assert_ptr_ne(mat, NULL);
+    for (unsigned pos = 0; pos < UPROC_SUFFIX_LEN; pos++) {
+        for (uproc_amino x = 0; x < UPROC_ALPHABET_SIZE; x++) {
+            for (uproc_amino y = 0; y < UPROC_ALPHABET_SIZE; y++) {
+                uproc_substmat_set(mat, pos, x, y,
+                                   x == y ? 1.0 : (double)rand() / RAND_MAX - 1);
+            }
+        }
+    }
+    pc = uproc_protclass_create(UPROC_PROTCLASS_ALL, ec, ec, mat, NULL, NULL);
+    ck_assert_ptr_ne(pc, NULL);
+}
+
+void teardown(void)
+{
+    uproc_protclass_destroy(pc);
+    uproc_substmat_destroy(mat);
+    uproc_ecurve_destroy(ec);
+}
+
+static void random_seq(char *seq, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        seq[i] = ALPHABET[rand() % 20];
+    }
+    seq[len] = '\0';
+}
+
+static void assert_results_eq(uproc_list *l1, uproc_list *l2)
+{
+    struct uproc_protresult r1, r2;
+    ck_assert_uint_eq(uproc_list_size(l1), uproc_list_size(l2));
+    for (long i = 0; i < uproc_list_size(l1); i++) {
+        uproc_list_get(l1, i, &r1);
+        uproc_list_get(l2, i, &r2);
+        ck_assert_uint_eq(r1.family, r2.family);
+        ck_assert(r1.score == r2.score);
+    }
+}
+
+START_TEST(test_create)
+{
+    uproc_wordcache *cache;
+
+    cache = uproc_wordcache_create(16);
+    ck_assert_ptr_eq(cache, NULL);
+
+    cache = uproc_wordcache_create(1 << 20);
+    ck_assert_ptr_ne(cache, NULL);
+    size_t n = uproc_wordcache_capacity(cache);
+    ck_assert_uint_ge(n, 2);
+    ck_assert_uint_eq(n & (n - 1), 0);
+    ck_assert_uint_eq(uproc_wordcache_used(cache), 0);
+    uproc_wordcache_destroy(cache);
+}
+END_TEST
+
+START_TEST(test_classify)
+{
+    int res;
+    char seqs[20][101];
+    uproc_list *plain = NULL, *cached = NULL;
+    uproc_classify_workspace *ws;
+    uproc_wordcache *cache;
+    struct uproc_protclass_stats stats;
+    unsigned long long words = 20 * 2 * (100 - UPROC_WORD_LEN + 1);
+
+    for (int i = 0; i < 20; i++) {
+        random_seq(seqs[i], 100);
+    }
+    cache = uproc_wordcache_create(8 << 20);
+    ck_assert_ptr_ne(cache, NULL);
+    ws = uproc_classify_workspace_create();
+    ck_assert_ptr_ne(ws, NULL);
+
+    /* every sequence twice, the second time the words are cached */
+    for (int k = 0; k < 2; k++) {
+        for (int i = 0; i < 20; i++) {
+            uproc_protclass_set_cache(pc, NULL);
+            res = uproc_protclass_classify(pc, seqs[i], &plain);
+            ck_assert_int_eq(res, 0);
+            ck_assert_uint_gt(uproc_list_size(plain), 0);
+            uproc_protclass_set_cache(pc, cache);
+            res = uproc_protclass_classify_ws(pc, ws, seqs[i], &cached);
+            ck_assert_int_eq(res, 0);
+            assert_results_eq(plain, cached);
+        }
+        uproc_classify_workspace_stats(ws, &stats);
+        if (!k) {
+            ck_assert_uint_gt(uproc_wordcache_used(cache), 0);
+            ck_assert_uint_eq(stats.cache_hits, 0);
+            ck_assert_uint_eq(stats.cache_misses, words);
+        }
+    }
+    /* words evicted by others that fall into the same place are missed */
+    ck_assert_uint_eq(stats.cache_hits + stats.cache_misses, 2 * words);
+    ck_assert_uint_gt(stats.cache_hits, words * 3 / 4);
+
+    uproc_list_destroy(plain);
+    uproc_list_destroy(cached);
+    uproc_classify_workspace_destroy(ws);
+    uproc_wordcache_destroy(cache);
+}
+END_TEST
+
+START_TEST(test_counts)
+{
+    int res;
+    char seq[101];
+    const char *seqs[2] = {seq, seq};
+    uproc_list *results[2] = {NULL};
+    uproc_classify_workspace *ws;
+    uproc_wordcache *cache;
+    struct uproc_protclass_stats stats;
+    unsigned long long words = 2 * (100 - UPROC_WORD_LEN + 1);
+
+    cache = uproc_wordcache_create(1 << 20);
+    ck_assert_ptr_ne(cache, NULL);
+    uproc_protclass_set_cache(pc, cache);
+    ws = uproc_classify_workspace_create();
+    ck_assert_ptr_ne(ws, NULL);
+
+    /* a single word, which can't be evicted by others; all words of a
+     * sequence are looked up before the first one is stored */
+    memset(seq, 'A', 100);
+    seq[100] = '\0';
+    res = uproc_protclass_classify_ws(pc, ws, seq, &results[0]);
+    ck_assert_int_eq(res, 0);
+    uproc_classify_workspace_stats(ws, &stats);
+    ck_assert_uint_eq(stats.cache_hits, 0);
+    ck_assert_uint_eq(stats.cache_misses, words);
+
+    res = uproc_protclass_classify_ws(pc, ws, seq, &results[0]);
+    ck_assert_int_eq(res, 0);
+    uproc_classify_workspace_stats(ws, &stats);
+    ck_assert_uint_eq(stats.cache_hits, words);
+    ck_assert_uint_eq(stats.cache_misses, words);
+
+    res = uproc_protclass_classify_many(pc, ws, seqs, 2, results);
+    ck_assert_int_eq(res, 0);
+    uproc_classify_workspace_stats(ws, &stats);
+    ck_assert_uint_eq(stats.cache_hits, 3 * words);
+    ck_assert_uint_eq(stats.cache_misses, words);
+
+    uproc_list_destroy(results[0]);
+    uproc_list_destroy(results[1]);
+    uproc_classify_workspace_destroy(ws);
+    uproc_wordcache_destroy(cache);
+}
+END_TEST
+
+START_TEST(test_classify_many)
+{
+    int res;
+    char seqs[20][101];
+    const char *ptrs[20];
+    uproc_list *plain[20] = {NULL}, *cached[20] = {NULL};
+    uproc_classify_workspace *ws;
+    uproc_wordcache *cache;
+    struct uproc_protclass_stats stats;
+    unsigned long long words = 20 * 2 * (100 - UPROC_WORD_LEN + 1);
+
+    for (int i = 0; i < 20; i++) {
+        random_seq(seqs[i], 100);
+        ptrs[i] = seqs[i];
+    }
+    cache = uproc_wordcache_create(8 << 20);
+    ck_assert_ptr_ne(cache, NULL);
+    ws = uproc_classify_workspace_create();
+    ck_assert_ptr_ne(ws, NULL);
+
+    res = uproc_protclass_classify_many(pc, NULL, ptrs, 20, plain);
+    ck_assert_int_eq(res, 0);
+    uproc_protclass_set_cache(pc, cache);
+    for (int k = 0; k < 2; k++) {
+        res = uproc_protclass_classify_many(pc, ws, ptrs, 20, cached);
+        ck_assert_int_eq(res, 0);
+        for (int i = 0; i < 20; i++) {
+            assert_results_eq(plain[i], cached[i]);
+        }
+        uproc_classify_workspace_stats(ws, &stats);
+        if (!k) {
+            ck_assert_uint_eq(stats.cache_hits, 0);
+            ck_assert_uint_eq(stats.cache_misses, words);
+        }
+    }
+    ck_assert_uint_eq(stats.cache_hits + stats.cache_misses, 2 * words);
+    ck_assert_uint_gt(stats.cache_hits, words * 3 / 4);
+
+    for (int i = 0; i < 20; i++) {
+        uproc_list_destroy(plain[i]);
+        uproc_list_destroy(cached[i]);
+    }
+    uproc_classify_workspace_destroy(ws);
+    uproc_wordcache_destroy(cache);
+}
+END_TEST
+
+START_TEST(test_replica)
+{
+    int res;
+    char seq[101];
+    uproc_ecurve *copy;
+    uproc_protclass *pc_copy;
+    uproc_list *results = NULL;
+    uproc_classify_workspace *ws;
+    uproc_wordcache *cache;
+    struct uproc_protclass_stats stats;
+    unsigned long long words = 2 * (100 - UPROC_WORD_LEN + 1);
+
+    copy = uproc_ecurve_replicate(ec, 0, -1);
+    if (!copy) {
+        ck_assert_int_eq(uproc_errno, UPROC_ENOTSUP);
+        return;
+    }
+    pc_copy = uproc_protclass_create(UPROC_PROTCLASS_ALL, copy, copy, mat,
+                                     NULL, NULL);
+    ck_assert_ptr_ne(pc_copy, NULL);
+    cache = uproc_wordcache_create(1 << 20);
+    ck_assert_ptr_ne(cache, NULL);
+    uproc_protclass_set_cache(pc, cache);
+    uproc_protclass_set_cache(pc_copy, cache);
+
+    /* a single word, which can't be evicted by others */
+    memset(seq, 'A', 100);
+    seq[100] = '\0';
+    res = uproc_protclass_classify(pc, seq, &results);
+    ck_assert_int_eq(res, 0);
+
+    /* the copy finds the entries stored for the original */
+    ws = uproc_classify_workspace_create();
+    ck_assert_ptr_ne(ws, NULL);
+    res = uproc_protclass_classify_ws(pc_copy, ws, seq, &results);
+    ck_assert_int_eq(res, 0);
+    uproc_classify_workspace_stats(ws, &stats);
+    ck_assert_uint_eq(stats.cache_hits, words);
+    ck_assert_uint_eq(stats.cache_misses, 0);
+
+    uproc_list_destroy(results);
+    uproc_classify_workspace_destroy(ws);
+    uproc_protclass_destroy(pc_copy);
+    uproc_ecurve_destroy(copy);
+    uproc_wordcache_destroy(cache);
+}
+END_TEST
+
+int main(void)
+{
+    Suite *s = suite_create("wordcache");
+
+    TCase *tc = tcase_create("");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, test_create);
+    tcase_add_test(tc, test_classify);
+    tcase_add_test(tc, test_counts);
+    tcase_add_test(tc, test_classify_many);
+    tcase_add_test(tc, test_replica);
+    suite_add_tcase(s, tc);
+
+    SRunner *sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    int n_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return n_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
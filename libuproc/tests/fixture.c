@@ -0,0 +1,32 @@
+#include <check.h>
+#include "fixture.h"
+
+uproc_ecurve *fixture_ecurve(const struct fixture_entry *entries, size_t n)
+{
+    int res;
+    size_t i;
+    uproc_list *list;
+    struct uproc_ecurve_suffixentry e;
+    uproc_ecurve *ec;
+
+    ec = uproc_ecurve_create("AGSTPKRQEDNHYWFMLIVC", 0);
+    ck_assert_ptr_ne(ec, NULL);
+    list = uproc_list_create(sizeof e);
+    ck_assert_ptr_ne(list, NULL);
+
+    for (i = 0; i < n; i++) {
+        e.suffix = entries[i].suffix;
+        e.family = entries[i].family;
+        res = uproc_list_append(list, &e);
+        ck_assert_int_eq(res, 0);
+        if (i + 1 == n || entries[i + 1].prefix != entries[i].prefix) {
+            res = uproc_ecurve_add_prefix(ec, entries[i].prefix, list);
+            ck_assert_int_eq(res, 0);
+            uproc_list_clear(list);
+        }
+    }
+    uproc_list_destroy(list);
+    res = uproc_ecurve_finalize(ec);
+    ck_assert_int_eq(res, 0);
+    return ec;
+}
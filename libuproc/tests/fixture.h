@@ -0,0 +1,22 @@
+#ifndef CK_FIXTURE_H
+#define CK_FIXTURE_H
+
+#include <stddef.h>
+
+#include "uproc.h"
+
+#define ELEMENTS(x) (sizeof(x) / sizeof(x)[0])
+
+/* An entry of a test ecurve */
+struct fixture_entry
+{
+    uproc_prefix prefix;
+    uproc_suffix suffix;
+    uproc_family family;
+};
+
+/* Build a finalized ecurve from the `n` entries, which must be sorted by
+ * prefix and suffix */
+uproc_ecurve *fixture_ecurve(const struct fixture_entry *entries, size_t n);
+
+#endif
@@ -164,12 +164,18 @@ uproc_worditer *uproc_worditer_create(const char *seq,
         uproc_error(UPROC_ENOMEM);
         return NULL;
     }
+    uproc_worditer_reset(iter, seq, alpha);
+    return iter;
+}
+
+void uproc_worditer_reset(uproc_worditer *iter, const char *seq,
+                          const uproc_alphabet *alpha)
+{
     iter->sequence = seq;
     iter->index = 0;
     iter->alphabet = alpha;
     iter->fwd = (struct uproc_word)UPROC_WORD_INITIALIZER;
     iter->rev = (struct uproc_word)UPROC_WORD_INITIALIZER;
-    return iter;
 }
 
 int uproc_worditer_next(uproc_worditer *iter, size_t *index,
@@ -0,0 +1,240 @@
+/* Cache of word lookups shared by the classifying threads
+ *
+ * Copyright 2014 Peter Meinicke, Robin Martinjak
+ *
+ * This file is part of libuproc.
+ *
+ * libuproc is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * libuproc is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libuproc.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uproc/common.h"
+#include "uproc/error.h"
+#include "uproc/wordcache.h"
+
+#include "wordcache_internal.h"
+
+#if defined(__GNUC__) && defined(__ATOMIC_RELAXED)
+#define WORDCACHE_ATOMICS 1
+#else
+#define WORDCACHE_ATOMICS 0
+#endif
+
+/* Contents of a slot */
+struct slot_data
+{
+    const void *ecurve, *substmat;
+    struct uproc_word word;
+    struct wordcache_entry entry;
+};
+
+#define SLOT_WORDS ((sizeof(struct slot_data) + 7) / 8)
+
+/* The data is only read and written with (relaxed) atomic accesses of its
+ * 64-bit words. `seq` is a sequence lock: 0 if the slot was never written,
+ * odd while it is being written, and increased by two with every write. */
+struct slot
+{
+    uint64_t seq;
+    uint64_t data[SLOT_WORDS];
+};
+
+struct uproc_wordcache_s
+{
+    struct slot *slots;
+    size_t n;
+};
+
+uproc_wordcache *uproc_wordcache_create(size_t max_bytes)
+{
+    struct uproc_wordcache_s *cache;
+    size_t n = 2;
+
+    if (!WORDCACHE_ATOMICS) {
+        uproc_error_msg(UPROC_ENOTSUP, "word cache requires atomic builtins");
+        return NULL;
+    }
+    /* a power of two of at least one bucket of two slots */
+    if (max_bytes < n * sizeof(struct slot)) {
+        uproc_error_msg(UPROC_EINVAL, "word cache limit too small");
+        return NULL;
+    }
+    while (n * 2 * sizeof(struct slot) <= max_bytes) {
+        n *= 2;
+    }
+    cache = malloc(sizeof *cache);
+    if (!cache) {
+        uproc_error(UPROC_ENOMEM);
+        return NULL;
+    }
+    cache->n = n;
+    cache->slots = calloc(n, sizeof *cache->slots);
+    if (!cache->slots) {
+        free(cache);
+        uproc_error(UPROC_ENOMEM);
+        return NULL;
+    }
+    return cache;
+}
+
+void uproc_wordcache_destroy(uproc_wordcache *cache)
+{
+    if (!cache) {
+        return;
+    }
+    free(cache->slots);
+    free(cache);
+}
+
+size_t uproc_wordcache_capacity(const uproc_wordcache *cache)
+{
+    return cache->n;
+}
+
+#if WORDCACHE_ATOMICS
+size_t uproc_wordcache_used(const uproc_wordcache *cache)
+{
+    size_t i, used = 0;
+    for (i = 0; i < cache->n; i++) {
+        used += !!__atomic_load_n(&cache->slots[i].seq, __ATOMIC_RELAXED);
+    }
+    return used;
+}
+
+static uint64_t hash(const void *ecurve, const void *substmat,
+                     const struct uproc_word *word)
+{
+    uint64_t h = word->suffix ^ (uint64_t)word->prefix << 40;
+    h ^= (uint64_t)(uintptr_t)ecurve ^ (uint64_t)(uintptr_t)substmat << 17;
+    /* splitmix64 finalizer */
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+/* First of the two slots `word` may occupy */
+static struct slot *bucket(uproc_wordcache *cache, uint64_t h)
+{
+    return &cache->slots[h & (cache->n - 1) & ~(size_t)1];
+}
+
+/* Copy the data of `slot` if it is not being written; returns its sequence
+ * number, or 0 if it is empty or changed meanwhile */
+static uint64_t slot_read(struct slot *slot, struct slot_data *data)
+{
+    uint64_t buf[SLOT_WORDS], seq;
+    size_t i;
+
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (!seq || seq & 1) {
+        return 0;
+    }
+    for (i = 0; i < SLOT_WORDS; i++) {
+        buf[i] = __atomic_load_n(&slot->data[i], __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+        return 0;
+    }
+    memcpy(data, buf, sizeof *data);
+    return seq;
+}
+
+static bool slot_matches(const struct slot_data *data, const void *ecurve,
+                         const void *substmat, const struct uproc_word *word)
+{
+    return data->ecurve == ecurve && data->substmat == substmat &&
+           data->word.prefix == word->prefix &&
+           data->word.suffix == word->suffix;
+}
+
+bool wordcache_get(uproc_wordcache *cache, const void *ecurve,
+                   const void *substmat, const struct uproc_word *word,
+                   struct wordcache_entry *entry)
+{
+    struct slot_data data;
+    struct slot *slot = bucket(cache, hash(ecurve, substmat, word));
+
+    for (int i = 0; i < 2; i++) {
+        if (slot_read(&slot[i], &data) &&
+            slot_matches(&data, ecurve, substmat, word)) {
+            *entry = data.entry;
+            return true;
+        }
+    }
+    return false;
+}
+
+void wordcache_put(uproc_wordcache *cache, const void *ecurve,
+                   const void *substmat, const struct uproc_word *word,
+                   const struct wordcache_entry *entry)
+{
+    uint64_t buf[SLOT_WORDS], h = hash(ecurve, substmat, word), seq[2];
+    struct slot_data data;
+    struct slot *slot = bucket(cache, h);
+    size_t i, k;
+
+    /* take an empty slot, or a pseudo-random one of the two */
+    seq[0] = __atomic_load_n(&slot[0].seq, __ATOMIC_RELAXED);
+    seq[1] = __atomic_load_n(&slot[1].seq, __ATOMIC_RELAXED);
+    k = !seq[0] ? 0 : !seq[1] ? 1 : ((h >> 32) ^ (seq[0] >> 1)) & 1;
+    slot += k;
+    if (seq[k] & 1 ||
+        !__atomic_compare_exchange_n(&slot->seq, &seq[k], seq[k] + 1, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memset(&data, 0, sizeof data);
+    data.ecurve = ecurve;
+    data.substmat = substmat;
+    data.word = *word;
+    data.entry = *entry;
+    memset(buf, 0, sizeof buf);
+    memcpy(buf, &data, sizeof data);
+    for (i = 0; i < SLOT_WORDS; i++) {
+        __atomic_store_n(&slot->data[i], buf[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot->seq, seq[k] + 2, __ATOMIC_RELEASE);
+}
+#else
+size_t uproc_wordcache_used(const uproc_wordcache *cache)
+{
+    (void)cache;
+    return 0;
+}
+
+bool wordcache_get(uproc_wordcache *cache, const void *ecurve,
+                   const void *substmat, const struct uproc_word *word,
+                   struct wordcache_entry *entry)
+{
+    (void)cache, (void)ecurve, (void)substmat, (void)word, (void)entry;
+    return false;
+}
+
+void wordcache_put(uproc_wordcache *cache, const void *ecurve,
+                   const void *substmat, const struct uproc_word *word,
+                   const struct wordcache_entry *entry)
+{
+    (void)cache, (void)ecurve, (void)substmat, (void)word, (void)entry;
+}
+#endif
@@ -0,0 +1,33 @@
+#ifndef UPROC_WORDCACHE_INTERNAL_H
+#define UPROC_WORDCACHE_INTERNAL_H
+
+#include <stdbool.h>
+
+#include "uproc/common.h"
+#include "uproc/word.h"
+#include "uproc/wordcache.h"
+
+/* Neighbours of a word and their distances to it; if both neighbours are the
+ * same word, only the lower one is set */
+struct wordcache_entry
+{
+    struct uproc_word lower_nb, upper_nb;
+    uproc_family lower_family, upper_family;
+    double lower_dist[UPROC_SUFFIX_LEN], upper_dist[UPROC_SUFFIX_LEN];
+};
+
+/* Look up the entry of `word` in the ecurve `ecurve` (aligned with the
+ * substitution matrix `substmat`); returns whether it was found. Copies of an
+ * ecurve are passed as the ecurve they were made from, see
+ * ecurve_identity(). */
+bool wordcache_get(uproc_wordcache *cache, const void *ecurve,
+                   const void *substmat, const struct uproc_word *word,
+                   struct wordcache_entry *entry);
+
+/* Store the entry of `word`, unless another thread is writing the place it
+ * would take */
+void wordcache_put(uproc_wordcache *cache, const void *ecurve,
+                   const void *substmat, const struct uproc_word *word,
+                   const struct wordcache_entry *entry);
+
+#endif
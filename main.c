@@ -33,6 +33,20 @@
 #include <omp.h>
 #endif
 
+#if HAVE_SCHED_H
+#include <sched.h>
+#endif
+
+#if SERVER_SUPPORT
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
 #include <uproc.h>
 
 #include "ppopts.h"
@@ -43,31 +57,89 @@
 #define PROGNAME "uproc-prot"
 #endif
 
-#define PROT_THRESH_DEFAULT 3
-#define ORF_THRESH_DEFAULT 2
-
-#define NUM_THREADS_DEFAULT 8
-#define CHUNK_SIZE_DEFAULT (1 << 10)
 #define CHUNK_SIZE_MAX (1 << 14)
 
+/* Limits of the number of bytes (headers and sequence data) in a chunk, and
+ * the number of bytes of the first chunk */
+#define CHUNK_BYTES_MIN (1 << 12)
+#define CHUNK_BYTES_MAX (1 << 22)
+#define CHUNK_BYTES_INITIAL (1 << 16)
+
+/* Time in seconds a thread should take to classify a chunk. Sweeps over the
+ * database pay off with larger chunks. */
+#define CHUNK_TIME 0.02
+#define CHUNK_TIME_SWEEP 0.25
+
+/* bytes of formatted results classify_file() collects before writing them
+ * without a pipeline */
+#define OUT_FLUSH_SIZE (1 << 16)
+
+/* chunks in flight per classifying thread (see classify_file_mt()) */
+#define PIPELINE_DEPTH 2
+
+/* bytes of sequences a classifying thread takes from a chunk at once */
+#define CLAIM_BYTES (1 << 12)
+
 #if MAIN_DNA
 #define clf uproc_dnaclass
-#define clf_classify uproc_dnaclass_classify
+#define clf_classify uproc_dnaclass_classify_ws
+#define clf_classify_many uproc_dnaclass_classify_many
 #define clfresult uproc_dnaresult
 #else
 #define clf uproc_protclass
-#define clf_classify uproc_protclass_classify
+#define clf_classify uproc_protclass_classify_ws
+#define clf_classify_many uproc_protclass_classify_many
 #define clfresult uproc_protresult
 #endif
 
-timeit t_in, t_out, t_clf, t_tot;
+timeit t_tot;
+
+/* Offsets of the header and data of a sequence in the arena of a buffer,
+ * and the length of the data */
+struct seqview
+{
+    size_t header, data, len;
+};
+
+/* Position and length of a sequence in a buffer */
+struct seqrank
+{
+    long long i;
+    size_t len;
+};
 
 struct buffer
 {
-    struct uproc_sequence seqs[CHUNK_SIZE_MAX];
-    uproc_list *results[CHUNK_SIZE_MAX];
-    long long n;
-} buf[2];
+    /* headers and data of the sequences in the buffer, each terminated by a
+     * null character, and their offsets */
+    char *arena;
+    size_t arena_size, arena_alloc;
+    struct seqview *views;
+
+    /* pointers into the arena, set once the buffer is filled */
+    const char **headers, **seq_data;
+
+    uproc_list **results;
+    long long n, alloc;
+
+    /* the sequences, longest first, the number of them taken by classifying
+     * threads and the number of classified ones (see pipeline_claim()) */
+    struct seqrank *order;
+    long long next, done;
+
+    /* number of the first sequence, counting from 1 over all input files,
+     * and the formatted results of the chunk (see -p) */
+    unsigned long first;
+    struct textbuf out;
+
+    /* bytes read into the buffer and time it took to classify them */
+    long long bytes;
+    double time;
+
+    /* number of the chunk in the buffer, and one more than that once it has
+     * been classified (see classify_file_mt()) */
+    unsigned long chunk, classified;
+};
 
 #if MAIN_DNA
 static void map_list_dnaresult_free(void *value, void *opaque)
@@ -77,10 +149,67 @@ static void map_list_dnaresult_free(void *value, void *opaque)
 }
 #endif
 
+/* Double the number of sequences the buffer can hold */
+int buffer_grow(struct buffer *buf)
+{
+    long long n = buf->alloc ? 2 * buf->alloc : 64;
+    struct seqview *views = realloc(buf->views, n * sizeof *views);
+    if (views) {
+        buf->views = views;
+    }
+    const char **headers = realloc(buf->headers, n * sizeof *headers);
+    if (headers) {
+        buf->headers = headers;
+    }
+    const char **seq_data = realloc(buf->seq_data, n * sizeof *seq_data);
+    if (seq_data) {
+        buf->seq_data = seq_data;
+    }
+    uproc_list **results = realloc(buf->results, n * sizeof *results);
+    if (results) {
+        buf->results = results;
+    }
+    struct seqrank *order = realloc(buf->order, n * sizeof *order);
+    if (order) {
+        buf->order = order;
+    }
+    if (!views || !headers || !seq_data || !results || !order) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    for (long long i = buf->alloc; i < n; i++) {
+        buf->results[i] = NULL;
+    }
+    buf->alloc = n;
+    return 0;
+}
+
+/* Append the `n` characters at `s` and a null character to the arena of
+ * `buf` and store their offset in `*offset` */
+int buffer_append(struct buffer *buf, const char *s, size_t n, size_t *offset)
+{
+    *offset = buf->arena_size;
+    if (*offset + n + 1 > buf->arena_alloc) {
+        size_t sz = buf->arena_alloc ? buf->arena_alloc : CHUNK_BYTES_MIN;
+        char *tmp;
+        while (sz < *offset + n + 1) {
+            sz *= 2;
+        }
+        tmp = realloc(buf->arena, sz);
+        if (!tmp) {
+            return uproc_error(UPROC_ENOMEM);
+        }
+        buf->arena = tmp;
+        buf->arena_alloc = sz;
+    }
+    memcpy(buf->arena + *offset, s, n);
+    buf->arena[*offset + n] = '\0';
+    buf->arena_size += n + 1;
+    return 0;
+}
+
 void buffer_free(struct buffer *buf)
 {
-    for (size_t i = 0; i < CHUNK_SIZE_MAX; i++) {
-        uproc_sequence_free(&buf->seqs[i]);
+    for (long long i = 0; i < buf->alloc; i++) {
         if (buf->results[i]) {
 #if MAIN_DNA
             uproc_list_map(buf->results[i], map_list_dnaresult_free, NULL);
@@ -88,11 +217,217 @@ void buffer_free(struct buffer *buf)
             uproc_list_destroy(buf->results[i]);
         }
     }
+    free(buf->arena);
+    free(buf->views);
+    free(buf->headers);
+    free(buf->seq_data);
+    free(buf->results);
+    free(buf->order);
+    textbuf_free(&buf->out);
+}
+
+/* chunk size in sequences if set with the UPROC_CHUNK_SIZE environment
+ * variable, otherwise 0 (see determine_chunk_size()) */
+long long chunk_size = 0;
+
+/* Without a fixed chunk size, a chunk is complete once it holds `chunk_bytes`
+ * bytes. The write stage adapts it to the measured throughput, so that
+ * classifying a chunk takes about `chunk_time` seconds (see chunk_adapt()). */
+long long chunk_bytes = CHUNK_BYTES_INITIAL;
+double chunk_time = CHUNK_TIME;
+
+/* classify whole chunks with clf_classify_many() (see -S) */
+bool sweep_mode = false;
+
+/* NUMA mode (see -N) */
+enum { NUMA_OFF, NUMA_REPLICATE, NUMA_INTERLEAVE } numa_mode = NUMA_OFF;
+
+/* number of classifiers, one per NUMA node when replicating the database */
+int numa_nodes = 1;
+
+/* per-thread statistics of the NUMA mode */
+#define THREADS_MAX 1024
+struct numa_stats
+{
+    /* node whose copy of the database the thread uses, or the node it ran on
+     * if the database is interleaved */
+    int node;
+
+    /* classified sequences, and how many of them while running on `node` */
+    unsigned long long seqs, local;
+} numa_stats[THREADS_MAX];
+
+/* node the calling thread is bound to */
+int thread_node = -1;
+#if _OPENMP
+#pragma omp threadprivate(thread_node)
+#endif
+
+int thread_num(void)
+{
+#if _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+/* Return the classifier index for thread number `t`, binding the calling
+ * thread to the corresponding node */
+int numa_enter(int t)
+{
+    int node = t % numa_nodes;
+    if (numa_mode == NUMA_REPLICATE && thread_node != node) {
+        uproc_numa_bind_thread(node);
+        thread_node = node;
+    }
+    return node;
+}
+
+/* Account `n` sequences classified by thread number `t` */
+void numa_account(int t, int node, unsigned long long n)
+{
+    int current;
+    if (numa_mode == NUMA_OFF || t >= THREADS_MAX) {
+        return;
+    }
+    current = uproc_numa_node();
+    if (numa_mode == NUMA_INTERLEAVE) {
+        node = current;
+    }
+    numa_stats[t].node = node;
+    numa_stats[t].seqs += n;
+    if (current == node) {
+        numa_stats[t].local += n;
+    }
+}
+
+/* Print the thread to node mapping and the share of sequences each node
+ * classified with local memory */
+void numa_report(void)
+{
+    int node, t, nodes = uproc_numa_nodes();
+    for (node = 0; node < nodes; node++) {
+        unsigned long long seqs = 0, local = 0;
+        fprintf(stderr, "NUMA node %d: threads", node);
+        for (t = 0; t < THREADS_MAX; t++) {
+            if (numa_stats[t].seqs && numa_stats[t].node == node) {
+                fprintf(stderr, " %d", t);
+                seqs += numa_stats[t].seqs;
+                local += numa_stats[t].local;
+            }
+        }
+        fprintf(stderr, ", %llu sequences", seqs);
+        if (numa_mode == NUMA_REPLICATE && seqs) {
+            fprintf(stderr, ", %.1f%% on the local node",
+                    100.0 * local / seqs);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+/* Number of word pairs aligned to validate the substmat mode */
+#define SUBSTMAT_SAMPLES 100000
+
+/* Print the substmat mode and how far its scores deviate from the scalar
+ * double precision ones */
+void substmat_report(const uproc_substmat *mat)
+{
+    char mode[64];
+    uproc_substmat_mode_str(uproc_substmat_mode(mat), mode, sizeof mode);
+    fprintf(stderr, "substmat: %s, max. deviation %g in %d word pairs\n",
+            mode, uproc_substmat_deviation(mat, SUBSTMAT_SAMPLES),
+            SUBSTMAT_SAMPLES);
+}
+
+/* classifier workspaces, indexed by the number of the classifying thread */
+uproc_classify_workspace **workspaces = NULL;
+int n_workspaces = 0;
+
+/* Make sure there is a workspace for each of `n` threads */
+void workspaces_reserve(int n)
+{
+    uproc_classify_workspace **tmp;
+    if (n <= n_workspaces) {
+        return;
+    }
+    tmp = realloc(workspaces, n * sizeof *tmp);
+    if (!tmp) {
+        uproc_error(UPROC_ENOMEM);
+        return;
+    }
+    workspaces = tmp;
+    for (; n_workspaces < n; n_workspaces++) {
+        workspaces[n_workspaces] = uproc_classify_workspace_create();
+    }
+}
+
+/* Sum up the statistics of all workspaces */
+void workspaces_stats(struct uproc_protclass_stats *total)
+{
+    struct uproc_protclass_stats stats;
+    *total = (struct uproc_protclass_stats){0};
+    for (int i = 0; i < n_workspaces; i++) {
+        uproc_classify_workspace_stats(workspaces[i], &stats);
+        total->aligned += stats.aligned;
+        total->skipped += stats.skipped;
+        total->pruned += stats.pruned;
+        total->cache_hits += stats.cache_hits;
+        total->cache_misses += stats.cache_misses;
+    }
+}
+
+/* Print the pruning statistics of all workspaces */
+void prune_report(void)
+{
+    struct uproc_protclass_stats total;
+    workspaces_stats(&total);
+    fprintf(stderr,
+            "pruning: %llu families pruned, %llu of %llu word matches "
+            "skipped\n",
+            total.pruned, total.skipped, total.aligned + total.skipped);
+}
+
+/* Word cache shared by all classifiers, if UPROC_WORD_CACHE is set */
+uproc_wordcache *word_cache = NULL;
+
+void word_cache_create(void)
+{
+    char *end, *value = getenv("UPROC_WORD_CACHE");
+    long long mb;
+    if (!value) {
+        return;
+    }
+    mb = strtoll(value, &end, 10);
+    if (*end || mb <= 0) {
+        fprintf(stderr, "UPROC_WORD_CACHE must be a positive number\n");
+        return;
+    }
+    word_cache = uproc_wordcache_create((size_t)mb << 20);
+}
+
+/* Print the hit rate and fill level of the word cache */
+void word_cache_report(void)
+{
+    struct uproc_protclass_stats total;
+    unsigned long long n;
+    workspaces_stats(&total);
+    n = total.cache_hits + total.cache_misses;
+    fprintf(stderr,
+            "word cache: %llu of %llu words found (%.1f%%), %zu of %zu "
+            "entries used\n",
+            total.cache_hits, n, n ? 100.0 * total.cache_hits / n : 0.0,
+            uproc_wordcache_used(word_cache),
+            uproc_wordcache_capacity(word_cache));
 }
 
-/* chunk size to use. can be overwritten by setting the UPROC_CHUNK_SIZE
- * environemt variable (see determine_chunk_size())*/
-long long chunk_size = CHUNK_SIZE_DEFAULT;
+void workspaces_free(void)
+{
+    for (int i = 0; i < n_workspaces; i++) {
+        uproc_classify_workspace_destroy(workspaces[i]);
+    }
+    free(workspaces);
+}
 
 void determine_chunk_size(void)
 {
@@ -102,61 +437,128 @@ void determine_chunk_size(void)
         sz = strtoll(value, &end, 10);
         if (!*end && sz > 0 && sz <= CHUNK_SIZE_MAX) {
             chunk_size = sz;
-            return;
         }
     }
-    chunk_size = CHUNK_SIZE_DEFAULT;
+    if (sweep_mode) {
+        chunk_time = CHUNK_TIME_SWEEP;
+        chunk_bytes = CHUNK_BYTES_INITIAL * (CHUNK_TIME_SWEEP / CHUNK_TIME);
+    }
 }
 
-/* Classify the buffer contents */
-void buffer_classify(struct buffer *buf, clf *classifier)
+/* Adapt `chunk_bytes` to the throughput of a classified chunk
+ *
+ * Only called in the write stage. */
+void chunk_adapt(const struct buffer *buf)
 {
-    long long i;
-#pragma omp parallel for private(i) shared(buf, classifier) schedule(static)
-    for (i = 0; i < buf->n; i++) {
-        clf_classify(classifier, buf->seqs[i].data, &buf->results[i]);
+    /* bytes per second classified by one thread, moving average */
+    static double throughput = 0.0;
+    double rate, bytes;
+    if (chunk_size || buf->time <= 0.0) {
+        return;
     }
+    rate = buf->bytes / buf->time;
+    throughput = throughput ? 0.75 * throughput + 0.25 * rate : rate;
+    bytes = throughput * chunk_time;
+    if (bytes < CHUNK_BYTES_MIN) {
+        bytes = CHUNK_BYTES_MIN;
+    } else if (bytes > CHUNK_BYTES_MAX) {
+        bytes = CHUNK_BYTES_MAX;
+    }
+    __atomic_store_n(&chunk_bytes, (long long)bytes, __ATOMIC_RELAXED);
 }
 
-/* Read sequences from seqit and store them in buf.
+/* Classify the sequences `order[from:to]` of the buffer in thread number `t`
+ * (all of them with -S)
  *
- * Returns non-zero if at least one sequence was read.
+ * `classifiers` has an entry for each of the `numa_nodes` nodes. */
+void buffer_classify(struct buffer *buf, clf **classifiers, int t,
+                     long long from, long long to)
+{
+    int node = numa_enter(t);
+    if (sweep_mode) {
+        clf_classify_many(classifiers[node], workspaces[t], buf->seq_data,
+                          buf->n, buf->results);
+    } else {
+        for (long long k = from; k < to; k++) {
+            long long i = buf->order[k].i;
+            clf_classify(classifiers[node], workspaces[t], buf->seq_data[i],
+                         &buf->results[i]);
+        }
+    }
+    numa_account(t, node, to - from);
+}
+
+static int seqrank_cmp(const void *p1, const void *p2)
+{
+    const struct seqrank *a = p1, *b = p2;
+    if (a->len != b->len) {
+        return a->len < b->len ? 1 : -1;
+    }
+    return (a->i > b->i) - (a->i < b->i);
+}
+
+/* Order the sequences of the buffer by decreasing length, the estimated cost
+ * of classifying them (the number of ORFs of a DNA sequence grows with its
+ * length as well) */
+void buffer_rank(struct buffer *buf)
+{
+    for (long long i = 0; i < buf->n; i++) {
+        buf->order[i] = (struct seqrank){.i = i, .len = buf->views[i].len};
+    }
+    qsort(buf->order, buf->n, sizeof *buf->order, seqrank_cmp);
+    buf->next = buf->done = 0;
+}
+
+/* Read sequences from seqit and store them in buf, `chunk_size` sequences
+ * or at least `chunk_bytes` bytes.
+ *
+ * Returns 1 if at least one sequence was read, 0 at the end of the input or
+ * -1 on error. On error, `buf` holds the sequences read before.
  */
 int buffer_read(struct buffer *buf, uproc_seqiter *seqit)
 {
+    int res = 0;
     long long i;
-    for (i = 0; i < chunk_size; i++) {
+    size_t limit = __atomic_load_n(&chunk_bytes, __ATOMIC_RELAXED);
+
+    /* release the arena if it had to grow far beyond the chunk size for a
+     * long sequence */
+    if (buf->arena_alloc > 2 * CHUNK_BYTES_MAX) {
+        free(buf->arena);
+        buf->arena = NULL;
+        buf->arena_alloc = 0;
+    }
+    buf->arena_size = 0;
+    for (i = 0; chunk_size ? i < chunk_size : buf->arena_size < limit; i++) {
         struct uproc_sequence seq;
-        int res = uproc_seqiter_next(seqit, &seq);
+        struct seqview *v;
+        res = uproc_seqiter_next(seqit, &seq);
         if (res) {
             break;
         }
         trim_header(seq.header);
-        uproc_sequence_free(&buf->seqs[i]);
-        uproc_sequence_copy(&buf->seqs[i], &seq);
+        if (i == buf->alloc && (res = buffer_grow(buf))) {
+            break;
+        }
+        v = &buf->views[i];
+        v->len = strlen(seq.data);
+        if ((res = buffer_append(buf, seq.header, strlen(seq.header),
+                                 &v->header)) ||
+            (res = buffer_append(buf, seq.data, v->len, &v->data))) {
+            break;
+        }
     }
     buf->n = i;
-    return buf->n > 0;
+    buf->bytes = buf->arena_size;
+    /* the arena doesn't move any more */
+    for (i = 0; i < buf->n; i++) {
+        buf->headers[i] = buf->arena + buf->views[i].header;
+        buf->seq_data[i] = buf->arena + buf->views[i].data;
+    }
+    buffer_rank(buf);
+    return res == -1 ? -1 : buf->n > 0;
 }
 
-
-// Available characters for the -F format string.
-#define OUTFMT_PROT "nhl"
-#define OUTFMT_DNA "FIL"  // only when compiling uproc-dna, see below
-#define OUTFMT_PRED "fs"
-enum {
-    OUTFMT_SEQ_NUMBER,
-    OUTFMT_SEQ_HEADER,
-    OUTFMT_SEQ_LENGTH,
-#ifdef MAIN_DNA
-    OUTFMT_ORF_FRAME,
-    OUTFMT_ORF_INDEX,
-    OUTFMT_ORF_LENGTH,
-#endif
-    OUTFMT_PFAM,
-    OUTFMT_SCORE,
-};
-
 #ifdef MAIN_DNA
 #define OUTFMT OUTFMT_PROT OUTFMT_DNA OUTFMT_PRED
 #else
@@ -166,69 +568,44 @@ enum {
 // Print all fields by default, can be overridden with -F
 const char *out_format = OUTFMT;
 
-void print_result(uproc_io_stream *stream,
-                  unsigned long seq_num, const char *header,
-                  unsigned long seq_len, struct clfresult *result,
-                  uproc_idmap *idmap)
-{
-    const char *format = out_format;
-    while (*format) {
-        // increment format here so we know later if we need to print a comma
-        const char *p = strchr(OUTFMT, *format++);
-        // ignore unknown format characters
-        if (!p) {
-            continue;
-        }
+/* out_format, compiled in main() */
+struct result_format out_fmt;
 
-        // print the item corresponding to the
-        switch (p - OUTFMT) {
-            case OUTFMT_SEQ_NUMBER:
-                uproc_io_printf(stream, "%lu", seq_num);
-                break;
-            case OUTFMT_SEQ_HEADER:
-                uproc_io_printf(stream, "%s", header);
-                break;
-            case OUTFMT_SEQ_LENGTH:
-                uproc_io_printf(stream, "%lu", seq_len);
-                break;
+void format_clfresult(struct textbuf *out, unsigned long seq_num,
+                      const char *header, unsigned long seq_len,
+                      struct clfresult *result, uproc_idmap *idmap)
+{
 #if MAIN_DNA
-            case OUTFMT_ORF_FRAME:
-                uproc_io_printf(stream, "%u", result->orf.frame + 1);
-                break;
-            case OUTFMT_ORF_INDEX:
-                uproc_io_printf(stream, "%lu",
-                                (unsigned long)result->orf.start + 1);
-                break;
-            case OUTFMT_ORF_LENGTH:
-                uproc_io_printf(stream, "%lu",
-                                (unsigned long)result->orf.length);
-                break;
+    const struct uproc_orf *orf = &result->orf;
+#else
+    const struct uproc_orf *orf = NULL;
 #endif
-            case OUTFMT_PFAM:
-                if (idmap) {
-                    uproc_io_printf(stream, "%s",
-                                    uproc_idmap_str(idmap, result->family));
-                } else {
-                    uproc_io_printf(stream, "%" UPROC_FAMILY_PRI,
-                                    result->family);
-                }
-                break;
-            case OUTFMT_SCORE:
-                uproc_io_printf(stream, "%1.3f", result->score);
-                break;
-        }
-        if (*format) {
-            uproc_io_putc(',', stream);
+    format_result(out, &out_fmt, seq_num, header, seq_len, orf,
+                  result->family, result->score, idmap);
+}
+
+/* Format the classification results into the output buffer (see -p) */
+void buffer_format(struct buffer *buf, uproc_idmap *idmap)
+{
+    struct clfresult result;
+    buf->out.len = 0;
+    for (long long i = 0; i < buf->n; i++) {
+        uproc_list *results = buf->results[i];
+        long n_results = uproc_list_size(results);
+        for (long k = 0; k < n_results; k++) {
+            uproc_list_get(results, k, &result);
+            format_clfresult(&buf->out, buf->first + i, buf->headers[i],
+                             buf->views[i].len, &result, idmap);
         }
     }
-    uproc_io_putc('\n', stream);
 }
 
-/* Process (and maybe output) classification results */
+/* Account the classification results and output the formatted ones, if
+ * `out_preds` is set */
 void buffer_process(struct buffer *buf, unsigned long *n_seqs,
                     unsigned long *n_seqs_unexplained,
                     unsigned long counts[UPROC_FAMILY_MAX + 1],
-                    uproc_io_stream *out_preds, uproc_idmap *idmap)
+                    uproc_io_stream *out_preds)
 {
     for (long long i = 0; i < buf->n; i++) {
         uproc_list *results = buf->results[i];
@@ -243,78 +620,433 @@ void buffer_process(struct buffer *buf, unsigned long *n_seqs,
         for (long k = 0; k < n_results; k++) {
             uproc_list_get(results, k, &result);
             counts[result.family] += 1;
-            if (out_preds) {
-                print_result(out_preds, *n_seqs, buf->seqs[i].header,
-                             strlen(buf->seqs[i].data), &result, idmap);
+        }
+    }
+    if (out_preds && buf->out.len) {
+        uproc_io_write(buf->out.data, 1, buf->out.len, out_preds);
+    }
+}
+
+/* Whether classify_file() reads and classifies chunks concurrently */
+bool classify_mt(void)
+{
+    bool use_mt = sweep_mode;
+#if _OPENMP
+    use_mt = use_mt || omp_get_max_threads() > 1;
+#endif
+    return use_mt;
+}
+
+/* Stages of classify_file() */
+enum stage {
+    STAGE_READ,
+    STAGE_CLASSIFY,
+    STAGE_WRITE,
+    STAGE_STALL, /* idle because all chunks in flight wait for the writer */
+    STAGE_IDLE,
+    STAGES
+};
+
+/* Time spent in each stage, summed over all threads, the time spent
+ * classifying input files, the longest time a thread took to classify a
+ * chunk and the longest time a thread was busy with one input file (see -V) */
+struct
+{
+    double time[STAGES], elapsed, chunk_max, busy_max;
+    int threads, busy_n;
+    unsigned long chunks, max_in_flight;
+    unsigned long long bytes;
+} stage_stats;
+
+/* Add the time since `*begin` to `time[stage]` and restart at the current
+ * time. Returns the added time. */
+double stage_time(double time[STAGES], enum stage stage, double *begin)
+{
+    double end = wall_time(), t = end - *begin;
+    time[stage] += t;
+    *begin = end;
+    return t;
+}
+
+/* Add the stage times of one thread and the longest time it took to
+ * classify a chunk to the totals */
+void stage_stats_add(const double time[STAGES], double chunk_max)
+{
+    double busy = 0.0;
+    for (int i = 0; i < STAGES; i++) {
+        if (i != STAGE_STALL && i != STAGE_IDLE) {
+            busy += time[i];
+        }
+    }
+#pragma omp critical(stage_stats)
+    {
+        for (int i = 0; i < STAGES; i++) {
+            stage_stats.time[i] += time[i];
+        }
+        if (chunk_max > stage_stats.chunk_max) {
+            stage_stats.chunk_max = chunk_max;
+        }
+        if (busy > stage_stats.busy_max) {
+            stage_stats.busy_max = busy;
+        }
+        stage_stats.busy_n++;
+    }
+}
+
+/* Print how much of the time the serial stages took and how much of the
+ * threads' time went into classification */
+void stage_report(void)
+{
+    double thread_time = 0.0, elapsed = stage_stats.elapsed;
+    for (int i = 0; i < STAGES; i++) {
+        thread_time += stage_stats.time[i];
+    }
+    if (!elapsed || !thread_time) {
+        return;
+    }
+    fprintf(stderr, "pipeline: %d thread%s, %.2f s", stage_stats.threads,
+            stage_stats.threads == 1 ? "" : "s", elapsed);
+    if (stage_stats.chunks) {
+        fprintf(stderr,
+                ", %lu chunks of %.1f kB on average (at most %lu in flight)",
+                stage_stats.chunks,
+                stage_stats.bytes / 1e3 / stage_stats.chunks,
+                stage_stats.max_in_flight);
+    }
+    fprintf(stderr,
+            "\npipeline: reading %.1f%%, writing %.1f%% of the time; "
+            "classifying %.1f%%, waiting for the writer %.1f%%, idle %.1f%% "
+            "of the thread time\n",
+            100.0 * stage_stats.time[STAGE_READ] / elapsed,
+            100.0 * stage_stats.time[STAGE_WRITE] / elapsed,
+            100.0 * stage_stats.time[STAGE_CLASSIFY] / thread_time,
+            100.0 * stage_stats.time[STAGE_STALL] / thread_time,
+            100.0 * stage_stats.time[STAGE_IDLE] / thread_time);
+    if (stage_stats.chunks && stage_stats.time[STAGE_CLASSIFY]) {
+        double mean = stage_stats.time[STAGE_CLASSIFY] / stage_stats.chunks;
+        fprintf(stderr,
+                "pipeline: classifying a chunk took %.2f ms on average, at "
+                "most %.2f ms (%.1f times the mean)\n",
+                1e3 * mean, 1e3 * stage_stats.chunk_max,
+                stage_stats.chunk_max / mean);
+    }
+    if (stage_stats.busy_n && stage_stats.busy_max) {
+        double mean = (thread_time - stage_stats.time[STAGE_STALL] -
+                       stage_stats.time[STAGE_IDLE]) /
+                      stage_stats.busy_n;
+        fprintf(stderr,
+                "pipeline: a thread was busy for %.2f s on average, at most "
+                "%.2f s (%.1f times the mean)\n",
+                mean, stage_stats.busy_max, stage_stats.busy_max / mean);
+    }
+}
+
+/* Chunks in flight in classify_file_mt()
+ *
+ * Chunk number `i` (counting over all input files) is kept in
+ * `chunks[i % depth]`. `read`, `claimed` and `written` count the chunks that
+ * were read, whose sequences were all taken by classifying threads and that
+ * were written, `seqs` the sequences that were read. Together with the
+ * `classified` member of the buffers, they form bounded lock-free queues
+ * between the stages. Reading and writing are serial; they run in whichever
+ * thread obtains the `reading` or `writing` flag. */
+struct
+{
+    struct buffer *chunks;
+    unsigned long depth, read, claimed, written, seqs;
+    bool eof, reading, writing;
+} pipeline;
+
+void pipeline_init(void)
+{
+    int threads = 1;
+    if (pipeline.chunks) {
+        return;
+    }
+#if _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    /* enough to keep every thread busy while the writer waits for the oldest
+     * chunk */
+    pipeline.depth = PIPELINE_DEPTH * threads + 2;
+    pipeline.chunks = calloc(pipeline.depth, sizeof *pipeline.chunks);
+    if (!pipeline.chunks) {
+        uproc_error(UPROC_ENOMEM);
+    }
+}
+
+void pipeline_free(void)
+{
+    if (!pipeline.chunks) {
+        return;
+    }
+    for (unsigned long i = 0; i < pipeline.depth; i++) {
+        buffer_free(&pipeline.chunks[i]);
+    }
+    free(pipeline.chunks);
+}
+
+struct buffer *pipeline_chunk(unsigned long i)
+{
+    return &pipeline.chunks[i % pipeline.depth];
+}
+
+/* Whether all chunks of the current input file have been written */
+bool pipeline_done(void)
+{
+    return __atomic_load_n(&pipeline.eof, __ATOMIC_ACQUIRE) &&
+           __atomic_load_n(&pipeline.written, __ATOMIC_ACQUIRE) ==
+               __atomic_load_n(&pipeline.read, __ATOMIC_RELAXED);
+}
+
+/* Read the next chunk from `seqit` if a buffer is free
+ *
+ * Returns whether the calling thread ran the read stage. */
+bool pipeline_read(uproc_seqiter *seqit)
+{
+    unsigned long r, in_flight;
+    bool ran = false;
+
+    if (__atomic_load_n(&pipeline.eof, __ATOMIC_RELAXED) ||
+        __atomic_test_and_set(&pipeline.reading, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    r = pipeline.read;
+    in_flight = r - __atomic_load_n(&pipeline.written, __ATOMIC_ACQUIRE);
+    if (!pipeline.eof && in_flight < pipeline.depth) {
+        struct buffer *buf = pipeline_chunk(r);
+        int res = buffer_read(buf, seqit);
+        if (buf->n) {
+            buf->chunk = r;
+            buf->time = 0.0;
+            buf->first = pipeline.seqs + 1;
+            pipeline.seqs += buf->n;
+            __atomic_store_n(&pipeline.read, r + 1, __ATOMIC_RELEASE);
+            stage_stats.chunks++;
+            stage_stats.bytes += buf->bytes;
+            if (in_flight + 1 > stage_stats.max_in_flight) {
+                stage_stats.max_in_flight = in_flight + 1;
             }
         }
+        if (res <= 0) {
+            /* end of input, or an error after which the sequences read so
+             * far are still classified */
+            __atomic_store_n(&pipeline.eof, true, __ATOMIC_RELEASE);
+        }
+        ran = true;
+    }
+    __atomic_clear(&pipeline.reading, __ATOMIC_RELEASE);
+    return ran;
+}
+
+/* Take sequences of the oldest chunk that has untaken ones, longest first,
+ * until they add up to CLAIM_BYTES (all of them with -S)
+ *
+ * Returns the chunk, whose sequences `order[*from:*to]` were taken, or NULL
+ * if there was no such chunk. */
+struct buffer *pipeline_claim(long long *from, long long *to)
+{
+    struct buffer *buf = NULL;
+#pragma omp critical(pipeline_claim)
+    {
+        unsigned long c = pipeline.claimed;
+        if (c != __atomic_load_n(&pipeline.read, __ATOMIC_ACQUIRE)) {
+            size_t bytes = 0;
+            buf = pipeline_chunk(c);
+            *from = *to = buf->next;
+            while (*to < buf->n && (sweep_mode || bytes < CLAIM_BYTES)) {
+                bytes += buf->order[(*to)++].len;
+            }
+            buf->next = *to;
+            if (buf->next == buf->n) {
+                pipeline.claimed = c + 1;
+            }
+        }
+    }
+    return buf;
+}
+
+/* Classify sequences of the oldest chunk that has untaken ones in thread
+ * number `t`. Several threads share a chunk this way, and its longest
+ * sequences are classified first. The thread that classifies the last
+ * sequence of the chunk formats its results unless `out_preds` is false, and
+ * raises `*chunk_max` to the time it took to classify the chunk.
+ *
+ * Returns false if there was no such chunk. */
+bool pipeline_classify(clf **classifiers, int t, bool out_preds,
+                       uproc_idmap *idmap, double *chunk_max)
+{
+    long long from, to;
+    double begin = wall_time(), t_claim;
+    struct buffer *buf = pipeline_claim(&from, &to);
+
+    if (!buf) {
+        return false;
+    }
+    buffer_classify(buf, classifiers, t, from, to);
+    t_claim = wall_time() - begin;
+#pragma omp atomic
+    buf->time += t_claim;
+    if (__atomic_add_fetch(&buf->done, to - from, __ATOMIC_ACQ_REL) <
+        buf->n) {
+        return true;
+    }
+    if (out_preds) {
+        begin = wall_time();
+        buffer_format(buf, idmap);
+        buf->time += wall_time() - begin;
+    }
+    if (buf->time > *chunk_max) {
+        *chunk_max = buf->time;
     }
+    __atomic_store_n(&buf->classified, buf->chunk + 1, __ATOMIC_RELEASE);
+    return true;
 }
 
-void classify_file_mt(const char *path, clf *classifier, unsigned long *n_seqs,
-                      unsigned long *n_seqs_unexplained,
+/* Start writing the next chunk in input order, if it has been classified
+ *
+ * Returns the chunk, which must be passed on to pipeline_write_end(), or
+ * NULL. */
+struct buffer *pipeline_write_begin(void)
+{
+    struct buffer *buf;
+    if (__atomic_test_and_set(&pipeline.writing, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    buf = pipeline_chunk(pipeline.written);
+    if (__atomic_load_n(&buf->classified, __ATOMIC_ACQUIRE) ==
+        pipeline.written + 1) {
+        return buf;
+    }
+    __atomic_clear(&pipeline.writing, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Release the buffer of the chunk returned by pipeline_write_begin() */
+void pipeline_write_end(void)
+{
+    __atomic_store_n(&pipeline.written, pipeline.written + 1,
+                     __ATOMIC_RELEASE);
+    __atomic_clear(&pipeline.writing, __ATOMIC_RELEASE);
+}
+
+/* Whether reading has to wait until the writer frees a buffer */
+bool pipeline_full(void)
+{
+    return __atomic_load_n(&pipeline.read, __ATOMIC_ACQUIRE) -
+               __atomic_load_n(&pipeline.written, __ATOMIC_ACQUIRE) ==
+           pipeline.depth;
+}
+
+/* Let other threads run while no stage is ready */
+void pipeline_pause(void)
+{
+#if HAVE_SCHED_H
+    sched_yield();
+#endif
+}
+
+/* First chunk of the first input file, read while the database is loading */
+struct
+{
+    const char *path;
+    uproc_seqiter *seqit;
+} prefetched;
+
+void prefetch_input(const char *path)
+{
+    prefetched.path = path;
+    prefetched.seqit = uproc_seqiter_create(open_read(path));
+    pipeline_init();
+    pipeline_read(prefetched.seqit);
+}
+
+/* Classify an input file in a pipeline of chunks: the threads of the team
+ * write the oldest classified chunk, read a new one or classify one, in that
+ * order of preference */
+void classify_file_mt(const char *path, clf **classifiers,
+                      unsigned long *n_seqs, unsigned long *n_seqs_unexplained,
                       unsigned long counts[UPROC_FAMILY_MAX + 1],
                       uproc_io_stream *out_preds, uproc_idmap *idmap)
 {
-    int more_input;
-    uproc_io_stream *stream = open_read(path);
-    uproc_seqiter *seqit = uproc_seqiter_create(stream);
+    uproc_seqiter *seqit;
+    int threads = 1;
+    double start;
+
+    if (prefetched.seqit && prefetched.path == path) {
+        seqit = prefetched.seqit;
+        prefetched.seqit = NULL;
+    } else {
+        pipeline_init();
+        seqit = uproc_seqiter_create(open_read(path));
+        pipeline.eof = false;
+    }
+#if _OPENMP
+    threads = omp_get_max_threads();
+#endif
+    workspaces_reserve(threads);
 
-    unsigned i_buf = 0;
     timeit_start(&t_tot);
-    do {
-        struct buffer *buf_in = &buf[i_buf], *buf_out = &buf[!i_buf];
-#pragma omp parallel sections
-        {
-#pragma omp section
-            {
-                timeit_start(&t_in);
-                more_input = buffer_read(buf_in, seqit);
-                timeit_stop(&t_in);
-            }
-#pragma omp section
-            {
-                timeit_start(&t_clf);
-                buffer_classify(buf_out, classifier);
-                timeit_stop(&t_clf);
-                timeit_start(&t_out);
-                buffer_process(buf_out, n_seqs, n_seqs_unexplained, counts,
-                               out_preds, idmap);
-                timeit_stop(&t_out);
+    start = wall_time();
+#pragma omp parallel num_threads(threads)
+    {
+        int t = thread_num();
+        double time[STAGES] = {0.0}, begin = wall_time(), chunk_max = 0.0;
+        enum stage stage;
+        struct buffer *buf;
+
+        while (!pipeline_done()) {
+            if ((buf = pipeline_write_begin())) {
+                buffer_process(buf, n_seqs, n_seqs_unexplained, counts,
+                               out_preds);
+                chunk_adapt(buf);
+                pipeline_write_end();
+                stage = STAGE_WRITE;
+            } else if (pipeline_read(seqit)) {
+                stage = STAGE_READ;
+            } else if (pipeline_classify(classifiers, t, out_preds, idmap,
+                                         &chunk_max)) {
+                stage = STAGE_CLASSIFY;
+            } else {
+                stage = pipeline_full() ? STAGE_STALL : STAGE_IDLE;
+                pipeline_pause();
             }
+            stage_time(time, stage, &begin);
         }
-        i_buf ^= 1;
-    } while (more_input);
+        stage_stats_add(time, chunk_max);
+    }
+    stage_stats.elapsed += wall_time() - start;
+    if (threads > stage_stats.threads) {
+        stage_stats.threads = threads;
+    }
     timeit_stop(&t_tot);
     uproc_seqiter_destroy(seqit);
 }
 
-void classify_file(const char *path, clf *classifier, unsigned long *n_seqs,
+void classify_file(const char *path, clf **classifiers, unsigned long *n_seqs,
                    unsigned long *n_seqs_unexplained,
                    unsigned long counts[UPROC_FAMILY_MAX + 1],
                    uproc_io_stream *out_preds, uproc_idmap *idmap)
 {
-#if _OPENMP
-    if (omp_get_max_threads() > 1) {
-        return classify_file_mt(path, classifier, n_seqs, n_seqs_unexplained,
+    if (classify_mt()) {
+        return classify_file_mt(path, classifiers, n_seqs, n_seqs_unexplained,
                                 counts, out_preds, idmap);
     }
-#endif
     timeit_start(&t_tot);
     uproc_io_stream *stream = open_read(path);
     uproc_seqiter *seqit = uproc_seqiter_create(stream);
     struct uproc_sequence seq;
     uproc_list *results = NULL;
-    timeit_start(&t_in);
+    struct textbuf out = {0};
+    double time[STAGES] = {0.0}, start = wall_time(), begin = start;
+    workspaces_reserve(1);
     while (!uproc_seqiter_next(seqit, &seq)) {
-        timeit_stop(&t_in);
         trim_header(seq.header);
+        stage_time(time, STAGE_READ, &begin);
 
-        timeit_start(&t_clf);
-        clf_classify(classifier, seq.data, &results);
-        timeit_stop(&t_clf);
+        clf_classify(classifiers[0], workspaces[0], seq.data, &results);
+        stage_time(time, STAGE_CLASSIFY, &begin);
 
-        timeit_start(&t_out);
         long n_results = uproc_list_size(results);
         *n_seqs += 1;
         if (!n_results) {
@@ -325,70 +1057,225 @@ void classify_file(const char *path, clf *classifier, unsigned long *n_seqs,
             uproc_list_get(results, i, &result);
             counts[result.family] += 1;
             if (out_preds) {
-                print_result(out_preds, *n_seqs, seq.header, strlen(seq.data),
-                             &result, idmap);
+                format_clfresult(&out, *n_seqs, seq.header, strlen(seq.data),
+                                 &result, idmap);
             }
         }
-        timeit_stop(&t_out);
-
-        timeit_start(&t_in);
+        if (out.len >= OUT_FLUSH_SIZE) {
+            uproc_io_write(out.data, 1, out.len, out_preds);
+            out.len = 0;
+        }
+        stage_time(time, STAGE_WRITE, &begin);
     }
-    timeit_stop(&t_in);
+    if (out.len) {
+        uproc_io_write(out.data, 1, out.len, out_preds);
+    }
+    textbuf_free(&out);
+    stage_time(time, STAGE_READ, &begin);
     uproc_seqiter_destroy(seqit);
+    stage_stats_add(time, 0.0);
+    stage_stats.elapsed += wall_time() - start;
+    stage_stats.threads = 1;
     timeit_stop(&t_tot);
 }
 
-struct count
+#if SERVER_SUPPORT
+/* Socket of uproc-server to use, see -C */
+const char *server_socket = NULL;
+
+#define SEND_BUFSZ (1 << 16)
+
+struct send_buffer
 {
-    uproc_family fam;
-    unsigned long n;
+    int fd;
+    char data[SEND_BUFSZ];
+    size_t n;
+    uproc_io_stream *out;
 };
 
-int compare_count(const void *p1, const void *p2)
+/* Copy what the server sent so far to `out`
+ *
+ * Returns 1 at the end of the output. */
+int forward_output(int fd, uproc_io_stream *out)
 {
-    const struct count *c1 = p1, *c2 = p2;
-
-    /* sort by n in descending order */
-    if (c1->n > c2->n) {
-        return -1;
-    } else if (c1->n < c2->n) {
+    char buf[SEND_BUFSZ];
+    ssize_t n = read(fd, buf, sizeof buf);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return 0;
+    }
+    if (n < 0) {
+        return uproc_error_msg(UPROC_ERRNO, "can't read from uproc-server");
+    }
+    if (!n) {
         return 1;
     }
+    uproc_io_write(buf, 1, n, out);
+    return 0;
+}
 
-    /* or fam in ascending */
-    if (c1->fam < c2->fam) {
+/* Send `n` bytes to the (non-blocking) socket `fd`, forwarding the output
+ * of the server in the meantime so that neither side blocks */
+int send_polled(int fd, const char *data, size_t n, uproc_io_stream *out)
+{
+    while (n) {
+        struct pollfd p = {.fd = fd, .events = POLLIN | POLLOUT};
+        if (poll(&p, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return uproc_error_msg(UPROC_ERRNO, "poll failed");
+        }
+        if (p.revents & (POLLIN | POLLHUP)) {
+            int res = forward_output(fd, out);
+            if (res) {
+                return res < 0 ? res : uproc_error_msg(
+                                           UPROC_EIO,
+                                           "uproc-server closed connection");
+            }
+        }
+        if (p.revents & POLLOUT) {
+            ssize_t res = write(fd, data, n);
+            if (res < 0 && errno != EINTR && errno != EAGAIN) {
+                return uproc_error_msg(UPROC_ERRNO,
+                                       "can't write to uproc-server");
+            }
+            if (res > 0) {
+                data += res;
+                n -= res;
+            }
+        } else if (p.revents & POLLERR) {
+            return uproc_error_msg(UPROC_EIO, "uproc-server connection failed");
+        }
+    }
+    return 0;
+}
+
+int send_flush(struct send_buffer *buf)
+{
+    int res = send_polled(buf->fd, buf->data, buf->n, buf->out);
+    buf->n = 0;
+    return res;
+}
+
+/* Append a line to `buf`, sending its contents when it is full */
+int send_line(struct send_buffer *buf, const char *line)
+{
+    size_t len = strlen(line);
+    if (buf->n + len + 1 > SEND_BUFSZ && send_flush(buf)) {
         return -1;
-    } else if (c1->fam > c2->fam) {
-        return 1;
     }
+    if (len + 1 > SEND_BUFSZ) {
+        return send_polled(buf->fd, line, len, buf->out) ||
+               send_polled(buf->fd, "\n", 1, buf->out);
+    }
+    memcpy(buf->data + buf->n, line, len);
+    buf->data[buf->n + len] = '\n';
+    buf->n += len + 1;
     return 0;
 }
 
-void print_counts(uproc_io_stream *stream,
-                  unsigned long counts[UPROC_FAMILY_MAX + 1],
-                  uproc_idmap *idmap)
+/* Classify the sequences of all `files` with the uproc-server listening on
+ * `path` and write its output to `out`
+ *
+ * Returns 1 if the server can't be used (so that the sequences can be
+ * classified locally instead), and 0 on success. */
+int classify_remote(const char *path, const struct server_request *req,
+                    char **files, int n_files, uproc_io_stream *out)
 {
-    struct count c[UPROC_FAMILY_MAX + 1];
-    uproc_family i, n = 0;
-    for (i = 0; i < UPROC_FAMILY_MAX + 1; i++) {
-        if (counts[i]) {
-            c[n].fam = i;
-            c[n].n = counts[i];
-            n++;
+    int fd, res;
+    char reply[256];
+    size_t len = 0;
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct send_buffer *buf;
+
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof addr)) {
+        fprintf(stderr,
+                "can't connect to uproc-server at %s, classifying locally\n",
+                path);
+        if (fd >= 0) {
+            close(fd);
         }
+        return 1;
     }
 
-    qsort(c, n, sizeof *c, compare_count);
+    server_request_send(fd, req);
+    while (len < sizeof reply - 1 && read(fd, &reply[len], 1) == 1 &&
+           reply[len] != '\n') {
+        len++;
+    }
+    reply[len] = '\0';
+    if (strcmp(reply, "OK")) {
+        const char *msg = reply;
+        if (!strncmp(msg, "ERROR ", 6)) {
+            msg += 6;
+        } else if (!len) {
+            msg = "no reply";
+        }
+        fprintf(stderr, "uproc-server: %s, classifying locally\n", msg);
+        close(fd);
+        return 1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 
-    for (i = 0; i < n; i++) {
-        if (idmap) {
-            uproc_io_printf(stream, "%s", uproc_idmap_str(idmap, c[i].fam));
-        } else {
-            uproc_io_printf(stream, "%" UPROC_FAMILY_PRI, c[i].fam);
+    buf = malloc(sizeof *buf);
+    if (!buf) {
+        return uproc_error(UPROC_ENOMEM);
+    }
+    *buf = (struct send_buffer){.fd = fd, .out = out};
+    for (int i = 0; i < n_files; i++) {
+        struct uproc_sequence seq;
+        uproc_seqiter *seqit = uproc_seqiter_create(open_read(files[i]));
+        while (!uproc_seqiter_next(seqit, &seq)) {
+            trim_header(seq.header);
+            send_line(buf, seq.header);
+            send_line(buf, seq.data);
         }
-        uproc_io_printf(stream, ",%lu\n", c[i].n);
+        uproc_seqiter_destroy(seqit);
     }
+    send_flush(buf);
+    free(buf);
+    shutdown(fd, SHUT_WR);
+
+    do {
+        struct pollfd p = {.fd = fd, .events = POLLIN};
+        if (poll(&p, 1, -1) < 0 && errno != EINTR) {
+            res = uproc_error_msg(UPROC_ERRNO, "poll failed");
+            break;
+        }
+        res = forward_output(fd, out);
+    } while (!res);
+    close(fd);
+    return res < 0 ? res : 0;
 }
+#endif
+
+/* Description of the environment variables, shown by -h */
+#define ENVIRONMENT_HELP                                                       \
+    "UPROC_MEMORY      \"hugepages\" and/or \"mlock\": move the database to\n" \
+    "                  huge pages and/or lock it in memory, and report the\n"  \
+    "                  memory obtained on stderr\n"                            \
+    "UPROC_RESIDENCY   how a mapped database is brought into memory:\n"        \
+    "                  \"populate\" (default), \"lazy\" or \"prefetch\",\n"    \
+    "                  optionally with \"keep-warm\"; the resident share is\n" \
+    "                  reported on stderr\n"                                   \
+    "UPROC_SUBSTMAT    kernel (\"scalar\", \"avx2\" or \"avx512\") and\n"      \
+    "                  precision (\"float\") of the distance lookups; the\n"   \
+    "                  largest deviation from \"scalar\" is reported on\n"     \
+    "                  stderr\n"                                               \
+    "UPROC_WORD_CACHE  size in MB of a cache of word lookups shared by all\n"  \
+    "                  threads (not used with -S); its hit rate is reported\n" \
+    "                  on stderr\n"                                            \
+    "UPROC_CHUNK_SIZE  number of sequences per chunk (default: sized by\n"     \
+    "                  bytes)\n"                                               \
+    "UPROC_PIPELINE    if set, report on stderr how the time was spent\n"      \
+    "                  reading, classifying and writing, and how evenly the\n" \
+    "                  work was spread over the threads"
 
 void make_opts(struct ppopts *o, const char *progname)
 {
@@ -417,9 +1304,31 @@ void make_opts(struct ppopts *o, const char *progname)
     O('V', "libversion", "", "Print libuproc version/features and exit.");
 
 #if _OPENMP
-    O('t', "threads", "N", "Maximum number of threads to use (default: %d).",
-      NUM_THREADS_DEFAULT);
+    O('t', "threads", "N",
+      "Maximum number of threads to use (default: OMP_NUM_THREADS or the "
+      "number of CPUs available to the process, considering its affinity "
+      "mask and cgroup CPU quota).");
+#endif
+#if SERVER_SUPPORT
+    O('C', "connect", "SOCKET",
+      "Send the sequences to the uproc-server listening on SOCKET (which "
+      "must use the same DBDIR, MODELDIR and classification options) instead "
+      "of loading the database. Falls back to classifying locally if the "
+      "server is not available. The default is the value of the "
+      "UPROC_SERVER environment variable, if set.");
 #endif
+    O('N', "numa", "MODE",
+      "On NUMA systems, either \"replicate\" the database on every node "
+      "and bind each thread to a node, so that it only reads local memory, "
+      "or \"interleave\" the database pages over all nodes. Prints the "
+      "thread to node mapping and the share of sequences classified on the "
+      "local node to stderr.");
+    O('S', "sweep", "",
+      "Classify the sequences in chunks (of up to %d MB, or the number of "
+      "sequences in the UPROC_CHUNK_SIZE environment variable): the words of "
+      "a whole chunk are sorted by prefix and looked up in that order. "
+      "Produces the same results, but is faster for large inputs.",
+      CHUNK_BYTES_MAX >> 20);
 
     ppopts_add_header(o, "OUTPUT FORMAT:");
     O('p', "preds", "",
@@ -469,6 +1378,14 @@ Protein threshold level. Allowed values:\n\
     3   more restrictive\n\
 Default is %d . ",
       PROT_THRESH_DEFAULT);
+    O('E', "prune", "",
+      "Stop scoring a protein family as soon as it can no longer reach the "
+      "threshold"
+#if MAIN_DNA
+      " (or, in short read mode, the maximum score)"
+#endif
+      ". Produces the same results. The number of skipped word matches is "
+      "reported on stderr (not counting -S).");
 
 #if MAIN_DNA
     ppopts_add_header(o, "DNA CLASSIFICATION OPTIONS:");
@@ -488,6 +1405,9 @@ Allowed values:\n\
 Default is %d.",
       ORF_THRESH_DEFAULT);
 #endif
+
+    ppopts_add_header(o, "ENVIRONMENT:");
+    ppopts_add_text(o, ENVIRONMENT_HELP);
 #undef O
 }
 
@@ -499,10 +1419,11 @@ int main(int argc, char **argv)
 
     uproc_io_stream *out_stream = uproc_stdout;
 
-    determine_chunk_size();
 #if _OPENMP
     omp_set_nested(1);
-    omp_set_num_threads(NUM_THREADS_DEFAULT);
+    if (!getenv("OMP_NUM_THREADS")) {
+        omp_set_num_threads(available_cpus());
+    }
 #endif
 
     /* output option flags */
@@ -512,6 +1433,7 @@ int main(int argc, char **argv)
         out_numeric = false;  // -n
 
     int prot_thresh_level = PROT_THRESH_DEFAULT;  // -P
+    bool prune = false;                           // -E
     int orf_thresh_level = ORF_THRESH_DEFAULT;    // -O
 
     bool short_read_mode = false;  // -s
@@ -530,6 +1452,25 @@ int main(int argc, char **argv)
             case 'V':
                 uproc_features_print(uproc_stdout);
                 return EXIT_SUCCESS;
+#if SERVER_SUPPORT
+            case 'C':
+                server_socket = optarg;
+                break;
+#endif
+            case 'N':
+                if (!strcmp(optarg, "replicate")) {
+                    numa_mode = NUMA_REPLICATE;
+                } else if (!strcmp(optarg, "interleave")) {
+                    numa_mode = NUMA_INTERLEAVE;
+                } else {
+                    fprintf(stderr,
+                            "-N argument must be replicate or interleave\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'S':
+                sweep_mode = true;
+                break;
             case 'p':
                 out_preds = true;
                 break;
@@ -557,6 +1498,9 @@ int main(int argc, char **argv)
                     return EXIT_FAILURE;
                 }
                 break;
+            case 'E':
+                prune = true;
+                break;
             case 't':
 #if _OPENMP
             {
@@ -590,6 +1534,16 @@ int main(int argc, char **argv)
         }
     }
 
+    determine_chunk_size();
+
+    bool dna = false;
+#if MAIN_DNA
+    dna = true;
+#endif
+    if (result_format_compile(&out_fmt, out_format, dna)) {
+        return EXIT_FAILURE;
+    }
+
     if (!out_counts && !out_preds && !out_stats) {
         out_counts = true;
     }
@@ -599,39 +1553,115 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    uproc_model *model =
-        uproc_model_load(argv[optind + MODELDIR], orf_thresh_level);
-    if (!model)
-        return EXIT_FAILURE;
+    /* use stdin if no input file specified */
+    if (argc < optind + ARGC) {
+        argv[argc++] = "-";
+    }
+
+#if SERVER_SUPPORT
+    if (!server_socket) {
+        server_socket = getenv("UPROC_SERVER");
+    }
+    if (server_socket && *server_socket) {
+        char dbdir[PATH_MAX], modeldir[PATH_MAX];
+        struct server_request req = {
+            .dbdir = dbdir,
+            .modeldir = modeldir,
+            .prot_thresh_level = prot_thresh_level,
+            .orf_thresh_level = orf_thresh_level,
+            .short_read_mode = short_read_mode,
+            .preds = out_preds,
+            .counts = out_counts,
+            .stats = out_stats,
+            .numeric = out_numeric,
+            .format = (char *)out_format,
+        };
+#if MAIN_DNA
+        req.dna = true;
+#endif
+        if (realpath(argv[optind + DBDIR], dbdir) &&
+            realpath(argv[optind + MODELDIR], modeldir) &&
+            !classify_remote(server_socket, &req, argv + optind + INFILES,
+                             argc - optind - INFILES, out_stream)) {
+            uproc_io_close(out_stream);
+            return EXIT_SUCCESS;
+        }
+    }
+#endif
 
-    uproc_database *db = uproc_database_load(
-        argv[optind + DBDIR], prot_thresh_level, UPROC_ECURVE_BINARY);
-    if (!db)
+    /* the model, the database and the first chunk of input are independent,
+     * so start up takes as long as loading the database */
+    uproc_model *model = NULL;
+    uproc_database *db = NULL;
+    bool prefetch = classify_mt();
+#pragma omp parallel sections num_threads(3)
+    {
+#pragma omp section
+        model = uproc_model_load(argv[optind + MODELDIR], orf_thresh_level);
+#pragma omp section
+        db = uproc_database_load(argv[optind + DBDIR], prot_thresh_level,
+                                 UPROC_ECURVE_BINARY);
+#pragma omp section
+        if (prefetch) {
+            prefetch_input(argv[optind + INFILES]);
+        }
+    }
+    if (!model || !db)
         return EXIT_FAILURE;
+    if (getenv("UPROC_MEMORY")) {
+        uproc_features_print(uproc_stderr);
+    }
+    if (getenv("UPROC_SUBSTMAT")) {
+        substmat_report(uproc_model_substitution_matrix(model));
+    }
 
-    uproc_protclass *pc;
-    uproc_dnaclass *dc;
-    clf *classifier;
+    uproc_protclass *pc[UPROC_NUMA_NODES_MAX];
+    uproc_dnaclass *dc[UPROC_NUMA_NODES_MAX];
+    uproc_ecurve *fwd[UPROC_NUMA_NODES_MAX], *rev[UPROC_NUMA_NODES_MAX];
+    clf *classifiers[UPROC_NUMA_NODES_MAX];
+
+    word_cache_create();
+
+    fwd[0] = uproc_database_ecurve_forward(db);
+    rev[0] = uproc_database_ecurve_reverse(db);
+    /* keep what UPROC_MEMORY obtained for the copies */
+    unsigned memory = uproc_ecurve_memory(fwd[0]);
+    if (numa_mode == NUMA_REPLICATE) {
+        numa_nodes = uproc_numa_nodes();
+        for (int node = 1; node < numa_nodes; node++) {
+            fwd[node] = uproc_ecurve_replicate(fwd[0], memory, node);
+            rev[node] = uproc_ecurve_replicate(rev[0], memory, node);
+        }
+        uproc_ecurve_place_node(fwd[0], memory, 0);
+        uproc_ecurve_place_node(rev[0], memory, 0);
+    } else if (numa_mode == NUMA_INTERLEAVE) {
+        memory |= UPROC_ECURVE_NUMA_INTERLEAVE;
+        uproc_ecurve_place(fwd[0], memory);
+        uproc_ecurve_place(rev[0], memory);
+    }
 
-    create_classifiers(&pc, &dc, db, model, short_read_mode);
+    for (int node = 0; node < numa_nodes; node++) {
+        if (create_classifiers_ecurves(&pc[node], &dc[node], fwd[node],
+                                       rev[node], db, model,
+                                       short_read_mode)) {
+            return EXIT_FAILURE;
+        }
+        uproc_protclass_set_pruning(pc[node], prune);
+        uproc_protclass_set_cache(pc[node], word_cache);
 #if MAIN_DNA
-    classifier = dc;
+        classifiers[node] = dc[node];
 #else
-    classifier = pc;
+        classifiers[node] = pc[node];
 #endif
+    }
 
     uproc_idmap *idmap = out_numeric ? NULL : uproc_database_idmap(db);
 
-    /* use stdin if no input file specified */
-    if (argc < optind + ARGC) {
-        argv[argc++] = "-";
-    }
-
     unsigned long n_seqs = 0, n_seqs_unexplained = 0;
     unsigned long counts[UPROC_FAMILY_MAX + 1] = {0};
 
     for (; optind + INFILES < argc; optind++) {
-        classify_file(argv[optind + INFILES], classifier, &n_seqs,
+        classify_file(argv[optind + INFILES], classifiers, &n_seqs,
                       &n_seqs_unexplained, counts,
                       out_preds ? out_stream : NULL, idmap);
     }
@@ -647,16 +1677,39 @@ int main(int argc, char **argv)
 
     uproc_io_close(out_stream);
 
-    uproc_protclass_destroy(pc);
-    uproc_dnaclass_destroy(dc);
+    if (numa_mode != NUMA_OFF) {
+        numa_report();
+    }
+    if (prune) {
+        prune_report();
+    }
+    if (word_cache) {
+        word_cache_report();
+    }
+    if (getenv("UPROC_PIPELINE")) {
+        stage_report();
+    }
+    if (getenv("UPROC_RESIDENCY")) {
+        uproc_io_printf(uproc_stderr,
+                        "ecurve residency: %.1f%% forward, %.1f%% reverse\n",
+                        uproc_ecurve_resident(fwd[0]),
+                        uproc_ecurve_resident(rev[0]));
+    }
+    for (int node = 0; node < numa_nodes; node++) {
+        uproc_protclass_destroy(pc[node]);
+        uproc_dnaclass_destroy(dc[node]);
+        if (node > 0) {
+            uproc_ecurve_destroy(fwd[node]);
+            uproc_ecurve_destroy(rev[node]);
+        }
+    }
     uproc_model_destroy(model);
     uproc_database_destroy(db);
-    buffer_free(&buf[0]);
-    buffer_free(&buf[1]);
+    pipeline_free();
+    result_format_free(&out_fmt);
+    workspaces_free();
+    uproc_wordcache_destroy(word_cache);
 
-    timeit_print(&t_in, "in ");
-    timeit_print(&t_out, "out");
-    timeit_print(&t_clf, "clf");
     timeit_print(&t_tot, "tot");
 
     return EXIT_SUCCESS;
@@ -348,7 +348,7 @@ static int build_ecurve(const char *infile, const char *alphabet,
 
 static int build_and_store(const char *infile, const char *outdir,
                            const char *alphabet, uproc_idmap *idmap,
-                           bool reverse)
+                           bool reverse, unsigned layout)
 {
     int res;
     uproc_ecurve *ecurve = NULL;
@@ -356,6 +356,11 @@ static int build_and_store(const char *infile, const char *outdir,
     if (res) {
         return res;
     }
+    res = uproc_ecurve_convert(ecurve, layout);
+    if (res) {
+        uproc_ecurve_destroy(ecurve);
+        return res;
+    }
     fprintf(stderr, "Storing %s/%s.ecurve...", outdir, reverse ? "rev" : "fwd");
     res = uproc_ecurve_store(ecurve, UPROC_ECURVE_BINARY, UPROC_IO_GZIP,
                              "%s/%s.ecurve", outdir, reverse ? "rev" : "fwd");
@@ -365,13 +370,13 @@ static int build_and_store(const char *infile, const char *outdir,
 }
 
 int build_ecurves(const char *infile, const char *outdir, const char *alphabet,
-                  uproc_idmap *idmap)
+                  uproc_idmap *idmap, unsigned layout)
 {
     int res;
-    res = build_and_store(infile, outdir, alphabet, idmap, false);
+    res = build_and_store(infile, outdir, alphabet, idmap, false, layout);
     if (res) {
         return res;
     }
-    res = build_and_store(infile, outdir, alphabet, idmap, true);
+    res = build_and_store(infile, outdir, alphabet, idmap, true, layout);
     return res;
 }
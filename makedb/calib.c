@@ -275,9 +275,11 @@ int calib(const char *alphabet, const char *dbdir, const char *modeldir)
             unsigned long i, seq_count;
             size_t seq_len;
             uproc_protclass *pc;
+            uproc_classify_workspace *ws;
             uproc_list *results = NULL;
             pc = uproc_protclass_create(UPROC_PROTCLASS_ALL, fwd, rev, substmat,
                                         prot_filter, NULL);
+            ws = uproc_classify_workspace_create();
 
             all_preds_n = 0;
             seq_len = 1 << power;
@@ -292,7 +294,7 @@ int calib(const char *alphabet, const char *dbdir, const char *modeldir)
                     }
                 }
                 randseq(seq, seq_len, alpha, aa_probs);
-                uproc_protclass_classify(pc, seq, &results);
+                uproc_protclass_classify_ws(pc, ws, seq, &results);
                 append(&all_preds, &all_preds_n, &all_preds_sz, results);
             }
             qsort(all_preds, all_preds_n, sizeof *all_preds, &double_cmp);
@@ -304,6 +306,7 @@ int calib(const char *alphabet, const char *dbdir, const char *modeldir)
                 all_preds[MIN(seq_count / 1000, all_preds_n - 1)];
             free(all_preds);
             uproc_list_destroy(results);
+            uproc_classify_workspace_destroy(ws);
             uproc_protclass_destroy(pc);
         }
     }
@@ -55,6 +55,7 @@ void make_opts(struct ppopts *o, const char *progname)
     O('n', "no-calib", "", "Do not calibrate created database.");
     O('c', "calib", "",
       "Re-calibrate existing database (SOURCEFILE will be ignored).");
+    O('L', "layout", "LAYOUT", ECURVE_LAYOUT_HELP);
 #undef O
 }
 
@@ -98,6 +99,7 @@ int main(int argc, char **argv)
     char alphabet[UPROC_ALPHABET_SIZE + 1], *modeldir, *infile, *outdir;
     bool calibrate_db = true;
     bool calib_only = false;
+    unsigned layout = UPROC_ECURVE_LAYOUT_DEFAULT;
 
     enum nonopt_args { MODELDIR, INFILE, OUTDIR, ARGC };
 
@@ -121,6 +123,12 @@ int main(int argc, char **argv)
             case 'c':
                 calib_only = true;
                 break;
+            case 'L':
+                if (uproc_ecurve_layout_parse(optarg, &layout)) {
+                    uproc_perror("");
+                    return EXIT_FAILURE;
+                }
+                break;
             case '?':
                 return EXIT_FAILURE;
         }
@@ -146,7 +154,7 @@ int main(int argc, char **argv)
             return EXIT_FAILURE;
         }
         make_dir(outdir);
-        res = build_ecurves(infile, outdir, alphabet, idmap);
+        res = build_ecurves(infile, outdir, alphabet, idmap, layout);
         if (res) {
             uproc_perror("error building ecurves");
             return EXIT_FAILURE;
@@ -162,7 +162,11 @@ void ppopts_print(struct ppopts *o, FILE *stream, int wrap, int flags)
                     fputc('\n', stream);
                 }
             case PPOPTS_TEXT:
-                print_desc(stream, opt->desc, 0, wrap);
+                if (strchr(opt->desc, '\n')) {
+                    fprintf(stream, "%s\n", opt->desc);
+                } else {
+                    print_desc(stream, opt->desc, 0, wrap);
+                }
                 break;
 
             default:
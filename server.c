@@ -0,0 +1,550 @@
+/* uproc-server
+ * Classify DNA/RNA or protein sequences sent by uproc-dna and uproc-prot
+ * using a database and model loaded only once.
+ *
+ * Copyright 2014 Peter Meinicke, Robin Martinjak
+ *
+ * This file is part of uproc.
+ *
+ * uproc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * uproc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with uproc.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include "common.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <uproc.h>
+
+#include "ppopts.h"
+
+#define PROGNAME "uproc-server"
+
+#define WORKERS_DEFAULT 8
+#define WORKERS_MAX 1024
+
+/* number of sequences read from a client before they are classified */
+#define CHUNK_SIZE (1 << 10)
+
+/* number of sequences classified by a worker at once */
+#define JOB_SIZE 64
+
+/* The classifiers, shared by all clients */
+struct classifiers
+{
+    uproc_protclass *pc_prot, *pc_dna;
+    uproc_dnaclass *dc;
+} clf;
+
+/* Loaded database and model and their settings */
+struct server_config
+{
+    char dbdir[PATH_MAX], modeldir[PATH_MAX];
+    int prot_thresh_level, orf_thresh_level;
+    bool short_read_mode;
+    uproc_database *db;
+} config;
+
+struct batch;
+
+/* Classify the sequences [start, end) of a batch */
+struct job
+{
+    struct batch *batch;
+    long long start, end;
+    struct job *next;
+};
+
+/* A chunk of sequences of one client, classified by the workers */
+struct batch
+{
+    bool dna;
+    char *seqs[CHUNK_SIZE];
+    uproc_list *results[CHUNK_SIZE];
+    long long n;
+
+    struct job jobs[CHUNK_SIZE / JOB_SIZE];
+    /* number of jobs not finished yet */
+    long long pending;
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+};
+
+/* Jobs of all clients, processed by the worker pool in FIFO order */
+struct job_queue
+{
+    struct job *head, *tail;
+    pthread_mutex_t mutex;
+    pthread_cond_t avail;
+} queue = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER, .avail = PTHREAD_COND_INITIALIZER,
+};
+
+const char *socket_path;
+
+void queue_push(struct job *job)
+{
+    job->next = NULL;
+    pthread_mutex_lock(&queue.mutex);
+    if (queue.tail) {
+        queue.tail->next = job;
+    } else {
+        queue.head = job;
+    }
+    queue.tail = job;
+    pthread_cond_signal(&queue.avail);
+    pthread_mutex_unlock(&queue.mutex);
+}
+
+struct job *queue_pop(void)
+{
+    struct job *job;
+    pthread_mutex_lock(&queue.mutex);
+    while (!queue.head) {
+        pthread_cond_wait(&queue.avail, &queue.mutex);
+    }
+    job = queue.head;
+    queue.head = job->next;
+    if (!queue.head) {
+        queue.tail = NULL;
+    }
+    pthread_mutex_unlock(&queue.mutex);
+    return job;
+}
+
+static void map_list_dnaresult_free(void *value, void *opaque)
+{
+    (void)opaque;
+    uproc_dnaresult_free(value);
+}
+
+void results_clear(uproc_list *results, bool dna)
+{
+    if (dna) {
+        uproc_list_map(results, map_list_dnaresult_free, NULL);
+    }
+    uproc_list_clear(results);
+}
+
+void *worker(void *arg)
+{
+    /* if this fails, the classify functions fall back to temporary ones */
+    uproc_classify_workspace *ws = uproc_classify_workspace_create();
+    (void)arg;
+    while (true) {
+        struct job *job = queue_pop();
+        struct batch *b = job->batch;
+        for (long long i = job->start; i < job->end; i++) {
+            int res;
+            if (b->dna) {
+                res = uproc_dnaclass_classify_ws(clf.dc, ws, b->seqs[i],
+                                                 &b->results[i]);
+            } else {
+                res = uproc_protclass_classify_ws(clf.pc_prot, ws, b->seqs[i],
+                                                  &b->results[i]);
+            }
+            /* report the sequence as unclassified */
+            if (res && b->results[i]) {
+                results_clear(b->results[i], b->dna);
+            }
+        }
+
+        pthread_mutex_lock(&b->mutex);
+        if (!--b->pending) {
+            pthread_cond_signal(&b->done);
+        }
+        pthread_mutex_unlock(&b->mutex);
+    }
+    return NULL;
+}
+
+/* Split the batch into jobs and wait until the workers finished them */
+void batch_classify(struct batch *b)
+{
+    long long n_jobs = (b->n + JOB_SIZE - 1) / JOB_SIZE;
+
+    pthread_mutex_lock(&b->mutex);
+    b->pending = n_jobs;
+    pthread_mutex_unlock(&b->mutex);
+    for (long long i = 0; i < n_jobs; i++) {
+        struct job *job = &b->jobs[i];
+        job->batch = b;
+        job->start = i * JOB_SIZE;
+        job->end = job->start + JOB_SIZE;
+        if (job->end > b->n) {
+            job->end = b->n;
+        }
+        queue_push(job);
+    }
+
+    pthread_mutex_lock(&b->mutex);
+    while (b->pending) {
+        pthread_cond_wait(&b->done, &b->mutex);
+    }
+    pthread_mutex_unlock(&b->mutex);
+}
+
+/* Read up to CHUNK_SIZE header/sequence line pairs into `headers` and the
+ * batch
+ *
+ * Returns non-zero if at least one sequence was read. */
+int batch_read(struct batch *b, char **headers, size_t *sizes,
+               uproc_io_stream *in)
+{
+    long long i;
+    for (i = 0; i < CHUNK_SIZE; i++) {
+        long len = uproc_io_getline(&headers[i], &sizes[2 * i], in);
+        if (len < 1) {
+            break;
+        }
+        if (headers[i][len - 1] == '\n') {
+            headers[i][len - 1] = '\0';
+        }
+        len = uproc_io_getline(&b->seqs[i], &sizes[2 * i + 1], in);
+        if (len < 1) {
+            break;
+        }
+        if (b->seqs[i][len - 1] == '\n') {
+            b->seqs[i][len - 1] = '\0';
+        }
+    }
+    b->n = i;
+    return b->n > 0;
+}
+
+/* Reject requests the loaded database, model or options can't serve */
+const char *request_check(const struct server_request *req)
+{
+    if (strcmp(req->dbdir, config.dbdir)) {
+        return "different database";
+    }
+    if (strcmp(req->modeldir, config.modeldir)) {
+        return "different model";
+    }
+    if (req->prot_thresh_level != config.prot_thresh_level) {
+        return "different protein threshold level";
+    }
+    if (req->dna && (req->orf_thresh_level != config.orf_thresh_level ||
+                     req->short_read_mode != config.short_read_mode)) {
+        return "different DNA classification options";
+    }
+    return NULL;
+}
+
+/* Handle a single client connection */
+void *client(void *arg)
+{
+    int fd = (intptr_t)arg;
+    uproc_io_stream *in = NULL, *out = NULL;
+    struct server_request req;
+    const char *reject;
+    struct batch *b = NULL;
+    char *headers[CHUNK_SIZE] = {0};
+    size_t sizes[2 * CHUNK_SIZE] = {0};
+    unsigned long n_seqs = 0, n_seqs_unexplained = 0;
+    unsigned long *counts = NULL;
+    uproc_idmap *idmap;
+    struct result_format fmt = {0};
+    struct textbuf text = {0};
+
+    in = uproc_io_fdopen(fd, "r");
+    if (!in) {
+        close(fd);
+        return NULL;
+    }
+    if (server_request_recv(in, &req)) {
+        const char *msg = "ERROR invalid request\n";
+        write_all(fd, msg, strlen(msg));
+        goto error;
+    }
+    reject = request_check(&req);
+    if (reject) {
+        write_all(fd, "ERROR ", 6);
+        write_all(fd, reject, strlen(reject));
+        write_all(fd, "\n", 1);
+        goto error;
+    }
+    if (write_all(fd, "OK\n", 3)) {
+        goto error;
+    }
+
+    out = uproc_io_fdopen(dup(fd), "w");
+    b = calloc(1, sizeof *b);
+    counts = calloc(UPROC_FAMILY_MAX + 1, sizeof *counts);
+    if (!out || !b || !counts ||
+        result_format_compile(&fmt, req.format, req.dna)) {
+        goto error;
+    }
+    pthread_mutex_init(&b->mutex, NULL);
+    pthread_cond_init(&b->done, NULL);
+    b->dna = req.dna;
+    idmap = req.numeric ? NULL : uproc_database_idmap(config.db);
+
+    while (batch_read(b, headers, sizes, in)) {
+        batch_classify(b);
+        for (long long i = 0; i < b->n; i++) {
+            long n_results = uproc_list_size(b->results[i]);
+            n_seqs += 1;
+            if (!n_results) {
+                n_seqs_unexplained += 1;
+                continue;
+            }
+            for (long k = 0; k < n_results; k++) {
+                uproc_family family;
+                double score;
+                const struct uproc_orf *orf = NULL;
+                struct uproc_dnaresult dres;
+                struct uproc_protresult pres;
+                if (b->dna) {
+                    uproc_list_get(b->results[i], k, &dres);
+                    family = dres.family;
+                    score = dres.score;
+                    orf = &dres.orf;
+                } else {
+                    uproc_list_get(b->results[i], k, &pres);
+                    family = pres.family;
+                    score = pres.score;
+                }
+                counts[family] += 1;
+                if (req.preds) {
+                    format_result(&text, &fmt, n_seqs, headers[i],
+                                  strlen(b->seqs[i]), orf, family, score,
+                                  idmap);
+                }
+            }
+        }
+        if (text.len) {
+            uproc_io_write(text.data, 1, text.len, out);
+            text.len = 0;
+        }
+    }
+
+    if (req.stats) {
+        uproc_io_printf(out, "%lu,", n_seqs - n_seqs_unexplained);
+        uproc_io_printf(out, "%lu,", n_seqs_unexplained);
+        uproc_io_printf(out, "%lu\n", n_seqs);
+    }
+    if (req.counts) {
+        print_counts(out, counts, idmap);
+    }
+
+error:
+    if (out) {
+        uproc_io_close(out);
+    }
+    uproc_io_close(in);
+    if (b) {
+        for (long long i = 0; i < CHUNK_SIZE; i++) {
+            free(b->seqs[i]);
+            if (b->results[i]) {
+                results_clear(b->results[i], b->dna);
+                uproc_list_destroy(b->results[i]);
+            }
+        }
+        pthread_mutex_destroy(&b->mutex);
+        pthread_cond_destroy(&b->done);
+        free(b);
+    }
+    for (long long i = 0; i < CHUNK_SIZE; i++) {
+        free(headers[i]);
+    }
+    free(counts);
+    result_format_free(&fmt);
+    textbuf_free(&text);
+    server_request_free(&req);
+    return NULL;
+}
+
+void remove_socket(int sig)
+{
+    unlink(socket_path);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void make_opts(struct ppopts *o, const char *progname)
+{
+#define O(...) ppopts_add(o, __VA_ARGS__)
+    ppopts_add_text(o, PROGNAME ", version " UPROC_VERSION);
+    ppopts_add_text(o, "USAGE: %s [options] SOCKET DBDIR MODELDIR", progname);
+
+    ppopts_add_text(
+        o,
+        "Loads the database in DBDIR and the model in MODELDIR and classifies "
+        "the sequences that uproc-dna and uproc-prot (with -C SOCKET or the "
+        "UPROC_SERVER environment variable set to SOCKET) send to the Unix "
+        "domain socket SOCKET. Clients are served concurrently by a shared "
+        "pool of worker threads. The clients must use the same DBDIR, "
+        "MODELDIR and classification options as the server; all output "
+        "options are chosen by the client.");
+
+    ppopts_add_header(o, "GENERAL OPTIONS:");
+    O('h', "help", "", "Print this message and exit.");
+    O('v', "version", "", "Print version and exit.");
+    O('V', "libversion", "", "Print libuproc version/features and exit.");
+    O('t', "threads", "N", "Number of worker threads (default: %d).",
+      WORKERS_DEFAULT);
+
+    ppopts_add_header(o, "CLASSIFICATION OPTIONS:");
+    O('P', "pthresh", "N",
+      "Protein threshold level (see uproc-dna). Default is %d.",
+      PROT_THRESH_DEFAULT);
+    O('l', "long", "", "Use long read mode for DNA sequences (default).");
+    O('s', "short", "", "Use short read mode for DNA sequences.");
+    O('O', "othresh", "N",
+      "ORF translation threshold level (see uproc-dna). Default is %d.",
+      ORF_THRESH_DEFAULT);
+#undef O
+}
+
+enum nonopt_args { SOCKET, DBDIR, MODELDIR, ARGC };
+
+int main(int argc, char **argv)
+{
+    uproc_error_set_handler(errhandler_bail, NULL);
+
+    int workers = WORKERS_DEFAULT;
+    config.prot_thresh_level = PROT_THRESH_DEFAULT;
+    config.orf_thresh_level = ORF_THRESH_DEFAULT;
+    config.short_read_mode = false;
+
+    struct ppopts opts = PPOPTS_INITIALIZER;
+    make_opts(&opts, argv[0]);
+    int opt;
+    while ((opt = ppopts_getopt(&opts, argc, argv)) != -1) {
+        switch (opt) {
+            case 'h':
+                ppopts_print(&opts, stdout, 80, PPOPTS_DESC_ON_NEXT_LINE);
+                return EXIT_SUCCESS;
+            case 'v':
+                print_version(PROGNAME);
+                return EXIT_SUCCESS;
+            case 'V':
+                uproc_features_print(uproc_stdout);
+                return EXIT_SUCCESS;
+            case 't': {
+                int res, tmp;
+                res = parse_int(optarg, &tmp);
+                if (res || tmp <= 0 || tmp > WORKERS_MAX) {
+                    fprintf(stderr, "-t requires a number between 1 and %d\n",
+                            WORKERS_MAX);
+                    return EXIT_FAILURE;
+                }
+                workers = tmp;
+            } break;
+            case 'P':
+                if (parse_prot_thresh_level(optarg,
+                                            &config.prot_thresh_level)) {
+                    fprintf(stderr, "-P requires a value of 0, 2 or 3\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                config.short_read_mode = true;
+                break;
+            case 'l':
+                config.short_read_mode = false;
+                break;
+            case 'O':
+                if (parse_orf_thresh_level(optarg, &config.orf_thresh_level)) {
+                    fprintf(stderr, "-O requires a value of 0, 1 or 2\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case '?':
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc < optind + ARGC) {
+        ppopts_print(&opts, stdout, 80, PPOPTS_DESC_ON_NEXT_LINE);
+        return EXIT_FAILURE;
+    }
+    socket_path = argv[optind + SOCKET];
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "socket path too long: %s\n", socket_path);
+        return EXIT_FAILURE;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    if (!realpath(argv[optind + DBDIR], config.dbdir) ||
+        !realpath(argv[optind + MODELDIR], config.modeldir)) {
+        uproc_error(UPROC_ERRNO);
+    }
+
+    uproc_model *model =
+        uproc_model_load(config.modeldir, config.orf_thresh_level);
+    config.db = uproc_database_load(config.dbdir, config.prot_thresh_level,
+                                    UPROC_ECURVE_BINARY);
+    if (getenv("UPROC_MEMORY")) {
+        uproc_features_print(uproc_stderr);
+    }
+    create_classifiers(&clf.pc_dna, &clf.dc, config.db, model,
+                       config.short_read_mode);
+    create_classifiers(&clf.pc_prot, NULL, config.db, model, false);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        uproc_error_msg(UPROC_ERRNO, "can't create socket");
+    }
+    /* remove the socket of a previous server */
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof addr) ||
+        listen(listen_fd, SOMAXCONN)) {
+        uproc_error_msg(UPROC_ERRNO, "can't listen on %s", socket_path);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, remove_socket);
+    signal(SIGTERM, remove_socket);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, worker, NULL)) {
+            uproc_error_msg(UPROC_ERRNO, "can't create worker thread");
+        }
+    }
+
+    /* from now on, errors only affect a single client */
+    uproc_error_set_handler(NULL, NULL);
+    fprintf(stderr, "%s: listening on %s\n", PROGNAME, socket_path);
+    while (true) {
+        pthread_t thread;
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                perror("accept");
+            }
+            continue;
+        }
+        if (pthread_create(&thread, &attr, client, (void *)(intptr_t)fd)) {
+            close(fd);
+        }
+    }
+    return EXIT_SUCCESS;
+}